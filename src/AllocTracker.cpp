@@ -0,0 +1,170 @@
+#include "AllocTracker.h"
+
+#ifdef ROBBAN_ALLOC_TRACKING
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#define ROBBAN_ALLOC_STACKS 1
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+
+// Plain thread-local counters: the allocating thread is the only writer
+thread_local alloc::Counts counts;
+
+#ifdef ROBBAN_ALLOC_STACKS
+const int MAX_FRAMES = 32;
+thread_local bool captureArmed = false;
+thread_local void* capturedFrames[MAX_FRAMES];
+thread_local int capturedDepth = 0;
+#endif
+
+void CountAllocation(std::size_t size) {
+    counts.allocations++;
+    counts.bytes += size;
+#ifdef ROBBAN_ALLOC_STACKS
+    if (captureArmed) {
+        captureArmed = false;  // backtrace() must not come back in here
+        capturedDepth = backtrace(capturedFrames, MAX_FRAMES);
+    }
+#endif
+}
+
+void* Allocate(std::size_t size) {
+    CountAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+    CountAllocation(size);
+    std::size_t align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+#ifdef _WIN32
+    return _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, align, size == 0 ? 1 : size) != 0) return nullptr;
+    return memory;
+#endif
+}
+
+void Free(void* memory) {
+    if (!memory) return;
+    counts.frees++;
+    std::free(memory);
+}
+
+void FreeAligned(void* memory) {
+    if (!memory) return;
+    counts.frees++;
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+}  // namespace
+
+namespace alloc {
+
+Counts ThreadCounts() {
+    return counts;
+}
+
+void CaptureNextStack() {
+#ifdef ROBBAN_ALLOC_STACKS
+    // The first backtrace() loads the unwinder, which allocates; get that over with
+    void* warmUp[1];
+    backtrace(warmUp, 1);
+    capturedDepth = 0;
+    captureArmed = true;
+#endif
+}
+
+bool WriteCapturedStack() {
+#ifdef ROBBAN_ALLOC_STACKS
+    captureArmed = false;
+    if (capturedDepth == 0) return false;
+    backtrace_symbols_fd(capturedFrames, capturedDepth, 2);  // Writes straight to stderr, no malloc
+    capturedDepth = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+}  // namespace alloc
+
+void* operator new(std::size_t size) {
+    void* memory = Allocate(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    void* memory = Allocate(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* memory = AllocateAligned(size, alignment);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    void* memory = AllocateAligned(size, alignment);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory) noexcept { Free(memory); }
+void operator delete[](void* memory) noexcept { Free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { Free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { Free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { Free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { Free(memory); }
+
+void operator delete(void* memory, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(memory); }
+
+#else
+
+namespace alloc {
+
+Counts ThreadCounts() {
+    return Counts();
+}
+
+void CaptureNextStack() {}
+
+bool WriteCapturedStack() {
+    return false;
+}
+
+}  // namespace alloc
+
+#endif
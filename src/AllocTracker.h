@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counting for finding allocations on the hot path. Built
+// with -DALLOC_TRACKING=ON (which defines ROBBAN_ALLOC_TRACKING) the global
+// operator new and delete are replaced by versions that count, per thread,
+// every allocation before handing it to malloc; otherwise nothing is
+// replaced and the counters stay at zero.
+//
+//   alloc::Scope scope;
+//   Simulate(dt);
+//   if (scope.Allocations() > 0) ...
+//
+// Only allocations made by the calling thread are counted, so the writer and
+// reporter threads don't disturb a measurement of the simulation thread.
+namespace alloc {
+
+struct Counts {
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;  // Requested, not including the allocator's overhead
+};
+
+constexpr bool IsCompiledIn() {
+#ifdef ROBBAN_ALLOC_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Everything the calling thread has allocated and freed so far
+Counts ThreadCounts();
+
+// Remembers the call stack of the next allocation on this thread (glibc
+// only), for finding out where an unexpected one came from
+void CaptureNextStack();
+// Writes the captured stack to stderr; false if there was nothing to write
+bool WriteCapturedStack();
+
+class Scope {
+private:
+    Counts start;
+
+public:
+    Scope() : start(ThreadCounts()) {}
+    uint64_t Allocations() const { return ThreadCounts().allocations - start.allocations; }
+    uint64_t Bytes() const { return ThreadCounts().bytes - start.bytes; }
+    void Restart() { start = ThreadCounts(); }
+};
+
+}  // namespace alloc
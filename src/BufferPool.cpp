@@ -0,0 +1,46 @@
+#include "BufferPool.h"
+
+const size_t BufferPool::CLASS_SIZES[CLASS_COUNT] = {256, 1024, 4096, 16384, 65536};
+
+BufferPool::BufferPool(size_t maxFreePerClass) : maxFreePerClass(maxFreePerClass) {
+    // Releasing must not allocate either
+    for (auto& buffers : freeBuffers) {
+        buffers.reserve(maxFreePerClass);
+    }
+}
+
+std::string BufferPool::Acquire(size_t size) {
+    size_t sizeClass = 0;
+    while (sizeClass < CLASS_COUNT && CLASS_SIZES[sizeClass] < size) sizeClass++;
+
+    std::string buffer;
+    if (sizeClass == CLASS_COUNT) {
+        buffer.reserve(size);  // Bigger than any class; Release() keeps it in the top one
+        return buffer;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Any larger class will do if this one is empty
+        for (size_t i = sizeClass; i < CLASS_COUNT; i++) {
+            if (freeBuffers[i].empty()) continue;
+            buffer = std::move(freeBuffers[i].back());
+            freeBuffers[i].pop_back();
+            buffer.clear();
+            return buffer;
+        }
+    }
+    buffer.reserve(CLASS_SIZES[sizeClass]);
+    return buffer;
+}
+
+void BufferPool::Release(std::string&& buffer) {
+    size_t capacity = buffer.capacity();
+    if (capacity < CLASS_SIZES[0]) return;
+    size_t sizeClass = CLASS_COUNT - 1;
+    while (CLASS_SIZES[sizeClass] > capacity) sizeClass--;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (freeBuffers[sizeClass].size() < maxFreePerClass) {
+        freeBuffers[sizeClass].push_back(std::move(buffer));
+    }
+}
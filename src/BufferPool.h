@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Recycled byte buffers for network messages that outlive the call that
+// built them: queued for the transport thread, or deferred from the browser
+// thread to the simulation. Buffers come in a few size classes; a released
+// buffer goes back to the largest class its capacity covers, so Acquire()
+// never hands out less than was asked for, and steady traffic settles on a
+// set of buffers that are passed around instead of allocated. Thread safe.
+//
+// Buffers are plain std::strings, so the wire:: writers fill them directly.
+class BufferPool {
+public:
+    static const size_t CLASS_COUNT = 5;
+    static const size_t CLASS_SIZES[CLASS_COUNT];  // 256 bytes to 64 KiB
+
+private:
+    std::vector<std::string> freeBuffers[CLASS_COUNT];
+    size_t maxFreePerClass;
+    std::mutex mutex;
+
+public:
+    explicit BufferPool(size_t maxFreePerClass = 256);
+
+    // An empty buffer with room for at least size bytes
+    std::string Acquire(size_t size);
+    // Takes a buffer back for reuse. Ones smaller than the smallest class, or
+    // beyond what the pool keeps, are freed
+    void Release(std::string&& buffer);
+};
@@ -0,0 +1,138 @@
+#include "FanoutBenchmark.h"
+#include "AllocTracker.h"
+#include "GameState.h"
+#include "Log.h"
+#include "NetworkManager.h"
+#include "SimRandom.h"
+#include "SnapshotScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace {
+
+const float TICK = 1.0f / 60.0f;
+const int MAX_ANIMALS = 15;
+const int WARMUP_TICKS = 300;  // Not measured: buffers and pools settle first
+
+struct World {
+    GameState state;
+    SnapshotScheduler& scheduler;
+    SimRandom random{42, 3};
+    int nextAnimalId = 0;
+    float time = 0.0f;
+
+    // Roughly what a busy game does per tick: a cell or two, some animals
+    // and every player move
+    void Step() {
+        time += TICK;
+        int width = static_cast<int>(state.grid[0].size());
+        int height = static_cast<int>(state.grid.size());
+        for (int i = 0; i < 2; i++) {
+            int x = random.NextInt(width);
+            int y = random.NextInt(height);
+            state.grid[y][x].type = static_cast<CellType>(random.NextInt(4));
+            scheduler.MarkCellChanged(x, y, time);
+        }
+        if (state.animals.size() < MAX_ANIMALS && random.NextInt(10) == 0) {
+            Animal animal;
+            animal.id = nextAnimalId++;
+            animal.x = random.NextInt(width);
+            animal.y = random.NextInt(height);
+            state.animals.push_back(animal);
+        }
+        if (!state.animals.empty() && random.NextInt(30) == 0) {
+            state.animals.erase(state.animals.begin() + random.NextInt(static_cast<uint32_t>(state.animals.size())));
+        }
+        for (auto& animal : state.animals) {
+            if (random.NextInt(8) == 0) animal.x = (animal.x + 1) % width;
+        }
+        for (auto& [id, player] : state.players) {
+            if (random.NextInt(4) != 0) continue;
+            player.x = std::clamp(player.x + static_cast<int>(random.NextInt(3)) - 1, 0, width - 1);
+            player.y = std::clamp(player.y + static_cast<int>(random.NextInt(3)) - 1, 0, height - 1);
+        }
+    }
+};
+
+}  // namespace
+
+int RunFanoutBenchmark(int peerCount, double seconds, int gridWidth, int gridHeight,
+                       const InterestConfig& interestConfig) {
+    peerCount = std::clamp(peerCount, 1, 31);  // Player ids must fit the routing mask
+    SnapshotScheduler scheduler(gridWidth, gridHeight, SnapshotConfig(), interestConfig);
+    World world{GameState(), scheduler};
+    world.state.grid.assign(gridHeight, std::vector<Cell>(gridWidth));
+    world.state.animals.reserve(MAX_ANIMALS);
+
+    NetworkManager network;
+    network.SetPlayerJoinCallback([&](int playerId) {
+        Player player;
+        player.id = playerId;
+        player.username = "peer" + std::to_string(playerId);
+        player.x = world.random.NextInt(gridWidth);
+        player.y = world.random.NextInt(gridHeight);
+        world.state.players[playerId] = player;
+        scheduler.AddPeer(playerId, world.time);
+    });
+    if (!network.CreateRoom("Bench")) return 1;
+    Player host;
+    host.id = 0;
+    host.username = "host";
+    world.state.players[0] = host;
+    for (int i = 0; i < peerCount; i++) {
+        network.HandlePlayerJoined("bench-peer-" + std::to_string(i));
+    }
+
+    LOGI(STRESS, "Fan-out benchmark: " << peerCount << " peers, " << gridWidth << "x" << gridHeight
+                 << " grid, " << seconds << " s");
+
+    std::vector<int> peerIds;
+    std::string packet;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    int tick = 0;
+    alloc::Scope allocations;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (elapsed < seconds || tick <= WARMUP_TICKS) {
+        if (tick == WARMUP_TICKS) {
+            messages = 0;
+            bytes = 0;
+            allocations.Restart();
+            start = std::chrono::steady_clock::now();
+        }
+        world.Step();
+
+        // Everyone hears about every player, as the host relays their moves
+        for (const auto& [id, player] : world.state.players) {
+            network.SendPlayerUpdate(player);
+            messages++;
+        }
+
+        scheduler.Observe(world.state, world.time);
+        network.GetConnectedPlayerIds(peerIds);
+        for (int peerId : peerIds) {
+            if (scheduler.BuildPacket(peerId, world.state, world.time, packet)) {
+                network.SendGameStateUpdate(peerId, packet);
+                messages++;
+                bytes += packet.size() + ROUTE_HEADER_SIZE;
+            }
+        }
+        network.ProcessMessages();
+
+        tick++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    LOGI(STRESS, "Fan-out: " << static_cast<uint64_t>(messages / elapsed) << " messages/s, "
+                 << static_cast<uint64_t>(bytes / elapsed / 1024.0) << " KiB/s of snapshots, "
+                 << static_cast<uint64_t>((tick - WARMUP_TICKS) / elapsed) << " ticks/s");
+    if (alloc::IsCompiledIn()) {
+        LOGI(STRESS, "Fan-out: " << static_cast<double>(allocations.Allocations()) / std::max<uint64_t>(messages, 1)
+                     << " heap allocations per message");
+    }
+    network.Disconnect();
+    return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "InterestManager.h"
+
+// Headless throughput test of the host's fan-out path (--bench-fanout): the
+// world changes a little every tick, every player's update is broadcast, the
+// snapshot scheduler builds a packet for each peer and everything goes out
+// through NetworkManager's native transport queue. Logs messages and bytes
+// per second, and heap allocations per message when built with
+// ALLOC_TRACKING. Returns the process exit code.
+int RunFanoutBenchmark(int peerCount, double seconds, int gridWidth, int gridHeight,
+                       const InterestConfig& interestConfig);
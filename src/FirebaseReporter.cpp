@@ -1,9 +1,11 @@
 #include "FirebaseReporter.h"
-#include <iostream>
+#include "Metrics.h"
+#include "Log.h"
 #include <sstream>
 #include <iomanip>
 #include <ctime>
 #include <cstdlib>
+#include <cstdio>
 
 #ifdef PLATFORM_WEB
 #include <emscripten.h>
@@ -19,6 +21,14 @@ static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *use
     ((std::string*)userp)->append((char*)contents, size * nmemb);
     return size * nmemb;
 }
+
+// Report schedule: every minute, and after a failure retry with exponential
+// backoff from RETRY_BASE up to REPORT_INTERVAL, jittered so many servers
+// that lost the dashboard at once don't all come back in lockstep
+static const std::chrono::seconds REPORT_INTERVAL(60);
+static const std::chrono::seconds RETRY_BASE(2);
+static const long CONNECT_TIMEOUT_SECONDS = 5;
+static const long REQUEST_TIMEOUT_SECONDS = 10;
 #endif
 
 FirebaseReporter::FirebaseReporter(const std::string& serverId,
@@ -28,9 +38,11 @@ FirebaseReporter::FirebaseReporter(const std::string& serverId,
     this->serverId = "unique-server-identifier-123";
     this->serverName = "My Awesome Game Server";
     this->firebaseUrl = "/api/server/status";
-#ifndef PLATFORM_WEB
-    lastReportTime = std::chrono::steady_clock::now();
-#else
+    // Lets a native build report to a real (or mock) endpoint
+    if (const char* url = std::getenv("ROBBAN_STATUS_URL")) {
+        this->firebaseUrl = url;
+    }
+#ifdef PLATFORM_WEB
     timeSinceLastReport = 0.0f;
 #endif
 }
@@ -45,55 +57,140 @@ void FirebaseReporter::Start() {
     isRunning = true;
     
 #ifdef PLATFORM_WEB
-    std::cout << "[Firebase] Reporter started (web mode)" << std::endl;
-    std::cout << "[Firebase] Report interval: " << reportInterval << " seconds" << std::endl;
+    LOGI(FIREBASE, "Reporter started (web mode)");
+    LOGI(FIREBASE, "Report interval: " << reportInterval << " seconds");
 #else
+    // One easy handle for every report; the multi handle owns the
+    // connection cache that keeps it open in between
+    curlMulti = curl_multi_init();
+    curl = curl_easy_init();
+    if (curl && curlMulti) {
+        requestHeaders = curl_slist_append(requestHeaders, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, requestHeaders);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBuffer);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, CONNECT_TIMEOUT_SECONDS);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, REQUEST_TIMEOUT_SECONDS);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);  // Timeouts without signals, we're not on the main thread
+    } else {
+        LOGE(FIREBASE, "Could not create curl handles, reports will fail");
+    }
     reporterThread = std::thread(&FirebaseReporter::ReporterLoop, this);
-    std::cout << "[Firebase] Reporter started (native mode)" << std::endl;
+    LOGI(FIREBASE, "Reporter started (native mode)");
 #endif
 }
 
 void FirebaseReporter::Stop() {
     if (!isRunning) return;
     
-    isRunning = false;
-    
 #ifndef PLATFORM_WEB
+    {
+        // Under the lock, so the reporter can't miss the wakeup between its check and its wait
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        isRunning = false;
+    }
+    wake.notify_all();
+    if (curlMulti) {
+        curl_multi_wakeup(curlMulti);  // Abandon a report in progress
+    }
     if (reporterThread.joinable()) {
         reporterThread.join();
     }
+    
+    if (curl) {
+        curl_easy_cleanup(curl);
+        curl = nullptr;
+    }
+    if (curlMulti) {
+        curl_multi_cleanup(curlMulti);
+        curlMulti = nullptr;
+    }
+    curl_slist_free_all(requestHeaders);
+    requestHeaders = nullptr;
+#else
+    isRunning = false;
 #endif
     
-    std::cout << "[Firebase] Reporter stopped" << std::endl;
+    LOGI(FIREBASE, "Reporter stopped");
 }
 
-void FirebaseReporter::UpdateGameState(const GameState& gameState) {
-#ifndef PLATFORM_WEB
-    std::lock_guard<std::mutex> lock(gameStateMutex);
-#endif
-    lastReportedState = gameState;
+void FirebaseReporter::UpdatePlayers(const std::map<int, Player>& players) {
+    // FNV-1a over exactly what a report contains
+    uint64_t signature = 14695981039346656037ull;
+    auto mix = [&signature](uint64_t value) {
+        signature ^= value;
+        signature *= 1099511628211ull;
+    };
+    mix(players.size());
+    for (const auto& [id, player] : players) {
+        mix(static_cast<uint32_t>(id));
+        mix(static_cast<uint32_t>(player.score));
+        for (char c : player.username) mix(static_cast<unsigned char>(c));
+        mix(0x100);  // Name terminator, so "ab"+"c" differs from "a"+"bc"
+    }
+    if (signature == publishedSignature) return;
+    publishedSignature = signature;
+    
+    // The write buffer may hold an older summary; every field is rewritten
+    StatusSummary& summary = summaries.WriteBuffer();
+    summary.playerCount = 0;
+    for (const auto& [id, player] : players) {
+        if (summary.playerCount == StatusSummary::MAX_PLAYERS) break;
+        ReportedPlayer& entry = summary.players[summary.playerCount++];
+        entry.id = id;
+        entry.score = player.score;
+        std::snprintf(entry.username, sizeof(entry.username), "%s", player.username.c_str());
+    }
+    summaries.Publish();
 }
 
 void FirebaseReporter::UpdateRoomId(const std::string& roomId) {
-    this->roomId = roomId;
-    std::cout << "[Firebase] Room ID updated: " << roomId << std::endl;
-    std::cout << "[Firebase] Triggering immediate report with new room ID" << std::endl;
+    {
+#ifndef PLATFORM_WEB
+        std::lock_guard<std::mutex> lock(roomMutex);
+#endif
+        this->roomId = roomId;
+    }
+    LOGI(FIREBASE, "Room ID updated: " << roomId);
+    LOGI(FIREBASE, "Triggering immediate report with new room ID");
 }
 
-void FirebaseReporter::ReportNow() {
+std::string FirebaseReporter::GetRoomId() {
 #ifndef PLATFORM_WEB
-    std::lock_guard<std::mutex> lock(gameStateMutex);
+    std::lock_guard<std::mutex> lock(roomMutex);
 #endif
-    std::string jsonData = CreateServerStatusJson(lastReportedState);
-    std::cout << "[Firebase] Reporting server status now" << jsonData << std::endl;
-    SendServerStatus(jsonData);
+    return roomId;
+}
+
+void FirebaseReporter::ReportNow() {
 #ifndef PLATFORM_WEB
-    lastReportTime = std::chrono::steady_clock::now();
+    // The summary has a single reader, the reporter thread, which also keeps
+    // the request off the caller's thread
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        reportRequested = true;
+    }
+    wake.notify_one();
 #else
+    LOGI(FIREBASE, "Reporting server status now");
+    SendLatestStatus();
     timeSinceLastReport = 0.0f;
 #endif
 }
 
+// Only ever called from one thread: the reporter thread natively, the game loop on the web
+bool FirebaseReporter::SendLatestStatus() {
+    summaries.Acquire();
+    std::string jsonData = CreateServerStatusJson(summaries.ReadBuffer());
+    if (SendServerStatus(jsonData)) {
+        LOGI(FIREBASE, "Server status reported successfully");
+        return true;
+    }
+    LOGE(FIREBASE, "Failed to report server status");
+    return false;
+}
+
 #ifdef PLATFORM_WEB
 void FirebaseReporter::Update() {
     if (!isRunning) return;
@@ -102,42 +199,61 @@ void FirebaseReporter::Update() {
     
     // Report every minute (60 seconds)
     if (timeSinceLastReport >= reportInterval) {
-        std::string jsonData = CreateServerStatusJson(lastReportedState);
-        std::cout << "[Firebase] Attempting to report server status (web mode)" << std::endl;
-        std::cout << "[Firebase] Time since last report: " << timeSinceLastReport << " seconds" << std::endl;
-        
-        if (SendServerStatus(jsonData)) {
-            timeSinceLastReport = 0.0f;
-            std::cout << "[Firebase] Server status reported successfully" << std::endl;
-        } else {
-            std::cerr << "[Firebase] Failed to report server status" << std::endl;
-        }
+        LOGI(FIREBASE, "Attempting to report server status (web mode)");
+        LOGD(FIREBASE, "Time since last report: " << timeSinceLastReport << " seconds");
+        SendLatestStatus();
+        timeSinceLastReport = 0.0f;
     }
 }
 #endif
 
 #ifndef PLATFORM_WEB
 void FirebaseReporter::ReporterLoop() {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point nextReport = Clock::now() + REPORT_INTERVAL;
+    Clock::time_point retryAt = Clock::now();  // No attempt before this while backing off
+    
+    std::unique_lock<std::mutex> lock(wakeMutex);
     while (isRunning) {
-        auto currentTime = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(currentTime - lastReportTime);
-        
-        // Report every minute (60 seconds)
-        if (elapsed.count() >= 60) {
-            std::lock_guard<std::mutex> lock(gameStateMutex);
-            std::string jsonData = CreateServerStatusJson(lastReportedState);
-            
-            if (SendServerStatus(jsonData)) {
-                lastReportTime = currentTime;
-                std::cout << "[Firebase] Server status reported successfully" << std::endl;
-            } else {
-                std::cerr << "[Firebase] Failed to report server status" << std::endl;
-            }
+        Clock::time_point now = Clock::now();
+        Clock::time_point due = std::max(reportRequested ? now : nextReport, retryAt);
+        if (now < due) {
+            // ReportNow() and Stop() wake us early; either way work the due time out again
+            wake.wait_until(lock, due);
+            continue;
         }
         
-        // Sleep for 5 seconds before checking again
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        // Requests made up to here are all answered by this one report
+        reportRequested = false;
+        lock.unlock();
+        bool sent = SendLatestStatus();
+        lock.lock();
+        
+        now = Clock::now();
+        if (sent) {
+            failedAttempts = 0;
+            retryAt = now;
+            nextReport = now + REPORT_INTERVAL;
+        } else if (isRunning) {
+            failedAttempts++;
+            std::chrono::milliseconds delay = RetryDelay();
+            LOGW(FIREBASE, "Retrying in " << delay.count() << " ms (attempt " << failedAttempts + 1 << ")");
+            retryAt = now + delay;
+            nextReport = retryAt;
+        }
+    }
+}
+
+// Exponential backoff with "equal jitter": half the delay is fixed, the other half random
+std::chrono::milliseconds FirebaseReporter::RetryDelay() {
+    auto ceiling = std::chrono::duration_cast<std::chrono::milliseconds>(REPORT_INTERVAL);
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(RETRY_BASE);
+    for (int i = 1; i < failedAttempts && delay < ceiling; i++) {
+        delay *= 2;
     }
+    delay = std::min(delay, ceiling);
+    std::uniform_int_distribution<long long> jitter(0, delay.count() / 2);
+    return std::chrono::milliseconds(delay.count() / 2 + jitter(jitterRandom));
 }
 #else
 // Web implementation - called from the main game loop
@@ -148,23 +264,60 @@ void FirebaseReporter::WebTimerCallback(void* userData) {
         
         // Report every minute (60 seconds)
         if (reporter->timeSinceLastReport >= reporter->reportInterval) {
-            std::string jsonData = reporter->CreateServerStatusJson(reporter->lastReportedState);
-            
-            if (reporter->SendServerStatus(jsonData)) {
-                reporter->timeSinceLastReport = 0.0f;
-                std::cout << "[Firebase] Server status reported successfully" << std::endl;
-            } else {
-                std::cerr << "[Firebase] Failed to report server status" << std::endl;
-            }
+            reporter->SendLatestStatus();
+            reporter->timeSinceLastReport = 0.0f;
         }
     }
 }
 #endif
 
-std::string FirebaseReporter::CreateServerStatusJson(const GameState& gameState) {
+// Key figures from the metrics registry: average tick and draw cost since
+// the last report, entity counts and network totals
+std::string FirebaseReporter::CreateHealthJson() {
+    const MetricsRegistry& metrics = Metrics();
+    auto histogramSum = [&](const char* subsystem) {
+        const Histogram* histogram = metrics.FindHistogram("robban_subsystem_seconds", std::string("subsystem=\"") + subsystem + "\"");
+        return histogram ? histogram->GetSum() : 0.0;
+    };
+    auto gauge = [&](const char* name) {
+        const Gauge* found = metrics.FindGauge(name);
+        return found ? static_cast<long long>(found->Get()) : 0;
+    };
+    auto counter = [&](const char* name, const char* labels) {
+        const Counter* found = metrics.FindCounter(name, labels);
+        return found ? found->Get() : 0;
+    };
+    
+    // Every tick runs the animals system once, so its count is the tick count
+    const Histogram* animals = metrics.FindHistogram("robban_subsystem_seconds", "subsystem=\"animals\"");
+    const Histogram* draw = metrics.FindHistogram("robban_subsystem_seconds", "subsystem=\"draw\"");
+    HealthBaseline current;
+    current.ticks = animals ? animals->GetCount() : 0;
+    current.tickSeconds = histogramSum("animals") + histogramSum("trees") + histogramSum("bullets");
+    current.frames = draw ? draw->GetCount() : 0;
+    current.drawSeconds = histogramSum("draw");
+    
+    uint64_t ticks = current.ticks - healthBaseline.ticks;
+    uint64_t frames = current.frames - healthBaseline.frames;
+    double tickMs = ticks > 0 ? (current.tickSeconds - healthBaseline.tickSeconds) * 1000.0 / ticks : 0.0;
+    double drawMs = frames > 0 ? (current.drawSeconds - healthBaseline.drawSeconds) * 1000.0 / frames : 0.0;
+    healthBaseline = current;
+    
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{ \"tickMs\": " << tickMs << ", \"drawMs\": " << drawMs
+         << ", \"animals\": " << gauge("robban_animals") << ", \"bullets\": " << gauge("robban_bullets")
+         << ", \"peers\": " << gauge("robban_peers")
+         << ", \"bytesSent\": " << counter("robban_net_bytes_total", "direction=\"sent\"")
+         << ", \"bytesReceived\": " << counter("robban_net_bytes_total", "direction=\"received\"") << " }";
+    return json.str();
+}
+
+std::string FirebaseReporter::CreateServerStatusJson(const StatusSummary& summary) {
     std::ostringstream json;
+    std::string roomId = GetRoomId();
     
-    std::cout << "[Firebase] CreateServerStatusJson - roomId: '" << roomId << "' (empty=" << (roomId.empty() ? "yes" : "no") << ")" << std::endl;
+    LOGD(FIREBASE, "CreateServerStatusJson - roomId: '" << roomId << "' (empty=" << (roomId.empty() ? "yes" : "no") << ")");
     
     json << "{\n";
     json << "  \"serverId\": \"" << serverId << "\",\n";
@@ -174,22 +327,24 @@ std::string FirebaseReporter::CreateServerStatusJson(const GameState& gameState)
     if (!roomId.empty()) {
         json << "  \"roomId\": \"" << roomId << "\",\n";
     } else {
-        std::cout << "[Firebase] WARNING: roomId is empty, skipping from JSON" << std::endl;
+        LOGW(FIREBASE, "roomId is empty, skipping from JSON");
     }
     
     json << "  \"players\": [\n";
     
     bool firstPlayer = true;
-    for (const auto& [id, player] : gameState.players) {
+    for (int i = 0; i < summary.playerCount; i++) {
+        const ReportedPlayer& player = summary.players[i];
         if (!firstPlayer) {
             json << ",\n";
         }
         
-        json << "    { \"userId\": \"" << (player.username.empty() ? "player_" + std::to_string(player.id) : player.username) << "\", \"score\": " << player.score << " }";
+        json << "    { \"userId\": \"" << (player.username[0] == '\0' ? "player_" + std::to_string(player.id) : std::string(player.username)) << "\", \"score\": " << player.score << " }";
         firstPlayer = false;
     }
     
     json << "\n  ],\n";
+    json << "  \"health\": " << CreateHealthJson() << ",\n";
     json << "  \"status\": \"Online\"\n";
     json << "}";
     
@@ -199,11 +354,12 @@ std::string FirebaseReporter::CreateServerStatusJson(const GameState& gameState)
 bool FirebaseReporter::SendServerStatus(const std::string& jsonData) {
 #ifdef PLATFORM_WEB
     // Web implementation using JavaScript function window._ReportStatusToDashboard
-    std::cout << "[Firebase] Calling window._ReportStatusToDashboard" << std::endl;
-    std::cout << "[Firebase] Data: " << jsonData << std::endl;
+    LOGD(FIREBASE, "Calling window._ReportStatusToDashboard");
+    LOGD(FIREBASE, "Data: " << jsonData);
     
-    // Call the JavaScript function directly using EM_ASM
-    EM_ASM({
+    // Call the JavaScript function on the main thread, where window exists
+    // (reports come from the simulation worker in the pthreads build)
+    MAIN_THREAD_EM_ASM({
         var jsonString = UTF8ToString($0);
         if (window._ReportStatusToDashboard) {
             window._ReportStatusToDashboard(jsonString);
@@ -214,43 +370,50 @@ bool FirebaseReporter::SendServerStatus(const std::string& jsonData) {
     
     return true; // Assume success for web (async)
 #else
-    // Native implementation using libcurl
-    CURL *curl;
-    CURLcode res;
-    std::string readBuffer;
-    bool success = false;
+    // Native implementation using libcurl, on the reporter thread only
+    if (!curl || !curlMulti) return false;
     
-    curl = curl_easy_init();
-    if (curl) {
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        
-        curl_easy_setopt(curl, CURLOPT_URL, firebaseUrl.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonData.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        
-        res = curl_easy_perform(curl);
-        
-        if (res == CURLE_OK) {
-            long response_code;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            
-            if (response_code >= 200 && response_code < 300) {
-                success = true;
-                std::cout << "[Firebase] Response: " << readBuffer << std::endl;
-            } else {
-                std::cerr << "[Firebase] HTTP error: " << response_code << std::endl;
-            }
-        } else {
-            std::cerr << "[Firebase] CURL error: " << curl_easy_strerror(res) << std::endl;
+    responseBuffer.clear();
+    curl_easy_setopt(curl, CURLOPT_URL, firebaseUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonData.c_str());  // Not copied; jsonData outlives the transfer
+    curl_multi_add_handle(curlMulti, curl);
+    
+    // Drive the transfer until it finishes; Stop() breaks the poll with curl_multi_wakeup
+    int running = 1;
+    while (isRunning) {
+        CURLMcode status = curl_multi_perform(curlMulti, &running);
+        if (status != CURLM_OK || running == 0) break;
+        status = curl_multi_poll(curlMulti, nullptr, 0, 1000, nullptr);
+        if (status != CURLM_OK) break;
+    }
+    
+    bool finished = false;
+    CURLcode res = CURLE_OK;
+    int queued = 0;
+    while (CURLMsg* message = curl_multi_info_read(curlMulti, &queued)) {
+        if (message->msg == CURLMSG_DONE && message->easy_handle == curl) {
+            finished = true;
+            res = message->data.result;
         }
-        
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
     }
+    curl_multi_remove_handle(curlMulti, curl);
     
-    return success;
+    if (!finished) {
+        LOGW(FIREBASE, "Report abandoned");
+        return false;
+    }
+    if (res != CURLE_OK) {
+        LOGE(FIREBASE, "CURL error: " << curl_easy_strerror(res));
+        return false;
+    }
+    
+    long response_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code < 200 || response_code >= 300) {
+        LOGE(FIREBASE, "HTTP error: " << response_code);
+        return false;
+    }
+    LOGD(FIREBASE, "Response: " << responseBuffer);
+    return true;
 #endif
 }
\ No newline at end of file
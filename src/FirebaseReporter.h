@@ -1,25 +1,46 @@
 #pragma once
 
 #include "GameState.h"
+#include "ThreadHandoff.h"
 #include <string>
+#include <map>
+#include <atomic>
+#include <cstdint>
 
 #ifdef PLATFORM_WEB
 // Web implementation doesn't use threads
 #include <emscripten.h>
 #else
 // Native implementation uses threads
+#include <curl/curl.h>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
+#include <random>
 #endif
 
+// Everything a status report says about the players, in a fixed-size block
+// so handing it to the reporter never allocates or copies the world
+struct ReportedPlayer {
+    int id;
+    int score;
+    char username[32];  // Truncated, always NUL-terminated
+};
+
+struct StatusSummary {
+    static const int MAX_PLAYERS = 32;  // Player ids stay below 32 (see RouteHeader)
+    int playerCount = 0;
+    ReportedPlayer players[MAX_PLAYERS];
+};
+
 class FirebaseReporter {
 private:
     std::string serverId;
     std::string serverName;
     std::string roomId;
     std::string firebaseUrl;
-    bool isRunning;
+    std::atomic<bool> isRunning;
     
 #ifdef PLATFORM_WEB
     // Web implementation uses timers instead of threads
@@ -27,15 +48,44 @@ private:
     float reportInterval = 60.0f; // seconds
     float timeSinceLastReport = 0.0f;
 #else
-    // Native implementation uses threads
+    // Native implementation: one reporter thread that sleeps on a condition
+    // variable and sends through a persistent curl handle on a multi handle,
+    // so the connection is kept alive between reports and Stop() can
+    // interrupt a transfer in progress
     std::thread reporterThread;
-    std::mutex gameStateMutex;
-    std::chrono::steady_clock::time_point lastReportTime;
+    std::mutex roomMutex;  // Only guards roomId, never held while sending
+    std::mutex wakeMutex;
+    std::condition_variable wake;  // ReportNow() and Stop()
+    bool reportRequested = false;  // Guarded by wakeMutex; any number of requests make one report
+    CURL* curl = nullptr;
+    CURLM* curlMulti = nullptr;
+    struct curl_slist* requestHeaders = nullptr;
+    std::string responseBuffer;
+    int failedAttempts = 0;
+    std::mt19937 jitterRandom{std::random_device{}()};
     void ReporterLoop();
+    std::chrono::milliseconds RetryDelay();
 #endif
 
-    GameState lastReportedState;
-    std::string CreateServerStatusJson(const GameState& gameState);
+    // Written by the game loop only when the roster or a score changed, read
+    // by the reporter without either side ever blocking
+    TripleBuffer<StatusSummary> summaries;
+    uint64_t publishedSignature = 0;
+    
+    // Metric totals at the previous report, so each report carries averages
+    // over its own interval. Only touched by the thread that sends
+    struct HealthBaseline {
+        uint64_t ticks = 0;
+        double tickSeconds = 0.0;
+        uint64_t frames = 0;
+        double drawSeconds = 0.0;
+    };
+    HealthBaseline healthBaseline;
+    
+    std::string GetRoomId();
+    std::string CreateHealthJson();
+    std::string CreateServerStatusJson(const StatusSummary& summary);
+    bool SendLatestStatus();
     bool SendServerStatus(const std::string& jsonData);
     
 public:
@@ -47,8 +97,10 @@ public:
     
     void Start();
     void Stop();
-    void UpdateGameState(const GameState& gameState);
+    // Cheap when nothing changed: compares a signature of ids, names and scores
+    void UpdatePlayers(const std::map<int, Player>& players);
     void UpdateRoomId(const std::string& roomId);
+    // Natively the report is sent from the reporter thread on its next check
     void ReportNow();
     bool IsRunning() const { return isRunning; }
     
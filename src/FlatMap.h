@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Sorted-vector map with the part of the std::map interface the simulation
+// uses. Entries live in one contiguous block that keeps its capacity when
+// entries are erased or the map is cleared, so a map whose size levels off
+// stops allocating; std::map allocates a node for every insert.
+//
+// Inserting or erasing moves the later entries and invalidates iterators and
+// references to them, which is fine for the few dozen ids these maps hold.
+template <typename Key, typename Value>
+class FlatMap {
+public:
+    using value_type = std::pair<Key, Value>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+private:
+    std::vector<value_type> entries;
+
+    iterator LowerBound(const Key& key) {
+        return std::lower_bound(entries.begin(), entries.end(), key,
+                                [](const value_type& entry, const Key& k) { return entry.first < k; });
+    }
+    const_iterator LowerBound(const Key& key) const {
+        return std::lower_bound(entries.begin(), entries.end(), key,
+                                [](const value_type& entry, const Key& k) { return entry.first < k; });
+    }
+
+public:
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void clear() { entries.clear(); }
+    void reserve(size_t count) { entries.reserve(count); }
+    void swap(FlatMap& other) { entries.swap(other.entries); }
+
+    iterator find(const Key& key) {
+        auto it = LowerBound(key);
+        return (it != entries.end() && it->first == key) ? it : entries.end();
+    }
+    const_iterator find(const Key& key) const {
+        auto it = LowerBound(key);
+        return (it != entries.end() && it->first == key) ? it : entries.end();
+    }
+
+    // Ids mostly arrive in increasing order, which appends without moving anything
+    Value& operator[](const Key& key) {
+        if (entries.empty() || entries.back().first < key) {
+            entries.emplace_back(key, Value());
+            return entries.back().second;
+        }
+        auto it = LowerBound(key);
+        if (it == entries.end() || it->first != key) {
+            it = entries.emplace(it, key, Value());
+        }
+        return it->second;
+    }
+
+    iterator erase(iterator it) { return entries.erase(it); }
+    size_t erase(const Key& key) {
+        auto it = find(key);
+        if (it == entries.end()) return 0;
+        entries.erase(it);
+        return 1;
+    }
+};
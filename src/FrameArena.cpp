@@ -0,0 +1,33 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t initialBytes)
+    : block(new char[initialBytes]), capacity(initialBytes) {
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+    size_t offset = ((base + used + alignment - 1) & ~(alignment - 1)) - base;
+    if (offset + bytes <= capacity) {
+        used = offset + bytes;
+        return block.get() + offset;
+    }
+
+    // Out of room until the next Reset(): give this request a block of its own
+    overflow.emplace_back(new char[bytes + alignment]);
+    overflowBytes += bytes + alignment;
+    uintptr_t start = reinterpret_cast<uintptr_t>(overflow.back().get());
+    return reinterpret_cast<void*>((start + alignment - 1) & ~(alignment - 1));
+}
+
+void FrameArena::Reset() {
+    if (!overflow.empty()) {
+        // Next time the whole tick fits in one block
+        capacity = std::max(capacity * 2, capacity + overflowBytes);
+        block.reset(new char[capacity]);
+        overflow.clear();
+        overflowBytes = 0;
+    }
+    used = 0;
+}
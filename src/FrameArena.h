@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// A run of T living in a FrameArena, valid until the arena is next reset
+template <typename T>
+struct FrameArray {
+    T* items = nullptr;
+    size_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) const { return items[index]; }
+};
+
+// Bump-pointer scratch memory for data that only lives until the end of a
+// simulation tick. Allocating moves a pointer; Reset() at the start of the
+// next tick takes everything back at once. A tick that needs more than the
+// block holds chains overflow blocks, and the next Reset() replaces them with
+// one block big enough for that tick, so the arena settles at the size of
+// the busiest tick. Not thread safe, and destructors are never run, so only
+// trivially destructible types go in.
+class FrameArena {
+private:
+    std::unique_ptr<char[]> block;
+    size_t capacity = 0;
+    size_t used = 0;
+    std::vector<std::unique_ptr<char[]>> overflow;
+    size_t overflowBytes = 0;
+
+public:
+    explicit FrameArena(size_t initialBytes = 16 * 1024);
+
+    void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    FrameArray<T> AllocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+        FrameArray<T> array;
+        if (count == 0) return array;
+        array.items = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_value_construct_n(array.items, count);
+        array.count = count;
+        return array;
+    }
+
+    void Reset();
+    size_t GetCapacity() const { return capacity; }
+};
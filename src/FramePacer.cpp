@@ -0,0 +1,63 @@
+#include "FramePacer.h"
+#include "Log.h"
+#include <algorithm>
+
+FramePacer::FramePacer(const FramePacerConfig& config) : config(config) {
+    this->config.activeFps = std::max(1, config.activeFps);
+    this->config.idleFps = std::clamp(config.idleFps, 1, this->config.activeFps);
+}
+
+void FramePacer::NoteActivity(double now) {
+    lastActivity = now;
+}
+
+bool FramePacer::ShouldDraw(double now, bool focused, bool changed) {
+    if (!started) {
+        // The clock's origin is arbitrary, so count from the first frame
+        started = true;
+        lastActivity = now;
+        lastReport = now;
+    }
+
+    bool wasIdle = idle;
+    idle = !focused || now - lastActivity >= config.afkSeconds;
+    if (idle != wasIdle) {
+        LOGI(FRAMES, (idle ? "Idle, drawing at " : "Active, drawing at ")
+                     << (idle ? config.idleFps : config.activeFps) << " fps");
+    }
+
+    double sinceDraw = now - lastDraw;
+    if (sinceDraw >= config.maxSkipSeconds) return true;
+    if (!changed) return false;
+    // Idle loops may still run at the active rate to keep simulating
+    return !idle || sinceDraw >= 1.0 / config.idleFps;
+}
+
+void FramePacer::EndFrame(double now, bool drawn) {
+    if (drawn) {
+        framesDrawn++;
+        lastDraw = now;
+    } else {
+        framesSkipped++;
+    }
+    if (now - lastReport >= config.reportInterval) {
+        Report(now);
+    }
+}
+
+double FramePacer::GetFrameInterval(bool keepTicking) const {
+    int fps = (idle && !keepTicking) ? config.idleFps : config.activeFps;
+    return 1.0 / fps;
+}
+
+void FramePacer::Report(double now) {
+    int total = framesDrawn + framesSkipped;
+    if (total > 0) {
+        LOGI(FRAMES, "Drew " << framesDrawn << " of " << total << " frames ("
+                     << framesSkipped << " skipped) in the last " << static_cast<int>(now - lastReport + 0.5)
+                     << "s" << (idle ? ", idle" : ""));
+    }
+    framesDrawn = 0;
+    framesSkipped = 0;
+    lastReport = now;
+}
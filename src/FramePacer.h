@@ -0,0 +1,55 @@
+#pragma once
+
+// Tuning for adaptive frame pacing
+struct FramePacerConfig {
+    int activeFps = 60;          // Loop rate while the player is around
+    int idleFps = 5;             // Loop and draw rate when unfocused or AFK
+    double afkSeconds = 30.0;    // No input or network traffic for this long counts as AFK
+    double maxSkipSeconds = 1.0; // Redraw at least this often, in case the window was damaged
+    double reportInterval = 10.0;
+};
+
+// Decides, frame by frame, whether the main loop needs to draw and how long it
+// should wait before the next frame. Frames are only drawn when the caller
+// says the picture changed; while the window is unfocused or nobody has
+// touched anything for afkSeconds, both drawing and (unless the caller must
+// keep ticking) the loop itself drop to idleFps. Any input or network
+// activity snaps straight back to the active rate.
+// Times are in seconds from any monotonic clock.
+class FramePacer {
+private:
+    FramePacerConfig config;
+    bool started = false;
+    double lastActivity = 0.0;
+    double lastDraw = -1.0e9;
+    bool idle = false;
+
+    int framesDrawn = 0;
+    int framesSkipped = 0;
+    double lastReport = 0.0;
+
+    void Report(double now);
+
+public:
+    explicit FramePacer(const FramePacerConfig& config = FramePacerConfig());
+
+    const FramePacerConfig& GetConfig() const { return config; }
+
+    // Local input or network traffic; the next ShouldDraw leaves idle
+    void NoteActivity(double now);
+
+    // Whether this frame should be drawn, given whether anything on screen changed
+    bool ShouldDraw(double now, bool focused, bool changed);
+    // Counts the frame and logs drawn/skipped totals every reportInterval
+    void EndFrame(double now, bool drawn);
+
+    bool IsIdle() const { return idle; }
+    // Seconds from the start of one loop iteration to the next. Loops that
+    // must keep simulating (e.g. a multiplayer host) stay at the active rate
+    // and only draw less often.
+    double GetFrameInterval(bool keepTicking) const;
+
+    // Counts since the last report
+    int GetFramesDrawn() const { return framesDrawn; }
+    int GetFramesSkipped() const { return framesSkipped; }
+};
@@ -67,6 +67,22 @@ struct Bullet {
     bool active = true;
 };
 
+struct CellUpdate {
+    int x, y;
+    Cell cell;
+};
+
+// Partial state produced by the host's SnapshotScheduler
+struct StateDelta {
+    bool reset = false;                              // Clear the whole world first
+    std::vector<std::pair<int, int>> leftChunks;     // Chunks to clear and forget
+    std::vector<std::pair<int, int>> enteredChunks;  // Chunks to clear before their cells arrive
+    std::vector<CellUpdate> cells;
+    std::vector<Player> players;
+    std::vector<Animal> animals;
+    std::vector<int> removedAnimals;
+};
+
 struct GameState {
     std::vector<std::vector<Cell>> grid;
     std::map<int, Player> players;
@@ -0,0 +1,80 @@
+#include "InterestManager.h"
+#include <algorithm>
+
+InterestManager::InterestManager(int gridWidth, int gridHeight, const InterestConfig& config)
+    : gridWidth(gridWidth), gridHeight(gridHeight), config(config) {
+    chunksX = (gridWidth + INTEREST_CHUNK_SIZE - 1) / INTEREST_CHUNK_SIZE;
+    chunksY = (gridHeight + INTEREST_CHUNK_SIZE - 1) / INTEREST_CHUNK_SIZE;
+}
+
+InterestManager::Region InterestManager::ComputeRegion(int playerX, int playerY) const {
+    Region region;
+    region.valid = true;
+    region.minX = std::max(0, playerX - config.marginX) / INTEREST_CHUNK_SIZE;
+    region.minY = std::max(0, playerY - config.marginY) / INTEREST_CHUNK_SIZE;
+    region.maxX = std::min(gridWidth - 1, playerX + config.marginX) / INTEREST_CHUNK_SIZE;
+    region.maxY = std::min(gridHeight - 1, playerY + config.marginY) / INTEREST_CHUNK_SIZE;
+    return region;
+}
+
+bool InterestManager::Contains(const Region& region, int chunkX, int chunkY) {
+    return region.valid && chunkX >= region.minX && chunkX <= region.maxX &&
+           chunkY >= region.minY && chunkY <= region.maxY;
+}
+
+void InterestManager::AddPeer(int peerId) {
+    regions[peerId] = Region();
+}
+
+void InterestManager::RemovePeer(int peerId) {
+    regions.erase(peerId);
+}
+
+void InterestManager::UpdateSubscription(int peerId, int playerX, int playerY,
+                                         std::vector<int>& entered, std::vector<int>& left) {
+    Region& current = regions[peerId];
+    Region next = ComputeRegion(playerX, playerY);
+
+    if (current.valid && current.minX == next.minX && current.minY == next.minY &&
+        current.maxX == next.maxX && current.maxY == next.maxY) {
+        return;
+    }
+
+    // Only walk the two rectangles, never the whole world
+    if (current.valid) {
+        for (int cy = current.minY; cy <= current.maxY; cy++) {
+            for (int cx = current.minX; cx <= current.maxX; cx++) {
+                if (!Contains(next, cx, cy)) left.push_back(cy * chunksX + cx);
+            }
+        }
+    }
+    for (int cy = next.minY; cy <= next.maxY; cy++) {
+        for (int cx = next.minX; cx <= next.maxX; cx++) {
+            if (!Contains(current, cx, cy)) entered.push_back(cy * chunksX + cx);
+        }
+    }
+
+    current = next;
+}
+
+bool InterestManager::IsChunkSubscribed(int peerId, int chunkIndex) const {
+    auto it = regions.find(peerId);
+    if (it == regions.end()) return false;
+    return Contains(it->second, chunkIndex % chunksX, chunkIndex / chunksX);
+}
+
+void InterestManager::GetSubscribedChunks(int peerId, std::vector<int>& chunks) const {
+    auto it = regions.find(peerId);
+    if (it == regions.end() || !it->second.valid) return;
+    for (int cy = it->second.minY; cy <= it->second.maxY; cy++) {
+        for (int cx = it->second.minX; cx <= it->second.maxX; cx++) {
+            chunks.push_back(cy * chunksX + cx);
+        }
+    }
+}
+
+bool InterestManager::IsCellVisible(int peerId, int x, int y) const {
+    auto it = regions.find(peerId);
+    if (it == regions.end()) return false;
+    return Contains(it->second, x / INTEREST_CHUNK_SIZE, y / INTEREST_CHUNK_SIZE);
+}
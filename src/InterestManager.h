@@ -0,0 +1,62 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+// Side length, in cells, of the chunks peers subscribe to.
+// Host and clients must agree on this since enter/leave events name chunks.
+const int INTEREST_CHUNK_SIZE = 8;
+
+// A margin wider than any grid: the whole world is in everyone's interest
+const int INTEREST_WHOLE_GRID = 1 << 20;
+
+// Cells around the player that must be kept in sync. The default keeps the
+// whole grid in sync; a game narrows it to what its camera can show
+struct InterestConfig {
+    int marginX = INTEREST_WHOLE_GRID;
+    int marginY = INTEREST_WHOLE_GRID;
+};
+
+// Tracks which chunks of the grid each peer is subscribed to. A peer's
+// subscription is the rectangle of chunks covering its player's position plus
+// a margin, so updating it costs time proportional to the region rather than
+// the world.
+class InterestManager {
+private:
+    struct Region {
+        bool valid = false;
+        int minX = 0, minY = 0, maxX = -1, maxY = -1; // Inclusive chunk coordinates
+    };
+
+    int gridWidth;
+    int gridHeight;
+    int chunksX;
+    int chunksY;
+    InterestConfig config;
+    std::map<int, Region> regions;
+
+    Region ComputeRegion(int playerX, int playerY) const;
+    static bool Contains(const Region& region, int chunkX, int chunkY);
+
+public:
+    InterestManager(int gridWidth, int gridHeight, const InterestConfig& config = InterestConfig());
+
+    void SetConfig(const InterestConfig& newConfig) { config = newConfig; }
+    const InterestConfig& GetConfig() const { return config; }
+
+    int GetChunksX() const { return chunksX; }
+    int GetChunksY() const { return chunksY; }
+
+    void AddPeer(int peerId);
+    void RemovePeer(int peerId);
+
+    // Move a peer's subscription to follow its player. Chunk indices
+    // (chunkY * chunksX + chunkX) are appended to entered/left.
+    void UpdateSubscription(int peerId, int playerX, int playerY,
+                            std::vector<int>& entered, std::vector<int>& left);
+
+    bool IsChunkSubscribed(int peerId, int chunkIndex) const;
+    void GetSubscribedChunks(int peerId, std::vector<int>& chunks) const;
+    bool IsCellVisible(int peerId, int x, int y) const;
+    int ChunkIndexForCell(int x, int y) const { return (y / INTEREST_CHUNK_SIZE) * chunksX + x / INTEREST_CHUNK_SIZE; }
+};
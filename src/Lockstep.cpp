@@ -0,0 +1,203 @@
+#include "Lockstep.h"
+#include "Log.h"
+#include <algorithm>
+
+LockstepSession::LockstepSession(const std::vector<int>& participants, const LockstepConfig& config, int startTick)
+    : config(config), participants(participants), currentTick(startTick) {
+    std::sort(this->participants.begin(), this->participants.end());
+    if (startTick > 0) return;  // Joined midway; the inputs come from the others
+
+    // Nobody can have sampled input for the first inputDelay ticks, start them empty
+    for (int tick = 0; tick < config.inputDelay; tick++) {
+        for (int playerId : this->participants) {
+            PlayerInput input = {};
+            input.playerId = playerId;
+            input.tick = tick;
+            input.mode = -1;
+            inputs[tick][playerId] = input;
+        }
+    }
+}
+
+bool LockstepSession::IsParticipant(int playerId) const {
+    return std::find(participants.begin(), participants.end(), playerId) != participants.end();
+}
+
+bool LockstepSession::ExpectsInput(int playerId, int tick) const {
+    auto join = joins.find(playerId);
+    if (join != joins.end() ? tick < join->second : !IsParticipant(playerId)) return false;
+    auto removal = removals.find(playerId);
+    return removal == removals.end() || tick < removal->second;
+}
+
+bool LockstepSession::HasInput(int tick, int playerId) const {
+    auto it = inputs.find(tick);
+    return it != inputs.end() && it->second.find(playerId) != it->second.end();
+}
+
+void LockstepSession::AddInput(const PlayerInput& input) {
+    if (input.tick < currentTick || !ExpectsInput(input.playerId, input.tick)) return;
+    inputs[input.tick].emplace(input.playerId, input);
+}
+
+bool LockstepSession::CanAdvance() const {
+    auto it = inputs.find(currentTick);
+    if (it == inputs.end()) return participants.empty();
+    for (int playerId : participants) {
+        auto removal = removals.find(playerId);
+        if (removal != removals.end() && currentTick >= removal->second) continue;
+        if (it->second.find(playerId) == it->second.end()) return false;
+    }
+    return true;
+}
+
+FrameArray<PlayerInput> LockstepSession::AdvanceTick(FrameArena& arena) {
+    FrameArray<PlayerInput> tickInputs;
+    auto it = inputs.find(currentTick);
+    if (it != inputs.end()) {
+        // std::map keeps them ordered by player id
+        tickInputs = arena.AllocateArray<PlayerInput>(it->second.size());
+        size_t index = 0;
+        for (const auto& [playerId, input] : it->second) {
+            tickInputs[index++] = input;
+        }
+        inputs.erase(it);
+    }
+    currentTick++;
+    return tickInputs;
+}
+
+int LockstepSession::GetRemovalTick(int playerId) const {
+    // Someone still waiting to join has inputs from their join tick on
+    int tick = currentTick;
+    auto join = joins.find(playerId);
+    if (join != joins.end()) {
+        tick = std::max(tick, join->second);
+    }
+    for (auto it = inputs.lower_bound(tick); it != inputs.end(); ++it) {
+        if (it->first == tick && it->second.find(playerId) != it->second.end()) {
+            tick++;
+        } else if (it->first >= tick) {
+            break;
+        }
+    }
+    return tick;
+}
+
+void LockstepSession::RemoveParticipant(int playerId, int fromTick) {
+    if ((!IsParticipant(playerId) && !IsJoining(playerId)) || removals.find(playerId) != removals.end()) return;
+    if (fromTick < currentTick) {
+        // Too late to drop them from the same tick as the host; the checksums will tell
+        LOGW(LOCKSTEP, "Player " << playerId << " removed from tick " << fromTick << ", already at " << currentTick);
+        fromTick = currentTick;
+    }
+    removals[playerId] = fromTick;
+    LOGI(LOCKSTEP, "Player " << playerId << " leaves from tick " << fromTick);
+}
+
+void LockstepSession::TakeRemovals(int tick, std::vector<int>& playerIds) {
+    playerIds.clear();
+    for (auto it = removals.begin(); it != removals.end();) {
+        if (it->second > tick) {
+            ++it;
+            continue;
+        }
+        playerIds.push_back(it->first);
+        participants.erase(std::remove(participants.begin(), participants.end(), it->first), participants.end());
+        for (auto input = inputs.lower_bound(tick); input != inputs.end(); ++input) {
+            input->second.erase(it->first);
+        }
+        it = removals.erase(it);
+    }
+}
+
+int LockstepSession::GetJoinTick() const {
+    // The furthest ahead anyone can be is the tick after the last host input,
+    // and they sample inputDelay ticks further still
+    int tick = currentTick + config.inputDelay * 2 + 1;
+    for (const auto& [playerId, fromTick] : removals) {
+        tick = std::max(tick, fromTick);
+    }
+    // Past the empty first inputs of anyone joining, which only exist where
+    // AddParticipant made them
+    for (const auto& [playerId, fromTick] : joins) {
+        tick = std::max(tick, fromTick + config.inputDelay);
+    }
+    return tick;
+}
+
+void LockstepSession::AddParticipant(int playerId, int fromTick) {
+    if (IsParticipant(playerId) || IsJoining(playerId)) return;
+    if (fromTick < currentTick) {
+        LOGW(LOCKSTEP, "Player " << playerId << " joins from tick " << fromTick << ", already at " << currentTick);
+        fromTick = currentTick;
+    }
+    joins[playerId] = fromTick;
+    for (int tick = fromTick; tick < fromTick + config.inputDelay; tick++) {
+        PlayerInput input = {};
+        input.playerId = playerId;
+        input.tick = tick;
+        input.mode = -1;
+        inputs[tick][playerId] = input;
+    }
+    LOGI(LOCKSTEP, "Player " << playerId << " joins from tick " << fromTick);
+}
+
+void LockstepSession::TakeJoins(int tick, std::vector<int>& playerIds) {
+    playerIds.clear();
+    for (auto it = joins.begin(); it != joins.end();) {
+        if (it->second > tick) {
+            ++it;
+            continue;
+        }
+        playerIds.push_back(it->first);
+        participants.insert(std::upper_bound(participants.begin(), participants.end(), it->first), it->first);
+        it = joins.erase(it);
+    }
+}
+
+void LockstepSession::GetParticipantsAfterPending(std::vector<int>& playerIds) const {
+    playerIds.clear();
+    for (int playerId : participants) {
+        if (removals.find(playerId) == removals.end()) {
+            playerIds.push_back(playerId);
+        }
+    }
+    for (const auto& [playerId, fromTick] : joins) {
+        if (removals.find(playerId) == removals.end()) {
+            playerIds.push_back(playerId);
+        }
+    }
+    std::sort(playerIds.begin(), playerIds.end());
+}
+
+void LockstepSession::RecordLocalChecksum(int tick, uint64_t hash) {
+    localChecksums[tick] = hash;
+    CompareChecksums(tick);
+
+    // Drop history nobody will report anymore
+    int oldest = tick - config.checksumInterval * 10;
+    localChecksums.erase(localChecksums.begin(), localChecksums.lower_bound(oldest));
+    remoteChecksums.erase(remoteChecksums.begin(), remoteChecksums.lower_bound(oldest));
+}
+
+void LockstepSession::ReceiveRemoteChecksum(int playerId, int tick, uint64_t hash) {
+    remoteChecksums[tick][playerId] = hash;
+    CompareChecksums(tick);
+}
+
+void LockstepSession::CompareChecksums(int tick) {
+    auto local = localChecksums.find(tick);
+    auto remote = remoteChecksums.find(tick);
+    if (local == localChecksums.end() || remote == remoteChecksums.end()) return;
+
+    for (const auto& [playerId, hash] : remote->second) {
+        if (hash != local->second && !desynced) {
+            desynced = true;
+            desyncTick = tick;
+            desyncPlayerId = playerId;
+            LOGE(LOCKSTEP, "Desync detected at tick " << tick << " with player " << playerId);
+        }
+    }
+    remote->second.clear();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "NetworkManager.h"
+#include "FrameArena.h"
+#include <map>
+#include <vector>
+#include <cstdint>
+
+struct LockstepConfig {
+    int tickRate = 20;          // Simulation ticks per second
+    int inputDelay = 2;         // Ticks between sampling an input and simulating it
+    int checksumInterval = 20;  // Exchange a state checksum every N ticks
+};
+
+// Deterministic lockstep bookkeeping. Every participant samples its input
+// for tick (current + inputDelay) and shares it; a tick is only simulated
+// once inputs from all participants are present, so every peer advances the
+// same simulation with the same inputs. Periodic checksums (StateHash)
+// detect desyncs.
+class LockstepSession {
+private:
+    LockstepConfig config;
+    std::vector<int> participants;
+    int currentTick = 0;
+
+    std::map<int, std::map<int, PlayerInput>> inputs;          // tick -> playerId -> input
+    std::map<int, uint64_t> localChecksums;                    // tick -> hash
+    std::map<int, std::map<int, uint64_t>> remoteChecksums;    // tick -> playerId -> hash
+    std::map<int, int> removals;                               // playerId -> first tick simulated without them
+    std::map<int, int> joins;                                  // playerId -> first tick simulated with them
+
+    bool desynced = false;
+    int desyncTick = -1;
+    int desyncPlayerId = -1;
+
+    void CompareChecksums(int tick);
+
+public:
+    // A peer that joins a running session starts at startTick, with the
+    // world as it is there (LOCKSTEP_WORLD) and no inputs yet
+    LockstepSession(const std::vector<int>& participants, const LockstepConfig& config = LockstepConfig(),
+                    int startTick = 0);
+
+    const LockstepConfig& GetConfig() const { return config; }
+    float GetTickDuration() const { return 1.0f / static_cast<float>(config.tickRate); }
+    int GetCurrentTick() const { return currentTick; }
+    // Tick that input sampled now is scheduled for
+    int GetInputTick() const { return currentTick + config.inputDelay; }
+    const std::vector<int>& GetParticipants() const { return participants; }
+    bool IsParticipant(int playerId) const;
+    bool IsJoining(int playerId) const { return joins.find(playerId) != joins.end(); }
+    // Whether an input from playerId for tick belongs in the session: they
+    // have joined by then and not left
+    bool ExpectsInput(int playerId, int tick) const;
+
+    bool HasInput(int tick, int playerId) const;
+    void AddInput(const PlayerInput& input); // Late or duplicate inputs are ignored
+    bool CanAdvance() const;
+    // Inputs for the current tick ordered by player id, in the frame arena;
+    // advances the tick
+    FrameArray<PlayerInput> AdvanceTick(FrameArena& arena);
+    // Host, for a participant who dropped out: the first tick to simulate
+    // without them. That is the tick after the last input we hold from them;
+    // every peer holds the same inputs, as the host forwarded them all, and
+    // nobody can have simulated a tick we have no input for
+    int GetRemovalTick(int playerId) const;
+    // Stops waiting for playerId's input from fromTick on. Every peer must
+    // use the same fromTick (LOCKSTEP_LEAVE)
+    void RemoveParticipant(int playerId, int fromTick);
+    // Participants whose removal takes effect at tick, for the world to drop
+    // before simulating it; each is handed out once
+    void TakeRemovals(int tick, std::vector<int>& playerIds);
+    // Host, for a peer joining midway: the first tick to simulate with them.
+    // Nobody can have sampled input that far ahead, so every input for it
+    // reaches the host after the join and is forwarded to the new peer too.
+    // It also comes after every join and removal already under way, so the
+    // new peer can start from the participants as they will be by then
+    int GetJoinTick() const;
+    // Waits for playerId's input from fromTick on; their first inputDelay
+    // ticks start empty. Every peer must use the same fromTick (LOCKSTEP_JOIN)
+    void AddParticipant(int playerId, int fromTick);
+    // Participants whose join takes effect at tick, for the world to add
+    // before simulating it; each is handed out once
+    void TakeJoins(int tick, std::vector<int>& playerIds);
+    // Who will be taking part by the join tick: everyone not leaving, and
+    // everyone joining. Sorted
+    void GetParticipantsAfterPending(std::vector<int>& playerIds) const;
+
+    bool IsChecksumTick(int tick) const { return tick % config.checksumInterval == 0; }
+    void RecordLocalChecksum(int tick, uint64_t hash);
+    void ReceiveRemoteChecksum(int playerId, int tick, uint64_t hash);
+    bool IsDesynced() const { return desynced; }
+    int GetDesyncTick() const { return desyncTick; }
+    int GetDesyncPlayerId() const { return desyncPlayerId; }
+};
@@ -0,0 +1,241 @@
+#include "Log.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <mutex>
+
+#ifndef PLATFORM_WEB
+#include <condition_variable>
+#include <thread>
+#endif
+
+namespace Log {
+
+namespace {
+
+const char* const CATEGORY_NAMES[] = {"Game", "Assets", "Audio", "Net", "Lockstep", "Snapshot",
+                                      "Firebase", "Frames", "Metrics", "Trace", "Stress",
+                                      "Save"};
+static_assert(sizeof(CATEGORY_NAMES) / sizeof(CATEGORY_NAMES[0]) == static_cast<size_t>(LogCategory::COUNT),
+              "every category needs a name");
+
+const char* const LEVEL_NAMES[] = {"debug", "info", "warning", "error"};
+
+// Bounded multi-producer queue after Dmitry Vyukov's: a slot's sequence says
+// whose turn it is, so producers only contend on the head counter and never
+// wait for each other. There is one consumer at a time (flushMutex).
+const size_t RING_SIZE = 1024;  // Power of two
+
+struct Slot {
+    std::atomic<uint64_t> sequence{0};
+    LogLevel level = LogLevel::INFO;
+    LogCategory category = LogCategory::GAME;
+    uint16_t length = 0;
+    char text[MESSAGE_CAPACITY];
+};
+
+struct Ring {
+    Slot slots[RING_SIZE];
+    std::atomic<uint64_t> head{0};  // Next position to reserve
+    uint64_t tail = 0;              // Next position to write out, under flushMutex
+    std::atomic<uint32_t> dropped{0};
+
+    Ring() {
+        for (size_t i = 0; i < RING_SIZE; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+};
+
+Ring& GetRing() {
+    static Ring ring;
+    return ring;
+}
+
+std::atomic<uint8_t> categoryLevels[static_cast<size_t>(LogCategory::COUNT)] = {};
+std::mutex flushMutex;
+
+void WriteOut(const Slot& slot) {
+    FILE* out = slot.level >= LogLevel::WARNING ? stderr : stdout;
+    std::fprintf(out, "[%s] %.*s\n", CATEGORY_NAMES[static_cast<size_t>(slot.category)], static_cast<int>(slot.length),
+                 slot.text);
+}
+
+#ifndef PLATFORM_WEB
+// Writes the ring out every few milliseconds, or at once for errors
+class Writer {
+private:
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool running = true;
+    std::thread thread;  // Last, so it starts after the members it uses
+
+public:
+    Writer() : thread([this]() { Run(); }) {}
+    ~Writer() { Stop(); }
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (running) {
+            wake.wait_for(lock, std::chrono::milliseconds(20));
+            lock.unlock();
+            Flush();
+            lock.lock();
+        }
+    }
+
+    void Notify() { wake.notify_one(); }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            if (!running) return;
+            running = false;
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        Flush();
+    }
+};
+
+Writer& GetWriter() {
+    static Writer writer;
+    return writer;
+}
+#endif
+
+}  // namespace
+
+bool IsEnabled(LogLevel level, LogCategory category) {
+    uint8_t minimum = categoryLevels[static_cast<size_t>(category)].load(std::memory_order_relaxed);
+    return static_cast<uint8_t>(level) >= minimum;
+}
+
+void SetLevel(LogCategory category, LogLevel level) {
+    categoryLevels[static_cast<size_t>(category)].store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+}
+
+bool Configure(const std::string& spec) {
+    auto lower = [](std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+        return text;
+    };
+
+    bool understood = true;
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string pair = spec.substr(start, end - start);
+        start = end + 1;
+
+        size_t equals = pair.find('=');
+        std::string category = lower(pair.substr(0, equals));
+        std::string level = equals == std::string::npos ? "" : lower(pair.substr(equals + 1));
+        auto levelIt = std::find(std::begin(LEVEL_NAMES), std::end(LEVEL_NAMES), level);
+        if (levelIt == std::end(LEVEL_NAMES)) {
+            understood = false;
+            continue;
+        }
+        LogLevel parsed = static_cast<LogLevel>(levelIt - std::begin(LEVEL_NAMES));
+
+        bool matched = false;
+        for (size_t i = 0; i < static_cast<size_t>(LogCategory::COUNT); i++) {
+            if (category == "all" || category == lower(CATEGORY_NAMES[i])) {
+                SetLevel(static_cast<LogCategory>(i), parsed);
+                matched = true;
+            }
+        }
+        understood = understood && matched;
+    }
+
+    if (ROBBAN_LOG_MIN_LEVEL > LOG_LEVEL_DEBUG && spec.find("debug") != std::string::npos) {
+        LOGW(GAME, "Debug messages are compiled out of this build (configure with -DLOG_LEVEL=debug)");
+    }
+    return understood;
+}
+
+void Flush() {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    Ring& ring = GetRing();
+
+    // Stop at the first slot still being formatted; it goes out next time
+    while (true) {
+        Slot& slot = ring.slots[ring.tail % RING_SIZE];
+        if (slot.sequence.load(std::memory_order_acquire) != ring.tail + 1) break;
+        WriteOut(slot);
+        slot.sequence.store(ring.tail + RING_SIZE, std::memory_order_release);
+        ring.tail++;
+    }
+
+    uint32_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::fprintf(stderr, "[Log] Dropped %u messages, the buffer was full\n", dropped);
+    }
+    std::fflush(stdout);
+}
+
+Message::Message(LogLevel level, LogCategory category) : stream(&buffer) {
+    Ring& ring = GetRing();
+    uint64_t position = ring.head.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& candidate = ring.slots[position % RING_SIZE];
+        uint64_t sequence = candidate.sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (ring.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                candidate.level = level;
+                candidate.category = category;
+                buffer.Reset(candidate.text, MESSAGE_CAPACITY);
+                slot = &candidate;
+                break;
+            }
+        } else if (sequence < position) {
+            // Full: a whole lap ahead of the writer
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        } else {
+            position = ring.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    if (!slot) {
+        stream.setstate(std::ios::badbit);  // Formatting into nothing
+    }
+#ifndef PLATFORM_WEB
+    GetWriter();  // Started by the first message
+#endif
+}
+
+Message::~Message() {
+    if (!slot) return;
+    Slot& published = *static_cast<Slot*>(slot);
+    published.length = static_cast<uint16_t>(buffer.Length());
+    uint64_t position = published.sequence.load(std::memory_order_relaxed);
+    published.sequence.store(position + 1, std::memory_order_release);
+#ifndef PLATFORM_WEB
+    if (published.level >= LogLevel::ERROR) {
+        GetWriter().Notify();
+    }
+#endif
+}
+
+bool RateLimit::Allow(uint32_t& suppressedBefore) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t current = window.load(std::memory_order_relaxed);
+    if (current != now && window.compare_exchange_strong(current, now, std::memory_order_relaxed)) {
+        inWindow.store(0, std::memory_order_relaxed);
+    }
+    if (inWindow.fetch_add(1, std::memory_order_relaxed) >= perSecond) {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressedBefore = suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+}  // namespace Log
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+// Leveled, per-module logging that keeps iostream and the console off the
+// hot paths:
+//
+//   LOGI(NET, "Joining room " << roomId);
+//   LOG_LIMITED(WARNING, GAME, 1, "Input queue full");   // at most once a second
+//
+// Levels below ROBBAN_LOG_MIN_LEVEL compile to nothing (the expression is
+// still type-checked). Enabled messages are formatted straight into a slot
+// of a lock-free ring buffer; a background thread (natively) or Log::Flush()
+// once per frame (on the web, where the page owns the only spare thread)
+// writes them out. The stream expression is only evaluated when the message
+// will be kept.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+// Set by the LOG_LEVEL CMake option
+#ifndef ROBBAN_LOG_MIN_LEVEL
+#define ROBBAN_LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+enum class LogLevel : uint8_t {
+    DEBUG = LOG_LEVEL_DEBUG,
+    INFO = LOG_LEVEL_INFO,
+    WARNING = LOG_LEVEL_WARNING,
+    ERROR = LOG_LEVEL_ERROR,
+};
+
+// Printed as the [Tag] in front of each line
+enum class LogCategory : uint8_t {
+    GAME,
+    ASSETS,
+    AUDIO,
+    NET,
+    LOCKSTEP,
+    SNAPSHOT,
+    FIREBASE,
+    FRAMES,
+    METRICS,
+    TRACE,
+    STRESS,
+    SAVE,
+    COUNT
+};
+
+namespace Log {
+
+constexpr bool IsCompiledIn(LogLevel level) {
+    return static_cast<int>(level) + 1 > ROBBAN_LOG_MIN_LEVEL;  // Not >=, which warns when the minimum is 0
+}
+
+// Runtime filter on top of the compile-time one, per category
+bool IsEnabled(LogLevel level, LogCategory category);
+void SetLevel(LogCategory category, LogLevel level);
+// Comma-separated category=level pairs, e.g. "net=debug,firebase=warning";
+// "all=..." sets every category. Returns false if anything was not understood
+bool Configure(const std::string& spec);
+
+// Writes out everything queued so far, on the calling thread. Natively the
+// writer thread does this, and a last time when the program exits
+void Flush();
+
+// Longest message kept; longer ones are cut off
+const size_t MESSAGE_CAPACITY = 240;
+
+// Formats into a fixed buffer and never allocates
+class FixedBuffer : public std::streambuf {
+public:
+    void Reset(char* begin, size_t capacity) { setp(begin, begin + capacity); }
+    size_t Length() const { return pptr() - pbase(); }
+};
+
+// One message: reserves a ring slot on construction and publishes it on
+// destruction. If the ring is full the message is counted and dropped.
+class Message {
+private:
+    void* slot = nullptr;
+    FixedBuffer buffer;
+    std::ostream stream;
+
+public:
+    Message(LogLevel level, LogCategory category);
+    ~Message();
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+
+    std::ostream& Stream() { return stream; }
+};
+
+// Per call site: lets perSecond messages through in each whole second and
+// counts the rest, to be mentioned on the next one that gets through
+class RateLimit {
+private:
+    const uint32_t perSecond;
+    std::atomic<int64_t> window{-1};
+    std::atomic<uint32_t> inWindow{0};
+    std::atomic<uint32_t> suppressed{0};
+
+public:
+    explicit RateLimit(uint32_t perSecond) : perSecond(perSecond) {}
+    bool Allow(uint32_t& suppressedBefore);
+};
+
+}  // namespace Log
+
+#define LOG_AT(level, category, expression)                                                   \
+    do {                                                                                      \
+        if constexpr (Log::IsCompiledIn(LogLevel::level)) {                                   \
+            if (Log::IsEnabled(LogLevel::level, LogCategory::category)) {                     \
+                Log::Message logMessage(LogLevel::level, LogCategory::category);              \
+                logMessage.Stream() << expression;                                            \
+            }                                                                                 \
+        }                                                                                     \
+    } while (0)
+
+#define LOG_LIMITED(level, category, perSecond, expression)                                   \
+    do {                                                                                      \
+        if constexpr (Log::IsCompiledIn(LogLevel::level)) {                                   \
+            static Log::RateLimit logRateLimit(perSecond);                                    \
+            uint32_t logSuppressed = 0;                                                       \
+            if (Log::IsEnabled(LogLevel::level, LogCategory::category) &&                     \
+                logRateLimit.Allow(logSuppressed)) {                                          \
+                Log::Message logMessage(LogLevel::level, LogCategory::category);              \
+                logMessage.Stream() << expression;                                            \
+                if (logSuppressed > 0) {                                                      \
+                    logMessage.Stream() << " (" << logSuppressed << " similar suppressed)";   \
+                }                                                                             \
+            }                                                                                 \
+        }                                                                                     \
+    } while (0)
+
+// The names raylib's TraceLogLevel already uses (LOG_INFO, ...) are taken
+#define LOGD(category, expression) LOG_AT(DEBUG, category, expression)
+#define LOGI(category, expression) LOG_AT(INFO, category, expression)
+#define LOGW(category, expression) LOG_AT(WARNING, category, expression)
+#define LOGE(category, expression) LOG_AT(ERROR, category, expression)
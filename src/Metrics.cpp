@@ -0,0 +1,275 @@
+#include "Metrics.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#ifndef PLATFORM_WEB
+#ifdef _WIN32
+// wingdi.h would define ERROR, which LogLevel uses
+#define NOGDI
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#endif
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds(bounds), buckets(new std::atomic<uint64_t>[bounds.size() + 1]) {
+    std::sort(this->bounds.begin(), this->bounds.end());
+    for (size_t i = 0; i <= bounds.size(); i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::Observe(double value) {
+    size_t index = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    buckets[index].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    // No fetch_add for atomic<double> before C++20
+    double current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
+const MetricsRegistry::Entry* MetricsRegistry::Find(Kind kind, const std::string& name, const std::string& labels) const {
+    for (const auto& entry : entries) {
+        if (entry.kind == kind && entry.name == name && entry.labels == labels) return &entry;
+    }
+    return nullptr;
+}
+
+Counter& MetricsRegistry::GetCounter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (const Entry* entry = Find(Kind::COUNTER, name, labels)) return *static_cast<Counter*>(entry->metric);
+    counters.emplace_back();
+    entries.push_back({Kind::COUNTER, name, labels, help, &counters.back()});
+    return counters.back();
+}
+
+Gauge& MetricsRegistry::GetGauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (const Entry* entry = Find(Kind::GAUGE, name, labels)) return *static_cast<Gauge*>(entry->metric);
+    gauges.emplace_back();
+    entries.push_back({Kind::GAUGE, name, labels, help, &gauges.back()});
+    return gauges.back();
+}
+
+Histogram& MetricsRegistry::GetHistogram(const std::string& name, const std::string& help,
+                                         const std::vector<double>& bounds, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (const Entry* entry = Find(Kind::HISTOGRAM, name, labels)) return *static_cast<Histogram*>(entry->metric);
+    histograms.emplace_back(bounds);
+    entries.push_back({Kind::HISTOGRAM, name, labels, help, &histograms.back()});
+    return histograms.back();
+}
+
+const Counter* MetricsRegistry::FindCounter(const std::string& name, const std::string& labels) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry* entry = Find(Kind::COUNTER, name, labels);
+    return entry ? static_cast<const Counter*>(entry->metric) : nullptr;
+}
+
+const Gauge* MetricsRegistry::FindGauge(const std::string& name, const std::string& labels) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry* entry = Find(Kind::GAUGE, name, labels);
+    return entry ? static_cast<const Gauge*>(entry->metric) : nullptr;
+}
+
+const Histogram* MetricsRegistry::FindHistogram(const std::string& name, const std::string& labels) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry* entry = Find(Kind::HISTOGRAM, name, labels);
+    return entry ? static_cast<const Histogram*>(entry->metric) : nullptr;
+}
+
+std::string MetricsRegistry::RenderPrometheus() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream text;
+    text.precision(9);
+
+    // Every series of one name must follow a single HELP/TYPE header
+    std::vector<std::string> announced;
+    for (const auto& first : entries) {
+        if (std::find(announced.begin(), announced.end(), first.name) != announced.end()) continue;
+        announced.push_back(first.name);
+
+        const char* type = first.kind == Kind::COUNTER ? "counter" : first.kind == Kind::GAUGE ? "gauge" : "histogram";
+        text << "# HELP " << first.name << " " << first.help << "\n";
+        text << "# TYPE " << first.name << " " << type << "\n";
+
+        for (const auto& entry : entries) {
+            if (entry.name != first.name) continue;
+            std::string braces = entry.labels.empty() ? "" : "{" + entry.labels + "}";
+            if (entry.kind == Kind::COUNTER) {
+                text << entry.name << braces << " " << static_cast<const Counter*>(entry.metric)->Get() << "\n";
+            } else if (entry.kind == Kind::GAUGE) {
+                text << entry.name << braces << " " << static_cast<const Gauge*>(entry.metric)->Get() << "\n";
+            } else {
+                const Histogram* histogram = static_cast<const Histogram*>(entry.metric);
+                std::string prefix = entry.labels.empty() ? "" : entry.labels + ",";
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < histogram->GetBounds().size(); i++) {
+                    cumulative += histogram->GetBucket(i);
+                    text << entry.name << "_bucket{" << prefix << "le=\"" << histogram->GetBounds()[i] << "\"} "
+                         << cumulative << "\n";
+                }
+                cumulative += histogram->GetBucket(histogram->GetBounds().size());
+                text << entry.name << "_bucket{" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+                text << entry.name << "_sum" << braces << " " << histogram->GetSum() << "\n";
+                text << entry.name << "_count" << braces << " " << histogram->GetCount() << "\n";
+            }
+        }
+    }
+    return text.str();
+}
+
+MetricsRegistry& Metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+#ifndef PLATFORM_WEB
+#ifdef _WIN32
+static void CloseSocket(int socket) { closesocket(socket); }
+static int PollSocket(int socket, int timeoutMs) {
+    WSAPOLLFD entry = {static_cast<SOCKET>(socket), POLLIN, 0};
+    return WSAPoll(&entry, 1, timeoutMs);
+}
+#else
+static void CloseSocket(int socket) { close(socket); }
+static int PollSocket(int socket, int timeoutMs) {
+    pollfd entry = {socket, POLLIN, 0};
+    return poll(&entry, 1, timeoutMs);
+}
+#endif
+
+// How often the loop checks for Stop() and how often the file is rewritten
+static const int POLL_INTERVAL_MS = 250;
+static const int FILE_INTERVAL_MS = 5000;
+
+MetricsExporter::~MetricsExporter() {
+    Stop();
+}
+
+bool MetricsExporter::Start(int port, const std::string& filePath) {
+    if (running) return true;
+    this->port = port;
+    this->filePath = filePath;
+
+    if (port > 0 && !OpenSocket()) {
+        LOGW(METRICS, "Could not listen on 127.0.0.1:" << port);
+        if (filePath.empty()) return false;
+    }
+
+    running = true;
+    exporterThread = std::thread(&MetricsExporter::ExporterLoop, this);
+    if (listenSocket >= 0) {
+        LOGI(METRICS, "Serving Prometheus metrics on http://127.0.0.1:" << port << "/metrics");
+    }
+    if (!filePath.empty()) {
+        LOGI(METRICS, "Writing metrics to " << filePath);
+    }
+    return true;
+}
+
+void MetricsExporter::Stop() {
+    if (!running) return;
+    running = false;
+    if (exporterThread.joinable()) {
+        exporterThread.join();
+    }
+    if (listenSocket >= 0) {
+        CloseSocket(listenSocket);
+        listenSocket = -1;
+    }
+    if (!filePath.empty()) {
+        WriteFile();  // Final figures
+    }
+}
+
+bool MetricsExporter::OpenSocket() {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) return false;
+#endif
+    int server = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (server < 0) return false;
+
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    // Local only: the endpoint has no authentication
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 4) != 0) {
+        CloseSocket(server);
+        return false;
+    }
+    listenSocket = server;
+    return true;
+}
+
+void MetricsExporter::ServeClient(int client) {
+    // Whatever the request, answer with the metrics; read it first so the
+    // client doesn't see a reset for unread data
+    char request[1024];
+    if (PollSocket(client, POLL_INTERVAL_MS) > 0) {
+        recv(client, request, sizeof(request), 0);
+    }
+
+    std::string body = Metrics().RenderPrometheus();
+    std::string response = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        int written = static_cast<int>(send(client, response.data() + sent, static_cast<int>(response.size() - sent), 0));
+        if (written <= 0) break;
+        sent += written;
+    }
+    CloseSocket(client);
+}
+
+void MetricsExporter::WriteFile() {
+    // Write then rename, so a scraper never reads a half-written file
+    std::string temporary = filePath + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "w");
+    if (!file) return;
+    std::string text = Metrics().RenderPrometheus();
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+#ifdef _WIN32
+    // rename() won't replace an existing file here
+    std::remove(filePath.c_str());
+#endif
+    std::rename(temporary.c_str(), filePath.c_str());
+}
+
+void MetricsExporter::ExporterLoop() {
+    auto nextWrite = std::chrono::steady_clock::now();
+    while (running) {
+        if (!filePath.empty() && std::chrono::steady_clock::now() >= nextWrite) {
+            WriteFile();
+            nextWrite = std::chrono::steady_clock::now() + std::chrono::milliseconds(FILE_INTERVAL_MS);
+        }
+
+        if (listenSocket < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+            continue;
+        }
+        if (PollSocket(listenSocket, POLL_INTERVAL_MS) <= 0) continue;
+        int client = static_cast<int>(accept(listenSocket, nullptr, nullptr));
+        if (client >= 0) {
+            ServeClient(client);
+        }
+    }
+}
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process-wide metrics. Recording a value only touches relaxed atomics, so
+// counters, gauges and histograms can be updated from any thread at tick
+// rate. Registration takes the registry's lock and is meant to happen once,
+// keeping the returned reference; rendering takes it too.
+
+class Counter {
+private:
+    std::atomic<uint64_t> value{0};
+
+public:
+    void Add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+};
+
+class Gauge {
+private:
+    std::atomic<double> value{0.0};
+
+public:
+    void Set(double newValue) { value.store(newValue, std::memory_order_relaxed); }
+    double Get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Fixed upper bounds chosen at registration, plus an implicit +Inf bucket.
+// Buckets are stored per range and only made cumulative when rendered.
+class Histogram {
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> sum{0.0};
+
+public:
+    explicit Histogram(const std::vector<double>& bounds);
+
+    void Observe(double value);
+
+    const std::vector<double>& GetBounds() const { return bounds; }
+    uint64_t GetBucket(size_t index) const { return buckets[index].load(std::memory_order_relaxed); }
+    uint64_t GetCount() const { return count.load(std::memory_order_relaxed); }
+    double GetSum() const { return sum.load(std::memory_order_relaxed); }
+};
+
+// Observes the lifetime of the scope in seconds, or the time since start
+// when given (e.g. when the work was queued)
+class ScopedTimer {
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(Histogram& histogram, std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now())
+        : histogram(histogram), start(start) {}
+    ~ScopedTimer() {
+        histogram.Observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+// Bucket bounds in seconds for per-tick and per-frame work, and for network
+// latency. Inline so metrics registered by other files' statics see them
+inline const std::vector<double> TIMING_BUCKETS = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1};
+inline const std::vector<double> LATENCY_BUCKETS = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0};
+
+class MetricsRegistry {
+private:
+    enum class Kind { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Entry {
+        Kind kind;
+        std::string name;
+        std::string labels;  // Prometheus label list without braces, e.g. subsystem="animals"
+        std::string help;
+        void* metric;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Entry> entries;
+    // Deques never move their elements, so handed-out references stay valid
+    std::deque<Counter> counters;
+    std::deque<Gauge> gauges;
+    std::deque<Histogram> histograms;
+
+    const Entry* Find(Kind kind, const std::string& name, const std::string& labels) const;
+
+public:
+    // Return the existing metric when name and labels were registered before
+    Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& GetHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                            const std::string& labels = "");
+
+    // Lookups for readers that don't register anything; nullptr if missing
+    const Counter* FindCounter(const std::string& name, const std::string& labels = "") const;
+    const Gauge* FindGauge(const std::string& name, const std::string& labels = "") const;
+    const Histogram* FindHistogram(const std::string& name, const std::string& labels = "") const;
+
+    // Prometheus text exposition format, version 0.0.4
+    std::string RenderPrometheus() const;
+};
+
+MetricsRegistry& Metrics();
+
+#ifndef PLATFORM_WEB
+// Serves Metrics() in Prometheus text format on 127.0.0.1:port, and/or
+// rewrites a file with the same text every few seconds. Runs on its own
+// thread; a port or path of 0/empty disables that output.
+class MetricsExporter {
+private:
+    int port = 0;
+    std::string filePath;
+    int listenSocket = -1;
+    std::atomic<bool> running{false};
+    std::thread exporterThread;
+
+    bool OpenSocket();
+    void ServeClient(int client);
+    void WriteFile();
+    void ExporterLoop();
+
+public:
+    ~MetricsExporter();
+
+    bool Start(int port, const std::string& filePath);
+    void Stop();
+};
+#endif
@@ -1,10 +1,15 @@
 #include "NetworkManager.h"
 #include "GameState.h"
-#include <iostream>
-#include <sstream>
+#include "Metrics.h"
+#include "Trace.h"
+#include "Log.h"
+#include "WireFormat.h"
 #include <random>
 #include <chrono>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
 
 // Callback function pointer for peer ready event
 typedef void (*PeerReadyCallback)(const char* peerId);
@@ -15,6 +20,18 @@ extern "C" void SetPeerReadyCallback(PeerReadyCallback callback) {
     g_peerReadyCallback = callback;
 }
 
+// Traffic through the web transport, counted on whichever thread sends or
+// dispatches; routing headers included
+static Counter& g_bytesSent = Metrics().GetCounter("robban_net_bytes_total", "Network message bytes, including routing headers",
+                                                   "direction=\"sent\"");
+static Counter& g_bytesReceived = Metrics().GetCounter("robban_net_bytes_total", "", "direction=\"received\"");
+static Histogram& g_messageLatency = Metrics().GetHistogram("robban_net_message_latency_seconds",
+                                                            "From a message arriving until the game has handled it",
+                                                            LATENCY_BUCKETS);
+
+// Queued native messages that wake the network thread before its next frame
+static const size_t OUTGOING_BATCH = 64;
+
 #ifdef PLATFORM_WEB
 #include <emscripten.h>
 
@@ -37,424 +54,567 @@ static NetworkManager* g_networkManager = nullptr;
 extern "C" {
     EMSCRIPTEN_KEEPALIVE
     void OnPeerReady(const char* peerId) {
-        std::cout << "[C++] Peer ready with ID: " << peerId << std::endl;
+        LOGI(NET, "Peer ready with ID: " << peerId);
         
         // Call the registered callback if available
         if (g_peerReadyCallback) {
-            g_peerReadyCallback(peerId);
+            std::string peerCopy(peerId);
+            auto notify = [peerCopy]() { g_peerReadyCallback(peerCopy.c_str()); };
+            if (g_networkManager) {
+                g_networkManager->RunOrDefer(notify);
+            } else {
+                notify();
+            }
         }
     }
     
     EMSCRIPTEN_KEEPALIVE
     void OnPlayerJoined(const char* peerId) {
-        std::cout << "[C++] Player joined: " << peerId << std::endl;
+        LOGI(NET, "Player joined: " << peerId);
         if (g_networkManager) {
-            g_networkManager->HandlePlayerJoined(peerId);
+            std::string peerCopy(peerId);
+            g_networkManager->RunOrDefer([peerCopy]() { g_networkManager->HandlePlayerJoined(peerCopy); });
         }
     }
     
     EMSCRIPTEN_KEEPALIVE
     void OnPlayerLeft(const char* peerId) {
-        std::cout << "[C++] Player left: " << peerId << std::endl;
+        LOGI(NET, "Player left: " << peerId);
+        if (g_networkManager) {
+            std::string peerCopy(peerId);
+            g_networkManager->RunOrDefer([peerCopy]() { g_networkManager->HandlePlayerLeft(peerCopy); });
+        }
     }
     
     EMSCRIPTEN_KEEPALIVE
-    void OnNetworkMessage(const char* message) {
-        // Parse message type first to filter logging
-        std::string msgStr(message);
-        std::string type;
-        {
-            std::string search = "\"type\":";
-            size_t pos = msgStr.find(search);
-            if (pos != std::string::npos) {
-                pos += search.length();
-                while (pos < msgStr.length() && (msgStr[pos] == ' ' || msgStr[pos] == '\t' || msgStr[pos] == '"')) pos++;
-                size_t endPos = msgStr.find('"', pos);
-                if (endPos != std::string::npos) {
-                    type = msgStr.substr(pos, endPos - pos);
+    void OnNetworkMessage(const char* message, const char* fromPeerId) {
+        if (!g_networkManager) return;
+        auto arrivedAt = std::chrono::steady_clock::now();
+        // JavaScript frees both strings when we return, so only a deferred message needs copies
+        if (!g_networkManager->IsDeferringEvents()) {
+            g_networkManager->HandleMessage(message, fromPeerId, arrivedAt);
+            return;
+        }
+        g_networkManager->DeferMessage(message, fromPeerId, arrivedAt);
+    }
+    
+    // UI button callbacks
+    EMSCRIPTEN_KEEPALIVE
+    void OnHostGameClicked() {
+        LOGI(NET, "Host game button clicked");
+        if (g_networkManager) {
+            g_networkManager->RunOrDefer([]() {
+                g_networkManager->CreateRoom("RobbanRoom");
+                // Host automatically gets player ID 0
+                if (g_networkManager->onPlayerIdAssigned) {
+                    g_networkManager->onPlayerIdAssigned(0);
                 }
-            }
+            });
         }
-        
-        // Only log non-FULL_GAME_STATE messages to reduce spam
-        if (type != "FULL_GAME_STATE") {
-            std::cout << "[C++] Network message received: " << type << std::endl;
-        }
-
-        // Host only rebroadcasts certain message types, not player moves
-        if (g_networkManager && g_networkManager->IsHost()) {
-            std::string msgStr(message);
-            auto extractType = [&]() -> std::string {
-                std::string search = "\"type\":";
-                size_t pos = msgStr.find(search);
-                if (pos == std::string::npos) return "";
-                pos += search.length();
-                while (pos < msgStr.length() && (msgStr[pos] == ' ' || msgStr[pos] == '\t' || msgStr[pos] == '"')) pos++;
-                size_t endPos = msgStr.find('"', pos);
-                if (endPos == std::string::npos) return "";
-                return msgStr.substr(pos, endPos - pos);
-            };
-            
-            std::string type = extractType();
-            // Only rebroadcast actions, not player moves (clients already see their own moves)
-            if (type == "PLAYER_ACTION") {
-                std::cout << "[C++] Host rebroadcasting PLAYER_ACTION" << std::endl;
-                JS_BroadcastMessage(message);
-            }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void OnJoinGameClicked(const char* roomId) {
+        LOGI(NET, "Join game button clicked with room: " << roomId);
+        if (g_networkManager) {
+            std::string roomCopy(roomId);
+            g_networkManager->RunOrDefer([roomCopy]() { g_networkManager->JoinRoom(roomCopy); });
         }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void OnDisconnectClicked() {
+        LOGI(NET, "Disconnect button clicked");
+        if (g_networkManager) {
+            g_networkManager->RunOrDefer([]() { g_networkManager->Disconnect(); });
+        }
+    }
+}
+#endif
 
-        // Parse JSON message and update game state
-        // (msgStr already defined above for type checking)
-
-        // Simple JSON parsing for key-value pairs
-        auto extractValue = [&](const std::string& key) -> std::string {
-            std::string search = "\"" + key + "\":";
-            size_t pos = msgStr.find(search);
-            if (pos == std::string::npos) return "";
-
-            pos += search.length();
-            // Skip whitespace
-            while (pos < msgStr.length() && (msgStr[pos] == ' ' || msgStr[pos] == '\t')) pos++;
-
-            if (pos >= msgStr.length()) return "";
-
-            if (msgStr[pos] == '"') {
-                // String value
-                pos++; // Skip opening quote
-                size_t endPos = msgStr.find('"', pos);
-                if (endPos == std::string::npos) return "";
-                return msgStr.substr(pos, endPos - pos);
-            } else if (msgStr[pos] == '[') {
-                // Array value - find matching closing bracket
-                size_t endPos = pos + 1;
-                int bracketCount = 1;
-                while (endPos < msgStr.length() && bracketCount > 0) {
-                    if (msgStr[endPos] == '[') bracketCount++;
-                    else if (msgStr[endPos] == ']') bracketCount--;
-                    endPos++;
-                }
-                return msgStr.substr(pos, endPos - pos);
-            } else {
-                // Numeric or boolean value
-                size_t endPos = pos;
-                while (endPos < msgStr.length() && msgStr[endPos] != ',' && msgStr[endPos] != '}') endPos++;
-                return msgStr.substr(pos, endPos - pos);
-            }
-        };
+// Reuses the element after the last one used, so refilling a vector keeps
+// both its capacity and whatever its elements own
+template <typename T>
+static T& NextSlot(std::vector<T>& items, size_t& used) {
+    if (used == items.size()) items.emplace_back();
+    return items[used++];
+}
 
-        try {
-            std::string type = extractValue("type");
-            // Don't log FULL_GAME_STATE messages to reduce spam
-            if (type != "FULL_GAME_STATE") {
-                std::cout << "[C++] Message type: " << type << std::endl;
-            }
+// Same colors as AddPlayer picks from
+static const Color PLAYER_COLORS[] = {BLUE, RED, GREEN, YELLOW, PURPLE, ORANGE, PINK, BROWN};
 
-            if (type == "PLAYER_MOVE") {
-                Player update = {};
-
-                std::string idStr = extractValue("playerId");
-                std::string xStr = extractValue("x");
-                std::string yStr = extractValue("y");
-                std::string modeStr = extractValue("mode");
-                std::string scoreStr = extractValue("score");
-                std::string aliveStr = extractValue("alive");
-                std::string dirXStr = extractValue("dirX");
-                std::string dirYStr = extractValue("dirY");
-                std::string usernameStr = extractValue("username");
-
-                if (!idStr.empty()) update.id = std::stoi(idStr);
-                if (!xStr.empty()) update.x = std::stoi(xStr);
-                if (!yStr.empty()) update.y = std::stoi(yStr);
-                if (!modeStr.empty()) update.mode = static_cast<PlayerMode>(std::stoi(modeStr));
-                if (!scoreStr.empty()) update.score = std::stoi(scoreStr);
-                update.alive = (aliveStr == "true");
-                if (!dirXStr.empty()) update.lastDirectionX = std::stoi(dirXStr);
-                if (!dirYStr.empty()) update.lastDirectionY = std::stoi(dirYStr);
-                if (!usernameStr.empty()) update.username = usernameStr;
-
-
-                // Update player if we have a valid network manager
-                if (g_networkManager) {
-                    g_networkManager->OnPlayerUpdate(update);
-                }
+// Back to defaults, keeping the username's buffer
+static void ResetPlayer(Player& player) {
+    std::string username = std::move(player.username);
+    player = Player();
+    username.clear();
+    player.username = std::move(username);
+}
 
-            } else if (type == "PLAYER_ACTION") {
-                ActionMessage action = {};
+// Fields shared by PLAYER_MOVE and the player objects of state messages.
+// Besides the id only the position is required
+static bool DecodePlayerFields(std::string_view json, std::string_view idKey, Player& player) {
+    ResetPlayer(player);
+    int mode = 0;
+    if (!wire::ParseInt(wire::FindValue(json, idKey), player.id) || player.id < 0 ||
+        !wire::ParseInt(wire::FindValue(json, "x"), player.x) ||
+        !wire::ParseInt(wire::FindValue(json, "y"), player.y)) {
+        return false;
+    }
+    if (wire::ParseInt(wire::FindValue(json, "mode"), mode)) player.mode = static_cast<PlayerMode>(mode);
+    wire::ParseInt(wire::FindValue(json, "score"), player.score);
+    player.alive = wire::FindValue(json, "alive") == "true";
+    wire::ParseInt(wire::FindValue(json, "dirX"), player.lastDirectionX);
+    wire::ParseInt(wire::FindValue(json, "dirY"), player.lastDirectionY);
+    player.username.assign(wire::FindValue(json, "username"));
+    player.color = PLAYER_COLORS[player.id % 8];
+    return true;
+}
 
-                std::string idStr = extractValue("playerId");
-                std::string xStr = extractValue("targetX");
-                std::string yStr = extractValue("targetY");
-                std::string actionStr = extractValue("actionType");
+// Calls visit with each {...} object of a JSON array as written by the serializers
+template <typename Visit>
+static bool ForEachObject(std::string_view array, Visit visit) {
+    size_t pos = 0;
+    while (true) {
+        size_t start = array.find('{', pos);
+        if (start == std::string_view::npos) return true;
+        size_t end = array.find('}', start);
+        if (end == std::string_view::npos) return false;
+        if (!visit(array.substr(start, end - start + 1))) return false;
+        pos = end + 1;
+    }
+}
 
-                if (!idStr.empty()) action.playerId = std::stoi(idStr);
-                if (!xStr.empty()) action.targetX = std::stoi(xStr);
-                if (!yStr.empty()) action.targetY = std::stoi(yStr);
-                if (!actionStr.empty()) action.actionType = std::stoi(actionStr);
+static bool DecodePlayerList(std::string_view list, std::vector<Player>& players) {
+    size_t used = 0;
+    bool ok = ForEachObject(list, [&](std::string_view object) {
+        return DecodePlayerFields(object, "id", NextSlot(players, used));
+    });
+    players.resize(used);
+    return ok;
+}
 
-                std::cout << "[C++] Player action: ID=" << action.playerId << " type=" << action.actionType << std::endl;
+static bool DecodeAnimalList(std::string_view list, std::vector<Animal>& animals) {
+    animals.clear();
+    return ForEachObject(list, [&](std::string_view object) {
+        Animal animal;
+        int type = 0;
+        if (!wire::ParseInt(wire::FindValue(object, "id"), animal.id) ||
+            !wire::ParseInt(wire::FindValue(object, "type"), type) ||
+            !wire::ParseInt(wire::FindValue(object, "x"), animal.x) ||
+            !wire::ParseInt(wire::FindValue(object, "y"), animal.y)) {
+            return false;
+        }
+        animal.type = static_cast<AnimalType>(type);
+        animals.push_back(animal);
+        return true;
+    });
+}
 
-                // Handle player action if we have a valid network manager
-                if (g_networkManager) {
-                    g_networkManager->OnPlayerAction(action);
-                }
+// "chunkX,chunkY;..." interest enter/leave lists
+static bool DecodeChunkList(std::string_view list, std::vector<std::pair<int, int>>& chunks) {
+    chunks.clear();
+    while (!list.empty()) {
+        std::string_view token = wire::NextToken(list, ';');
+        if (token.empty()) continue;
+        std::pair<int, int> chunk;
+        if (!wire::ParseInt(wire::NextToken(token, ','), chunk.first) || !wire::ParseInt(token, chunk.second)) {
+            return false;
+        }
+        chunks.push_back(chunk);
+    }
+    return true;
+}
 
-            } else if (type == "PLAYER_MODE_CHANGE") {
-                std::string idStr = extractValue("playerId");
-                std::string modeStr = extractValue("mode");
-
-                int playerId = idStr.empty() ? -1 : std::stoi(idStr);
-                int newMode = modeStr.empty() ? 0 : std::stoi(modeStr);
-
-                std::cout << "[C++] Player " << playerId << " changed mode to " << newMode << std::endl;
-            } else if (type == "FULL_GAME_STATE") {
-                 if (g_networkManager) {
-                    GameState state;
-                    std::string grid_str = extractValue("grid");
-                    std::string players_str = extractValue("players");
-
-                    // Parse grid
-                    std::stringstream grid_ss(grid_str);
-                    std::string row_token;
-                    int y = 0;
-                    while(std::getline(grid_ss, row_token, '|')) {
-                        state.grid.resize(y + 1);
-                        std::stringstream cell_row_ss(row_token);
-                        std::string cell_token;
-                        int x = 0;
-                        while(std::getline(cell_row_ss, cell_token, ';')) {
-                           state.grid[y].resize(x + 1);
-                           std::stringstream cell_props_ss(cell_token);
-                           std::string prop;
-                           std::getline(cell_props_ss, prop, ',');
-                           state.grid[y][x].type = static_cast<CellType>(std::stoi(prop));
-                           std::getline(cell_props_ss, prop, ',');
-                           state.grid[y][x].playerId = std::stoi(prop);
-                           std::getline(cell_props_ss, prop, ',');
-                           state.grid[y][x].growth = std::stof(prop);
-                           x++;
-                        }
-                        y++;
-                    }
+// "type,playerId,growth", the fields SerializeCellUpdate writes after x,y
+static bool DecodeCellFields(std::string_view text, Cell& cell) {
+    int type = 0;
+    if (!wire::ParseInt(wire::NextToken(text, ','), type) ||
+        !wire::ParseInt(wire::NextToken(text, ','), cell.playerId) ||
+        !wire::ParseFloat(text, cell.growth)) {
+        return false;
+    }
+    cell.type = static_cast<CellType>(type);
+    return true;
+}
 
-                     size_t current_pos = 0;
-                     while(current_pos < players_str.length()) {
-                        size_t start_obj = players_str.find('{', current_pos);
-                        if (start_obj == std::string::npos) break;
-                        size_t end_obj = players_str.find('}', start_obj);
-                        if (end_obj == std::string::npos) break;
-
-                        std::string player_obj_str = players_str.substr(start_obj, end_obj - start_obj + 1);
-                        
-                         auto extractPlayerValue = [&](const std::string& key) -> std::string {
-                             std::string search = "\"" + key + "\":";
-                             size_t pos = player_obj_str.find(search);
-                             if (pos == std::string::npos) return "";
-                             pos += search.length();
-                             if (player_obj_str[pos] == '"') {
-                                 pos++;
-                                 size_t endPos = player_obj_str.find('"', pos);
-                                 return player_obj_str.substr(pos, endPos - pos);
-                             } else {
-                                 size_t endPos = pos;
-                                 while (endPos < player_obj_str.length() && player_obj_str[endPos] != ',' && player_obj_str[endPos] != '}') endPos++;
-                                 return player_obj_str.substr(pos, endPos - pos);
-                             }
-                         };
-
-                        Player p;
-                        p.id = std::stoi(extractPlayerValue("id"));
-                        p.x = std::stoi(extractPlayerValue("x"));
-                        p.y = std::stoi(extractPlayerValue("y"));
-                        p.mode = static_cast<PlayerMode>(std::stoi(extractPlayerValue("mode")));
-                        p.score = std::stoi(extractPlayerValue("score"));
-                        p.alive = extractPlayerValue("alive") == "true";
-                        
-                        std::string dirXStr = extractPlayerValue("dirX");
-                        std::string dirYStr = extractPlayerValue("dirY");
-                        if (!dirXStr.empty()) p.lastDirectionX = std::stoi(dirXStr);
-                        if (!dirYStr.empty()) p.lastDirectionY = std::stoi(dirYStr);
-                        
-                        // Extract username
-                        std::string usernameStr = extractPlayerValue("username");
-                        if (!usernameStr.empty()) {
-                            p.username = usernameStr;
-                        }
-
-                        // Set player color based on ID (same as in AddPlayer)
-                        const Color PLAYER_COLORS[] = {
-                            BLUE, RED, GREEN, YELLOW, PURPLE, ORANGE, PINK, BROWN
-                        };
-                        p.color = PLAYER_COLORS[p.id % 8];
-
-                        state.players[p.id] = p;
-
-                        current_pos = end_obj + 1;
-                     }
-                     
-                     // Parse animals
-                     std::string animals_str = extractValue("animals");
-                     current_pos = 0;
-                     while(current_pos < animals_str.length()) {
-                        size_t start_obj = animals_str.find('{', current_pos);
-                        if (start_obj == std::string::npos) break;
-                        size_t end_obj = animals_str.find('}', start_obj);
-                        if (end_obj == std::string::npos) break;
-
-                        std::string animal_obj_str = animals_str.substr(start_obj, end_obj - start_obj + 1);
-                        
-                        auto extractAnimalValue = [&](const std::string& key) -> std::string {
-                            std::string search = "\"" + key + "\":";
-                            size_t pos = animal_obj_str.find(search);
-                            if (pos == std::string::npos) return "";
-                            pos += search.length();
-                            size_t endPos = pos;
-                            while (endPos < animal_obj_str.length() && animal_obj_str[endPos] != ',' && animal_obj_str[endPos] != '}') endPos++;
-                            return animal_obj_str.substr(pos, endPos - pos);
-                        };
-
-                        Animal a;
-                        a.id = std::stoi(extractAnimalValue("id"));
-                        a.type = static_cast<AnimalType>(std::stoi(extractAnimalValue("type")));
-                        a.x = std::stoi(extractAnimalValue("x"));
-                        a.y = std::stoi(extractAnimalValue("y"));
-
-                        state.animals.push_back(a);
-                        current_pos = end_obj + 1;
-                     }
-                     
-                     // Note: Bullets are NOT parsed from game state
-                     // They are created via PLAYER_ACTION messages which are already synced
-                     
-                     g_networkManager->OnFullGameState(state);
-                }
-            } else if (type == "ASSIGN_PLAYER_ID") {
-                if (g_networkManager && g_networkManager->onPlayerIdAssigned) {
-                    g_networkManager->onPlayerIdAssigned(std::stoi(extractValue("playerId")));
-                }
-            }
-             else {
-                std::cout << "[C++] Unknown message type: " << type << std::endl;
-            }
+// "x,y,type,playerId,growth;..." as written by SerializeCellUpdate
+static bool DecodeCellUpdates(std::string_view list, std::vector<CellUpdate>& cells) {
+    cells.clear();
+    while (!list.empty()) {
+        std::string_view token = wire::NextToken(list, ';');
+        if (token.empty()) continue;
+        CellUpdate update;
+        if (!wire::ParseInt(wire::NextToken(token, ','), update.x) ||
+            !wire::ParseInt(wire::NextToken(token, ','), update.y) ||
+            !DecodeCellFields(token, update.cell)) {
+            return false;
+        }
+        cells.push_back(update);
+    }
+    return true;
+}
+
+// "id;id;..."
+static bool DecodeIdList(std::string_view list, std::vector<int>& ids) {
+    ids.clear();
+    while (!list.empty()) {
+        std::string_view token = wire::NextToken(list, ';');
+        if (token.empty()) continue;
+        int id;
+        if (!wire::ParseInt(token, id)) return false;
+        ids.push_back(id);
+    }
+    return true;
+}
 
-        } catch (const std::exception& e) {
-            std::cerr << "[C++] Error parsing network message: " << e.what() << " (message: " << message << ")" << std::endl;
+bool DecodePlayerUpdate(std::string_view payload, Player& player) {
+    return DecodePlayerFields(payload, "playerId", player);
+}
+
+bool DecodeAction(std::string_view payload, ActionMessage& action) {
+    return wire::ParseInt(wire::FindValue(payload, "playerId"), action.playerId) &&
+           wire::ParseInt(wire::FindValue(payload, "targetX"), action.targetX) &&
+           wire::ParseInt(wire::FindValue(payload, "targetY"), action.targetY) &&
+           wire::ParseInt(wire::FindValue(payload, "actionType"), action.actionType);
+}
+
+// The fields a state message carries for a player, written into player only
+// where they differ; the ones kept locally (animation, throttling) stay as
+// they are. False if the message is malformed, changed tells whether
+// anything was written
+static bool ApplyPlayerFields(std::string_view json, int id, Player& player, bool& changed) {
+    int x, y;
+    if (!wire::ParseInt(wire::FindValue(json, "x"), x) || !wire::ParseInt(wire::FindValue(json, "y"), y)) {
+        return false;
+    }
+    int mode = static_cast<int>(PlayerMode::PLANT);
+    int score = 0, dirX = 0, dirY = 0;
+    wire::ParseInt(wire::FindValue(json, "mode"), mode);
+    wire::ParseInt(wire::FindValue(json, "score"), score);
+    wire::ParseInt(wire::FindValue(json, "dirX"), dirX);
+    wire::ParseInt(wire::FindValue(json, "dirY"), dirY);
+    bool alive = wire::FindValue(json, "alive") == "true";
+    std::string_view username = wire::FindValue(json, "username");
+
+    changed = player.id != id || player.x != x || player.y != y || player.mode != static_cast<PlayerMode>(mode) ||
+              player.score != score || player.alive != alive || player.lastDirectionX != dirX ||
+              player.lastDirectionY != dirY || player.username != username;
+    if (!changed) return true;
+
+    player.id = id;
+    player.x = x;
+    player.y = y;
+    player.mode = static_cast<PlayerMode>(mode);
+    player.score = score;
+    player.alive = alive;
+    player.lastDirectionX = dirX;
+    player.lastDirectionY = dirY;
+    if (player.username != username) player.username.assign(username);
+    player.color = PLAYER_COLORS[id % 8];
+    return true;
+}
+
+static bool SameCell(const Cell& a, const Cell& b) {
+    return a.type == b.type && a.playerId == b.playerId && a.growth == b.growth;
+}
+
+// Whether a serialized grid has exactly height rows of width cells, counted
+// without decoding them
+static bool GridHasShape(std::string_view grid, int width, int height) {
+    int rows = 0;
+    while (!grid.empty()) {
+        std::string_view rowText = wire::NextToken(grid, '|');
+        int cells = 0;
+        while (!rowText.empty()) {
+            wire::NextToken(rowText, ';');
+            cells++;
         }
+        if (cells != width || ++rows > height) return false;
     }
-    
-    // UI button callbacks
-    EMSCRIPTEN_KEEPALIVE
-    void OnHostGameClicked() {
-        std::cout << "[C++] Host game button clicked" << std::endl;
-        if (g_networkManager) {
-            g_networkManager->CreateRoom("RobbanRoom");
-            // Host automatically gets player ID 0
-            if (g_networkManager->onPlayerIdAssigned) {
-                g_networkManager->onPlayerIdAssigned(0);
+    return rows == height;
+}
+
+bool ApplyGameState(std::string_view payload, GameState& state, int localPlayerId, int width, int height,
+                    GameStateChanges& changes) {
+    TRACE_SCOPE("ApplyGameState");
+    changes.cells.clear();
+    changes.players.clear();
+    changes.removedPlayers.clear();
+    changes.listedPlayers.clear();
+    changes.animals.clear();
+    changes.removedAnimals.clear();
+
+    // Grid rows are separated by |, cells by ;. Only cells that differ are
+    // written; lastUpdate is not on the wire and stays as it is. A grid of
+    // the wrong size is refused before anything is written
+    std::string_view grid = wire::FindValue(payload, "grid");
+    if (!GridHasShape(grid, width, height)) return false;
+    int y = 0;
+    while (!grid.empty()) {
+        std::string_view rowText = wire::NextToken(grid, '|');
+        if (y == static_cast<int>(state.grid.size())) state.grid.emplace_back();
+        std::vector<Cell>& row = state.grid[y];
+        int x = 0;
+        while (!rowText.empty()) {
+            Cell received;
+            if (!DecodeCellFields(wire::NextToken(rowText, ';'), received)) return false;
+            if (x == static_cast<int>(row.size())) {
+                row.emplace_back();
+                changes.cells.emplace_back(x, y);
+            } else if (!SameCell(row[x], received)) {
+                changes.cells.emplace_back(x, y);
+            } else {
+                x++;
+                continue;
             }
+            row[x].type = received.type;
+            row[x].playerId = received.playerId;
+            row[x].growth = received.growth;
+            x++;
         }
+        row.resize(x);
+        y++;
     }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void OnJoinGameClicked(const char* roomId) {
-        std::cout << "[C++] Join game button clicked with room: " << roomId << std::endl;
-        if (g_networkManager) {
-            g_networkManager->JoinRoom(roomId);
+    state.grid.resize(y);
+
+    // Players are updated where they are, so the map only allocates for
+    // newcomers. The local player is left alone once it exists
+    bool hasLocalPlayer = state.players.find(localPlayerId) != state.players.end();
+    bool ok = ForEachObject(wire::FindValue(payload, "players"), [&](std::string_view object) {
+        int id;
+        if (!wire::ParseInt(wire::FindValue(object, "id"), id) || id < 0) return false;
+        changes.listedPlayers.push_back(id);
+        if (id == localPlayerId && hasLocalPlayer) return true;
+        bool added = state.players.find(id) == state.players.end();
+        Player& player = state.players[id];
+        if (added) player.id = -1;  // So every field gets written
+        bool changed = false;
+        if (!ApplyPlayerFields(object, id, player, changed)) {
+            if (added) state.players.erase(id);
+            return false;
+        }
+        if (changed) changes.players.push_back(id);
+        return true;
+    });
+    if (!ok) return false;
+    for (auto it = state.players.begin(); it != state.players.end();) {
+        bool listed = std::find(changes.listedPlayers.begin(), changes.listedPlayers.end(), it->first) !=
+                      changes.listedPlayers.end();
+        if (listed || it->first == localPlayerId) {
+            ++it;
+            continue;
         }
+        changes.removedPlayers.push_back(it->first);
+        it = state.players.erase(it);
     }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void OnDisconnectClicked() {
-        std::cout << "[C++] Disconnect button clicked" << std::endl;
-        if (g_networkManager) {
-            g_networkManager->Disconnect();
+
+    // Animals are refilled slot by slot. Everything that was there counts as
+    // removed until it turns up in the message again
+    for (const auto& animal : state.animals) {
+        changes.removedAnimals.push_back(animal.id);
+    }
+    size_t used = 0;
+    ok = ForEachObject(wire::FindValue(payload, "animals"), [&](std::string_view object) {
+        int id, type, x, y;
+        if (!wire::ParseInt(wire::FindValue(object, "id"), id) ||
+            !wire::ParseInt(wire::FindValue(object, "type"), type) ||
+            !wire::ParseInt(wire::FindValue(object, "x"), x) ||
+            !wire::ParseInt(wire::FindValue(object, "y"), y)) {
+            return false;
+        }
+        auto removed = std::find(changes.removedAnimals.begin(), changes.removedAnimals.end(), id);
+        if (removed != changes.removedAnimals.end()) changes.removedAnimals.erase(removed);
+
+        bool added = used == state.animals.size();
+        Animal& animal = NextSlot(state.animals, used);
+        if (!added && animal.id == id && animal.type == static_cast<AnimalType>(type) && animal.x == x && animal.y == y) {
+            return true;
+        }
+        if (added || animal.id != id) animal = Animal();
+        animal.id = id;
+        animal.type = static_cast<AnimalType>(type);
+        animal.x = x;
+        animal.y = y;
+        changes.animals.push_back(id);
+        return true;
+    });
+    state.animals.resize(used);
+
+    // Bullets are not part of the state, they follow from PLAYER_ACTION messages
+    return ok;
+}
+
+bool DecodeStateDelta(std::string_view payload, StateDelta& delta) {
+    delta.reset = wire::FindValue(payload, "reset") == "true";
+    return DecodeChunkList(wire::FindValue(payload, "left"), delta.leftChunks) &&
+           DecodeChunkList(wire::FindValue(payload, "entered"), delta.enteredChunks) &&
+           DecodeCellUpdates(wire::FindValue(payload, "cells"), delta.cells) &&
+           DecodePlayerList(wire::FindValue(payload, "players"), delta.players) &&
+           DecodeAnimalList(wire::FindValue(payload, "animals"), delta.animals) &&
+           DecodeIdList(wire::FindValue(payload, "removed"), delta.removedAnimals);
+}
+
+bool DecodeLockstepStart(std::string_view payload, LockstepStartMessage& start) {
+    // Only there for a peer joining a running session
+    std::string_view startTick = wire::FindValue(payload, "tick");
+    start.startTick = 0;
+    return wire::ParseHex(wire::FindValue(payload, "seed"), start.seed) &&
+           wire::ParseInt(wire::FindValue(payload, "tickRate"), start.tickRate) &&
+           wire::ParseInt(wire::FindValue(payload, "inputDelay"), start.inputDelay) &&
+           DecodeIdList(wire::FindValue(payload, "players"), start.playerIds) &&
+           (startTick.empty() || wire::ParseInt(startTick, start.startTick));
+}
+
+bool DecodePlayerInput(std::string_view payload, PlayerInput& input) {
+    input.action = wire::FindValue(payload, "action") == "true";
+    return wire::ParseInt(wire::FindValue(payload, "playerId"), input.playerId) &&
+           wire::ParseInt(wire::FindValue(payload, "tick"), input.tick) &&
+           wire::ParseInt(wire::FindValue(payload, "moveX"), input.moveX) &&
+           wire::ParseInt(wire::FindValue(payload, "moveY"), input.moveY) &&
+           wire::ParseInt(wire::FindValue(payload, "mode"), input.mode);
+}
+
+// "chunkX,chunkY,hexHash;..." as written by SendStateHash
+bool DecodeChunkHashes(std::string_view list, std::vector<ChunkHash>& chunks) {
+    chunks.clear();
+    while (!list.empty()) {
+        std::string_view token = wire::NextToken(list, ';');
+        if (token.empty()) continue;
+        ChunkHash chunk;
+        if (!wire::ParseInt(wire::NextToken(token, ','), chunk.chunkX) ||
+            !wire::ParseInt(wire::NextToken(token, ','), chunk.chunkY) ||
+            !wire::ParseHex(token, chunk.hash)) {
+            return false;
         }
+        chunks.push_back(chunk);
     }
+    return true;
 }
-#endif
 
-// JSON-like serialization helpers
-std::string SerializeAction(const ActionMessage& action) {
-    std::ostringstream oss;
-    oss << action.playerId << "," << action.targetX << "," << action.targetY << "," << action.actionType;
-    return oss.str();
+std::string EncodeRouteHeader(const RouteHeader& header) {
+    char buffer[ROUTE_HEADER_SIZE + 1];
+    snprintf(buffer, sizeof(buffer), "%02x%02x%08x", static_cast<unsigned>(header.type) & 0xFFu,
+             static_cast<unsigned>(header.senderId) & 0xFFu, static_cast<unsigned>(header.targetMask));
+    return std::string(buffer, ROUTE_HEADER_SIZE);
 }
 
-ActionMessage DeserializeAction(const std::string& data) {
-    ActionMessage action = {};
-    std::istringstream iss(data);
-    std::string token;
-    
-    if (std::getline(iss, token, ',')) action.playerId = std::stoi(token);
-    if (std::getline(iss, token, ',')) action.targetX = std::stoi(token);
-    if (std::getline(iss, token, ',')) action.targetY = std::stoi(token);
-    if (std::getline(iss, token, ',')) action.actionType = std::stoi(token);
-    
-    return action;
+bool DecodeRouteHeader(const char* message, RouteHeader& header) {
+    uint32_t fields[3] = {0, 0, 0};
+    const size_t widths[3] = {2, 2, 8};
+    size_t pos = 0;
+    for (int field = 0; field < 3; field++) {
+        for (size_t i = 0; i < widths[field]; i++, pos++) {
+            char c = message[pos];
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else return false; // Also stops at the terminator of a short message
+            fields[field] = (fields[field] << 4) | digit;
+        }
+    }
+    header.type = static_cast<MessageType>(fields[0]);
+    header.senderId = (fields[1] == 0xFFu) ? -1 : static_cast<int>(fields[1]);
+    header.targetMask = fields[2];
+    return true;
 }
 
-std::string SerializeGameState(const GameState& state) {
-    std::ostringstream oss;
-    oss << "{\"type\":\"FULL_GAME_STATE\",";
+void SerializePlayerJson(const Player& player, std::string& out) {
+    out += "{\"id\":";
+    wire::AppendInt(out, player.id);
+    out += ",\"x\":";
+    wire::AppendInt(out, player.x);
+    out += ",\"y\":";
+    wire::AppendInt(out, player.y);
+    out += ",\"mode\":";
+    wire::AppendInt(out, static_cast<int>(player.mode));
+    out += ",\"score\":";
+    wire::AppendInt(out, player.score);
+    out += ",\"alive\":";
+    wire::AppendBool(out, player.alive);
+    out += ",\"dirX\":";
+    wire::AppendInt(out, player.lastDirectionX);
+    out += ",\"dirY\":";
+    wire::AppendInt(out, player.lastDirectionY);
+    out += ",\"username\":\"";
+    out += player.username;
+    out += "\"}";
+}
+
+void SerializeAnimalJson(const Animal& animal, std::string& out) {
+    out += "{\"id\":";
+    wire::AppendInt(out, animal.id);
+    out += ",\"type\":";
+    wire::AppendInt(out, static_cast<int>(animal.type));
+    out += ",\"x\":";
+    wire::AppendInt(out, animal.x);
+    out += ",\"y\":";
+    wire::AppendInt(out, animal.y);
+    out += '}';
+}
+
+void SerializeCellUpdate(int x, int y, const Cell& cell, std::string& out) {
+    wire::AppendInt(out, x);
+    out += ',';
+    wire::AppendInt(out, y);
+    out += ',';
+    wire::AppendInt(out, static_cast<int>(cell.type));
+    out += ',';
+    wire::AppendInt(out, cell.playerId);
+    out += ',';
+    wire::AppendFloat(out, cell.growth);
+}
+
+void SerializeGameState(const GameState& state, std::string& out) {
+    TRACE_SCOPE("SerializeGameState");
+    out += "{\"type\":\"FULL_GAME_STATE\",";
 
     // Serialize grid
-    oss << "\"grid\":\"";
-    for(size_t y = 0; y < state.grid.size(); ++y) {
-        for(size_t x = 0; x < state.grid[y].size(); ++x) {
+    out += "\"grid\":\"";
+    for (size_t y = 0; y < state.grid.size(); ++y) {
+        if (y > 0) out += '|';
+        for (size_t x = 0; x < state.grid[y].size(); ++x) {
             const auto& cell = state.grid[y][x];
-            oss << static_cast<int>(cell.type) << "," << cell.playerId << "," << cell.growth;
-            if (x < state.grid[y].size() - 1) {
-                oss << ";";
-            }
-        }
-        if (y < state.grid.size() - 1) {
-            oss << "|";
+            if (x > 0) out += ';';
+            wire::AppendInt(out, static_cast<int>(cell.type));
+            out += ',';
+            wire::AppendInt(out, cell.playerId);
+            out += ',';
+            wire::AppendFloat(out, cell.growth);
         }
     }
-    oss << "\",";
+    out += "\",";
 
-    oss << "\"players\":[";
+    out += "\"players\":[";
     bool first = true;
     for (const auto& [id, player] : state.players) {
-        if (!first) {
-            oss << ",";
-        }
-        oss << "{\"id\":" << player.id
-            << ",\"x\":" << player.x
-            << ",\"y\":" << player.y
-            << ",\"mode\":" << static_cast<int>(player.mode)
-            << ",\"score\":" << player.score
-            << ",\"alive\":" << (player.alive ? "true" : "false")
-            << ",\"dirX\":" << player.lastDirectionX
-            << ",\"dirY\":" << player.lastDirectionY
-            << ",\"username\":\"" << player.username << "\""
-            << "}";
+        if (!first) out += ',';
+        SerializePlayerJson(player, out);
         first = false;
     }
-    oss << "],";
+    out += "],";
     
     // Serialize animals
-    oss << "\"animals\":[";
+    out += "\"animals\":[";
     first = true;
     for (const auto& animal : state.animals) {
-        if (!first) {
-            oss << ",";
-        }
-        oss << "{\"id\":" << animal.id
-            << ",\"type\":" << static_cast<int>(animal.type)
-            << ",\"x\":" << animal.x
-            << ",\"y\":" << animal.y
-            << "}";
+        if (!first) out += ',';
+        SerializeAnimalJson(animal, out);
         first = false;
     }
-    oss << "]}";
+    out += "]}";
     
     // Note: Bullets are NOT serialized in game state
     // They are created via PLAYER_ACTION messages which are already synced
-    
-    return oss.str();
 }
 
-NetworkManager::NetworkManager() {
+NetworkManager::NetworkManager()
+    : decodedPlayer(std::make_unique<Player>()), decodedDelta(std::make_unique<StateDelta>()) {
+    // Room for a busy update up front; the cell list grows to the packet budget by itself
+    decodedDelta->players.reserve(32);
+    decodedDelta->animals.reserve(64);
+    decodedDelta->removedAnimals.reserve(64);
+    
     // Initialize random room ID generator
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -466,9 +626,9 @@ NetworkManager::NetworkManager() {
     
     // Initialize PeerJS networking on web
     if (JS_InitPeerNetwork()) {
-        std::cout << "PeerJS networking initialized" << std::endl;
+        LOGI(NET, "PeerJS networking initialized");
     } else {
-        std::cerr << "Failed to initialize PeerJS networking" << std::endl;
+        LOGE(NET, "Failed to initialize PeerJS networking");
     }
     #endif
 }
@@ -476,26 +636,72 @@ NetworkManager::NetworkManager() {
 NetworkManager::~NetworkManager() {
     Disconnect();
 }
+void NetworkManager::EnableLoopback() {
+    loopback = true;
+    // A tick's worth of traffic, so a burst doesn't have to grow the buffers
+    loopbackOutbox.reserve(64 * 1024);
+    loopbackInbox.reserve(64 * 1024);
+}
+
+void NetworkManager::HostLocal(const std::string& roomName) {
+    localTransport = true;
+    roomId = roomName;
+    isHost = true;
+    isConnected = true;
+    localPlayerId = 0;
+    LOGI(NET, "Hosting " << roomId << " in process");
+}
+
+void NetworkManager::JoinLocal(NetworkManager& host, const std::string& peerId) {
+    localTransport = true;
+    roomId = host.roomId;
+    isHost = false;
+    isConnected = true;
+    localHost = &host;
+    localPeerId = peerId;
+    host.localPeers[peerId] = this;
+    // The host assigns our id as the connection opens, as PeerJS would
+    host.HandlePlayerJoined(peerId);
+}
+
 void NetworkManager::HandlePlayerJoined(const std::string& peerId) {
-    int newPlayerId = connectedPeers.size() + 1; // Simple ID assignment for now
+    // Lowest free id, so one that left can't be handed out twice
+    int newPlayerId = 1;
+    while (connectedPeers.find(newPlayerId) != connectedPeers.end()) {
+        newPlayerId++;
+    }
     connectedPeers[newPlayerId] = peerId;
     if (onPlayerJoin) {
         onPlayerJoin(newPlayerId);
     }
 }
+
+void NetworkManager::HandlePlayerLeft(const std::string& peerId) {
+    for (auto it = connectedPeers.begin(); it != connectedPeers.end(); ++it) {
+        if (it->second == peerId) {
+            int playerId = it->first;
+            connectedPeers.erase(it);
+            if (onPlayerLeave) {
+                onPlayerLeave(playerId);
+            }
+            return;
+        }
+    }
+}
 bool NetworkManager::CreateRoom(const std::string& roomName) {
 #ifdef PLATFORM_WEB
     // On web, PeerJS auto-generates room ID
     if (JS_CreateRoom()) {
         isHost = true;
         isConnected = true;
+        localPlayerId = 0;
         
         // Get the generated room ID from JS
         char buffer[256];
         if (JS_GetRoomId(buffer, sizeof(buffer))) {
             roomId = std::string(buffer);
-            std::cout << "Created room with ID: " << roomId << std::endl;
-            std::cout << "Share this ID with others to join!" << std::endl;
+            LOGI(NET, "Created room with ID: " << roomId);
+            LOGI(NET, "Share this ID with others to join!");
             return true;
         }
     }
@@ -509,11 +715,12 @@ bool NetworkManager::CreateRoom(const std::string& roomName) {
     
     isHost = true;
     isConnected = true;
+    localPlayerId = 0;
     
     shouldStop = false;
     networkThread = std::thread(&NetworkManager::NetworkLoop, this);
     
-    std::cout << "Created room: " << roomId << std::endl;
+    LOGI(NET, "Created room: " << roomId);
     return true;
     #endif
 }
@@ -525,7 +732,7 @@ bool NetworkManager::JoinRoom(const std::string& targetRoomId) {
         roomId = targetRoomId;
         isHost = false;
         isConnected = true;
-        std::cout << "Joining room: " << roomId << std::endl;
+        LOGI(NET, "Joining room: " << roomId);
         return true;
     }
     return false;
@@ -538,7 +745,7 @@ bool NetworkManager::JoinRoom(const std::string& targetRoomId) {
     shouldStop = false;
     networkThread = std::thread(&NetworkManager::NetworkLoop, this);
     
-    std::cout << "Joined room: " << roomId << std::endl;
+    LOGI(NET, "Joined room: " << roomId);
     return true;
     #endif
 }
@@ -548,139 +755,597 @@ void NetworkManager::Disconnect() {
         #ifdef PLATFORM_WEB
         JS_DisconnectPeer();
         #else
-        shouldStop = true;
+        {
+            std::lock_guard<std::mutex> lock(messageMutex);
+            shouldStop = true;
+        }
+        outgoingReady.notify_one();
         
         if (networkThread.joinable()) {
             networkThread.join();
         }
+        if (localHost) {
+            localHost->localPeers.erase(localPeerId);
+            localHost = nullptr;
+        }
+        localPeers.clear();
+        localTransport = false;
         #endif
         
         isConnected = false;
         isHost = false;
+        localPlayerId = -1;
         connectedPeers.clear();
         roomId.clear();
         
         // Clear message queues
         std::lock_guard<std::mutex> lock(messageMutex);
-        while (!incomingMessages.empty()) incomingMessages.pop();
-        while (!outgoingMessages.empty()) outgoingMessages.pop();
+        incomingMessages.clear();
+        outgoingMessages.clear();
     }
 }
 
 void NetworkManager::SendPlayerUpdate(const Player& update) {
     if (!isConnected) return;
     
-    #ifdef PLATFORM_WEB
-    // Build JSON message for JavaScript
-    std::ostringstream json;
-    json << "{\"type\":\"PLAYER_MOVE\",\"playerId\":" << update.id
-         << ",\"x\":" << update.x << ",\"y\":" << update.y
-         << ",\"mode\":" << static_cast<int>(update.mode) << ",\"score\":" << update.score
-         << ",\"alive\":" << (update.alive ? "true" : "false")
-         << ",\"dirX\":" << update.lastDirectionX
-         << ",\"dirY\":" << update.lastDirectionY 
-         << ",\"username\":\"" << update.username << "\"}"; 
-    
-    JS_BroadcastMessage(json.str().c_str());
-    #else
-    NetworkMessage msg;
-    msg.type = MessageType::PLAYER_MOVE;
-    msg.playerId = update.id;
-    std::ostringstream oss;
-    oss << update.id << "," << update.x << "," << update.y << ","
-        << static_cast<int>(update.mode) << "," << update.score << "," << (update.alive ? 1 : 0)
-        << "," << update.lastDirectionX << "," << update.lastDirectionY;
-    msg.data = oss.str();
-    msg.timestamp = std::chrono::duration<float>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    BeginPayload();
+    payload += "{\"type\":\"PLAYER_MOVE\",\"playerId\":";
+    wire::AppendInt(payload, update.id);
+    payload += ",\"x\":";
+    wire::AppendInt(payload, update.x);
+    payload += ",\"y\":";
+    wire::AppendInt(payload, update.y);
+    payload += ",\"mode\":";
+    wire::AppendInt(payload, static_cast<int>(update.mode));
+    payload += ",\"score\":";
+    wire::AppendInt(payload, update.score);
+    payload += ",\"alive\":";
+    wire::AppendBool(payload, update.alive);
+    payload += ",\"dirX\":";
+    wire::AppendInt(payload, update.lastDirectionX);
+    payload += ",\"dirY\":";
+    wire::AppendInt(payload, update.lastDirectionY);
+    payload += ",\"username\":\"";
+    payload += update.username;
+    payload += "\"}";
     
-    std::lock_guard<std::mutex> lock(messageMutex);
-    outgoingMessages.push(msg);
-    #endif
+    // Other clients get moves through the host's snapshots
+    SendPayload(MessageType::PLAYER_MOVE, isHost ? ROUTE_ALL : ROUTE_HOST);
 }
 
 void NetworkManager::SendPlayerAction(const ActionMessage& action) {
     if (!isConnected) return;
     
-    #ifdef PLATFORM_WEB
-    // Build JSON message for JavaScript
-    std::ostringstream json;
-    json << "{\"type\":\"PLAYER_ACTION\",\"playerId\":" << action.playerId
-         << ",\"targetX\":" << action.targetX << ",\"targetY\":" << action.targetY
-         << ",\"actionType\":" << action.actionType << "}";
-    
-    std::cout << "[C++] Sending player action from player " << action.playerId << " type " << action.actionType << std::endl;
-    JS_BroadcastMessage(json.str().c_str());
-    #else
-    NetworkMessage msg;
-    msg.type = MessageType::PLAYER_ACTION;
-    msg.playerId = action.playerId;
-    msg.data = SerializeAction(action);
-    msg.timestamp = std::chrono::duration<float>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    BeginPayload();
+    payload += "{\"type\":\"PLAYER_ACTION\",\"playerId\":";
+    wire::AppendInt(payload, action.playerId);
+    payload += ",\"targetX\":";
+    wire::AppendInt(payload, action.targetX);
+    payload += ",\"targetY\":";
+    wire::AppendInt(payload, action.targetY);
+    payload += ",\"actionType\":";
+    wire::AppendInt(payload, action.actionType);
+    payload += '}';
     
-    std::lock_guard<std::mutex> lock(messageMutex);
-    outgoingMessages.push(msg);
-    #endif
+    LOGD(NET, "Sending player action from player " << action.playerId << " type " << action.actionType);
+    SendPayload(MessageType::PLAYER_ACTION, ROUTE_ALL);
 }
 
 void NetworkManager::SendPlayerModeChange(int playerId, int newMode) {
     if (!isConnected) return;
     
-    #ifdef PLATFORM_WEB
-    // Build JSON message for JavaScript
-    std::ostringstream json;
-    json << "{\"type\":\"PLAYER_MODE_CHANGE\",\"playerId\":" << playerId
-         << ",\"mode\":" << newMode << "}";
-    
-    JS_BroadcastMessage(json.str().c_str());
-    #else
-    NetworkMessage msg;
-    msg.type = MessageType::PLAYER_MODE_CHANGE;
-    msg.playerId = playerId;
-    msg.data = std::to_string(newMode);
-    msg.timestamp = std::chrono::duration<float>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    BeginPayload();
+    payload += "{\"type\":\"PLAYER_MODE_CHANGE\",\"playerId\":";
+    wire::AppendInt(payload, playerId);
+    payload += ",\"mode\":";
+    wire::AppendInt(payload, newMode);
+    payload += '}';
     
-    std::lock_guard<std::mutex> lock(messageMutex);
-    outgoingMessages.push(msg);
-    #endif
+    SendPayload(MessageType::PLAYER_MODE_CHANGE, isHost ? ROUTE_ALL : ROUTE_HOST);
 }
 
 void NetworkManager::SendGameState(const GameState& state) {
     if (!isConnected) return;
 
+    BeginPayload();
+    SerializeGameState(state, payload);
+    SendPayload(MessageType::FULL_GAME_STATE, ROUTE_ALL);
+}
+
+void NetworkManager::SendGameStateUpdate(int playerId, const std::string& packet) {
+    if (!isConnected || !isHost) return;
+
+    SendRouted(MessageType::GAME_STATE_UPDATE, RouteTo(playerId), packet);
+}
+
+void NetworkManager::SendLockstepStart(const LockstepStartMessage& start, uint32_t targetMask) {
+    if (!isConnected || !isHost) return;
+
+    // Seed goes as a hex string, JSON numbers can't hold 64 bits
+    BeginPayload();
+    payload += "{\"type\":\"LOCKSTEP_START\",\"seed\":\"";
+    wire::AppendHex(payload, start.seed);
+    payload += "\",\"tickRate\":";
+    wire::AppendInt(payload, start.tickRate);
+    payload += ",\"inputDelay\":";
+    wire::AppendInt(payload, start.inputDelay);
+    payload += ",\"players\":\"";
+    size_t idsStart = payload.size();
+    for (size_t i = 0; i < start.playerIds.size(); ++i) {
+        if (i > 0) payload += ';';
+        wire::AppendInt(payload, start.playerIds[i]);
+    }
+    LOGI(NET, "Starting lockstep with players " << std::string_view(payload).substr(idsStart));
+    payload += '"';
+    if (start.startTick > 0) {
+        payload += ",\"tick\":";
+        wire::AppendInt(payload, start.startTick);
+    }
+    payload += '}';
+    
+    SendPayload(MessageType::LOCKSTEP_START, targetMask);
+}
+
+void NetworkManager::SendPlayerInput(const PlayerInput& input) {
+    if (!isConnected) return;
+
+    BeginPayload();
+    payload += "{\"type\":\"PLAYER_INPUT\",\"playerId\":";
+    wire::AppendInt(payload, input.playerId);
+    payload += ",\"tick\":";
+    wire::AppendInt(payload, input.tick);
+    payload += ",\"moveX\":";
+    wire::AppendInt(payload, input.moveX);
+    payload += ",\"moveY\":";
+    wire::AppendInt(payload, input.moveY);
+    payload += ",\"mode\":";
+    wire::AppendInt(payload, input.mode);
+    payload += ",\"action\":";
+    wire::AppendBool(payload, input.action);
+    payload += '}';
+    
+    SendPayload(MessageType::PLAYER_INPUT, ROUTE_ALL);
+}
+
+void NetworkManager::SendStateChecksum(int playerId, int tick, uint64_t hash) {
+    if (!isConnected) return;
+
+    BeginPayload();
+    payload += "{\"type\":\"STATE_CHECKSUM\",\"playerId\":";
+    wire::AppendInt(payload, playerId);
+    payload += ",\"tick\":";
+    wire::AppendInt(payload, tick);
+    payload += ",\"hash\":\"";
+    wire::AppendHex(payload, hash);
+    payload += "\"}";
+    
+    SendPayload(MessageType::STATE_CHECKSUM, ROUTE_ALL);
+}
+
+void NetworkManager::SendLockstepLeave(int playerId, int fromTick) {
+    if (!isConnected || !isHost) return;
+
+    BeginPayload();
+    payload += "{\"type\":\"LOCKSTEP_LEAVE\",\"playerId\":";
+    wire::AppendInt(payload, playerId);
+    payload += ",\"tick\":";
+    wire::AppendInt(payload, fromTick);
+    payload += '}';
+    
+    SendPayload(MessageType::LOCKSTEP_LEAVE, ROUTE_ALL);
+}
+
+void NetworkManager::SendLockstepJoin(int playerId, int fromTick) {
+    if (!isConnected || !isHost) return;
+
+    BeginPayload();
+    payload += "{\"type\":\"LOCKSTEP_JOIN\",\"playerId\":";
+    wire::AppendInt(payload, playerId);
+    payload += ",\"tick\":";
+    wire::AppendInt(payload, fromTick);
+    payload += '}';
+    
+    SendPayload(MessageType::LOCKSTEP_JOIN, ROUTE_ALL);
+}
+
+void NetworkManager::SendLockstepWorld(int playerId, int tick, const std::string& world) {
+    if (!isConnected || !isHost) return;
+
+    // The save format is binary; the transport carries text
+    BeginPayload();
+    payload += "{\"type\":\"LOCKSTEP_WORLD\",\"tick\":";
+    wire::AppendInt(payload, tick);
+    payload += ",\"world\":\"";
+    wire::AppendHexBytes(payload, world.data(), world.size());
+    payload += "\"}";
+    LOGI(NET, "Sending the tick " << tick << " world to player " << playerId << ", " << payload.size() << " bytes");
+    
+    SendPayload(MessageType::LOCKSTEP_WORLD, RouteTo(playerId));
+}
+
+void NetworkManager::SendStateHash(int playerId, uint64_t hash, const std::vector<ChunkHash>& chunks) {
+    if (!isConnected || (isHost && !loopback)) return;  // Loopback stands in for a client
+
+    BeginPayload();
+    payload += "{\"type\":\"STATE_HASH\",\"playerId\":";
+    wire::AppendInt(payload, playerId);
+    payload += ",\"hash\":\"";
+    wire::AppendHex(payload, hash);
+    payload += "\",\"chunks\":\"";
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (i > 0) payload += ';';
+        wire::AppendInt(payload, chunks[i].chunkX);
+        payload += ',';
+        wire::AppendInt(payload, chunks[i].chunkY);
+        payload += ',';
+        wire::AppendHex(payload, chunks[i].hash);
+    }
+    payload += "\"}";
+    
+    SendPayload(MessageType::STATE_HASH, ROUTE_HOST);
+}
+
+void NetworkManager::SendRouted(MessageType type, uint32_t targetMask, const std::string& body) {
+    RouteHeader header = {type, isHost ? 0 : localPlayerId, targetMask};
+    const std::string encodedHeader = EncodeRouteHeader(header);  // Short enough to stay off the heap
+#ifndef PLATFORM_WEB
+    if (loopback) {
+        loopbackOutbox += encodedHeader;
+        loopbackOutbox += body;
+        loopbackOutbox += '\0';
+        g_bytesSent.Add(encodedHeader.size() + body.size());
+        return;
+    }
+    if (!localTransport) {
+        std::string data = messageBuffers.Acquire(body.size());
+        data.assign(body);
+        QueueOutgoing(type, targetMask, std::move(data));
+        return;
+    }
+#endif
+    // assign() rather than operator=, which may give up the buffer we already have
+    wireMessage.assign(encodedHeader);
+    wireMessage += body;
+    
+    if (isHost) {
+        for (const auto& [playerId, peerId] : connectedPeers) {
+            if (targetMask & RouteTo(playerId)) {
+                SendToPeer(peerId, wireMessage.c_str());
+            }
+        }
+    } else {
+        // Clients are only connected to the host, which forwards as needed
+        SendToHost(wireMessage.c_str());
+    }
+}
+
+void NetworkManager::SendToPeer(const std::string& peerId, const char* message) {
 #ifdef PLATFORM_WEB
-    std::string stateStr = SerializeGameState(state);
-    JS_BroadcastMessage(stateStr.c_str());
+    JS_SendMessageTo(peerId.c_str(), message);
 #else
-    // Native implementation would go here
+    auto peer = localPeers.find(peerId);
+    if (peer == localPeers.end()) return;
+    peer->second->localInbox.emplace_back("host", message);
 #endif
+    g_bytesSent.Add(std::strlen(message));
 }
 
-void NetworkManager::AssignPlayerId(int playerId) {
-    if (!isConnected || !isHost) return;
-
+void NetworkManager::SendToHost(const char* message) {
 #ifdef PLATFORM_WEB
-    std::ostringstream json;
-    json << "{\"type\":\"ASSIGN_PLAYER_ID\",\"playerId\":" << playerId << "}";
+    JS_BroadcastMessage(message);
+#else
+    if (!localHost) return;
+    localHost->localInbox.emplace_back(localPeerId, message);
+#endif
+    g_bytesSent.Add(std::strlen(message));
+}
+
+void NetworkManager::BeginPayload() {
+#ifndef PLATFORM_WEB
+    // The last buffer went out with its message
+    if (payload.capacity() < BufferPool::CLASS_SIZES[0]) {
+        payload = messageBuffers.Acquire(BufferPool::CLASS_SIZES[0]);
+    }
+#endif
+    payload.clear();
+}
+
+void NetworkManager::SendPayload(MessageType type, uint32_t targetMask) {
+#ifndef PLATFORM_WEB
+    if (!loopback && !localTransport) {
+        QueueOutgoing(type, targetMask, std::move(payload));
+        return;
+    }
+#endif
+    SendRouted(type, targetMask, payload);
+}
+
+void NetworkManager::QueueOutgoing(MessageType type, uint32_t targetMask, std::string&& data) {
+    NetworkMessage msg;
+    msg.type = type;
+    msg.playerId = isHost ? 0 : localPlayerId;
+    msg.targetMask = targetMask;
+    msg.data = std::move(data);
+    msg.timestamp = std::chrono::duration<float>(std::chrono::steady_clock::now().time_since_epoch()).count();
     
-    // Find the peerId from the connectedPeers map
-    for (const auto& [pId, peerId] : connectedPeers) {
-        if (pId == playerId) {
-            JS_SendMessageTo(peerId.c_str(), json.str().c_str());
+    bool batchFull;
+    {
+        std::lock_guard<std::mutex> lock(messageMutex);
+        outgoingMessages.push_back(std::move(msg));
+        batchFull = outgoingMessages.size() == OUTGOING_BATCH;
+    }
+    if (batchFull) {
+        outgoingReady.notify_one();
+    }
+}
+
+bool NetworkManager::RouteMessage(const RouteHeader& header, const char* message, std::string_view fromPeerId) {
+    if (!isHost) {
+        return localPlayerId < 0 || (header.targetMask & RouteTo(localPlayerId));
+    }
+
+    // The connection tells us who really sent it; never echo back to them
+    int senderId = header.senderId;
+    for (const auto& [playerId, peerId] : connectedPeers) {
+        if (peerId == fromPeerId) {
+            senderId = playerId;
             break;
         }
     }
-#endif
+    
+    for (const auto& [playerId, peerId] : connectedPeers) {
+        if (playerId != senderId && (header.targetMask & RouteTo(playerId))) {
+            SendToPeer(peerId, message);
+        }
+    }
+    return (header.targetMask & ROUTE_HOST) != 0;
+}
+
+void NetworkManager::HandleMessage(const char* message, std::string_view fromPeerId,
+                                   std::chrono::steady_clock::time_point arrivedAt) {
+    TRACE_SCOPE("ParseNetworkMessage");
+    ScopedTimer latency(g_messageLatency, arrivedAt);
+    g_bytesReceived.Add(std::strlen(message));
+    RouteHeader header;
+    if (!DecodeRouteHeader(message, header)) {
+        LOG_LIMITED(WARNING, NET, 1, "Dropping message without routing header from " << fromPeerId);
+        return;
+    }
+    
+    // The host forwards raw messages to their targets; only parse what is meant for us
+    if (!loopback && !RouteMessage(header, message, fromPeerId)) {
+        return;
+    }
+    // Parse the payload in place, right after the header
+    DispatchPayload(header.type, header.senderId, std::string_view(message + ROUTE_HEADER_SIZE));
+}
+
+void NetworkManager::DispatchPayload(MessageType type, int senderId, std::string_view body) {
+    // High frequency messages are not logged
+    if (type != MessageType::FULL_GAME_STATE && type != MessageType::GAME_STATE_UPDATE &&
+        type != MessageType::PLAYER_INPUT && type != MessageType::STATE_HASH) {
+        LOGD(NET, "Network message received: " << static_cast<int>(type) << " from player " << senderId);
+    }
+    // Every transport ends up here, so this is the one place messages are counted
+    messagesReceived++;
+
+    bool parsed = true;
+    switch (type) {
+        case MessageType::PLAYER_MOVE:
+            parsed = DecodePlayerUpdate(body, *decodedPlayer);
+            if (parsed) OnPlayerUpdate(*decodedPlayer);
+            break;
+
+        case MessageType::PLAYER_ACTION: {
+            ActionMessage action = {};
+            parsed = DecodeAction(body, action);
+            if (parsed) {
+                LOGD(NET, "Player action: ID=" << action.playerId << " type=" << action.actionType);
+                OnPlayerAction(action);
+            }
+            break;
+        }
+
+        case MessageType::PLAYER_MODE_CHANGE: {
+            int playerId = -1;
+            int newMode = 0;
+            wire::ParseInt(wire::FindValue(body, "playerId"), playerId);
+            wire::ParseInt(wire::FindValue(body, "mode"), newMode);
+            LOGD(NET, "Player " << playerId << " changed mode to " << newMode);
+            break;
+        }
+
+        case MessageType::FULL_GAME_STATE:
+            // Decoded by the receiver, straight into its live state
+            parsed = OnFullGameState(body);
+            break;
+
+        case MessageType::GAME_STATE_UPDATE:
+            parsed = DecodeStateDelta(body, *decodedDelta);
+            if (parsed) OnStateDelta(*decodedDelta);
+            break;
+
+        case MessageType::LOCKSTEP_START:
+            parsed = DecodeLockstepStart(body, decodedStart);
+            if (parsed) OnLockstepStart(decodedStart);
+            break;
+
+        case MessageType::PLAYER_INPUT: {
+            PlayerInput input = {};
+            parsed = DecodePlayerInput(body, input);
+            if (parsed) OnPlayerInput(input);
+            break;
+        }
+
+        case MessageType::STATE_CHECKSUM: {
+            int playerId = 0, tick = 0;
+            uint64_t hash = 0;
+            parsed = wire::ParseInt(wire::FindValue(body, "playerId"), playerId) &&
+                     wire::ParseInt(wire::FindValue(body, "tick"), tick) &&
+                     wire::ParseHex(wire::FindValue(body, "hash"), hash);
+            if (parsed) OnStateChecksum(playerId, tick, hash);
+            break;
+        }
+
+        case MessageType::LOCKSTEP_LEAVE:
+            // Only the host decides who has left
+            if (!isHost) {
+                int playerId = 0, tick = 0;
+                parsed = wire::ParseInt(wire::FindValue(body, "playerId"), playerId) &&
+                         wire::ParseInt(wire::FindValue(body, "tick"), tick);
+                if (parsed && onLockstepLeave) onLockstepLeave(playerId, tick);
+            }
+            break;
+
+        case MessageType::LOCKSTEP_JOIN:
+            // Only the host decides who has joined
+            if (!isHost) {
+                int playerId = 0, tick = 0;
+                parsed = wire::ParseInt(wire::FindValue(body, "playerId"), playerId) &&
+                         wire::ParseInt(wire::FindValue(body, "tick"), tick);
+                if (parsed && onLockstepJoin) onLockstepJoin(playerId, tick);
+            }
+            break;
+
+        case MessageType::LOCKSTEP_WORLD:
+            if (!isHost) {
+                int tick = 0;
+                parsed = wire::ParseInt(wire::FindValue(body, "tick"), tick) &&
+                         wire::ParseHexBytes(wire::FindValue(body, "world"), decodedWorld);
+                if (parsed && onLockstepWorld) onLockstepWorld(tick, decodedWorld);
+            }
+            break;
+
+        case MessageType::STATE_HASH:
+            if (isHost) {
+                int playerId = 0;
+                uint64_t hash = 0;
+                parsed = wire::ParseInt(wire::FindValue(body, "playerId"), playerId) &&
+                         wire::ParseHex(wire::FindValue(body, "hash"), hash) &&
+                         DecodeChunkHashes(wire::FindValue(body, "chunks"), decodedChunks);
+                if (parsed) OnStateHash(playerId, hash, decodedChunks);
+            }
+            break;
+
+        case MessageType::ASSIGN_PLAYER_ID:
+            // Nobody assigns the host an id
+            if (!isHost) {
+                int assignedId = 0;
+                parsed = wire::ParseInt(wire::FindValue(body, "playerId"), assignedId);
+                if (parsed) {
+                    SetLocalPlayerId(assignedId);
+                    if (onPlayerIdAssigned) {
+                        onPlayerIdAssigned(assignedId);
+                    }
+                }
+            }
+            break;
+
+        default:
+            LOG_LIMITED(WARNING, NET, 1, "Unknown message type: " << static_cast<int>(type));
+            break;
+    }
+
+    if (!parsed) {
+        LOG_LIMITED(WARNING, NET, 1, "Error parsing network message " << static_cast<int>(type)
+                    << " from player " << senderId << ": " << body);
+    }
+}
+
+void NetworkManager::GetConnectedPlayerIds(std::vector<int>& ids) const {
+    ids.clear();
+    for (const auto& [playerId, peerId] : connectedPeers) {
+        ids.push_back(playerId);
+    }
+}
+
+void NetworkManager::AssignPlayerId(int playerId) {
+    if (!isConnected || !isHost) return;
+
+    BeginPayload();
+    payload += "{\"type\":\"ASSIGN_PLAYER_ID\",\"playerId\":";
+    wire::AppendInt(payload, playerId);
+    payload += '}';
+    
+    SendPayload(MessageType::ASSIGN_PLAYER_ID, RouteTo(playerId));
+}
+
+void NetworkManager::RunOrDefer(std::function<void()> event) {
+    if (!deferEvents) {
+        event();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(deferredMutex);
+    deferredEvents.push_back(std::move(event));
+}
+
+void NetworkManager::DeferMessage(const char* message, const char* fromPeerId,
+                                  std::chrono::steady_clock::time_point arrivedAt) {
+    DeferredMessage deferred;
+    size_t length = std::strlen(message);
+    deferred.message = messageBuffers.Acquire(length);
+    deferred.message.assign(message, length);
+    length = std::strlen(fromPeerId);
+    deferred.fromPeerId = messageBuffers.Acquire(length);
+    deferred.fromPeerId.assign(fromPeerId, length);
+    deferred.arrivedAt = arrivedAt;
+    
+    std::lock_guard<std::mutex> lock(deferredMutex);
+    deferredMessages.push_back(std::move(deferred));
 }
 
 void NetworkManager::ProcessMessages() {
-    std::lock_guard<std::mutex> lock(messageMutex);
+    TRACE_SCOPE("ProcessMessages");
+    if (deferEvents) {
+        {
+            std::lock_guard<std::mutex> lock(deferredMutex);
+            runningEvents.swap(deferredEvents);
+            runningMessages.swap(deferredMessages);
+        }
+        // Events first: a peer's join has to be known before its messages
+        for (auto& event : runningEvents) {
+            event();
+        }
+        runningEvents.clear();
+        for (auto& deferred : runningMessages) {
+            HandleMessage(deferred.message.c_str(), deferred.fromPeerId, deferred.arrivedAt);
+            messageBuffers.Release(std::move(deferred.message));
+            messageBuffers.Release(std::move(deferred.fromPeerId));
+        }
+        runningMessages.clear();
+    }
+
+    if (loopback) {
+        // Whatever the handlers send goes to the outbox, for the next call
+        loopbackInbox.swap(loopbackOutbox);
+        loopbackOutbox.clear();
+        auto now = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < loopbackInbox.size();) {
+            const char* message = loopbackInbox.c_str() + offset;
+            HandleMessage(message, "loopback", now);
+            offset += std::strlen(message) + 1;
+        }
+    }
     
-    while (!incomingMessages.empty()) {
-        NetworkMessage msg = incomingMessages.front();
-        incomingMessages.pop();
-        
+    if (localTransport) {
+        // Whatever the handlers forward goes to the other peers' inboxes
+        localProcessing.swap(localInbox);
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& [fromPeerId, message] : localProcessing) {
+            HandleMessage(message.c_str(), fromPeerId, now);
+        }
+        localProcessing.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(messageMutex);
+        processingMessages.swap(incomingMessages);
+    }
+    for (auto& msg : processingMessages) {
         ProcessIncomingMessage(msg);
+        messageBuffers.Release(std::move(msg.data));
     }
+    processingMessages.clear();
 }
 
 void NetworkManager::ProcessIncomingMessage(const NetworkMessage& msg) {
@@ -697,63 +1362,34 @@ void NetworkManager::ProcessIncomingMessage(const NetworkMessage& msg) {
             }
             break;
             
-        case MessageType::PLAYER_MOVE: {
-            Player update = {};
-            std::istringstream iss(msg.data);
-            std::string token;
-            
-            if (std::getline(iss, token, ',')) update.id = std::stoi(token);
-            if (std::getline(iss, token, ',')) update.x = std::stoi(token);
-            if (std::getline(iss, token, ',')) update.y = std::stoi(token);
-            if (std::getline(iss, token, ',')) update.mode = static_cast<PlayerMode>(std::stoi(token));
-            if (std::getline(iss, token, ',')) update.score = std::stoi(token);
-            if (std::getline(iss, token, ',')) update.alive = (std::stoi(token) == 1);
-            if (std::getline(iss, token, ',')) update.lastDirectionX = std::stoi(token);
-            if (std::getline(iss, token, ',')) update.lastDirectionY = std::stoi(token);
-
-            if (onPlayerUpdate) {
-                onPlayerUpdate(update);
-            }
-            break;
-        }
-        
-        case MessageType::PLAYER_ACTION: {
-            ActionMessage action = DeserializeAction(msg.data);
-            if (onPlayerAction) {
-                onPlayerAction(action);
-            }
-            break;
-        }
-        
-        case MessageType::PLAYER_MODE_CHANGE:
-            // Handle mode change
-            break;
-            
         default:
+            // Everything else carries the same payload as on the web
+            DispatchPayload(msg.type, msg.playerId, msg.data);
             break;
     }
 }
 
 void NetworkManager::NetworkLoop() {
     while (!shouldStop) {
-        // Process outgoing messages
+        // Process outgoing messages every frame, or sooner when a batch is
+        // waiting so a burst doesn't pile up buffers
         {
-            std::lock_guard<std::mutex> lock(messageMutex);
-            while (!outgoingMessages.empty()) {
-                NetworkMessage msg = outgoingMessages.front();
-                outgoingMessages.pop();
-                
-                // In a real implementation, this would send the message
-                // via WebRTC data channels to all connected peers
-                std::cout << "Sending message type " << (int)msg.type 
-                         << " from player " << msg.playerId << std::endl;
-            }
+            std::unique_lock<std::mutex> lock(messageMutex);
+            outgoingReady.wait_for(lock, std::chrono::milliseconds(16),
+                                   [this] { return shouldStop || outgoingMessages.size() >= OUTGOING_BATCH; });
+            sendingMessages.swap(outgoingMessages);
         }
+        for (auto& msg : sendingMessages) {
+            // In a real implementation, this would send the message
+            // via WebRTC data channels to all connected peers
+            LOGD(NET, "Sending message type " << (int)msg.type 
+                      << " from player " << msg.playerId << " to mask " << std::hex << msg.targetMask << std::dec);
+            messageBuffers.Release(std::move(msg.data));
+        }
+        sendingMessages.clear();
         
         // Simulate receiving messages (in real implementation, this would
         // be triggered by WebRTC data channel events)
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(16)); // ~60 FPS
     }
 }
 
@@ -789,11 +1425,11 @@ bool WebRTCConnection::Initialize() {
         //     if (onMessage) onMessage(message);
         // });
         
-        std::cout << "WebRTC connection initialized" << std::endl;
+        LOGI(NET, "WebRTC connection initialized");
         return true;
         
     } catch (const std::exception& e) {
-        std::cerr << "Failed to initialize WebRTC: " << e.what() << std::endl;
+        LOGE(NET, "Failed to initialize WebRTC: " << e.what());
         return false;
     }
 }
@@ -813,7 +1449,7 @@ bool WebRTCConnection::CreateOffer(std::string& offer) {
            "a=ice-pwd:simulatedpassword\r\na=setup:actpass\r\n"
            "a=mid:0\r\na=sctp-port:5000\r\n";
     
-    std::cout << "Created WebRTC offer" << std::endl;
+    LOGI(NET, "Created WebRTC offer");
     return true;
 }
 
@@ -834,7 +1470,7 @@ bool WebRTCConnection::CreateAnswer(const std::string& /*offer*/, std::string& a
             "a=ice-pwd:simulatedpassword\r\na=setup:active\r\n"
             "a=mid:0\r\na=sctp-port:5000\r\n";
     
-    std::cout << "Created WebRTC answer" << std::endl;
+    LOGI(NET, "Created WebRTC answer");
     return true;
 }
 
@@ -845,7 +1481,7 @@ bool WebRTCConnection::SetRemoteAnswer(const std::string& /*answer*/) {
     // auto answerSdp = RTCSessionDescription::FromString(answer);
     // peerConnection->SetRemoteDescription(answerSdp);
     
-    std::cout << "Set remote answer" << std::endl;
+    LOGI(NET, "Set remote answer");
     
     // Simulate connection establishment
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -861,7 +1497,7 @@ bool WebRTCConnection::SetRemoteOffer(const std::string& /*offer*/) {
     // auto offerSdp = RTCSessionDescription::FromString(offer);
     // peerConnection->SetRemoteDescription(offerSdp);
     
-    std::cout << "Set remote offer" << std::endl;
+    LOGI(NET, "Set remote offer");
     return true;
 }
 
@@ -871,7 +1507,7 @@ void WebRTCConnection::SendMessage(const std::string& message) {
     // In real implementation:
     // dataChannel->Send(message);
     
-    std::cout << "Sending WebRTC message: " << message.substr(0, 50) << "..." << std::endl;
+    LOGD(NET, "Sending WebRTC message: " << message.substr(0, 50) << "...");
 }
 
 bool WebRTCConnection::IsConnected() const {
@@ -1,15 +1,24 @@
 #pragma once
+#include "BufferPool.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
 #include <map>
+#include <memory>
+#include <atomic>
 #include <thread>
 #include <mutex>
-#include <queue>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
 
 // Forward declarations to avoid circular dependency
 struct Player;
+struct Animal;
+struct Cell;
 struct GameState;
+struct StateDelta;
 
 // Simple message types for game networking
 enum class MessageType {
@@ -23,12 +32,20 @@ enum class MessageType {
     ANIMAL_UPDATE,
     TREE_UPDATE,
     FULL_GAME_STATE,
-    GAME_STATE_CHUNK
+    GAME_STATE_CHUNK,
+    LOCKSTEP_START,
+    PLAYER_INPUT,
+    STATE_CHECKSUM,
+    STATE_HASH,
+    LOCKSTEP_LEAVE,
+    LOCKSTEP_JOIN,
+    LOCKSTEP_WORLD
 };
 
 struct NetworkMessage {
     MessageType type;
     int playerId;
+    uint32_t targetMask = 0;  // RouteTo() bits of the players it is for, on outgoing messages
     std::string data;
     float timestamp;
 };
@@ -39,19 +56,109 @@ struct ActionMessage {
     int actionType; // 0=plant, 1=shoot, 2=chop
 };
 
+// One player's input for one lockstep tick
+struct PlayerInput {
+    int playerId;
+    int tick;
+    int moveX, moveY;
+    int mode;       // New PlayerMode, or -1 to keep the current one
+    bool action;
+};
+
+// Every web message starts with a fixed-size routing header so the host can
+// forward it without looking at the payload: message type, sender player id
+// and a target mask (bit N = player N), as 2 + 2 + 8 hex digits.
+// Player ids must stay below 32 to be addressable.
+const size_t ROUTE_HEADER_SIZE = 12;
+const uint32_t ROUTE_ALL = 0xFFFFFFFFu;
+const uint32_t ROUTE_HOST = 1u; // The host is always player 0
+
+struct RouteHeader {
+    MessageType type;
+    int senderId;        // -1 before the sender has been assigned an id
+    uint32_t targetMask;
+};
+
+inline uint32_t RouteTo(int playerId) { return (playerId >= 0 && playerId < 32) ? (1u << playerId) : 0u; }
+
+// A client's hash of one interest chunk, see StateHash
+struct ChunkHash {
+    int chunkX, chunkY;
+    uint64_t hash;
+};
+
+// Sent by the host to switch every peer into lockstep mode, and to a peer
+// joining a running session
+struct LockstepStartMessage {
+    uint64_t seed;
+    int tickRate;
+    int inputDelay;
+    std::vector<int> playerIds;
+    int startTick = 0;  // For a joining peer: its join tick, where LOCKSTEP_WORLD picks up
+};
+
 class NetworkManager {
 private:
     bool isHost = false;
     bool isConnected = false;
     std::string roomId;
     std::map<int, std::string> connectedPeers;
+    int localPlayerId = -1;
+    
+    uint32_t messagesReceived = 0;
     
-    std::queue<NetworkMessage> incomingMessages;
-    std::queue<NetworkMessage> outgoingMessages;
+    // Native transport queues, swapped out whole by whichever side drains them
+    std::vector<NetworkMessage> incomingMessages;
+    std::vector<NetworkMessage> outgoingMessages;
+    std::vector<NetworkMessage> processingMessages;  // Simulation thread
+    std::vector<NetworkMessage> sendingMessages;     // Network thread
     std::mutex messageMutex;
+    std::condition_variable outgoingReady;
+    // Bodies of queued and deferred messages, returned once they are handled
+    BufferPool messageBuffers;
+
+    // JavaScript callbacks arrive on the browser main thread; with the
+    // simulation in a worker they are queued here and run by ProcessMessages
+    bool deferEvents = false;
+    std::vector<std::function<void()>> deferredEvents;
+    std::vector<std::function<void()>> runningEvents;
+    struct DeferredMessage {
+        std::string message;  // Pooled copies; JavaScript frees the originals
+        std::string fromPeerId;
+        std::chrono::steady_clock::time_point arrivedAt;
+    };
+    std::vector<DeferredMessage> deferredMessages;
+    std::vector<DeferredMessage> runningMessages;
+    std::mutex deferredMutex;
+    
+    // Reused for every message, so sending and decoding stop allocating once
+    // they have seen the largest message
+    std::string payload;      // JSON body being encoded (a pooled buffer on native, see BeginPayload)
+    std::string wireMessage;  // Routing header + payload
+    std::unique_ptr<Player> decodedPlayer;
+    std::unique_ptr<StateDelta> decodedDelta;
+    LockstepStartMessage decodedStart;
+    std::vector<ChunkHash> decodedChunks;
+    std::string decodedWorld;
+    
+    // Native only: messages are handed back to this peer on the next
+    // ProcessMessages instead of going out (EnableLoopback)
+    bool loopback = false;
+    std::string loopbackOutbox;  // Messages back to back, each NUL-terminated
+    std::string loopbackInbox;
+    
+    // In-process transport (HostLocal/JoinLocal): the other peers are
+    // managers driven from the same thread, and a message goes straight into
+    // the target's inbox, to be handled on its next ProcessMessages
+    bool localTransport = false;
+    NetworkManager* localHost = nullptr;                // Client: the host it joined
+    std::string localPeerId;                            // Client: the peer id the host knows it by
+    std::map<std::string, NetworkManager*> localPeers;  // Host: peer id -> client
+    std::vector<std::pair<std::string, std::string>> localInbox;       // Sender's peer id, message
+    std::vector<std::pair<std::string, std::string>> localProcessing;
     
     std::thread networkThread;
-    bool shouldStop = false;
+    std::atomic<bool> shouldStop{false};
     
     // Callbacks
 public:
@@ -61,16 +168,51 @@ private:
     std::function<void(int)> onPlayerLeave;
     std::function<void(const Player&)> onPlayerUpdate;
     std::function<void(const ActionMessage&)> onPlayerAction;
-    std::function<void(const GameState&)> onFullGameState;
+    std::function<bool(std::string_view)> onFullGameState;
+    std::function<void(const StateDelta&)> onStateDelta;
+    std::function<void(const LockstepStartMessage&)> onLockstepStart;
+    std::function<void(const PlayerInput&)> onPlayerInput;
+    std::function<void(int, int, uint64_t)> onStateChecksum;
+    std::function<void(int, int)> onLockstepLeave;
+    std::function<void(int, int)> onLockstepJoin;
+    std::function<void(int, std::string_view)> onLockstepWorld;
+    std::function<void(int, uint64_t, const std::vector<ChunkHash>&)> onStateHash;
     
     void NetworkLoop();
     void ProcessIncomingMessage(const NetworkMessage& msg);
+    void SendRouted(MessageType type, uint32_t targetMask, const std::string& payload);
+    // Encoders write into payload between these two; natively the buffer
+    // itself goes into the transport queue instead of a copy
+    void BeginPayload();
+    void SendPayload(MessageType type, uint32_t targetMask);
+    void QueueOutgoing(MessageType type, uint32_t targetMask, std::string&& data);
+    // Decodes a payload and calls whichever callback it is for
+    void DispatchPayload(MessageType type, int senderId, std::string_view payload);
+    // A whole routed message to one connection: the host to a client, or a
+    // client to its host
+    void SendToPeer(const std::string& peerId, const char* message);
+    void SendToHost(const char* message);
 
 public:
     void OnPlayerUpdate(const Player& update) { if (onPlayerUpdate) onPlayerUpdate(update); }
     void OnPlayerAction(const ActionMessage& action) { if (onPlayerAction) onPlayerAction(action); }
-    void OnFullGameState(const GameState& state) { if (onFullGameState) onFullGameState(state); }
+    bool OnFullGameState(std::string_view payload) { return !onFullGameState || onFullGameState(payload); }
+    void OnStateDelta(const StateDelta& delta) { if (onStateDelta) onStateDelta(delta); }
+    void OnLockstepStart(const LockstepStartMessage& start) { if (onLockstepStart) onLockstepStart(start); }
+    void OnPlayerInput(const PlayerInput& input) { if (onPlayerInput) onPlayerInput(input); }
+    void OnStateChecksum(int playerId, int tick, uint64_t hash) { if (onStateChecksum) onStateChecksum(playerId, tick, hash); }
+    void OnStateHash(int playerId, uint64_t hash, const std::vector<ChunkHash>& chunks) { if (onStateHash) onStateHash(playerId, hash, chunks); }
     void HandlePlayerJoined(const std::string& peerId);
+    void HandlePlayerLeft(const std::string& peerId);
+    void SetLocalPlayerId(int playerId) { localPlayerId = playerId; }
+    // Host: forward a received message to the other peers it targets. Returns
+    // whether this peer should handle the message itself.
+    bool RouteMessage(const RouteHeader& header, const char* message, std::string_view fromPeerId);
+    // A raw message from a peer: routes it and dispatches whatever is meant
+    // for us. arrivedAt is when JavaScript handed it over, so deferred
+    // messages count their time in the queue towards the latency
+    void HandleMessage(const char* message, std::string_view fromPeerId,
+                       std::chrono::steady_clock::time_point arrivedAt);
     
 public:
     NetworkManager();
@@ -86,10 +228,43 @@ public:
     void SendPlayerAction(const ActionMessage& action);
     void SendPlayerModeChange(int playerId, int newMode);
     void SendGameState(const GameState& state);
+    void SendGameStateUpdate(int playerId, const std::string& payload);
+    void SendLockstepStart(const LockstepStartMessage& start, uint32_t targetMask = ROUTE_ALL);
+    void SendPlayerInput(const PlayerInput& input);
+    void SendStateChecksum(int playerId, int tick, uint64_t hash);
+    // Host: playerId dropped out of the lockstep session; peers stop
+    // waiting for their input from fromTick on
+    void SendLockstepLeave(int playerId, int fromTick);
+    // Host: playerId joins the lockstep session; peers wait for their input
+    // from fromTick on
+    void SendLockstepJoin(int playerId, int fromTick);
+    // Host, to a peer joining the lockstep session: the world (EncodeWorld)
+    // at its join tick, before anything is simulated there
+    void SendLockstepWorld(int playerId, int tick, const std::string& world);
+    void SendStateHash(int playerId, uint64_t hash, const std::vector<ChunkHash>& chunks);
     void AssignPlayerId(int playerId);
 
     // Message processing
     void ProcessMessages();
+    // Runs the event now, or on the next ProcessMessages once deferral is on
+    void RunOrDefer(std::function<void()> event);
+    // Queues a copy of a raw message for HandleMessage on the next
+    // ProcessMessages, after the deferred events
+    void DeferMessage(const char* message, const char* fromPeerId, std::chrono::steady_clock::time_point arrivedAt);
+    // Hands JavaScript callbacks to whichever thread calls ProcessMessages.
+    // Must be set before the simulation thread starts.
+    void SetDeferEvents(bool defer) { deferEvents = defer; }
+    bool IsDeferringEvents() const { return deferEvents; }
+    // Native builds have no transport: deliver everything this peer sends
+    // back to itself as if it were the target, to exercise the encoders and
+    // decoders end to end
+    void EnableLoopback();
+    // Native only: hosts, or joins host, over the in-process transport, so
+    // several games can play each other in one process. Every manager
+    // involved must be driven from the same thread, and the host has to
+    // outlive its clients
+    void HostLocal(const std::string& roomName);
+    void JoinLocal(NetworkManager& host, const std::string& peerId);
     
     // Callbacks
     void SetPlayerIdAssignedCallback(std::function<void(int)> callback) { onPlayerIdAssigned = callback; }
@@ -97,15 +272,70 @@ public:
     void SetPlayerLeaveCallback(std::function<void(int)> callback) { onPlayerLeave = callback; }
     void SetPlayerUpdateCallback(std::function<void(const Player&)> callback) { onPlayerUpdate = callback; }
     void SetPlayerActionCallback(std::function<void(const ActionMessage&)> callback) { onPlayerAction = callback; }
-    void SetFullGameStateCallback(std::function<void(const GameState&)> callback) { onFullGameState = callback; }
+    // Gets the raw FULL_GAME_STATE payload to apply with ApplyGameState;
+    // returns false if it didn't parse
+    void SetFullGameStateCallback(std::function<bool(std::string_view)> callback) { onFullGameState = callback; }
+    void SetStateDeltaCallback(std::function<void(const StateDelta&)> callback) { onStateDelta = callback; }
+    void SetLockstepStartCallback(std::function<void(const LockstepStartMessage&)> callback) { onLockstepStart = callback; }
+    void SetPlayerInputCallback(std::function<void(const PlayerInput&)> callback) { onPlayerInput = callback; }
+    void SetStateChecksumCallback(std::function<void(int, int, uint64_t)> callback) { onStateChecksum = callback; }
+    void SetLockstepLeaveCallback(std::function<void(int, int)> callback) { onLockstepLeave = callback; }
+    void SetLockstepJoinCallback(std::function<void(int, int)> callback) { onLockstepJoin = callback; }
+    // Gets the decoded world bytes for DecodeWorld, and the tick they are for
+    void SetLockstepWorldCallback(std::function<void(int, std::string_view)> callback) { onLockstepWorld = callback; }
+    void SetStateHashCallback(std::function<void(int, uint64_t, const std::vector<ChunkHash>&)> callback) { onStateHash = callback; }
     
     // Status
     bool IsConnected() const { return isConnected; }
     bool IsHost() const { return isHost; }
     std::string GetRoomId() const { return roomId; }
     int GetPlayerCount() const { return connectedPeers.size() + (isConnected ? 1 : 0); }
+    int GetPeerCount() const { return connectedPeers.size(); }
+    void GetConnectedPlayerIds(std::vector<int>& ids) const;
+    // Running total of payloads decoded, read by the thread that calls ProcessMessages
+    uint32_t GetMessagesReceived() const { return messagesReceived; }
+};
+
+std::string EncodeRouteHeader(const RouteHeader& header);
+bool DecodeRouteHeader(const char* message, RouteHeader& header);
+
+// Serialization helpers shared by full game state and partial updates; they
+// append to out
+void SerializePlayerJson(const Player& player, std::string& out);
+void SerializeAnimalJson(const Animal& animal, std::string& out);
+void SerializeCellUpdate(int x, int y, const Cell& cell, std::string& out);
+void SerializeGameState(const GameState& state, std::string& out);
+
+// Decoders for the payloads written above and by the Send functions. They
+// read views into the message and refill the output in place, so reusing
+// the output keeps its capacity. False if a required field is missing or
+// malformed
+bool DecodePlayerUpdate(std::string_view payload, Player& player);
+bool DecodeAction(std::string_view payload, ActionMessage& action);
+bool DecodeStateDelta(std::string_view payload, StateDelta& delta);
+bool DecodeLockstepStart(std::string_view payload, LockstepStartMessage& start);
+bool DecodePlayerInput(std::string_view payload, PlayerInput& input);
+bool DecodeChunkHashes(std::string_view list, std::vector<ChunkHash>& chunks);
+
+// What ApplyGameState wrote, so the receiver can bring hashes and dirty
+// rows up to date without rescanning the world. Reused between calls
+struct GameStateChanges {
+    std::vector<std::pair<int, int>> cells;  // x, y
+    std::vector<int> players;                // Added or changed
+    std::vector<int> removedPlayers;
+    std::vector<int> listedPlayers;          // Every player in the message
+    std::vector<int> animals;                // Added or changed
+    std::vector<int> removedAnimals;
 };
 
+// Applies a FULL_GAME_STATE payload directly to a live state: only fields
+// that differ are written, the local player is left alone once it exists,
+// and bullets (which follow from PLAYER_ACTION) aren't touched. False if the
+// grid isn't width x height, in which case nothing is written, or if the
+// payload is malformed further in; changes then lists what was written
+// before that point
+bool ApplyGameState(std::string_view payload, GameState& state, int localPlayerId, int width, int height,
+                    GameStateChanges& changes);
 // WebRTC wrapper class - simplified interface
 class WebRTCConnection {
 private:
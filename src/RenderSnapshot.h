@@ -0,0 +1,84 @@
+#pragma once
+
+#include "GameState.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Copies of the simulation state taken after each step, so drawing never
+// reads the live GameState (which may be advancing on the simulation thread).
+// Moving things carry their pose from the start of the last tick as well, for
+// the renderer to interpolate between.
+
+struct RenderPlayer {
+    int id;
+    int x, y;
+    int prevX, prevY;
+    float rotation, prevRotation;
+    PlayerMode mode;
+    Color color;
+    bool alive;
+    int lastDirectionX, lastDirectionY;
+    int score;
+};
+
+struct RenderAnimal {
+    int id;
+    AnimalType type;
+    int x, y;
+    int prevX, prevY;
+};
+
+struct RenderBullet {
+    int x, y;
+    int dirX, dirY;
+    float startTime;
+};
+
+struct RenderSnapshot {
+    double publishedAt = 0.0;   // Steady clock seconds, to advance alpha between snapshots
+    float gameTime = 0.0f;
+    float tickDuration = 1.0f / 60.0f;
+    float alpha = 1.0f;         // Interpolation alpha when published
+
+    // Bumped whenever anything drawn differs from the previous snapshot, so
+    // an unchanged frame need not be redrawn. While animating (something is
+    // still moving between its previous and current pose, or bullets are in
+    // flight) every frame differs even within one snapshot.
+    uint64_t contentVersion = 0;
+    bool animating = false;
+    uint32_t networkMessages = 0;  // Running total of messages received
+
+    // Row-major grid; rows are only recopied when their version changed
+    uint64_t gridVersion = 0;
+    std::vector<uint64_t> rowVersions;  // gridVersion at each row's last change
+    std::vector<Cell> cells;
+
+    std::vector<RenderPlayer> players;
+    std::vector<RenderAnimal> animals;
+    std::vector<RenderBullet> bullets;
+
+    // HUD
+    int localPlayerId = 0;
+    bool multiplayer = false;
+    bool host = false;
+    int playerCount = 0;
+    std::string room;
+    bool lockstep = false;
+    int lockstepTick = 0;
+    bool desynced = false;
+    int desyncTick = -1;
+    int desyncPlayerId = -1;
+
+    // Running totals; the renderer plays a sound for every increase, so
+    // snapshots it never saw don't lose any
+    uint32_t shootSounds = 0;
+    uint32_t axeSounds = 0;
+
+    const RenderPlayer* FindPlayer(int id) const {
+        for (const auto& player : players) {
+            if (player.id == id) return &player;
+        }
+        return nullptr;
+    }
+};
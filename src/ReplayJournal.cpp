@@ -0,0 +1,345 @@
+#include "ReplayJournal.h"
+#include "Log.h"
+#include "Trace.h"
+#include "raylib.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const uint32_t JOURNAL_MAGIC = 0x4A524252;  // "RBRJ" in a little-endian file
+const uint32_t JOURNAL_VERSION = 1;
+const size_t FILE_HEADER_SIZE = 8;    // Magic, version
+const size_t RECORD_HEADER_SIZE = 5;  // Type, body length
+const size_t MAX_NAME_LENGTH = 255;
+
+template <typename T>
+void Put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads fixed-size values off the front of a record body
+class BodyReader {
+private:
+    std::string_view body;
+    bool ok = true;
+
+public:
+    explicit BodyReader(std::string_view body) : body(body) {}
+
+    template <typename T>
+    T Get() {
+        T value = {};
+        if (body.size() < sizeof(value)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, body.data(), sizeof(value));
+        body.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    std::string_view Rest() {
+        std::string_view rest = body;
+        body = {};
+        return rest;
+    }
+
+    std::string_view Take(size_t size) {
+        if (body.size() < size) {
+            ok = false;
+            return {};
+        }
+        std::string_view taken = body.substr(0, size);
+        body.remove_prefix(size);
+        return taken;
+    }
+
+    bool Ok() const { return ok; }
+};
+
+bool IsIdle(const PlayerInput& input) {
+    return input.moveX == 0 && input.moveY == 0 && input.mode < 0 && !input.action;
+}
+
+}  // namespace
+
+bool JournalWriter::Open(const std::string& path) {
+    Close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        LOGW(SAVE, "Could not open journal " << path);
+        return false;
+    }
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    record.clear();
+    Put(record, JOURNAL_MAGIC);
+    Put(record, JOURNAL_VERSION);
+    std::fwrite(record.data(), 1, record.size(), file);
+    bytesWritten = record.size();
+    keyframes = 0;
+    LOGI(SAVE, "Recording session journal to " << path);
+    return true;
+}
+
+void JournalWriter::Close() {
+    if (!file) return;
+    std::fclose(file);
+    file = nullptr;
+    LOGI(SAVE, "Journal closed: " << bytesWritten << " bytes, " << keyframes << " keyframes");
+}
+
+void JournalWriter::Append(JournalRecord type) {
+    uint8_t typeByte = static_cast<uint8_t>(type);
+    uint32_t length = static_cast<uint32_t>(record.size());
+    std::fwrite(&typeByte, 1, 1, file);
+    std::fwrite(&length, sizeof(length), 1, file);
+    std::fwrite(record.data(), 1, record.size(), file);
+    bytesWritten += RECORD_HEADER_SIZE + record.size();
+}
+
+void JournalWriter::WriteKeyframe(int tick, int localPlayerId, uint64_t stateHash, const GameState& state,
+                                  const WorldMeta& meta) {
+    if (!file) return;
+    TRACE_SCOPE("JournalKeyframe");
+    if (!EncodeWorld(state, meta, world)) return;
+    int compressedSize = 0;
+    unsigned char* compressed = CompressData(reinterpret_cast<const unsigned char*>(world.data()),
+                                             static_cast<int>(world.size()), &compressedSize);
+    if (!compressed) return;
+
+    record.clear();
+    Put(record, static_cast<int32_t>(tick));
+    Put(record, static_cast<int32_t>(localPlayerId));
+    Put(record, stateHash);
+    Put(record, static_cast<uint32_t>(world.size()));
+    record.append(reinterpret_cast<const char*>(compressed), compressedSize);
+    MemFree(compressed);
+    Append(JournalRecord::KEYFRAME);
+    // Whatever is in the journal up to here survives a crash
+    std::fflush(file);
+    keyframes++;
+}
+
+void JournalWriter::WriteTick(float gameTime, float dt, const PlayerInput* inputs, size_t count) {
+    if (!file) return;
+    record.clear();
+    Put(record, gameTime);
+    Put(record, dt);
+    for (size_t i = 0; i < count; i++) {
+        const PlayerInput& input = inputs[i];
+        if (IsIdle(input)) continue;
+        Put(record, static_cast<int32_t>(input.playerId));
+        Put(record, static_cast<int8_t>(input.moveX));
+        Put(record, static_cast<int8_t>(input.moveY));
+        Put(record, static_cast<int8_t>(input.mode));
+        Put(record, static_cast<uint8_t>(input.action ? 1 : 0));
+    }
+    Append(JournalRecord::TICK);
+}
+
+void JournalWriter::WriteJoin(int playerId) {
+    if (!file) return;
+    record.clear();
+    Put(record, static_cast<int32_t>(playerId));
+    Append(JournalRecord::JOIN);
+}
+
+void JournalWriter::WriteLeave(int playerId) {
+    if (!file) return;
+    record.clear();
+    Put(record, static_cast<int32_t>(playerId));
+    Append(JournalRecord::LEAVE);
+}
+
+void JournalWriter::WritePlayerUpdate(const Player& player) {
+    if (!file) return;
+    record.clear();
+    Put(record, static_cast<int32_t>(player.id));
+    Put(record, static_cast<int32_t>(player.x));
+    Put(record, static_cast<int32_t>(player.y));
+    Put(record, static_cast<int32_t>(player.mode));
+    Put(record, static_cast<int32_t>(player.score));
+    Put(record, static_cast<uint8_t>(player.alive ? 1 : 0));
+    Put(record, static_cast<int8_t>(player.lastDirectionX));
+    Put(record, static_cast<int8_t>(player.lastDirectionY));
+    size_t nameLength = std::min(player.username.size(), MAX_NAME_LENGTH);
+    Put(record, static_cast<uint8_t>(nameLength));
+    record.append(player.username, 0, nameLength);
+    Append(JournalRecord::PLAYER_UPDATE);
+}
+
+void JournalWriter::WriteAction(const ActionMessage& action) {
+    if (!file) return;
+    record.clear();
+    Put(record, static_cast<int32_t>(action.playerId));
+    Put(record, static_cast<int32_t>(action.targetX));
+    Put(record, static_cast<int32_t>(action.targetY));
+    Put(record, static_cast<int32_t>(action.actionType));
+    Append(JournalRecord::ACTION);
+}
+
+bool JournalReader::Open(const std::string& path) {
+    TRACE_SCOPE("JournalOpen");
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        LOGE(SAVE, "Could not open journal " << path);
+        return false;
+    }
+    data.clear();
+    char chunk[1 << 16];
+    size_t count;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.append(chunk, count);
+    }
+    std::fclose(file);
+
+    uint32_t magic = 0, version = 0;
+    if (data.size() >= FILE_HEADER_SIZE) {
+        std::memcpy(&magic, data.data(), sizeof(magic));
+        std::memcpy(&version, data.data() + sizeof(magic), sizeof(version));
+    }
+    if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION) {
+        LOGE(SAVE, path << " is not a journal this version can read");
+        return false;
+    }
+
+    // Index the keyframes and count the ticks up to the first damaged record
+    keyframes.clear();
+    tickCount = 0;
+    size_t offset = FILE_HEADER_SIZE;
+    JournalRecord type;
+    std::string_view body;
+    while (ReadRecord(offset, type, body)) {
+        if (type == JournalRecord::KEYFRAME) {
+            keyframes.push_back({offset, tickCount});
+        } else if (type == JournalRecord::TICK) {
+            tickCount++;
+        }
+        offset += RECORD_HEADER_SIZE + body.size();
+    }
+    position = FILE_HEADER_SIZE;
+    tick = 0;
+    return true;
+}
+
+bool JournalReader::ReadRecord(size_t offset, JournalRecord& type, std::string_view& body) const {
+    if (offset + RECORD_HEADER_SIZE > data.size()) return false;
+    uint8_t typeByte = static_cast<uint8_t>(data[offset]);
+    uint32_t length = 0;
+    std::memcpy(&length, data.data() + offset + 1, sizeof(length));
+    if (typeByte > static_cast<uint8_t>(JournalRecord::ACTION) ||
+        length > data.size() - offset - RECORD_HEADER_SIZE) {
+        return false;
+    }
+    type = static_cast<JournalRecord>(typeByte);
+    body = std::string_view(data).substr(offset + RECORD_HEADER_SIZE, length);
+    return true;
+}
+
+bool JournalReader::Next(JournalEntry& entry) {
+    JournalRecord type;
+    std::string_view body;
+    if (!ReadRecord(position, type, body)) return false;
+    position += RECORD_HEADER_SIZE + body.size();
+
+    BodyReader reader(body);
+    entry.type = type;
+    entry.tick = tick;
+    switch (type) {
+        case JournalRecord::KEYFRAME:
+            entry.tick = reader.Get<int32_t>();
+            entry.localPlayerId = reader.Get<int32_t>();
+            entry.stateHash = reader.Get<uint64_t>();
+            break;
+
+        case JournalRecord::TICK: {
+            entry.gameTime = reader.Get<float>();
+            entry.dt = reader.Get<float>();
+            entry.inputs.clear();
+            std::string_view inputs = reader.Rest();
+            const size_t INPUT_SIZE = 8;
+            while (inputs.size() >= INPUT_SIZE) {
+                BodyReader inputReader(inputs.substr(0, INPUT_SIZE));
+                inputs.remove_prefix(INPUT_SIZE);
+                PlayerInput input = {};
+                input.playerId = inputReader.Get<int32_t>();
+                input.tick = tick;
+                input.moveX = inputReader.Get<int8_t>();
+                input.moveY = inputReader.Get<int8_t>();
+                input.mode = inputReader.Get<int8_t>();
+                input.action = inputReader.Get<uint8_t>() != 0;
+                entry.inputs.push_back(input);
+            }
+            tick++;
+            break;
+        }
+
+        case JournalRecord::JOIN:
+        case JournalRecord::LEAVE:
+            entry.playerId = reader.Get<int32_t>();
+            break;
+
+        case JournalRecord::PLAYER_UPDATE: {
+            Player& player = entry.player;
+            player.id = reader.Get<int32_t>();
+            player.x = reader.Get<int32_t>();
+            player.y = reader.Get<int32_t>();
+            player.mode = static_cast<PlayerMode>(reader.Get<int32_t>());
+            player.score = reader.Get<int32_t>();
+            player.alive = reader.Get<uint8_t>() != 0;
+            player.lastDirectionX = reader.Get<int8_t>();
+            player.lastDirectionY = reader.Get<int8_t>();
+            size_t nameLength = reader.Get<uint8_t>();
+            player.username.assign(reader.Take(nameLength));
+            break;
+        }
+
+        case JournalRecord::ACTION:
+            entry.action.playerId = reader.Get<int32_t>();
+            entry.action.targetX = reader.Get<int32_t>();
+            entry.action.targetY = reader.Get<int32_t>();
+            entry.action.actionType = reader.Get<int32_t>();
+            break;
+    }
+    if (!reader.Ok()) {
+        LOGW(SAVE, "Journal record " << static_cast<int>(type) << " at byte " << position << " is damaged");
+        return false;
+    }
+    return true;
+}
+
+bool JournalReader::Seek(int targetTick, GameState& state, WorldMeta& meta, JournalEntry& keyframe) {
+    TRACE_SCOPE("JournalSeek");
+    for (auto it = keyframes.rbegin(); it != keyframes.rend(); ++it) {
+        if (it->tick > targetTick) continue;
+
+        JournalRecord type;
+        std::string_view body;
+        if (!ReadRecord(it->offset, type, body)) return false;
+        BodyReader reader(body);
+        keyframe.type = JournalRecord::KEYFRAME;
+        keyframe.tick = reader.Get<int32_t>();
+        keyframe.localPlayerId = reader.Get<int32_t>();
+        keyframe.stateHash = reader.Get<uint64_t>();
+        uint32_t worldSize = reader.Get<uint32_t>();
+        std::string_view compressed = reader.Rest();
+        if (!reader.Ok()) return false;
+
+        int decompressedSize = 0;
+        unsigned char* world = DecompressData(reinterpret_cast<const unsigned char*>(compressed.data()),
+                                              static_cast<int>(compressed.size()), &decompressedSize);
+        bool ok = world && static_cast<uint32_t>(decompressedSize) == worldSize &&
+                  DecodeWorld(reinterpret_cast<const char*>(world), worldSize, state, meta);
+        if (world) MemFree(world);
+        if (!ok) {
+            LOGE(SAVE, "Keyframe at tick " << it->tick << " is damaged");
+            return false;
+        }
+
+        position = it->offset + RECORD_HEADER_SIZE + body.size();
+        tick = it->tick;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "GameState.h"
+#include "WorldSave.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-only binary journal of a session, for replaying it headlessly
+// (--replay) to look into a bug or to measure the simulation on a real game.
+//
+// The journal is a short file header followed by records, each a type byte
+// and a 32-bit length. At regular intervals a KEYFRAME holds the whole world
+// in the WorldSave format, compressed with raylib's CompressData. In
+// between, the records are exactly what changed the world, in the order it
+// happened: one TICK per simulation step with the inputs applied in it, and
+// the network events (joins, leaves, remote player updates and actions)
+// applied between steps. Replaying starts from a keyframe and applies the
+// records after it; seeking starts from the last keyframe before the target.
+//
+// A crash leaves at most a truncated last record, which a reader treats as
+// the end of the journal.
+enum class JournalRecord : uint8_t {
+    KEYFRAME,
+    TICK,
+    JOIN,
+    LEAVE,
+    PLAYER_UPDATE,
+    ACTION
+};
+
+class JournalWriter {
+private:
+    FILE* file = nullptr;
+    std::string record;  // Body of the record being written, reused
+    std::string world;   // Uncompressed keyframe, reused
+    uint64_t bytesWritten = 0;
+    int keyframes = 0;
+
+    void Append(JournalRecord type);
+
+public:
+    ~JournalWriter() { Close(); }
+
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return file != nullptr; }
+
+    // tick counts the TICK records written so far; the hash lets a replay
+    // check it arrived at the same world. Flushes the file
+    void WriteKeyframe(int tick, int localPlayerId, uint64_t stateHash, const GameState& state, const WorldMeta& meta);
+    // gameTime is the time the step runs at. Inputs that do nothing are left out
+    void WriteTick(float gameTime, float dt, const PlayerInput* inputs, size_t count);
+    void WriteJoin(int playerId);
+    void WriteLeave(int playerId);
+    void WritePlayerUpdate(const Player& player);
+    void WriteAction(const ActionMessage& action);
+
+    uint64_t GetBytesWritten() const { return bytesWritten; }
+    int GetKeyframeCount() const { return keyframes; }
+};
+
+// One record as read back; only the fields of its type are set
+struct JournalEntry {
+    JournalRecord type = JournalRecord::TICK;
+    int tick = 0;  // TICK records before this one, since the start of the journal
+
+    // KEYFRAME
+    int localPlayerId = 0;
+    uint64_t stateHash = 0;
+    // TICK
+    float gameTime = 0.0f;
+    float dt = 0.0f;
+    std::vector<PlayerInput> inputs;
+    // JOIN, LEAVE
+    int playerId = -1;
+    // PLAYER_UPDATE
+    Player player = {};
+    // ACTION
+    ActionMessage action = {};
+};
+
+class JournalReader {
+private:
+    struct Keyframe {
+        size_t offset;  // Of the record
+        int tick;
+    };
+
+    std::string data;
+    size_t position = 0;
+    int tick = 0;
+    int tickCount = 0;
+    std::vector<Keyframe> keyframes;
+
+    // The record at offset, or false past the last complete one
+    bool ReadRecord(size_t offset, JournalRecord& type, std::string_view& body) const;
+
+public:
+    // Reads the file and indexes its keyframes
+    bool Open(const std::string& path);
+
+    // The next record in file order; keyframes come back without their
+    // world (see Seek). False at the end
+    bool Next(JournalEntry& entry);
+    // Loads the last keyframe at or before targetTick into state and
+    // continues reading after it. False if there is no such keyframe
+    bool Seek(int targetTick, GameState& state, WorldMeta& meta, JournalEntry& keyframe);
+
+    int GetTickCount() const { return tickCount; }
+    size_t GetKeyframeCount() const { return keyframes.size(); }
+};
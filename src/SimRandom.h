@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Small deterministic random generator (PCG32). Unlike std::mt19937 combined
+// with std:: distributions, the sequence for a given seed and stream is fully
+// specified here, so every peer in a lockstep session draws the same numbers.
+class SimRandom {
+private:
+    uint64_t state = 0;
+    uint64_t increment = 1;
+
+public:
+    using result_type = uint32_t;
+
+    SimRandom(uint64_t seed = 0, uint64_t stream = 0) { Seed(seed, stream); }
+
+    void Seed(uint64_t seed, uint64_t stream) {
+        state = 0;
+        increment = (stream << 1u) | 1u;
+        (*this)();
+        state += seed;
+        (*this)();
+    }
+
+    // Raw generator state, so a saved world continues the same sequence
+    uint64_t GetState() const { return state; }
+    uint64_t GetIncrement() const { return increment; }
+    void Restore(uint64_t savedState, uint64_t savedIncrement) {
+        state = savedState;
+        increment = savedIncrement | 1u;
+    }
+
+    uint32_t operator()() {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ULL + increment;
+        uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+        uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31u));
+    }
+
+    static constexpr uint32_t min() { return 0; }
+    static constexpr uint32_t max() { return 0xFFFFFFFFu; }
+
+    // Uniform integer in [0, bound) without modulo bias
+    uint32_t NextInt(uint32_t bound) {
+        if (bound == 0) return 0;
+        uint32_t threshold = (~bound + 1u) % bound;
+        for (;;) {
+            uint32_t value = (*this)();
+            if (value >= threshold) return value % bound;
+        }
+    }
+
+    // Deterministic Fisher-Yates shuffle (std::shuffle is implementation defined)
+    template <typename T, size_t N>
+    void Shuffle(T (&items)[N]) {
+        for (size_t i = N - 1; i > 0; --i) {
+            size_t j = NextInt(static_cast<uint32_t>(i + 1));
+            T tmp = items[i];
+            items[i] = items[j];
+            items[j] = tmp;
+        }
+    }
+};
+
+// One generator per simulation subsystem, so extra draws in one system
+// (e.g. a new animal behaviour) don't shift the sequence seen by the others
+struct SimRandomStreams {
+    uint64_t seed = 0;
+    SimRandom world;   // Initial shrubbery
+    SimRandom players; // Spawn corners
+    SimRandom animals; // Spawning and movement
+
+    explicit SimRandomStreams(uint64_t seed = 0) { Seed(seed); }
+
+    void Seed(uint64_t newSeed) {
+        seed = newSeed;
+        world.Seed(newSeed, 1);
+        players.Seed(newSeed, 2);
+        animals.Seed(newSeed, 3);
+    }
+};
@@ -0,0 +1,456 @@
+#include "SnapshotScheduler.h"
+#include "Log.h"
+#include "WireFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+
+// Ids the per-entity maps have room for before they have to grow; players are
+// limited to 32 by the routing mask, animals by the simulation
+const size_t EXPECTED_ENTITIES = 64;
+
+SnapshotScheduler::SnapshotScheduler(int gridWidth, int gridHeight, const SnapshotConfig& config,
+                                     const InterestConfig& interestConfig)
+    : gridWidth(gridWidth), gridHeight(gridHeight), config(config),
+      interest(gridWidth, gridHeight, interestConfig) {
+    cellVersion.assign(gridWidth * gridHeight, 0);
+    cellChangedAt.assign(gridWidth * gridHeight, -1000.0f);
+    candidates.reserve(gridWidth * gridHeight);
+    enteredChunks.reserve(interest.GetChunksX() * interest.GetChunksY());
+    leftChunks.reserve(interest.GetChunksX() * interest.GetChunksY());
+    playerChangedAt.reserve(EXPECTED_ENTITIES);
+    animalChangedAt.reserve(EXPECTED_ENTITIES);
+    lastPlayers.reserve(EXPECTED_ENTITIES);
+    lastAnimals.reserve(EXPECTED_ENTITIES);
+    currentAnimals.reserve(EXPECTED_ENTITIES);
+    animalsById.reserve(EXPECTED_ENTITIES);
+}
+
+void SnapshotScheduler::RecordPlayer(SentPlayer& sent, const Player& player) {
+    sent.x = player.x;
+    sent.y = player.y;
+    sent.mode = player.mode;
+    sent.score = player.score;
+    sent.alive = player.alive;
+    sent.dirX = player.lastDirectionX;
+    sent.dirY = player.lastDirectionY;
+    sent.username = player.username;  // Reuses the buffer when it is big enough
+}
+
+bool SnapshotScheduler::SamePlayer(const SentPlayer& sent, const Player& player) {
+    return sent.x == player.x && sent.y == player.y && sent.mode == player.mode && sent.score == player.score &&
+           sent.alive == player.alive && sent.dirX == player.lastDirectionX && sent.dirY == player.lastDirectionY &&
+           sent.username == player.username;
+}
+
+bool SnapshotScheduler::SamePlayer(const SentPlayer& a, const SentPlayer& b) {
+    return a.x == b.x && a.y == b.y && a.mode == b.mode && a.score == b.score &&
+           a.alive == b.alive && a.dirX == b.dirX && a.dirY == b.dirY && a.username == b.username;
+}
+
+float SnapshotScheduler::DistanceFactor(int x, int y, const Player* viewer) const {
+    if (!viewer) return 1.0f;
+    float dx = static_cast<float>(x - viewer->x);
+    float dy = static_cast<float>(y - viewer->y);
+    float distance = std::sqrt(dx * dx + dy * dy);
+    return config.distanceFalloff / (config.distanceFalloff + distance);
+}
+
+float SnapshotScheduler::RecencyFactor(float changedAt, float time) const {
+    return (time - changedAt <= config.recentChangeWindow) ? config.recentChangeBoost : 1.0f;
+}
+
+void SnapshotScheduler::MarkCellChanged(int x, int y, float time) {
+    if (x < 0 || x >= gridWidth || y < 0 || y >= gridHeight) return;
+
+    int index = y * gridWidth + x;
+    cellVersion[index]++;
+    cellChangedAt[index] = time;
+
+    for (auto& [id, peer] : peers) {
+        if (!peer.cellQueued[index]) {
+            peer.cellQueued[index] = true;
+            peer.dirtyCells.push_back(index);
+        }
+    }
+}
+
+void SnapshotScheduler::Observe(const GameState& state, float time) {
+    // Players
+    for (auto it = lastPlayers.begin(); it != lastPlayers.end();) {
+        if (state.players.find(it->first) == state.players.end()) {
+            playerChangedAt.erase(it->first);
+            it = lastPlayers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto& [id, player] : state.players) {
+        auto last = lastPlayers.find(id);
+        if (last == lastPlayers.end() || !SamePlayer(last->second, player)) {
+            RecordPlayer(lastPlayers[id], player);
+            playerChangedAt[id] = time;
+        }
+    }
+
+    // Animals
+    currentAnimals.clear();
+    for (const auto& animal : state.animals) {
+        currentAnimals[animal.id] = {animal.x, animal.y};
+        auto last = lastAnimals.find(animal.id);
+        if (last == lastAnimals.end() || last->second.x != animal.x || last->second.y != animal.y) {
+            animalChangedAt[animal.id] = time;
+        }
+    }
+    for (auto it = animalChangedAt.begin(); it != animalChangedAt.end();) {
+        if (currentAnimals.find(it->first) == currentAnimals.end()) {
+            it = animalChangedAt.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    lastAnimals.swap(currentAnimals);
+}
+
+void SnapshotScheduler::AddPeer(int playerId, float time) {
+    // The peer starts with an empty world and no subscription; chunks stream
+    // in as they enter its area of interest
+    PeerState peer;
+    peer.sentCellVersion = cellVersion;
+    peer.cellPriority.assign(cellVersion.size(), 0.0f);
+    peer.cellQueued.assign(cellVersion.size(), false);
+    peer.dirtyCells.reserve(cellVersion.size());  // Each cell is queued at most once
+    peer.sentPlayers.reserve(EXPECTED_ENTITIES);
+    peer.playerPriority.reserve(EXPECTED_ENTITIES);
+    peer.sentAnimals.reserve(EXPECTED_ENTITIES);
+    peer.animalPriority.reserve(EXPECTED_ENTITIES);
+    peer.removalPriority.reserve(EXPECTED_ENTITIES);
+    peer.lastPacketTime = time;
+    peer.needsReset = true;
+    peers[playerId] = std::move(peer);
+    interest.AddPeer(playerId);
+}
+
+void SnapshotScheduler::RemovePeer(int playerId) {
+    peers.erase(playerId);
+    interest.RemovePeer(playerId);
+}
+
+bool SnapshotScheduler::HasPendingUpdates(int playerId, const PeerState& peer, int chunk) const {
+    int startX = (chunk % interest.GetChunksX()) * INTEREST_CHUNK_SIZE;
+    int startY = (chunk / interest.GetChunksX()) * INTEREST_CHUNK_SIZE;
+    for (int y = startY; y < std::min(gridHeight, startY + INTEREST_CHUNK_SIZE); y++) {
+        for (int x = startX; x < std::min(gridWidth, startX + INTEREST_CHUNK_SIZE); x++) {
+            int index = y * gridWidth + x;
+            if (peer.cellQueued[index] && peer.sentCellVersion[index] != cellVersion[index]) return true;
+        }
+    }
+    for (const auto& [id, current] : lastAnimals) {
+        if (interest.ChunkIndexForCell(current.x, current.y) != chunk) continue;
+        auto sent = peer.sentAnimals.find(id);
+        if (sent == peer.sentAnimals.end() || sent->second.x != current.x || sent->second.y != current.y) return true;
+    }
+    for (const auto& [id, sent] : peer.sentAnimals) {
+        if (interest.ChunkIndexForCell(sent.x, sent.y) != chunk) continue;
+        auto current = lastAnimals.find(id);
+        if (current == lastAnimals.end() || !interest.IsCellVisible(playerId, current->second.x, current->second.y)) return true;
+    }
+    return false;
+}
+
+int SnapshotScheduler::ReconcileHashes(int playerId, uint64_t summary, const std::vector<ChunkHash>& chunks,
+                                       const StateHash& hash, float time) {
+    auto peerIt = peers.find(playerId);
+    if (peerIt == peers.end()) return 0;
+    PeerState& peer = peerIt->second;
+
+    subscribedChunks.clear();
+    interest.GetSubscribedChunks(playerId, subscribedChunks);
+
+    // Fast path: the client's summary covers exactly the chunks it holds
+    uint64_t expected = 0;
+    for (int chunk : subscribedChunks) {
+        expected ^= hash.GetChunkHash(chunk);
+    }
+    if (expected == summary) {
+        peer.chunkMismatches.clear();
+        return 0;
+    }
+
+    // Chunks the client doesn't report are empty on its side
+    reportedHashes.clear();
+    for (const auto& chunk : chunks) {
+        if (chunk.chunkX < 0 || chunk.chunkX >= interest.GetChunksX() ||
+            chunk.chunkY < 0 || chunk.chunkY >= interest.GetChunksY()) continue;
+        reportedHashes[chunk.chunkY * interest.GetChunksX() + chunk.chunkX] = chunk.hash;
+    }
+
+    newMismatches.clear();
+    int queued = 0;
+    for (int chunk : subscribedChunks) {
+        auto theirs = reportedHashes.find(chunk);
+        uint64_t theirHash = (theirs != reportedHashes.end()) ? theirs->second : 0;
+        if (theirHash == hash.GetChunkHash(chunk)) continue;
+        if (time - hash.GetChunkChangedAt(chunk) < config.hashSettleTime) continue;
+        if (HasPendingUpdates(playerId, peer, chunk)) continue;
+        if (std::find(peer.resyncChunks.begin(), peer.resyncChunks.end(), chunk) != peer.resyncChunks.end()) continue;
+
+        auto previous = peer.chunkMismatches.find(chunk);
+        int count = (previous != peer.chunkMismatches.end()) ? previous->second + 1 : 1;
+        if (count >= 2) {
+            peer.resyncChunks.push_back(chunk);
+            queued++;
+        } else {
+            newMismatches[chunk] = count;
+        }
+    }
+    peer.chunkMismatches.swap(newMismatches);
+
+    if (queued > 0) {
+        LOGI(SNAPSHOT, "Player " << playerId << " out of sync, resending " << queued << " chunk(s)");
+    }
+    return queued;
+}
+
+bool SnapshotScheduler::BuildPacket(int playerId, const GameState& state, float time, std::string& packet) {
+    packet.clear();
+    auto peerIt = peers.find(playerId);
+    if (peerIt == peers.end()) return false;
+    PeerState& peer = peerIt->second;
+
+    float dt = std::max(0.0f, time - peer.lastPacketTime);
+    peer.lastPacketTime = time;
+
+    const Player* viewer = nullptr;
+    auto viewerIt = state.players.find(playerId);
+    if (viewerIt != state.players.end()) {
+        viewer = &viewerIt->second;
+    }
+
+    // Follow the peer's player with its area of interest
+    enteredChunks.clear();
+    leftChunks.clear();
+    if (viewer) {
+        interest.UpdateSubscription(playerId, viewer->x, viewer->y, enteredChunks, leftChunks);
+    }
+
+    // Resynced chunks go out exactly like newly entered ones: the client clears them first
+    for (int chunk : peer.resyncChunks) {
+        if (interest.IsChunkSubscribed(playerId, chunk) &&
+            std::find(enteredChunks.begin(), enteredChunks.end(), chunk) == enteredChunks.end()) {
+            enteredChunks.push_back(chunk);
+        }
+    }
+    peer.resyncChunks.clear();
+
+    // The client clears left and entered chunks itself, including animals in
+    // them, so anything sent there before must be sent again
+    auto forgetAnimalsIn = [&](int chunk) {
+        for (auto it = peer.sentAnimals.begin(); it != peer.sentAnimals.end();) {
+            if (interest.ChunkIndexForCell(it->second.x, it->second.y) == chunk) {
+                peer.removalPriority.erase(it->first);
+                peer.animalPriority.erase(it->first);
+                it = peer.sentAnimals.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    for (int chunk : leftChunks) {
+        forgetAnimalsIn(chunk);
+        peer.chunkMismatches.erase(chunk);
+    }
+
+    for (int chunk : enteredChunks) {
+        forgetAnimalsIn(chunk);
+        // Only non-empty cells need sending into a cleared chunk
+        int startX = (chunk % interest.GetChunksX()) * INTEREST_CHUNK_SIZE;
+        int startY = (chunk / interest.GetChunksX()) * INTEREST_CHUNK_SIZE;
+        for (int y = startY; y < std::min(gridHeight, startY + INTEREST_CHUNK_SIZE); y++) {
+            for (int x = startX; x < std::min(gridWidth, startX + INTEREST_CHUNK_SIZE); x++) {
+                int index = y * gridWidth + x;
+                if (state.grid[y][x].type == CellType::EMPTY) {
+                    peer.sentCellVersion[index] = cellVersion[index];
+                } else {
+                    peer.sentCellVersion[index] = cellVersion[index] - 1;
+                    if (!peer.cellQueued[index]) {
+                        peer.cellQueued[index] = true;
+                        peer.dirtyCells.push_back(index);
+                    }
+                }
+            }
+        }
+    }
+
+    candidates.clear();
+
+    // Animals the peer knows about that no longer exist or walked out of view
+    for (const auto& [id, sent] : peer.sentAnimals) {
+        auto current = lastAnimals.find(id);
+        if (current == lastAnimals.end() || !interest.IsCellVisible(playerId, current->second.x, current->second.y)) {
+            float& priority = peer.removalPriority[id];
+            priority += dt * config.removalWeight;
+            candidates.push_back({priority, 0, id});
+        }
+    }
+
+    // Players whose state differs from what the peer last received
+    for (const auto& [id, current] : lastPlayers) {
+        if (id == playerId) continue; // Clients own their local player
+        auto sent = peer.sentPlayers.find(id);
+        if (sent != peer.sentPlayers.end() && SamePlayer(sent->second, current)) {
+            peer.playerPriority.erase(id);
+            continue;
+        }
+        float& priority = peer.playerPriority[id];
+        priority += dt * config.playerWeight * DistanceFactor(current.x, current.y, viewer) *
+                    RecencyFactor(playerChangedAt[id], time);
+        candidates.push_back({priority, 1, id});
+    }
+
+    // Animals that moved or appeared within view
+    for (const auto& [id, current] : lastAnimals) {
+        if (!interest.IsCellVisible(playerId, current.x, current.y)) continue;
+        auto sent = peer.sentAnimals.find(id);
+        if (sent != peer.sentAnimals.end() && sent->second.x == current.x && sent->second.y == current.y) {
+            peer.animalPriority.erase(id);
+            continue;
+        }
+        float& priority = peer.animalPriority[id];
+        priority += dt * config.animalWeight * DistanceFactor(current.x, current.y, viewer) *
+                    RecencyFactor(animalChangedAt[id], time);
+        candidates.push_back({priority, 2, id});
+    }
+
+    // Cells changed since the peer last received them; cells outside the
+    // subscription are dropped and picked up again when their chunk enters
+    size_t keep = 0;
+    for (size_t i = 0; i < peer.dirtyCells.size(); ++i) {
+        int index = peer.dirtyCells[i];
+        if (peer.sentCellVersion[index] == cellVersion[index] ||
+            !interest.IsCellVisible(playerId, index % gridWidth, index / gridWidth)) {
+            peer.cellQueued[index] = false;
+            peer.cellPriority[index] = 0.0f;
+            continue;
+        }
+        peer.dirtyCells[keep++] = index;
+        float& priority = peer.cellPriority[index];
+        priority += dt * config.cellWeight * DistanceFactor(index % gridWidth, index / gridWidth, viewer) *
+                    RecencyFactor(cellChangedAt[index], time);
+        candidates.push_back({priority, 3, index});
+    }
+    peer.dirtyCells.resize(keep);
+
+    bool reset = peer.needsReset;
+    peer.needsReset = false;
+    if (candidates.empty() && !reset && enteredChunks.empty() && leftChunks.empty()) return false;
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.priority > b.priority; });
+
+    animalsById.clear();
+    for (const auto& animal : state.animals) {
+        animalsById[animal.id] = &animal;
+    }
+
+    // Subscription changes always go out, they are tiny and cells depend on them
+    auto appendChunkList = [&](const std::vector<int>& chunks) {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            if (i > 0) packet += ';';
+            wire::AppendInt(packet, chunks[i] % interest.GetChunksX());
+            packet += ',';
+            wire::AppendInt(packet, chunks[i] / interest.GetChunksX());
+        }
+    };
+
+    packet += "{\"type\":\"GAME_STATE_UPDATE\",";
+    if (reset) packet += "\"reset\":true,";
+    packet += "\"left\":\"";
+    appendChunkList(leftChunks);
+    packet += "\",\"entered\":\"";
+    appendChunkList(enteredChunks);
+    packet += "\",";
+
+    cellsSection.clear();
+    playersSection.clear();
+    animalsSection.clear();
+    removedSection.clear();
+    // Size of the message with all sections empty
+    const std::string_view emptySections = "\"cells\":\"\",\"players\":[],\"animals\":[],\"removed\":\"\"}";
+    size_t used = packet.size() + emptySections.size();
+    // The routing header is part of what goes on the wire
+    size_t budget = static_cast<size_t>(std::max(0, config.packetBudgetBytes - static_cast<int>(ROUTE_HEADER_SIZE)));
+    bool anything = reset || !enteredChunks.empty() || !leftChunks.empty();
+
+    // Writes the fragment straight into its section and takes it back out if it doesn't fit
+    auto tryAppend = [&](std::string& section, char separator, auto writeFragment) {
+        size_t before = section.size();
+        if (!section.empty()) section += separator;
+        writeFragment(section);
+        size_t cost = section.size() - before;
+        if (used + cost > budget) {
+            section.resize(before);
+            return false;
+        }
+        used += cost;
+        anything = true;
+        return true;
+    };
+
+    for (const auto& candidate : candidates) {
+        switch (candidate.kind) {
+            case 0:
+                if (tryAppend(removedSection, ';', [&](std::string& out) { wire::AppendInt(out, candidate.id); })) {
+                    peer.sentAnimals.erase(candidate.id);
+                    peer.removalPriority.erase(candidate.id);
+                }
+                break;
+
+            case 1: {
+                const Player& player = state.players.at(candidate.id);
+                if (tryAppend(playersSection, ',', [&](std::string& out) { SerializePlayerJson(player, out); })) {
+                    peer.sentPlayers[candidate.id] = lastPlayers[candidate.id];
+                    peer.playerPriority.erase(candidate.id);
+                }
+                break;
+            }
+
+            case 2: {
+                auto animal = animalsById.find(candidate.id);
+                if (animal == animalsById.end()) break;
+                if (tryAppend(animalsSection, ',', [&](std::string& out) { SerializeAnimalJson(*animal->second, out); })) {
+                    peer.sentAnimals[candidate.id] = {animal->second->x, animal->second->y};
+                    peer.animalPriority.erase(candidate.id);
+                }
+                break;
+            }
+
+            case 3: {
+                int x = candidate.id % gridWidth;
+                int y = candidate.id / gridWidth;
+                if (tryAppend(cellsSection, ';', [&](std::string& out) { SerializeCellUpdate(x, y, state.grid[y][x], out); })) {
+                    peer.sentCellVersion[candidate.id] = cellVersion[candidate.id];
+                    peer.cellPriority[candidate.id] = 0.0f;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!anything) {
+        packet.clear();
+        return false;
+    }
+
+    packet += "\"cells\":\"";
+    packet += cellsSection;
+    packet += "\",\"players\":[";
+    packet += playersSection;
+    packet += "],\"animals\":[";
+    packet += animalsSection;
+    packet += "],\"removed\":\"";
+    packet += removedSection;
+    packet += "\"}";
+    return true;
+}
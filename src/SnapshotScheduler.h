@@ -0,0 +1,133 @@
+#pragma once
+
+#include "GameState.h"
+#include "FlatMap.h"
+#include "InterestManager.h"
+#include "StateHash.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+// Tuning for the per-peer snapshot scheduler
+struct SnapshotConfig {
+    int packetBudgetBytes = 1200;    // Max size of one GAME_STATE_UPDATE message
+    float sendInterval = 0.1f;       // Seconds between packets to each peer
+    float playerWeight = 4.0f;       // Players matter most
+    float animalWeight = 2.0f;       // Animals move and can be shot
+    float cellWeight = 1.0f;         // Trees, shrubs and graves
+    float removalWeight = 8.0f;      // Removed animals are cheap and must not linger
+    float distanceFalloff = 8.0f;    // Distance in cells at which priority is halved
+    float recentChangeWindow = 1.0f; // Entities changed within this window get boosted
+    float recentChangeBoost = 2.0f;
+    float hashSettleTime = 1.0f;     // Chunks changed more recently than this may still be in flight
+};
+
+// Host-side scheduler that decides what each peer gets in its next snapshot.
+// Every entity that differs from what a peer last received accumulates
+// priority over time (weighted by type, distance to that peer's player and
+// how recently it changed). Each packet is then filled greedily, highest
+// priority first, until the byte budget is used up. Sent entities reset to
+// zero, so everything eventually gets through while nearby action wins.
+// Cells and animals are further limited to the chunks the peer is
+// subscribed to (see InterestManager); chunks entering or leaving the
+// subscription are announced so the client can clear them.
+class SnapshotScheduler {
+private:
+    struct SentPlayer {
+        int x, y;
+        PlayerMode mode;
+        int score;
+        bool alive;
+        int dirX, dirY;
+        std::string username;
+    };
+
+    struct SentAnimal {
+        int x, y;
+    };
+
+    struct PeerState {
+        std::vector<uint32_t> sentCellVersion;
+        std::vector<float> cellPriority;
+        std::vector<int> dirtyCells;      // Cells this peer has not seen yet
+        std::vector<bool> cellQueued;
+        FlatMap<int, SentPlayer> sentPlayers;
+        FlatMap<int, float> playerPriority;
+        FlatMap<int, SentAnimal> sentAnimals;
+        FlatMap<int, float> animalPriority;
+        FlatMap<int, float> removalPriority;
+        float lastPacketTime = 0.0f;
+        bool needsReset = true;           // Next packet tells the client to clear its world
+        std::vector<int> resyncChunks;    // Chunks to resend as if they had just entered
+        FlatMap<int, int> chunkMismatches; // Chunk -> consecutive hash reports that disagreed
+    };
+
+    struct Candidate {
+        float priority;
+        int kind;  // 0 = removal, 1 = player, 2 = animal, 3 = cell
+        int id;    // Animal/player id or cell index
+    };
+
+    int gridWidth;
+    int gridHeight;
+    SnapshotConfig config;
+    InterestManager interest;
+
+    std::vector<uint32_t> cellVersion;
+    std::vector<float> cellChangedAt;
+    FlatMap<int, float> playerChangedAt;
+    FlatMap<int, float> animalChangedAt;
+    FlatMap<int, SentPlayer> lastPlayers;
+    FlatMap<int, SentAnimal> lastAnimals;
+
+    std::map<int, PeerState> peers;
+
+    // Scratch space reused between ticks and packets, so steady traffic doesn't allocate
+    std::vector<Candidate> candidates;
+    std::vector<int> enteredChunks;
+    std::vector<int> leftChunks;
+    FlatMap<int, SentAnimal> currentAnimals;
+    FlatMap<int, const Animal*> animalsById;
+    std::vector<int> subscribedChunks;
+    FlatMap<int, uint64_t> reportedHashes;
+    FlatMap<int, int> newMismatches;
+    std::string cellsSection, playersSection, animalsSection, removedSection;
+
+    float DistanceFactor(int x, int y, const Player* viewer) const;
+    float RecencyFactor(float changedAt, float time) const;
+    bool HasPendingUpdates(int playerId, const PeerState& peer, int chunk) const;
+
+    static void RecordPlayer(SentPlayer& sent, const Player& player);
+    static bool SamePlayer(const SentPlayer& sent, const Player& player);
+    static bool SamePlayer(const SentPlayer& a, const SentPlayer& b);
+
+public:
+    SnapshotScheduler(int gridWidth, int gridHeight, const SnapshotConfig& config = SnapshotConfig(),
+                      const InterestConfig& interestConfig = InterestConfig());
+
+    void SetConfig(const SnapshotConfig& newConfig) { config = newConfig; }
+    const SnapshotConfig& GetConfig() const { return config; }
+    InterestManager& GetInterest() { return interest; }
+
+    // Called by the simulation whenever a cell's type or owner changes
+    void MarkCellChanged(int x, int y, float time);
+
+    // Track entity changes; call once per tick before building packets
+    void Observe(const GameState& state, float time);
+
+    // Start tracking a newly joined peer; its first packet resets the client's world
+    void AddPeer(int playerId, float time);
+    void RemovePeer(int playerId);
+    bool HasPeer(int playerId) const { return peers.find(playerId) != peers.end(); }
+
+    // Compare a client's reported hashes with ours. Chunks that disagree on
+    // two reports in a row, with nothing still queued or in flight for them,
+    // are resent through the next packet. Returns how many were queued.
+    int ReconcileHashes(int playerId, uint64_t summary, const std::vector<ChunkHash>& chunks,
+                        const StateHash& hash, float time);
+
+    // Build the next GAME_STATE_UPDATE for a peer into packet (replacing what
+    // was there); false if nothing is pending
+    bool BuildPacket(int playerId, const GameState& state, float time, std::string& packet);
+};
@@ -0,0 +1,176 @@
+#include "SpriteBatch.h"
+#include "rlgl.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const int CIRCLE_TEXTURE_SIZE = 64;
+
+    // Shapes are given in arbitrary winding; rlgl culls clockwise quads, so
+    // flip them to match the top-left, bottom-left, bottom-right order
+    void FixWinding(Vector2 (&corners)[4]) {
+        float cross = (corners[1].x - corners[0].x) * (corners[2].y - corners[0].y) -
+                      (corners[1].y - corners[0].y) * (corners[2].x - corners[0].x);
+        if (cross > 0.0f) std::swap(corners[1], corners[3]);
+    }
+}
+
+void SpriteBatch::Load() {
+    Image image = GenImageColor(CIRCLE_TEXTURE_SIZE, CIRCLE_TEXTURE_SIZE, BLANK);
+    ImageDrawCircle(&image, CIRCLE_TEXTURE_SIZE / 2, CIRCLE_TEXTURE_SIZE / 2, CIRCLE_TEXTURE_SIZE / 2 - 1, WHITE);
+    circleTexture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    if (circleTexture.id > 0) {
+        SetTextureFilter(circleTexture, TEXTURE_FILTER_BILINEAR);
+    }
+}
+
+void SpriteBatch::Unload() {
+    if (circleTexture.id > 0) {
+        UnloadTexture(circleTexture);
+        circleTexture = {};
+    }
+}
+
+void SpriteBatch::Push(SpriteLayer layer, const Quad& quad) {
+    uint64_t key = (static_cast<uint64_t>(layer) << 56) |
+                   (static_cast<uint64_t>(quad.textureId & 0xFFFFFF) << 32) |
+                   static_cast<uint64_t>(quads.size());
+    order.push_back(key);
+    quads.push_back(quad);
+}
+
+void SpriteBatch::AddSprite(SpriteLayer layer, Texture2D texture, Rectangle source, Rectangle dest, Color tint) {
+    if (texture.id == 0 || texture.width == 0 || texture.height == 0) return;
+
+    bool flipX = source.width < 0.0f;
+    if (flipX) source.width = -source.width;
+
+    Quad quad;
+    quad.textureId = texture.id;
+    quad.corners[0] = {dest.x, dest.y};
+    quad.corners[1] = {dest.x, dest.y + dest.height};
+    quad.corners[2] = {dest.x + dest.width, dest.y + dest.height};
+    quad.corners[3] = {dest.x + dest.width, dest.y};
+    quad.u0 = source.x / texture.width;
+    quad.v0 = source.y / texture.height;
+    quad.u1 = (source.x + source.width) / texture.width;
+    quad.v1 = (source.y + source.height) / texture.height;
+    if (flipX) std::swap(quad.u0, quad.u1);
+    quad.color = tint;
+    Push(layer, quad);
+}
+
+void SpriteBatch::AddRect(SpriteLayer layer, Rectangle dest, Color color) {
+    Quad quad;
+    quad.textureId = rlGetTextureIdDefault();
+    quad.corners[0] = {dest.x, dest.y};
+    quad.corners[1] = {dest.x, dest.y + dest.height};
+    quad.corners[2] = {dest.x + dest.width, dest.y + dest.height};
+    quad.corners[3] = {dest.x + dest.width, dest.y};
+    quad.u0 = 0.0f;
+    quad.v0 = 0.0f;
+    quad.u1 = 1.0f;
+    quad.v1 = 1.0f;
+    quad.color = color;
+    Push(layer, quad);
+}
+
+void SpriteBatch::AddCircle(SpriteLayer layer, Vector2 center, float radius, Color color) {
+    Rectangle dest = {center.x - radius, center.y - radius, radius * 2.0f, radius * 2.0f};
+    if (circleTexture.id == 0) {
+        AddRect(layer, dest, color);
+        return;
+    }
+    AddSprite(layer, circleTexture, {0.0f, 0.0f, static_cast<float>(circleTexture.width),
+                                     static_cast<float>(circleTexture.height)}, dest, color);
+}
+
+void SpriteBatch::AddLine(SpriteLayer layer, Vector2 start, Vector2 end, float thickness, Color color) {
+    float dx = end.x - start.x;
+    float dy = end.y - start.y;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if (length <= 0.0f) return;
+
+    // Offset both ends by half the thickness perpendicular to the line
+    float nx = -dy / length * thickness * 0.5f;
+    float ny = dx / length * thickness * 0.5f;
+
+    Quad quad;
+    quad.textureId = rlGetTextureIdDefault();
+    quad.corners[0] = {start.x + nx, start.y + ny};
+    quad.corners[1] = {start.x - nx, start.y - ny};
+    quad.corners[2] = {end.x - nx, end.y - ny};
+    quad.corners[3] = {end.x + nx, end.y + ny};
+    FixWinding(quad.corners);
+    quad.u0 = 0.0f;
+    quad.v0 = 0.0f;
+    quad.u1 = 1.0f;
+    quad.v1 = 1.0f;
+    quad.color = color;
+    Push(layer, quad);
+}
+
+void SpriteBatch::AddTriangle(SpriteLayer layer, Vector2 v1, Vector2 v2, Vector2 v3, Color color) {
+    // A quad with its last corner repeated rasterises as the triangle
+    Quad quad;
+    quad.textureId = rlGetTextureIdDefault();
+    quad.corners[0] = v1;
+    quad.corners[1] = v2;
+    quad.corners[2] = v3;
+    quad.corners[3] = v3;
+    float cross = (v2.x - v1.x) * (v3.y - v1.y) - (v2.y - v1.y) * (v3.x - v1.x);
+    if (cross > 0.0f) {
+        quad.corners[1] = v3;
+        quad.corners[2] = v2;
+        quad.corners[3] = v2;
+    }
+    quad.u0 = 0.0f;
+    quad.v0 = 0.0f;
+    quad.u1 = 1.0f;
+    quad.v1 = 1.0f;
+    quad.color = color;
+    Push(layer, quad);
+}
+
+void SpriteBatch::Flush() {
+    lastQuadCount = static_cast<int>(quads.size());
+    lastBatchCount = 0;
+    if (quads.empty()) return;
+
+    // The submission index in the low bits makes every key unique, so a plain
+    // sort keeps the callers' order within each layer and texture
+    std::sort(order.begin(), order.end());
+
+    // rlgl starts a new draw call whenever the bound texture changes and
+    // splits long RL_QUADS runs into several vertex buffer uploads by itself
+    unsigned int boundTexture = 0;
+    bool inBatch = false;
+    for (uint64_t key : order) {
+        const Quad& quad = quads[static_cast<uint32_t>(key)];
+        if (!inBatch || quad.textureId != boundTexture) {
+            if (inBatch) rlEnd();
+            boundTexture = quad.textureId;
+            rlSetTexture(boundTexture);
+            rlBegin(RL_QUADS);
+            rlNormal3f(0.0f, 0.0f, 1.0f);
+            inBatch = true;
+            lastBatchCount++;
+        }
+
+        rlColor4ub(quad.color.r, quad.color.g, quad.color.b, quad.color.a);
+        rlTexCoord2f(quad.u0, quad.v0);
+        rlVertex2f(quad.corners[0].x, quad.corners[0].y);
+        rlTexCoord2f(quad.u0, quad.v1);
+        rlVertex2f(quad.corners[1].x, quad.corners[1].y);
+        rlTexCoord2f(quad.u1, quad.v1);
+        rlVertex2f(quad.corners[2].x, quad.corners[2].y);
+        rlTexCoord2f(quad.u1, quad.v0);
+        rlVertex2f(quad.corners[3].x, quad.corners[3].y);
+    }
+    rlEnd();
+    rlSetTexture(0);
+
+    quads.clear();
+    order.clear();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "raylib.h"
+#include <vector>
+#include <cstdint>
+
+// Draw order of batched quads; quads on a lower layer are always drawn first
+enum class SpriteLayer : uint8_t {
+    TERRAIN = 0,
+    ANIMALS,
+    BULLETS,
+    PLAYERS,
+    OVERLAY
+};
+
+// Collects a frame's quads and submits them through rlgl in one pass.
+// Quads are sorted by (layer, texture), keeping submission order within each
+// group, so every texture is bound once per layer no matter how sprites,
+// rectangles and circles were interleaved by the callers. Rectangles use
+// raylib's default white texture and circles a small baked circle texture,
+// tinted per quad, so shapes batch the same way sprites do.
+class SpriteBatch {
+private:
+    struct Quad {
+        unsigned int textureId;
+        Vector2 corners[4];  // Top-left, bottom-left, bottom-right, top-right
+        float u0, v0, u1, v1;
+        Color color;
+    };
+
+    std::vector<Quad> quads;
+    std::vector<uint64_t> order;  // layer | texture | submission index, sorted at Flush
+    Texture2D circleTexture = {};
+
+    int lastQuadCount = 0;
+    int lastBatchCount = 0;
+
+    void Push(SpriteLayer layer, const Quad& quad);
+
+public:
+    // Needs a GL context; without it circles fall back to plain quads
+    void Load();
+    void Unload();
+
+    // Negative source width flips horizontally, as with DrawTexturePro
+    void AddSprite(SpriteLayer layer, Texture2D texture, Rectangle source, Rectangle dest, Color tint);
+    void AddRect(SpriteLayer layer, Rectangle dest, Color color);
+    void AddCircle(SpriteLayer layer, Vector2 center, float radius, Color color);
+    void AddLine(SpriteLayer layer, Vector2 start, Vector2 end, float thickness, Color color);
+    void AddTriangle(SpriteLayer layer, Vector2 v1, Vector2 v2, Vector2 v3, Color color);
+
+    // Sorts and submits everything added since the last flush
+    void Flush();
+
+    int GetPendingQuadCount() const { return static_cast<int>(quads.size()); }
+    // Statistics of the previous flush
+    int GetLastQuadCount() const { return lastQuadCount; }
+    int GetLastBatchCount() const { return lastBatchCount; }
+};
@@ -0,0 +1,124 @@
+#include "StateHash.h"
+#include "InterestManager.h"
+#include <algorithm>
+
+StateHash::StateHash(int gridWidth, int gridHeight)
+    : gridWidth(gridWidth), gridHeight(gridHeight) {
+    chunksX = (gridWidth + INTEREST_CHUNK_SIZE - 1) / INTEREST_CHUNK_SIZE;
+    chunksY = (gridHeight + INTEREST_CHUNK_SIZE - 1) / INTEREST_CHUNK_SIZE;
+    cellTerms.assign(gridWidth * gridHeight, 0);
+    chunkHashes.assign(chunksX * chunksY, 0);
+    chunkChangedAt.assign(chunksX * chunksY, -1000.0f);
+}
+
+// splitmix64 finaliser: turns structured input into a well spread 64-bit key
+uint64_t StateHash::Mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t StateHash::CellTerm(int index, const Cell& cell) {
+    if (cell.type == CellType::EMPTY) return 0;
+    uint64_t term = Mix(0x1000000000000000ULL ^ static_cast<uint32_t>(index));
+    term = Mix(term ^ static_cast<uint64_t>(cell.type));
+    return Mix(term ^ static_cast<uint32_t>(cell.playerId));
+}
+
+uint64_t StateHash::PlayerTerm(const Player& player) {
+    uint64_t term = Mix(0x2000000000000000ULL ^ static_cast<uint32_t>(player.id));
+    term = Mix(term ^ (static_cast<uint64_t>(static_cast<uint32_t>(player.x)) << 32) ^ static_cast<uint32_t>(player.y));
+    term = Mix(term ^ static_cast<uint32_t>(player.score));
+    return Mix(term ^ (static_cast<uint64_t>(player.mode) << 1) ^ (player.alive ? 1u : 0u));
+}
+
+uint64_t StateHash::AnimalTermFor(const Animal& animal) {
+    uint64_t term = Mix(0x3000000000000000ULL ^ static_cast<uint32_t>(animal.id));
+    term = Mix(term ^ (static_cast<uint64_t>(static_cast<uint32_t>(animal.x)) << 32) ^ static_cast<uint32_t>(animal.y));
+    return Mix(term ^ static_cast<uint64_t>(animal.type));
+}
+
+int StateHash::ChunkIndex(int x, int y) const {
+    return (y / INTEREST_CHUNK_SIZE) * chunksX + x / INTEREST_CHUNK_SIZE;
+}
+
+void StateHash::ToggleChunk(int chunk, uint64_t term, float time) {
+    if (term == 0) return;
+    worldHash ^= term;
+    chunkHashes[chunk] ^= term;
+    chunkChangedAt[chunk] = time;
+}
+
+void StateHash::Rebuild(const GameState& state, float time) {
+    worldHash = 0;
+    std::fill(cellTerms.begin(), cellTerms.end(), 0);
+    std::fill(chunkHashes.begin(), chunkHashes.end(), 0);
+    std::fill(chunkChangedAt.begin(), chunkChangedAt.end(), time);
+    playerTerms.clear();
+    animalTerms.clear();
+
+    for (int y = 0; y < gridHeight && y < static_cast<int>(state.grid.size()); y++) {
+        for (int x = 0; x < gridWidth && x < static_cast<int>(state.grid[y].size()); x++) {
+            SetCell(x, y, state.grid[y][x], time);
+        }
+    }
+    for (const auto& [id, player] : state.players) {
+        SetPlayer(player);
+    }
+    for (const auto& animal : state.animals) {
+        SetAnimal(animal, time);
+    }
+}
+
+void StateHash::SetCell(int x, int y, const Cell& cell, float time) {
+    if (x < 0 || x >= gridWidth || y < 0 || y >= gridHeight) return;
+
+    int index = y * gridWidth + x;
+    uint64_t term = CellTerm(index, cell);
+    if (term == cellTerms[index]) return;
+
+    ToggleChunk(ChunkIndex(x, y), cellTerms[index] ^ term, time);
+    cellTerms[index] = term;
+}
+
+void StateHash::SetPlayer(const Player& player) {
+    uint64_t term = PlayerTerm(player);
+    auto it = playerTerms.find(player.id);
+    if (it != playerTerms.end()) {
+        worldHash ^= it->second;
+        it->second = term;
+    } else {
+        playerTerms[player.id] = term;
+    }
+    worldHash ^= term;
+}
+
+void StateHash::RemovePlayer(int playerId) {
+    auto it = playerTerms.find(playerId);
+    if (it == playerTerms.end()) return;
+    worldHash ^= it->second;
+    playerTerms.erase(it);
+}
+
+void StateHash::SetAnimal(const Animal& animal, float time) {
+    if (animal.x < 0 || animal.x >= gridWidth || animal.y < 0 || animal.y >= gridHeight) return;
+
+    AnimalTerm next = {AnimalTermFor(animal), ChunkIndex(animal.x, animal.y)};
+    auto it = animalTerms.find(animal.id);
+    if (it != animalTerms.end()) {
+        if (it->second.term == next.term) return;
+        ToggleChunk(it->second.chunk, it->second.term, time);
+        it->second = next;
+    } else {
+        animalTerms[animal.id] = next;
+    }
+    ToggleChunk(next.chunk, next.term, time);
+}
+
+void StateHash::RemoveAnimal(int animalId, float time) {
+    auto it = animalTerms.find(animalId);
+    if (it == animalTerms.end()) return;
+    ToggleChunk(it->second.chunk, it->second.term, time);
+    animalTerms.erase(it);
+}
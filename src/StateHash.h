@@ -0,0 +1,63 @@
+#pragma once
+
+#include "GameState.h"
+#include "FlatMap.h"
+#include <vector>
+#include <cstdint>
+
+// Zobrist-style hash of the simulated game state. Every cell, player and
+// animal contributes a pseudo-random 64-bit term derived from its fields; the
+// hash is the XOR of all terms, so a mutation only has to XOR out the old term
+// and XOR in the new one instead of rescanning the world.
+//
+// Cells and animals are also hashed per interest chunk (INTEREST_CHUNK_SIZE),
+// which lets the host find exactly which regions a client disagrees on.
+// Players are only part of the world hash, not of any chunk.
+// Empty cells hash to zero whatever their owner, so a chunk the host streams
+// as "non-empty cells only" hashes the same on both ends.
+class StateHash {
+private:
+    struct AnimalTerm {
+        uint64_t term;
+        int chunk;
+    };
+
+    int gridWidth;
+    int gridHeight;
+    int chunksX;
+    int chunksY;
+
+    uint64_t worldHash = 0;
+    std::vector<uint64_t> cellTerms;
+    std::vector<uint64_t> chunkHashes;
+    std::vector<float> chunkChangedAt;
+    FlatMap<int, uint64_t> playerTerms;
+    FlatMap<int, AnimalTerm> animalTerms;
+
+    int ChunkIndex(int x, int y) const;
+    void ToggleChunk(int chunk, uint64_t term, float time);
+
+    static uint64_t Mix(uint64_t value);
+    static uint64_t CellTerm(int index, const Cell& cell);
+    static uint64_t PlayerTerm(const Player& player);
+    static uint64_t AnimalTermFor(const Animal& animal);
+
+public:
+    StateHash(int gridWidth, int gridHeight);
+
+    // Recompute everything from scratch, after the state was replaced wholesale
+    void Rebuild(const GameState& state, float time);
+
+    void SetCell(int x, int y, const Cell& cell, float time);
+    void SetPlayer(const Player& player);
+    void RemovePlayer(int playerId);
+    void SetAnimal(const Animal& animal, float time);
+    void RemoveAnimal(int animalId, float time);
+
+    uint64_t GetHash() const { return worldHash; }
+    int GetChunksX() const { return chunksX; }
+    int GetChunkCount() const { return chunksX * chunksY; }
+    uint64_t GetChunkHash(int chunk) const { return chunkHashes[chunk]; }
+    // Last time a cell or animal in the chunk changed
+    float GetChunkChangedAt(int chunk) const { return chunkChangedAt[chunk]; }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free triple buffer for one writer and one reader. The writer fills
+// WriteBuffer() and publishes it; the reader picks up the most recently
+// published buffer with Acquire(). Neither side ever waits: the writer
+// always has a buffer of its own, and frames the reader didn't get to are
+// simply overwritten.
+template <typename T>
+class TripleBuffer {
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;  // Middle buffer published but not yet acquired
+
+    T buffers[3];
+    std::atomic<uint8_t> middle{1};
+    uint8_t writeIndex = 0;
+    uint8_t readIndex = 2;
+
+public:
+    T& WriteBuffer() { return buffers[writeIndex]; }
+
+    void Publish() {
+        uint8_t previous = middle.exchange(static_cast<uint8_t>(writeIndex | FRESH), std::memory_order_acq_rel);
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    // Switches to the latest published buffer; false if nothing new arrived
+    bool Acquire() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+        uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& ReadBuffer() const { return buffers[readIndex]; }
+};
+
+// Bounded single-producer single-consumer ring. Push fails when full rather
+// than blocking the producer.
+template <typename T, size_t Capacity>
+class SpscQueue {
+private:
+    T items[Capacity];
+    std::atomic<size_t> head{0};  // Next slot to read, owned by the consumer
+    std::atomic<size_t> tail{0};  // Next slot to write, owned by the producer
+
+public:
+    bool Push(const T& item) {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+        size_t nextTail = (currentTail + 1) % Capacity;
+        if (nextTail == head.load(std::memory_order_acquire)) return false;
+        items[currentTail] = item;
+        tail.store(nextTail, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& item) {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire)) return false;
+        item = items[currentHead];
+        head.store((currentHead + 1) % Capacity, std::memory_order_release);
+        return true;
+    }
+};
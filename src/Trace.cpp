@@ -0,0 +1,185 @@
+#include "Trace.h"
+#include "Log.h"
+
+#ifdef ROBBAN_TRACING
+
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef PLATFORM_WEB
+#include <emscripten.h>
+#endif
+
+namespace trace {
+
+namespace {
+
+// Events kept per thread; at 60 fps with a few dozen scopes per frame that
+// is several seconds of history
+const uint64_t RING_SIZE = 16384;
+
+struct ThreadRing {
+    Event events[RING_SIZE];
+    // claimed moves on before an event is written and written after, so a
+    // capture can tell which of the slots it copied may have changed under it
+    std::atomic<uint64_t> claimed{0};
+    std::atomic<uint64_t> written{0};
+    std::atomic<const char*> threadName{nullptr};
+    int threadId = 0;
+};
+
+std::mutex ringsMutex;
+// Rings outlive their threads, so a capture still shows a thread that just exited
+std::vector<std::unique_ptr<ThreadRing>> rings;
+std::atomic<bool> dumpRequested{false};
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+ThreadRing& LocalRing() {
+    thread_local ThreadRing* ring = nullptr;
+    if (!ring) {
+        auto created = std::make_unique<ThreadRing>();
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        created->threadId = static_cast<int>(rings.size()) + 1;
+        ring = created.get();
+        rings.push_back(std::move(created));
+    }
+    return *ring;
+}
+
+void OnDumpSignal(int) {
+    dumpRequested.store(true, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Record(const char* name, uint64_t startNs, uint64_t endNs) {
+    ThreadRing& ring = LocalRing();
+    uint64_t index = ring.written.load(std::memory_order_relaxed);
+    ring.claimed.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Event& event = ring.events[index % RING_SIZE];
+    event.name.store(name, std::memory_order_relaxed);
+    event.startNs.store(startNs, std::memory_order_relaxed);
+    event.durationNs.store(endNs - startNs, std::memory_order_relaxed);
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+void SetThreadName(const char* name) {
+    LocalRing().threadName.store(name, std::memory_order_relaxed);
+}
+
+static std::string BuildTrace(size_t& eventCount) {
+    struct Copied {
+        uint64_t index;
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+    };
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\"traceEvents\":[\n";
+    bool first = true;
+    eventCount = 0;
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    std::vector<Copied> copied;
+    for (const auto& ring : rings) {
+        if (const char* threadName = ring->threadName.load(std::memory_order_relaxed)) {
+            json << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadId
+                 << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+            first = false;
+        }
+
+        uint64_t end = ring->written.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+        copied.clear();
+        for (uint64_t i = begin; i < end; i++) {
+            const Event& event = ring->events[i % RING_SIZE];
+            copied.push_back({i, event.name.load(std::memory_order_relaxed), event.startNs.load(std::memory_order_relaxed),
+                              event.durationNs.load(std::memory_order_relaxed)});
+        }
+
+        // Slots the thread started overwriting while we copied are dropped
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimed = ring->claimed.load(std::memory_order_relaxed);
+        uint64_t firstIntact = claimed > RING_SIZE ? claimed - RING_SIZE : 0;
+
+        for (const Copied& event : copied) {
+            if (event.index < firstIntact || !event.name) continue;
+            json << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":"
+                 << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0 << ",\"pid\":1,\"tid\":"
+                 << ring->threadId << "}";
+            first = false;
+            eventCount++;
+        }
+    }
+
+    json << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return json.str();
+}
+
+std::string BuildChromeTrace() {
+    size_t eventCount;
+    return BuildTrace(eventCount);
+}
+
+bool WriteChromeTrace() {
+    size_t eventCount;
+    std::string json = BuildTrace(eventCount);
+
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+    std::string fileName = std::string("robban-trace-") + stamp + ".json";
+
+#ifdef PLATFORM_WEB
+    // No useful filesystem in the browser: hand the capture over as a download
+    MAIN_THREAD_EM_ASM({
+        var blob = new Blob([UTF8ToString($0)], {type: 'application/json'});
+        var link = document.createElement('a');
+        link.href = URL.createObjectURL(blob);
+        link.download = UTF8ToString($1);
+        link.click();
+        setTimeout(function() { URL.revokeObjectURL(link.href); }, 1000);
+    }, json.c_str(), fileName.c_str());
+#else
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file || !file.write(json.data(), json.size())) {
+        LOGE(TRACE, "Could not write " << fileName);
+        return false;
+    }
+#endif
+    LOGI(TRACE, "Wrote " << eventCount << " events to " << fileName);
+    return true;
+}
+
+void InstallSignalHandler() {
+#if !defined(_WIN32) && !defined(PLATFORM_WEB)
+    std::signal(SIGUSR1, OnDumpSignal);
+    LOGI(TRACE, "Tracing compiled in; F9 or SIGUSR1 writes a capture");
+#else
+    (void)OnDumpSignal;
+    LOGI(TRACE, "Tracing compiled in; F9 writes a capture");
+#endif
+}
+
+bool ConsumeDumpRequest() {
+    return dumpRequested.exchange(false, std::memory_order_relaxed);
+}
+
+}  // namespace trace
+
+#endif
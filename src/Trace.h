@@ -0,0 +1,71 @@
+#pragma once
+
+// Scoped trace markers for the hot path. Built with -DTRACING=ON (which
+// defines ROBBAN_TRACING) every TRACE_SCOPE records one complete event into
+// a fixed ring buffer owned by the calling thread; otherwise the macros
+// expand to nothing and this header declares nothing else.
+//
+// Rings keep the most recent events only, so a capture shows the seconds
+// before it was requested. WriteChromeTrace() turns them into Chrome
+// trace_event JSON that Perfetto and chrome://tracing open directly.
+
+#ifdef ROBBAN_TRACING
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace trace {
+
+// Names must be string literals (or otherwise live for the whole process):
+// only the pointer is stored
+struct Event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> startNs{0};
+    std::atomic<uint64_t> durationNs{0};
+};
+
+// Nanoseconds since the process started tracing
+uint64_t NowNs();
+void Record(const char* name, uint64_t startNs, uint64_t endNs);
+// Shown as the thread's track name; call once from the thread itself
+void SetThreadName(const char* name);
+
+// Writes every thread's ring as {"traceEvents": [...]}. Threads keep
+// recording meanwhile; the few events they overwrite during the copy are
+// skipped rather than written torn
+std::string BuildChromeTrace();
+// To robban-trace-<time>.json in the working directory natively, as a
+// browser download on the web. Returns false if nothing could be written
+bool WriteChromeTrace();
+
+// SIGUSR1 (POSIX) asks for a capture; the main loop answers it by calling
+// WriteChromeTrace() when ConsumeDumpRequest() says so
+void InstallSignalHandler();
+bool ConsumeDumpRequest();
+
+class Scope {
+private:
+    const char* name;
+    uint64_t start;
+
+public:
+    explicit Scope(const char* name) : name(name), start(NowNs()) {}
+    ~Scope() { Record(name, start, NowNs()); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace::SetThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+
+#endif
@@ -0,0 +1,123 @@
+#include "WireFormat.h"
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace wire {
+
+void AppendInt(std::string& out, long long value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+void AppendHex(std::string& out, uint64_t value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, 16);
+    out.append(buffer, result.ptr);
+}
+
+void AppendHexBytes(std::string& out, const char* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    size_t start = out.size();
+    out.resize(start + size * 2);
+    for (size_t i = 0; i < size; i++) {
+        unsigned char byte = static_cast<unsigned char>(data[i]);
+        out[start + i * 2] = digits[byte >> 4];
+        out[start + i * 2 + 1] = digits[byte & 0xF];
+    }
+}
+
+void AppendFloat(std::string& out, float value) {
+    // Floating point to_chars is missing from older standard libraries
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%g", static_cast<double>(value));
+    if (length > 0) out.append(buffer, static_cast<size_t>(length));
+}
+
+std::string_view FindValue(std::string_view json, std::string_view key) {
+    // Look for "key": without building the search string
+    size_t pos = 0;
+    while ((pos = json.find(key, pos)) != std::string_view::npos) {
+        size_t after = pos + key.size();
+        if (pos > 0 && json[pos - 1] == '"' && json.substr(after, 2) == "\":") {
+            pos = after + 2;
+            break;
+        }
+        pos = after;
+    }
+    if (pos == std::string_view::npos) return {};
+
+    while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\t')) pos++;
+    if (pos >= json.size()) return {};
+
+    if (json[pos] == '"') {
+        size_t end = json.find('"', pos + 1);
+        if (end == std::string_view::npos) return {};
+        return json.substr(pos + 1, end - pos - 1);
+    }
+    if (json[pos] == '[') {
+        size_t end = pos + 1;
+        int depth = 1;
+        while (end < json.size() && depth > 0) {
+            if (json[end] == '[') depth++;
+            else if (json[end] == ']') depth--;
+            end++;
+        }
+        return json.substr(pos, end - pos);
+    }
+    size_t end = pos;
+    while (end < json.size() && json[end] != ',' && json[end] != '}') end++;
+    return json.substr(pos, end - pos);
+}
+
+bool ParseInt(std::string_view text, int& value) {
+    int parsed;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return false;
+    value = parsed;
+    return true;
+}
+
+bool ParseHex(std::string_view text, uint64_t& value) {
+    uint64_t parsed;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), parsed, 16);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return false;
+    value = parsed;
+    return true;
+}
+
+bool ParseFloat(std::string_view text, float& value) {
+    // strtof needs a terminator; no float we write is anywhere near this long
+    char buffer[32];
+    if (text.empty() || text.size() >= sizeof(buffer)) return false;
+    std::memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = '\0';
+    char* end = nullptr;
+    float parsed = std::strtof(buffer, &end);
+    if (end != buffer + text.size()) return false;
+    value = parsed;
+    return true;
+}
+
+static int HexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ParseHexBytes(std::string_view text, std::string& out) {
+    if (text.size() % 2 != 0) return false;
+    out.resize(text.size() / 2);
+    for (size_t i = 0; i < out.size(); i++) {
+        int high = HexDigit(text[i * 2]);
+        int low = HexDigit(text[i * 2 + 1]);
+        if (high < 0 || low < 0) return false;
+        out[i] = static_cast<char>(high << 4 | low);
+    }
+    return true;
+}
+
+}  // namespace wire
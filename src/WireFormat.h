@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Text building blocks for the network messages, shared by the encoders in
+// NetworkManager and SnapshotScheduler. Writers append to a caller-owned
+// string, so a buffer that is reused keeps its capacity; readers work on
+// views into the received message. Neither side creates temporary strings.
+namespace wire {
+
+void AppendInt(std::string& out, long long value);
+void AppendHex(std::string& out, uint64_t value);
+// Shortest of %g, like streaming a float with the default precision
+void AppendFloat(std::string& out, float value);
+// Binary data as two hex digits a byte
+void AppendHexBytes(std::string& out, const char* data, size_t size);
+inline void AppendBool(std::string& out, bool value) { out += value ? "true" : "false"; }
+
+// The raw value of "key": in a flat JSON object: the text between the quotes
+// of a string, the brackets of an array (inclusive) or up to the next , or }
+// for anything else. Empty if the key is missing
+std::string_view FindValue(std::string_view json, std::string_view key);
+
+// Whole-text parses; false (leaving value alone) if the text isn't a number
+bool ParseInt(std::string_view text, int& value);
+bool ParseHex(std::string_view text, uint64_t& value);
+bool ParseFloat(std::string_view text, float& value);
+// Back from AppendHexBytes into out, which is overwritten; false if the text
+// isn't pairs of hex digits
+bool ParseHexBytes(std::string_view text, std::string& out);
+
+// Splits the next separator-terminated token off the front of text
+inline std::string_view NextToken(std::string_view& text, char separator) {
+    size_t end = text.find(separator);
+    std::string_view token = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    return token;
+}
+
+}  // namespace wire
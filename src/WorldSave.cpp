@@ -0,0 +1,494 @@
+#include "WorldSave.h"
+#include "GameState.h"
+#include "Log.h"
+#include "Trace.h"
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__) || defined(PLATFORM_WEB)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ROBBAN_WORLD_MMAP 1
+#endif
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(PLATFORM_WEB)
+#include <cerrno>
+#include <sys/wait.h>
+#define ROBBAN_WORLD_FORK 1
+#endif
+
+#ifdef PLATFORM_WEB
+#include <emscripten.h>
+#endif
+
+namespace {
+
+const uint32_t WORLD_MAGIC = 0x53574252;  // "RBWS" in a little-endian file
+const uint32_t WORLD_VERSION = 2;  // 2: player action timers and bullets in flight
+
+// Sanity limits for what a header may claim, checked before any sizes are multiplied
+const int32_t MAX_GRID_SIDE = 1 << 14;
+const int32_t MAX_RECORDS = 1 << 20;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t gridWidth;
+    int32_t gridHeight;
+    int32_t playerCount;
+    int32_t animalCount;
+    uint32_t namesBytes;
+    float gameTime;
+    int32_t nextAnimalId;
+    int32_t bulletCount;
+    uint64_t seed;
+    uint64_t rngState[3];      // world, players, animals
+    uint64_t rngIncrement[3];
+};
+
+struct SavedPlayer {
+    int32_t id;
+    int32_t x, y;
+    int32_t mode;
+    int32_t score;
+    int32_t alive;
+    int32_t directionX, directionY;
+    uint32_t nameOffset;  // Into the names block
+    uint32_t nameLength;
+    uint8_t color[4];
+    float lastAction;
+};
+
+struct SavedAnimal {
+    int32_t id;
+    int32_t type;
+    int32_t x, y;
+    float lastMove;
+    float moveDelay;
+};
+
+struct SavedBullet {
+    int32_t x, y;
+    int32_t directionX, directionY;
+    int32_t playerId;
+    float startTime;
+    int32_t active;
+};
+
+static_assert(sizeof(FileHeader) == 96 && sizeof(SavedPlayer) == 48 && sizeof(SavedAnimal) == 24 &&
+                  sizeof(SavedBullet) == 28,
+              "record layouts are part of the file format");
+// Grid rows are written and read as they are in memory
+static_assert(std::is_trivially_copyable<Cell>::value && sizeof(Cell) == 16,
+              "Cell changed: bump WORLD_VERSION");
+
+// Collects the encoder's output in a fixed block and hands full blocks to
+// flush, so encoding never allocates; the forked writer depends on that
+class BlockWriter {
+private:
+    using FlushFunction = bool (*)(void* target, const char* data, size_t size);
+
+    char block[16384];
+    size_t used = 0;
+    bool ok = true;
+    FlushFunction flush;
+    void* target;
+
+    void Flush() {
+        if (ok && used > 0) ok = flush(target, block, used);
+        used = 0;
+    }
+
+public:
+    BlockWriter(FlushFunction flush, void* target) : flush(flush), target(target) {}
+
+    void Write(const void* data, size_t size) {
+        if (used + size > sizeof(block)) {
+            Flush();
+            if (size > sizeof(block)) {
+                ok = ok && flush(target, static_cast<const char*>(data), size);
+                return;
+            }
+        }
+        std::memcpy(block + used, data, size);
+        used += size;
+    }
+
+    bool Finish() {
+        Flush();
+        return ok;
+    }
+};
+
+bool WriteWorld(const GameState& state, const WorldMeta& meta, BlockWriter& writer) {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = WORLD_MAGIC;
+    header.version = WORLD_VERSION;
+    header.gridHeight = static_cast<int32_t>(state.grid.size());
+    header.gridWidth = state.grid.empty() ? 0 : static_cast<int32_t>(state.grid[0].size());
+    for (const auto& row : state.grid) {
+        if (static_cast<int32_t>(row.size()) != header.gridWidth) return false;
+    }
+    header.playerCount = static_cast<int32_t>(state.players.size());
+    header.animalCount = static_cast<int32_t>(state.animals.size());
+    header.bulletCount = static_cast<int32_t>(state.bullets.size());
+    for (const auto& [id, player] : state.players) {
+        header.namesBytes += static_cast<uint32_t>(player.username.size());
+    }
+    header.gameTime = meta.gameTime;
+    header.nextAnimalId = meta.nextAnimalId;
+    header.seed = meta.rng.seed;
+    const SimRandom* streams[3] = {&meta.rng.world, &meta.rng.players, &meta.rng.animals};
+    for (int i = 0; i < 3; i++) {
+        header.rngState[i] = streams[i]->GetState();
+        header.rngIncrement[i] = streams[i]->GetIncrement();
+    }
+    writer.Write(&header, sizeof(header));
+
+    for (const auto& row : state.grid) {
+        writer.Write(row.data(), row.size() * sizeof(Cell));
+    }
+
+    uint32_t nameOffset = 0;
+    for (const auto& [id, player] : state.players) {
+        SavedPlayer saved;
+        std::memset(&saved, 0, sizeof(saved));
+        saved.id = player.id;
+        saved.x = player.x;
+        saved.y = player.y;
+        saved.mode = static_cast<int32_t>(player.mode);
+        saved.score = player.score;
+        saved.alive = player.alive ? 1 : 0;
+        saved.directionX = player.lastDirectionX;
+        saved.directionY = player.lastDirectionY;
+        saved.nameOffset = nameOffset;
+        saved.nameLength = static_cast<uint32_t>(player.username.size());
+        saved.color[0] = player.color.r;
+        saved.color[1] = player.color.g;
+        saved.color[2] = player.color.b;
+        saved.color[3] = player.color.a;
+        saved.lastAction = player.lastAction;
+        writer.Write(&saved, sizeof(saved));
+        nameOffset += saved.nameLength;
+    }
+
+    for (const auto& animal : state.animals) {
+        SavedAnimal saved = {animal.id, static_cast<int32_t>(animal.type), animal.x, animal.y,
+                             animal.lastMove, animal.moveDelay};
+        writer.Write(&saved, sizeof(saved));
+    }
+
+    for (const auto& bullet : state.bullets) {
+        SavedBullet saved = {bullet.x, bullet.y, bullet.dirX, bullet.dirY, bullet.playerId, bullet.startTime,
+                             bullet.active ? 1 : 0};
+        writer.Write(&saved, sizeof(saved));
+    }
+
+    for (const auto& [id, player] : state.players) {
+        writer.Write(player.username.data(), player.username.size());
+    }
+    return writer.Finish();
+}
+
+// Appends to a std::string, for keeping a world in memory
+bool FlushToString(void* target, const char* data, size_t size) {
+    static_cast<std::string*>(target)->append(data, size);
+    return true;
+}
+
+}  // namespace
+
+bool EncodeWorld(const GameState& state, const WorldMeta& meta, std::string& out) {
+    out.clear();
+    BlockWriter writer(FlushToString, &out);
+    return WriteWorld(state, meta, writer);
+}
+
+bool DecodeWorld(const char* data, size_t size, GameState& state, WorldMeta& meta) {
+    FileHeader header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != WORLD_MAGIC || header.version != WORLD_VERSION) return false;
+    if (header.gridWidth < 0 || header.gridWidth > MAX_GRID_SIDE || header.gridHeight < 0 ||
+        header.gridHeight > MAX_GRID_SIDE || header.playerCount < 0 || header.playerCount > MAX_RECORDS ||
+        header.animalCount < 0 || header.animalCount > MAX_RECORDS || header.bulletCount < 0 ||
+        header.bulletCount > MAX_RECORDS) {
+        return false;
+    }
+
+    size_t rowBytes = static_cast<size_t>(header.gridWidth) * sizeof(Cell);
+    size_t cellsAt = sizeof(header);
+    size_t playersAt = cellsAt + rowBytes * header.gridHeight;
+    size_t animalsAt = playersAt + sizeof(SavedPlayer) * header.playerCount;
+    size_t bulletsAt = animalsAt + sizeof(SavedAnimal) * header.animalCount;
+    size_t namesAt = bulletsAt + sizeof(SavedBullet) * header.bulletCount;
+    if (size != namesAt + header.namesBytes) return false;
+
+    // Check every name before touching state, so a bad file changes nothing
+    for (int32_t i = 0; i < header.playerCount; i++) {
+        SavedPlayer saved;
+        std::memcpy(&saved, data + playersAt + i * sizeof(SavedPlayer), sizeof(saved));
+        if (saved.id < 0 || saved.nameOffset > header.namesBytes ||
+            saved.nameLength > header.namesBytes - saved.nameOffset) {
+            return false;
+        }
+    }
+
+    state.grid.resize(header.gridHeight);
+    for (int32_t y = 0; y < header.gridHeight; y++) {
+        state.grid[y].resize(header.gridWidth);
+        std::memcpy(static_cast<void*>(state.grid[y].data()), data + cellsAt + y * rowBytes, rowBytes);
+    }
+
+    state.players.clear();
+    for (int32_t i = 0; i < header.playerCount; i++) {
+        SavedPlayer saved;
+        std::memcpy(&saved, data + playersAt + i * sizeof(SavedPlayer), sizeof(saved));
+        Player& player = state.players[saved.id];
+        player.id = saved.id;
+        player.x = saved.x;
+        player.y = saved.y;
+        player.mode = static_cast<PlayerMode>(saved.mode);
+        player.score = saved.score;
+        player.alive = saved.alive != 0;
+        player.lastDirectionX = saved.directionX;
+        player.lastDirectionY = saved.directionY;
+        player.username.assign(data + namesAt + saved.nameOffset, saved.nameLength);
+        player.color = Color{saved.color[0], saved.color[1], saved.color[2], saved.color[3]};
+        player.lastAction = saved.lastAction;
+    }
+
+    state.animals.resize(header.animalCount);
+    for (int32_t i = 0; i < header.animalCount; i++) {
+        SavedAnimal saved;
+        std::memcpy(&saved, data + animalsAt + i * sizeof(SavedAnimal), sizeof(saved));
+        Animal& animal = state.animals[i];
+        animal.id = saved.id;
+        animal.type = static_cast<AnimalType>(saved.type);
+        animal.x = saved.x;
+        animal.y = saved.y;
+        animal.lastMove = saved.lastMove;
+        animal.moveDelay = saved.moveDelay;
+    }
+    state.bullets.resize(header.bulletCount);
+    for (int32_t i = 0; i < header.bulletCount; i++) {
+        SavedBullet saved;
+        std::memcpy(&saved, data + bulletsAt + i * sizeof(SavedBullet), sizeof(saved));
+        Bullet& bullet = state.bullets[i];
+        bullet.x = saved.x;
+        bullet.y = saved.y;
+        bullet.dirX = saved.directionX;
+        bullet.dirY = saved.directionY;
+        bullet.playerId = saved.playerId;
+        bullet.startTime = saved.startTime;
+        bullet.active = saved.active != 0;
+    }
+
+    meta.gameTime = header.gameTime;
+    meta.nextAnimalId = header.nextAnimalId;
+    meta.rng.seed = header.seed;
+    SimRandom* streams[3] = {&meta.rng.world, &meta.rng.players, &meta.rng.animals};
+    for (int i = 0; i < 3; i++) {
+        streams[i]->Restore(header.rngState[i], header.rngIncrement[i]);
+    }
+    return true;
+}
+
+namespace {
+
+bool FlushToFile(void* target, const char* data, size_t size) {
+    return std::fwrite(data, 1, size, static_cast<FILE*>(target)) == size;
+}
+
+bool ReplaceWith(const char* temporaryPath, const char* path) {
+#ifdef _WIN32
+    // rename() won't replace an existing file here
+    std::remove(path);
+#endif
+    return std::rename(temporaryPath, path) == 0;
+}
+
+#ifdef ROBBAN_WORLD_FORK
+// Runs in the forked child: only raw system calls from here on, no locks
+// another thread may have been holding at the fork
+bool FlushToDescriptor(void* target, const char* data, size_t size) {
+    int fd = *static_cast<int*>(target);
+    while (size > 0) {
+        ssize_t count = write(fd, data, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+[[noreturn]] void WriteCheckpointAndExit(const char* temporaryPath, const char* path, const GameState& state,
+                                         const WorldMeta& meta) {
+    int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) _exit(1);
+    BlockWriter writer(FlushToDescriptor, &fd);
+    bool ok = WriteWorld(state, meta, writer) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    _exit(ok && ReplaceWith(temporaryPath, path) ? 0 : 1);
+}
+#endif
+
+#ifdef PLATFORM_WEB
+// Copies what the in-memory filesystem holds out to IndexedDB
+void PersistWorldStorage() {
+    MAIN_THREAD_ASYNC_EM_ASM({
+        FS.syncfs(false, function(err) {
+            if (err) console.warn('Saving the world to IndexedDB failed', err);
+        });
+    });
+}
+#endif
+
+}  // namespace
+
+bool SaveWorld(const std::string& path, const GameState& state, const WorldMeta& meta) {
+    TRACE_SCOPE("SaveWorld");
+    std::string temporaryPath = path + ".tmp";
+    FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        LOGW(SAVE, "Could not open " << temporaryPath);
+        return false;
+    }
+    BlockWriter writer(FlushToFile, file);
+    bool ok = WriteWorld(state, meta, writer) && std::fflush(file) == 0;
+#if defined(ROBBAN_WORLD_MMAP) && !defined(PLATFORM_WEB)
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || !ReplaceWith(temporaryPath.c_str(), path.c_str())) {
+        LOGW(SAVE, "Could not write " << path);
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+#ifdef PLATFORM_WEB
+    PersistWorldStorage();
+#endif
+    return true;
+}
+
+bool LoadWorld(const std::string& path, GameState& state, WorldMeta& meta) {
+    TRACE_SCOPE("LoadWorld");
+#ifdef ROBBAN_WORLD_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping stays valid on its own
+    if (mapped == MAP_FAILED) return false;
+    bool ok = DecodeWorld(static_cast<const char*>(mapped), size, state, meta);
+    munmap(mapped, size);
+#else
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::string contents;
+    char chunk[16384];
+    size_t count;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        contents.append(chunk, count);
+    }
+    std::fclose(file);
+    bool ok = DecodeWorld(contents.data(), contents.size(), state, meta);
+#endif
+    if (!ok) {
+        LOGW(SAVE, path << " is not a world save this version can read");
+    }
+    return ok;
+}
+
+void MountWorldStorage(const char* directory) {
+#ifdef PLATFORM_WEB
+    MAIN_THREAD_EM_ASM({
+        var directory = UTF8ToString($0);
+        try { FS.mkdir(directory); } catch (e) {}
+        FS.mount(IDBFS, {}, directory);
+        FS.syncfs(true, function(err) {
+            if (err) console.warn('Loading saved worlds from IndexedDB failed', err);
+        });
+    }, directory);
+#else
+    (void)directory;
+#endif
+}
+
+WorldCheckpointer::WorldCheckpointer(const std::string& path) : path(path), temporaryPath(path + ".tmp") {}
+
+WorldCheckpointer::~WorldCheckpointer() {
+    Wait();
+}
+
+void WorldCheckpointer::Wait() {
+#ifdef ROBBAN_WORLD_FORK
+    if (writerPid == 0) return;
+    int status = 0;
+    while (waitpid(writerPid, &status, 0) < 0 && errno == EINTR) {
+    }
+    writerPid = 0;
+#endif
+}
+
+bool WorldCheckpointer::Start(const GameState& state, const WorldMeta& meta) {
+    TRACE_SCOPE("WorldCheckpoint");
+    Poll();
+    if (writerPid != 0) return false;
+
+#ifdef ROBBAN_WORLD_FORK
+    pid_t pid = fork();
+    if (pid == 0) {
+        WriteCheckpointAndExit(temporaryPath.c_str(), path.c_str(), state, meta);
+    }
+    if (pid > 0) {
+        writerPid = static_cast<int>(pid);
+        return true;
+    }
+    LOGW(SAVE, "fork() failed, writing the checkpoint in place");
+#endif
+    if (SaveWorld(path, state, meta)) {
+        written++;
+    } else {
+        failed++;
+    }
+    return true;
+}
+
+bool WorldCheckpointer::SaveNow(const GameState& state, const WorldMeta& meta) {
+    Wait();
+    bool ok = SaveWorld(path, state, meta);
+    if (ok) {
+        written++;
+    } else {
+        failed++;
+    }
+    return ok;
+}
+
+void WorldCheckpointer::Poll() {
+#ifdef ROBBAN_WORLD_FORK
+    if (writerPid == 0) return;
+    int status = 0;
+    pid_t done = waitpid(writerPid, &status, WNOHANG);
+    if (done == 0) return;  // Still writing
+    writerPid = 0;
+    if (done > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        written++;
+        LOGD(SAVE, "Checkpoint written to " << path);
+    } else {
+        failed++;
+        LOGW(SAVE, "Checkpoint to " << path << " failed");
+    }
+#endif
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "SimRandom.h"
+#include <cstdint>
+#include <string>
+
+struct GameState;
+
+// Binary world saves, so a host can pick up a forest where it left off.
+//
+// A save is a fixed header followed by fixed-size records: the grid as raw
+// Cell rows, then players, animals, bullets and a block of player names. Loading maps
+// the file and copies the sections straight into the state, a memcpy per
+// grid row, with no parsing. Files are native-endian; one written on a
+// machine with a different byte order fails the magic check.
+//
+// Writes go to path + ".tmp", which then replaces the save in one rename,
+// so a crash mid-write leaves the previous save in place.
+
+// Everything a save holds besides GameState
+struct WorldMeta {
+    float gameTime = 0.0f;
+    int nextAnimalId = 0;
+    SimRandomStreams rng;
+};
+
+bool SaveWorld(const std::string& path, const GameState& state, const WorldMeta& meta);
+// False, leaving state alone, if the file is missing, truncated or from
+// another version. Reuses the capacity already in state
+bool LoadWorld(const std::string& path, GameState& state, WorldMeta& meta);
+
+// The same bytes as a save file, for worlds kept in memory (replay keyframes).
+// out is overwritten, keeping its capacity
+bool EncodeWorld(const GameState& state, const WorldMeta& meta, std::string& out);
+bool DecodeWorld(const char* data, size_t size, GameState& state, WorldMeta& meta);
+
+// Web only: mounts the IndexedDB-backed directory saves are kept in and
+// starts loading its contents. Does nothing natively
+void MountWorldStorage(const char* directory);
+
+// Periodic checkpoints that don't stall the tick. On Linux and macOS each
+// checkpoint is written by a fork()ed child: the kernel gives it a
+// copy-on-write view of the world as it was at the fork, and the
+// simulation carries on while the child writes. Elsewhere the save is
+// written in place, which on the web is a copy into memory followed by an
+// asynchronous flush to IndexedDB.
+class WorldCheckpointer {
+private:
+    std::string path;
+    std::string temporaryPath;
+    int writerPid = 0;  // Child still writing the last checkpoint
+    int written = 0;
+    int failed = 0;
+
+    void Wait();
+
+public:
+    explicit WorldCheckpointer(const std::string& path);
+    ~WorldCheckpointer();  // Waits for a checkpoint that is being written
+
+    // Starts a checkpoint; false if the previous one is still being written
+    bool Start(const GameState& state, const WorldMeta& meta);
+    // Notices finished checkpoints; call every tick or so
+    void Poll();
+    // Waits for a checkpoint being written, then saves in place; for shutdown
+    bool SaveNow(const GameState& state, const WorldMeta& meta);
+    bool IsWriting() const { return writerPid != 0; }
+    int GetWrittenCount() const { return written; }
+    int GetFailedCount() const { return failed; }
+    const std::string& GetPath() const { return path; }
+};
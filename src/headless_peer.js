@@ -0,0 +1,130 @@
+// Stand-in for PeerJS when robban_headless_mt runs under Node (--pre-js).
+// It opens at once, clicks Host, then connects one fake client that plays
+// the client side of the protocol: it takes the id the host assigns, sends
+// moves and counts the state the host sends back, and later disconnects.
+// Everything it does goes through the same callbacks as the browser, so the
+// simulation worker sees PeerJS events only through RunOrDefer and reaches
+// PeerJS only through the __proxy: 'sync' bridge in peer_network.js
+
+(function() {
+    if (typeof process === 'undefined' || typeof Peer !== 'undefined') {
+        return;
+    }
+    // Workers load this file too; only the main thread drives the session
+    if (typeof ENVIRONMENT_IS_PTHREAD !== 'undefined' && ENVIRONMENT_IS_PTHREAD) {
+        return;
+    }
+
+    var argIndex = process.argv.indexOf('--headless');
+    var seconds = argIndex >= 0 && parseFloat(process.argv[argIndex + 1]) > 0 ? parseFloat(process.argv[argIndex + 1]) : 10;
+
+    var ASSIGN_PLAYER_ID = 0, PLAYER_MOVE = 3, GAME_STATE_UPDATE = 6, FULL_GAME_STATE = 9, GAME_STATE_CHUNK = 10;
+    var stats = { assignedId: -1, received: 0, stateMessages: 0, sent: 0, joined: false, left: false };
+
+    function later(ms, fn) {
+        var timer = setTimeout(fn, ms);
+        if (timer.unref) timer.unref();
+        return timer;
+    }
+
+    function Emitter() {
+        this.handlers = {};
+    }
+    Emitter.prototype.on = function(event, fn) {
+        this.handlers[event] = fn;
+    };
+    Emitter.prototype.emit = function(event, arg) {
+        if (this.handlers[event]) this.handlers[event](arg);
+    };
+
+    function hex(value, digits) {
+        var text = (value >>> 0).toString(16);
+        while (text.length < digits) text = '0' + text;
+        return text;
+    }
+
+    function FakeConnection(peerId) {
+        Emitter.call(this);
+        this.peer = peerId;
+        this.open = false;
+        this.moveTimer = null;
+    }
+    FakeConnection.prototype = Object.create(Emitter.prototype);
+
+    // What the host sends to the client
+    FakeConnection.prototype.send = function(message) {
+        stats.received++;
+        var type = parseInt(message.substr(0, 2), 16);
+        if (type === ASSIGN_PLAYER_ID) {
+            var match = /"playerId":(\d+)/.exec(message);
+            if (match) stats.assignedId = parseInt(match[1], 10);
+        } else if (type === GAME_STATE_UPDATE || type === FULL_GAME_STATE || type === GAME_STATE_CHUNK) {
+            stats.stateMessages++;
+        }
+    };
+
+    FakeConnection.prototype.close = function() {
+        if (!this.open) return;
+        this.open = false;
+        clearInterval(this.moveTimer);
+        this.emit('close');
+    };
+
+    // Moves as the client would send them, routed to the host
+    FakeConnection.prototype.sendMove = function(step) {
+        if (stats.assignedId < 0) return;
+        var id = stats.assignedId;
+        var body = '{"type":"PLAYER_MOVE","playerId":' + id + ',"x":' + (10 + step % 20) + ',"y":10,"mode":0,"score":0' +
+                   ',"alive":true,"dirX":1,"dirY":0,"username":"headless"}';
+        this.emit('data', hex(PLAYER_MOVE, 2) + hex(id, 2) + hex(1, 8) + body);
+        stats.sent++;
+    };
+
+    function FakePeer() {
+        Emitter.call(this);
+        var peer = this;
+        later(0, function() {
+            peer.emit('open', 'headless-host');
+            Module['_OnHostGameClicked']();
+            later(500, function() { peer.connectClient(); });
+        });
+    }
+    FakePeer.prototype = Object.create(Emitter.prototype);
+
+    FakePeer.prototype.connectClient = function() {
+        var conn = new FakeConnection('headless-client');
+        this.emit('connection', conn);
+        conn.open = true;
+        conn.emit('open');
+        stats.joined = true;
+
+        var step = 0;
+        conn.moveTimer = setInterval(function() { conn.sendMove(step++); }, 100);
+        if (conn.moveTimer.unref) conn.moveTimer.unref();
+
+        // Leave before the run ends, so the host drops the player mid-session
+        later(Math.max(1000, seconds * 700), function() {
+            conn.close();
+            stats.left = true;
+        });
+    };
+
+    FakePeer.prototype.connect = function() {
+        throw new Error('The headless peer only hosts');
+    };
+
+    FakePeer.prototype.destroy = function() {};
+
+    globalThis['Peer'] = FakePeer;
+
+    // The game decides its own exit code; a client that never got an id or
+    // any state fails the run as well
+    process.on('exit', function() {
+        console.log('[HeadlessPeer] client id ' + stats.assignedId + ', ' + stats.received + ' messages received (' +
+                    stats.stateMessages + ' state), ' + stats.sent + ' moves sent' + (stats.left ? ', left' : ''));
+        if (stats.assignedId < 1 || stats.stateMessages === 0 || !stats.left) {
+            console.error('[HeadlessPeer] the fake client was never served');
+            if (!process.exitCode) process.exitCode = 1;
+        }
+    });
+})();
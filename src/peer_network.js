@@ -1,7 +1,9 @@
 // PeerJS WebRTC Networking for Robban Planterar
 // This bridges between Emscripten/WASM and PeerJS for multiplayer
 
-// Emscripten library integration
+// Emscripten library integration. PeerJS lives on the browser main thread;
+// in the pthreads build the __proxy entries run calls made from the
+// simulation worker there, waiting so pointer arguments stay valid
 mergeInto(LibraryManager.library, {
     // Define PeerNetworkState in library scope
     $PeerNetworkState__postset: 'PeerNetworkState = { peer: null, connections: {}, roomId: null, isHost: false };',
@@ -9,6 +11,7 @@ mergeInto(LibraryManager.library, {
 
     // Initialize PeerJS networking
     JS_InitPeerNetwork__deps: ['$PeerNetworkState'],
+    JS_InitPeerNetwork__proxy: 'sync',
     JS_InitPeerNetwork: function() {
         console.log('[PeerNetwork] JS_InitPeerNetwork called');
 
@@ -43,7 +46,7 @@ mergeInto(LibraryManager.library, {
                 Module._OnPeerReady(idPtr);
                 Module._free(idPtr);
             }
-            if(window.updateRoomId) {
+            if (typeof window !== 'undefined' && window.updateRoomId) {
                 window.updateRoomId(id);
             }
         });
@@ -69,10 +72,13 @@ mergeInto(LibraryManager.library, {
 
                 // Notify C++ code with message
                 if (Module._OnNetworkMessage) {
-                    var dataStr = JSON.stringify(data);
+                    // Messages are routed strings with a fixed header, hand them over untouched
+                    var dataStr = (typeof data === 'string') ? data : JSON.stringify(data);
                     var dataPtr = stringToNewUTF8(dataStr);
-                    Module._OnNetworkMessage(dataPtr);
+                    var fromPtr = stringToNewUTF8(conn.peer);
+                    Module._OnNetworkMessage(dataPtr, fromPtr);
                     Module._free(dataPtr);
+                    Module._free(fromPtr);
                 }
             });
 
@@ -102,6 +108,7 @@ mergeInto(LibraryManager.library, {
 
     // Create room (host)
     JS_CreateRoom__deps: ['$PeerNetworkState'],
+    JS_CreateRoom__proxy: 'sync',
     JS_CreateRoom: function() {
         console.log('[PeerNetwork] JS_CreateRoom called');
         PeerNetworkState.isHost = true;
@@ -112,6 +119,7 @@ mergeInto(LibraryManager.library, {
 
     // Join room
     JS_JoinRoom__deps: ['$PeerNetworkState'],
+    JS_JoinRoom__proxy: 'sync',
     JS_JoinRoom: function(roomIdPtr) {
         var roomId = UTF8ToString(roomIdPtr);
         console.log('[PeerNetwork] Connecting to:', roomId);
@@ -146,10 +154,13 @@ mergeInto(LibraryManager.library, {
 
             // Notify C++ code with message
             if (Module._OnNetworkMessage) {
-                var dataStr = JSON.stringify(data);
+                // Messages are routed strings with a fixed header, hand them over untouched
+                var dataStr = (typeof data === 'string') ? data : JSON.stringify(data);
                 var dataPtr = stringToNewUTF8(dataStr);
-                Module._OnNetworkMessage(dataPtr);
+                var fromPtr = stringToNewUTF8(conn.peer);
+                Module._OnNetworkMessage(dataPtr, fromPtr);
                 Module._free(dataPtr);
+                Module._free(fromPtr);
             }
         });
 
@@ -174,19 +185,14 @@ mergeInto(LibraryManager.library, {
 
     // Send message to all peers
     JS_BroadcastMessage__deps: ['$PeerNetworkState'],
+    JS_BroadcastMessage__proxy: 'sync',
     JS_BroadcastMessage: function(messagePtr) {
         var message = UTF8ToString(messagePtr);
-        var messageObj = JSON.parse(message);
-        
-        // Only log non-FULL_GAME_STATE messages to reduce spam
-        if (messageObj.type !== 'FULL_GAME_STATE') {
-            console.log('[PeerNetwork] Broadcasting:', messageObj.type);
-        }
 
         for (var peerId in PeerNetworkState.connections) {
             if (PeerNetworkState.connections.hasOwnProperty(peerId)) {
                 try {
-                    PeerNetworkState.connections[peerId].send(messageObj);
+                    PeerNetworkState.connections[peerId].send(message);
                 } catch (e) {
                     console.error('[PeerNetwork] Error sending to', peerId, ':', e);
                 }
@@ -196,16 +202,14 @@ mergeInto(LibraryManager.library, {
 
     // Send message to a specific peer
     JS_SendMessageTo__deps: ['$PeerNetworkState'],
+    JS_SendMessageTo__proxy: 'sync',
     JS_SendMessageTo: function(peerIdPtr, messagePtr) {
         var peerId = UTF8ToString(peerIdPtr);
         var message = UTF8ToString(messagePtr);
-        console.log('[PeerNetwork] Sending message to ' + peerId + ':', message);
-
-        var messageObj = JSON.parse(message);
 
         if (PeerNetworkState.connections.hasOwnProperty(peerId)) {
             try {
-                PeerNetworkState.connections[peerId].send(messageObj);
+                PeerNetworkState.connections[peerId].send(message);
             } catch (e) {
                 console.error('[PeerNetwork] Error sending to', peerId, ':', e);
             }
@@ -216,6 +220,7 @@ mergeInto(LibraryManager.library, {
 
     // Get room ID
     JS_GetRoomId__deps: ['$PeerNetworkState'],
+    JS_GetRoomId__proxy: 'sync',
     JS_GetRoomId: function(buffer, bufferSize) {
         var roomId = PeerNetworkState.roomId;
         if (roomId) {
@@ -227,12 +232,14 @@ mergeInto(LibraryManager.library, {
 
     // Get connection count
     JS_GetConnectionCount__deps: ['$PeerNetworkState'],
+    JS_GetConnectionCount__proxy: 'sync',
     JS_GetConnectionCount: function() {
         return Object.keys(PeerNetworkState.connections).length;
     },
 
     // Disconnect
     JS_DisconnectPeer__deps: ['$PeerNetworkState'],
+    JS_DisconnectPeer__proxy: 'sync',
     JS_DisconnectPeer: function() {
         for (var peerId in PeerNetworkState.connections) {
             if (PeerNetworkState.connections.hasOwnProperty(peerId)) {
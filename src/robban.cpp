@@ -2,6 +2,23 @@
 #include "NetworkManager.h"
 #include "GameState.h"
 #include "FirebaseReporter.h"
+#include "SnapshotScheduler.h"
+#include "Lockstep.h"
+#include "SimRandom.h"
+#include "StateHash.h"
+#include "SpriteBatch.h"
+#include "RenderSnapshot.h"
+#include "ThreadHandoff.h"
+#include "FramePacer.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Log.h"
+#include "AllocTracker.h"
+#include "FlatMap.h"
+#include "FrameArena.h"
+#include "FanoutBenchmark.h"
+#include "WorldSave.h"
+#include "ReplayJournal.h"
 #include <vector>
 #include <map>
 #include <random>
@@ -9,9 +26,17 @@
 #include <memory>
 #include <string>
 #include <algorithm>
-#include <iostream>
 #include <stdint.h>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <atomic>
+
+#ifdef PLATFORM_WEB
+#include <emscripten.h>
+#endif
 
 // Global username
 std::string globalUsername = "Player";
@@ -77,7 +102,7 @@ public:
         spriteSheet = LoadTexture("robban.png");
         if (spriteSheet.id > 0) {
             spritesLoaded = true;
-            std::cout << "Sprite test: loaded " << spriteSheet.width << "x" << spriteSheet.height << std::endl;
+            LOGI(ASSETS, "Sprite test: loaded " << spriteSheet.width << "x" << spriteSheet.height);
         }
     }
     
@@ -159,11 +184,25 @@ int main() {
 const int GRID_WIDTH = 30;     // Reduced from 40
 const int GRID_HEIGHT = 20;    // Reduced from 30
 const int CELL_SIZE = 40;      // Doubled from 20
-const int WINDOW_WIDTH = GRID_WIDTH * CELL_SIZE;   // Now 1200px
-const int WINDOW_HEIGHT = GRID_HEIGHT * CELL_SIZE; // Now 800px
+const int WINDOW_WIDTH = 1200;  // Independent of the grid, the camera scrolls over larger maps
+const int WINDOW_HEIGHT = 800;
+const float CAMERA_MIN_ZOOM = 0.5f;
+const float CAMERA_MAX_ZOOM = 3.0f;
+const int TERRAIN_TILE_CELLS = INTEREST_CHUNK_SIZE;  // Cells per side of a cached terrain texture
+const int TERRAIN_TILES_X = (GRID_WIDTH + TERRAIN_TILE_CELLS - 1) / TERRAIN_TILE_CELLS;
+const int TERRAIN_TILES_Y = (GRID_HEIGHT + TERRAIN_TILE_CELLS - 1) / TERRAIN_TILE_CELLS;
 const float TREE_GROWTH_TIME = 10.0f; // seconds
-const float ANIMAL_SPAWN_RATE = 0.02f; // probability per frame
+const float ANIMAL_SPAWN_RATE = 0.02f; // probability per simulation tick
 const int MAX_ANIMALS = 15;    // Reduced proportionally
+const float STATE_HASH_INTERVAL = 2.0f; // seconds between client hash reports to the host
+const int SIM_TICK_RATE = 60;          // Default simulation ticks per second (--sim-hz)
+const float ROTATION_EASE_RATE = 12.0f; // Player facing catches up at this rate (1/s)
+const int MINIMAP_MAX_SIZE = 200;      // Screen pixels; the minimap is scaled by whole pixels to fit
+const int EXPECTED_BULLETS = 64;       // Bullets in flight that fit before the list has to grow
+const int ALLOC_CHECK_WARMUP_TICKS = 600; // --alloc-check: ticks for buffers to reach their working size
+const int ALLOC_CHECK_BOT_ID = 1;
+const float WORLD_CHECKPOINT_INTERVAL = 30.0f; // seconds between background saves of a hosted world
+const int JOURNAL_KEYFRAME_TICKS = 600;       // Session journal keyframe every 10 s at the default tick rate
 
 // Player colors
 const Color PLAYER_COLORS[] = {
@@ -171,22 +210,103 @@ const Color PLAYER_COLORS[] = {
 };
 
 
+// Peers must see every cell the camera can show around their player: a full
+// view at the widest zoom, since the view stops scrolling at the map edges
+static InterestConfig GameInterestConfig() {
+    InterestConfig config;
+    config.marginX = static_cast<int>(std::ceil(WINDOW_WIDTH / (CELL_SIZE * CAMERA_MIN_ZOOM)));
+    config.marginY = static_cast<int>(std::ceil(WINDOW_HEIGHT / (CELL_SIZE * CAMERA_MIN_ZOOM)));
+    return config;
+}
+
 class RobbanPlanterar {
 private:
     GameState gameState;
     int localPlayerId = 0;
-    std::mt19937 rng;
+    SimRandomStreams rng;
+    StateHash stateHash{GRID_WIDTH, GRID_HEIGHT};  // Kept current by every mutation below
+    float lastStateHashTime = 0.0f;
     float gameTime = 0.0f;
     int nextAnimalId = 0;
-    // Sprite sheet
-    Texture2D spriteSheet;
+    // Sprite atlas built from robban.png at load time
+    Texture2D spriteAtlas;
+    Rectangle atlasRects[2][SPRITE_COUNT] = {};  // [0] = cell size, [1] = 2x for HiDPI
+    int atlasLevel = 0;
     bool spritesLoaded = false;
+    SpriteBatch spriteBatch;  // Every world-space quad goes through here, flushed once per pass
+    
+    // Render stress test (--stress N): extra sprites that are drawn but not simulated
+    std::vector<RenderAnimal> stressSprites;
+    float stressFrameTime = 0.0f;
+    int stressFrames = 0;
+    float stressReportTimer = 0.0f;
+    
+    // Allocation check (--alloc-check N): a bot joins over the loopback
+    // transport and both players act at random; after a warm-up, N ticks in a
+    // row must get through Simulate() and PublishSnapshot() without the heap
+    int allocCheckTicks = 0;
+    int allocCheckTick = 0;
+    int allocCheckFailures = 0;
+    int allocCheckResult = -1;  // Process exit code once the check is over
+    SimRandom allocCheckRandom{12345, 1};
+    Player allocCheckBot;       // The bot's own view of itself, as a client would keep it
+    
+    // Headless run (--headless N), counted on the thread standing in for the renderer
+    double headlessEnd = 0.0;
+    float headlessGameTime = 0.0f;
+    int headlessFrames = 0;
+    int headlessSnapshots = 0;
+    int headlessPlayers = 0;
+    int headlessDroppedInputs = 0;
+    int headlessErrors = 0;
+    uint32_t headlessMessages = 0;
+    
+    // Terrain and vegetation are cached in textures of TERRAIN_TILE_CELLS
+    // square cells, kept only for the tiles in and around the view. Only
+    // cells that differ from what a tile last drew are redrawn, the rest is a
+    // blit per tile per frame
+    struct TerrainTile {
+        int tileX = 0, tileY = 0;
+        RenderTexture2D texture = {};
+        bool fresh = true;                      // Nothing drawn into it yet
+        std::vector<uint64_t> drawnRowVersions; // Per tile row
+        std::vector<Cell> drawnCells;           // Row-major within the tile
+    };
+    struct TileRange {
+        int minX, minY, maxX, maxY;  // Inclusive
+        bool Contains(int x, int y) const { return x >= minX && x <= maxX && y >= minY && y <= maxY; }
+    };
+    std::vector<TerrainTile> terrainTiles;
+    std::vector<int> terrainTileSlots = std::vector<int>(TERRAIN_TILES_X * TERRAIN_TILES_Y, -1);  // Index into terrainTiles
+    std::vector<RenderTexture2D> spareTerrainTextures;  // Given back by tiles that left the view
+    uint64_t drawnGridVersion = 0;
+    uint64_t gridVersion = 1;  // Bumped on every grid change, tells the renderer to look for dirty cells
+    std::vector<uint64_t> rowVersions = std::vector<uint64_t>(GRID_HEIGHT, 1);  // gridVersion of each row's last change
+    
+    // Overview map with one pixel per cell. Only rows whose version changed
+    // are rewritten in minimapImage and uploaded with UpdateTextureRec, so
+    // the per-frame cost follows the changed rows, not the map size
+    Image minimapImage = {};
+    Texture2D minimapTexture = {};
+    std::vector<uint64_t> minimapRowVersions;
+    uint64_t minimapGridVersion = 0;
+    bool showMinimap = true;
+    
+    // Viewport following the local player; drawing is culled to visibleCells
+    Camera2D camera = {};
+    struct CellRange {
+        int minX, minY, maxX, maxY;  // Inclusive
+    } visibleCells = {0, 0, GRID_WIDTH - 1, GRID_HEIGHT - 1};
     
     // Sound effects
     Sound shootSound;
     Sound axeSound;
     bool soundsLoaded = false;
     bool audioResumed = false;
+    uint32_t shootSoundCount = 0;  // Requested by the simulation, played by the renderer
+    uint32_t axeSoundCount = 0;
+    uint32_t playedShootSounds = 0;
+    uint32_t playedAxeSounds = 0;
     
     // Networking
     std::unique_ptr<NetworkManager> networkManager;
@@ -194,6 +314,103 @@ private:
     bool isHost = false;
     bool playerIdAssigned = false;  // Track if player ID has been assigned
     
+    // Host-side per-peer snapshot scheduling (replaces the periodic full state broadcast)
+    std::unique_ptr<SnapshotScheduler> snapshotScheduler;
+    float lastSnapshotTime = 0.0f;
+    std::vector<int> snapshotPeers;  // Reused every send, like the packet
+    std::string snapshotPacket;
+    std::vector<ChunkHash> reportedChunks;
+    GameStateChanges fullStateChanges;  // What the last FULL_GAME_STATE changed
+    
+    // World saves (--world on native, IndexedDB on the web): a host resumes
+    // the saved world and checkpoints it in the background while it plays
+    std::unique_ptr<WorldCheckpointer> worldCheckpointer;
+    bool worldResumed = false;  // Only the first time we become host
+    float lastCheckpointTime = 0.0f;
+    
+    // Session journal (--journal, see ReplayJournal.h): keyframes plus every
+    // input and network event that changed the world while it was ours to run
+    JournalWriter journal;
+    int journalTick = 0;              // TICK records written
+    bool journalKeyframeDue = true;   // The world was replaced; the next tick starts with a keyframe
+    bool headless = false;            // Replaying (--replay): no window, sprites or sound
+    
+    // Scratch memory for the current Simulate() call, reset at its start
+    FrameArena frameArena;
+    
+    // Deterministic lockstep mode: peers exchange inputs instead of state (null when off)
+    std::unique_ptr<LockstepSession> lockstep;
+    float lockstepAccumulator = 0.0f;
+    std::vector<int> lockstepRemovals;  // Players leaving on the tick being simulated
+    std::vector<int> lockstepJoins;     // Players joining on the tick being simulated
+    std::vector<int> lockstepWaiting;   // Host: connected during lockstep, not in the session yet
+    std::string lockstepWorld;          // Host: the world a joining peer starts from
+    bool lockstepWorldPending = false;  // Joined a running session; waiting for LOCKSTEP_WORLD
+    PlayerInput pendingInput = {};  // Local input merged until its tick is submitted
+    
+    // Fixed-step simulation outside lockstep. The renderer draws between the
+    // previous and current tick, so the tick rate can be lower than the
+    // display rate without movement snapping from cell to cell. simAlpha is
+    // how far the simulation is towards the next tick; it goes out in the
+    // snapshot, and the renderer works out its own alpha from there
+    float simTickDuration = 1.0f / SIM_TICK_RATE;
+    float simAccumulator = 0.0f;
+    float simAlpha = 1.0f;
+    // Most a frame may catch up on after a stall, beyond the usual five ticks.
+    // The single-threaded loop raises it to cover its own frame interval, so
+    // an idle single-player game at a few frames a second still runs at full speed
+    float simCatchUp = 0.0f;
+    struct PreviousPose {
+        int x, y;
+        float rotation;
+    };
+    FlatMap<int, PreviousPose> previousPlayers;  // State at the start of the current tick
+    FlatMap<int, PreviousPose> previousAnimals;
+    
+    // Simulation/render split. The simulation publishes a RenderSnapshot after
+    // each step and only learns about input through frameInputs; Draw() only
+    // reads the latest snapshot. With --threaded (native) or in the pthreads web
+    // build the simulation runs on simThread, otherwise Update() does both
+    // halves on the main thread
+    struct FrameInput {
+        PlayerInput player;
+        bool host, join, lockstep;
+    };
+    TripleBuffer<RenderSnapshot> renderSnapshots;
+    SpscQueue<FrameInput, 64> frameInputs;
+    std::thread simThread;
+    std::atomic<bool> simRunning{false};
+    double lastUpdateAt = 0.0;
+    
+    // Adaptive frame pacing (on unless --fixed-fps): frames are only drawn
+    // when the picture changed. The simulation numbers its snapshots by
+    // content; the render side remembers what it last drew.
+    bool adaptiveFrames = false;
+    FramePacer framePacer;
+    uint64_t publishedContentHash = 0;
+    uint64_t publishedContentVersion = 0;
+    uint64_t drawnContentVersion = ~0ull;
+    bool drawnAudioResumed = false;
+    uint32_t seenNetworkMessages = 0;
+    bool frameChangedView = false;  // Input this frame that changes what is drawn
+    bool frameUserActive = false;   // Any input at all, including mouse movement
+    #ifdef PLATFORM_WEB
+    bool webLoopIdle = false;
+    #endif
+    
+    // Registered once here; recording is a few relaxed atomic ops
+    Histogram& animalsTime = Metrics().GetHistogram("robban_subsystem_seconds", "Time spent per tick (per frame for draw), by subsystem",
+                                                    TIMING_BUCKETS, "subsystem=\"animals\"");
+    Histogram& treesTime = Metrics().GetHistogram("robban_subsystem_seconds", "", TIMING_BUCKETS, "subsystem=\"trees\"");
+    Histogram& bulletsTime = Metrics().GetHistogram("robban_subsystem_seconds", "", TIMING_BUCKETS, "subsystem=\"bullets\"");
+    Histogram& drawTime = Metrics().GetHistogram("robban_subsystem_seconds", "", TIMING_BUCKETS, "subsystem=\"draw\"");
+    Gauge& playersGauge = Metrics().GetGauge("robban_players", "Players in the game");
+    Gauge& animalsGauge = Metrics().GetGauge("robban_animals", "Animals alive");
+    Gauge& bulletsGauge = Metrics().GetGauge("robban_bullets", "Bullets in flight");
+    Gauge& peersGauge = Metrics().GetGauge("robban_peers", "Connected network peers");
+    Counter& framesDrawnCounter = Metrics().GetCounter("robban_frames_total", "Frames presented", "result=\"drawn\"");
+    Counter& framesSkippedCounter = Metrics().GetCounter("robban_frames_total", "", "result=\"skipped\"");
+    
     // Firebase reporting (firebaseReporter and currentRoom moved to public for callbacks)
     bool firebaseReportingEnabled = false;
     
@@ -203,13 +420,56 @@ private:
 
     // Sprite helper functions - MUST be defined before other functions that use them
     void LoadSprites() {
-        spriteSheet = LoadTexture("robban.png");
-        if (spriteSheet.id > 0) {
-            spritesLoaded = true;
-            std::cout << "Sprite sheet loaded successfully: " << spriteSheet.width << "x" << spriteSheet.height << std::endl;
-        } else {
-            std::cout << "Warning: Could not load robban.png, using fallback graphics" << std::endl;
+        Image sheet = LoadImage("robban.png");
+        if (sheet.data == nullptr) {
+            LOGW(ASSETS, "Could not load robban.png, using fallback graphics");
             spritesLoaded = false;
+            return;
+        }
+        
+        // Resample every sprite once, at cell size and at 2x for HiDPI, into one
+        // small atlas instead of downscaling ~350px regions of the sheet per draw
+        const int padding = 2; // Keeps filtering from bleeding between sprites
+        int atlasWidth = SPRITE_COUNT * (CELL_SIZE * 2 + padding);
+        int atlasHeight = CELL_SIZE + padding + CELL_SIZE * 2;
+        Image atlas = GenImageColor(atlasWidth, atlasHeight, BLANK);
+        
+        for (int level = 0; level < 2; level++) {
+            int size = CELL_SIZE * (level + 1);
+            int rowY = (level == 0) ? 0 : CELL_SIZE + padding;
+            for (int i = 0; i < SPRITE_COUNT; i++) {
+                SpriteRect rect = spriteRects[i];
+                atlasRects[level][i] = {0.0f, 0.0f, 0.0f, 0.0f};
+                
+                // Validate sprite coordinates are within the sheet
+                if (rect.x + rect.width > sheet.width || rect.y + rect.height > sheet.height) {
+                    LOGW(ASSETS, "Sprite " << i << " coordinates (" << rect.x << "," << rect.y
+                                 << " " << rect.width << "x" << rect.height << ") out of bounds for texture "
+                                 << sheet.width << "x" << sheet.height);
+                    continue;
+                }
+                
+                Image sprite = ImageFromImage(sheet, {static_cast<float>(rect.x), static_cast<float>(rect.y),
+                                                      static_cast<float>(rect.width), static_cast<float>(rect.height)});
+                ImageResize(&sprite, size, size);
+                Rectangle dest = {static_cast<float>(i * (size + padding)), static_cast<float>(rowY),
+                                  static_cast<float>(size), static_cast<float>(size)};
+                ImageDraw(&atlas, sprite, {0.0f, 0.0f, static_cast<float>(size), static_cast<float>(size)}, dest, WHITE);
+                UnloadImage(sprite);
+                atlasRects[level][i] = dest;
+            }
+        }
+        
+        spriteAtlas = LoadTextureFromImage(atlas);
+        UnloadImage(atlas);
+        UnloadImage(sheet);
+        
+        spritesLoaded = spriteAtlas.id > 0;
+        atlasLevel = (GetWindowScaleDPI().x > 1.0f) ? 1 : 0;
+        if (spritesLoaded) {
+            LOGI(ASSETS, "Sprite atlas built: " << spriteAtlas.width << "x" << spriteAtlas.height);
+        } else {
+            LOGW(ASSETS, "Could not create sprite atlas, using fallback graphics");
         }
     }
     
@@ -224,70 +484,56 @@ private:
         // Check if sounds loaded successfully
         if (shootSound.frameCount > 0 && axeSound.frameCount > 0) {
             soundsLoaded = true;
-            std::cout << "Sound effects loaded successfully" << std::endl;
+            LOGI(AUDIO, "Sound effects loaded successfully");
         } else {
             soundsLoaded = false;
-            std::cout << "Warning: Could not load sound effects" << std::endl;
+            LOGW(AUDIO, "Could not load sound effects");
         }
     }
     
-    void DrawSprite(SpriteIndex index, int x, int y, Color tint = WHITE, bool flipX = false, float rotation = 0.0f) {
-        if (!spritesLoaded || spriteSheet.id == 0) return;
+    void DrawSprite(SpriteLayer layer, SpriteIndex index, float x, float y, Color tint = WHITE, bool flipX = false) {
+        if (!spritesLoaded || spriteAtlas.id == 0) return;
         
-        SpriteRect rect = spriteRects[index];
-        
-        // Validate sprite coordinates are within texture bounds
-        if (rect.x + rect.width > spriteSheet.width || rect.y + rect.height > spriteSheet.height) {
-            std::cout << "Warning: Sprite " << index << " coordinates (" << rect.x << "," << rect.y
-                     << " " << rect.width << "x" << rect.height << ") out of bounds for texture "
-                     << spriteSheet.width << "x" << spriteSheet.height << std::endl;
-            return;
-        }
+        // Sprites that were out of bounds at load time have no atlas entry
+        Rectangle rect = atlasRects[atlasLevel][index];
+        if (rect.width == 0.0f) return;
         
         Rectangle source = {
-            static_cast<float>(rect.x),
-            static_cast<float>(rect.y),
-            static_cast<float>(rect.width) * (flipX ? -1.0f : 1.0f),  // Negative width flips horizontally
-            static_cast<float>(rect.height)
-        };
-        Rectangle dest = {
-            static_cast<float>(x),
-            static_cast<float>(y),
-            static_cast<float>(CELL_SIZE),
-            static_cast<float>(CELL_SIZE)
+            rect.x,
+            rect.y,
+            rect.width * (flipX ? -1.0f : 1.0f),  // Negative width flips horizontally
+            rect.height
         };
+        Rectangle dest = {x, y, static_cast<float>(CELL_SIZE), static_cast<float>(CELL_SIZE)};
         
-        // Debug: print sprite draw info for first few draws
-        static int debugCount = 0;
-        if (debugCount < 5) {
-            std::cout << "Drawing sprite " << index << " from (" << rect.x << "," << rect.y
-                     << ") size " << rect.width << "x" << rect.height << " to (" << x << "," << y << ")" << std::endl;
-            debugCount++;
-        }
-        
-        // Use origin {0,0} to draw sprite at exact position without offset
-        Vector2 origin = {0.0f, 0.0f};
-        DrawTexturePro(spriteSheet, source, dest, origin, rotation * RAD2DEG, tint);
+        spriteBatch.AddSprite(layer, spriteAtlas, source, dest, tint);
     }
 
     void SetupNetworking() {
         networkManager = std::make_unique<NetworkManager>();
+        #ifdef ROBBAN_WEB_THREADS
+        // PeerJS calls back on the browser main thread; the simulation worker picks the events up
+        networkManager->SetDeferEvents(true);
+        #endif
         
         // Set up network callbacks
         networkManager->SetPlayerIdAssignedCallback([this](int playerId) {
             // Only accept player ID assignment once to prevent being overwritten
             if (this->playerIdAssigned) {
-                std::cout << "Ignoring duplicate player ID assignment: " << playerId << std::endl;
+                LOGI(GAME, "Ignoring duplicate player ID assignment: " << playerId);
                 return;
             }
             
             this->playerIdAssigned = true;
             this->localPlayerId = playerId;
-            std::cout << "Assigned player ID: " << playerId << std::endl;
+            LOGI(GAME, "Assigned player ID: " << playerId);
             
             // Enable multiplayer mode when we receive a player ID assignment
             this->isMultiplayer = true;
             this->isHost = (playerId == 0);  // Player 0 is the host
+            if (this->isHost) {
+                this->ResumeSavedWorld();
+            }
             
             // Update Firebase reporter with room ID when we have a network connection
             if (this->firebaseReporter && !this->currentRoom.empty()) {
@@ -305,7 +551,7 @@ private:
                              
                 // Immediately send player update to share username with other players
                 if (this->networkManager && this->networkManager->IsConnected()) {
-                    std::cout << "Sending initial player state with username: " << globalUsername << std::endl;
+                    LOGI(GAME, "Sending initial player state with username: " << globalUsername);
                     this->networkManager->SendPlayerUpdate(this->gameState.players[playerId]);
                 }
             }
@@ -323,38 +569,116 @@ private:
             this->OnPlayerUpdate(update);
         });
         
-        networkManager->SetFullGameStateCallback([this](const GameState& state) {
-            this->OnFullGameState(state);
+        networkManager->SetFullGameStateCallback([this](std::string_view payload) {
+            return this->OnFullGameState(payload);
         });
         
         networkManager->SetPlayerActionCallback([this](const ActionMessage& action) {
             this->OnPlayerAction(action);
         });
+        
+        networkManager->SetStateDeltaCallback([this](const StateDelta& delta) {
+            this->OnStateDelta(delta);
+        });
+        
+        networkManager->SetLockstepStartCallback([this](const LockstepStartMessage& start) {
+            if (!this->isHost) {
+                this->StartLockstep(start);
+            }
+        });
+        
+        networkManager->SetPlayerInputCallback([this](const PlayerInput& input) {
+            if (this->lockstep && input.playerId != this->localPlayerId) {
+                this->lockstep->AddInput(input);
+            }
+        });
+        
+        networkManager->SetStateHashCallback([this](int playerId, uint64_t hash, const std::vector<ChunkHash>& chunks) {
+            if (this->isHost && !this->lockstep) {
+                this->snapshotScheduler->ReconcileHashes(playerId, hash, chunks, this->stateHash, this->gameTime);
+            }
+        });
+        
+        networkManager->SetLockstepLeaveCallback([this](int playerId, int fromTick) {
+            if (this->lockstep) {
+                this->lockstep->RemoveParticipant(playerId, fromTick);
+            }
+        });
+        
+        networkManager->SetLockstepJoinCallback([this](int playerId, int fromTick) {
+            if (this->lockstep) {
+                this->lockstep->AddParticipant(playerId, fromTick);
+            }
+        });
+        
+        networkManager->SetLockstepWorldCallback([this](int tick, std::string_view world) {
+            this->OnLockstepWorld(tick, world);
+        });
+        
+        networkManager->SetStateChecksumCallback([this](int playerId, int tick, uint64_t hash) {
+            if (this->lockstep && playerId != this->localPlayerId) {
+                this->lockstep->ReceiveRemoteChecksum(playerId, tick, hash);
+            }
+        });
     }
     
     void OnPlayerJoin(int playerId) {
-        std::cout << "Player " << playerId << " joined the game" << std::endl;
+        LOGI(GAME, "Player " << playerId << " joined the game");
+        if (lockstep) {
+            // Every peer adds them on the same tick, see StartLockstepJoins and SimulateTick
+            if (isHost) {
+                networkManager->AssignPlayerId(playerId);
+                lockstepWaiting.push_back(playerId);
+                StartLockstepJoins();
+            }
+            return;
+        }
+        if (IsJournaling()) {
+            journal.WriteJoin(playerId);
+        }
         AddPlayer(playerId);
 
         if (networkManager->IsHost()) {
-            networkManager->SendGameState(gameState);
             networkManager->AssignPlayerId(playerId);
-            std::cout << "Sent game state and assigned ID to new player " << playerId << std::endl;
+            // The world streams in chunk by chunk around the new player
+            snapshotScheduler->AddPeer(playerId, gameTime);
+            LOGI(GAME, "Assigned ID to new player " << playerId);
         }
     }
     
     void OnPlayerLeave(int playerId) {
-        std::cout << "Player " << playerId << " left the game" << std::endl;
+        LOGI(GAME, "Player " << playerId << " left the game");
+        snapshotScheduler->RemovePeer(playerId);
+        if (lockstep) {
+            // Every peer drops them from the same tick, see SimulateTick
+            lockstepWaiting.erase(std::remove(lockstepWaiting.begin(), lockstepWaiting.end(), playerId),
+                                  lockstepWaiting.end());
+            if (isHost && (lockstep->IsParticipant(playerId) || lockstep->IsJoining(playerId))) {
+                int fromTick = lockstep->GetRemovalTick(playerId);
+                lockstep->RemoveParticipant(playerId, fromTick);
+                networkManager->SendLockstepLeave(playerId, fromTick);
+            }
+            return;
+        }
+        if (IsJournaling()) {
+            journal.WriteLeave(playerId);
+        }
         RemovePlayer(playerId);
     }
     
     void OnPlayerUpdate(const Player& update) {
         // Don't overwrite local player's state from network updates
         // Local player is controlled by this client
-        if (update.id == localPlayerId) {
+        if (update.id == localPlayerId || lockstep) {
             return;
         }
-        
+        if (IsJournaling()) {
+            journal.WritePlayerUpdate(update);
+        }
+        ApplyPlayerUpdate(update);
+    }
+    
+    void ApplyPlayerUpdate(const Player& update) {
         if (gameState.players.find(update.id) != gameState.players.end()) {
             Player& player = gameState.players[update.id];
             player.x = update.x;
@@ -383,49 +707,354 @@ private:
                 player.username = update.username;
             }
         }
+        stateHash.SetPlayer(gameState.players[update.id]);
     }
     
     void OnPlayerAction(const ActionMessage& action) {
+        // Lockstep actions arrive as inputs
+        if (lockstep) return;
+        if (IsJournaling()) {
+            journal.WriteAction(action);
+        }
         HandlePlayerAction(action.playerId, action.targetX, action.targetY, action.actionType);
     }
     
-    void OnFullGameState(const GameState& state) {
+    bool OnFullGameState(std::string_view payload) {
         // Host doesn't need to apply its own game state broadcasts
+        if (isHost || lockstep) {
+            return true;
+        }
+        // Written straight into gameState; the local player and bullets stay
+        // as they are, bullets being synced via actions. A malformed message
+        // can stop partway, and what it wrote still has to reach the hash
+        // and the dirty rows
+        bool applied = ApplyGameState(payload, gameState, localPlayerId, GRID_WIDTH, GRID_HEIGHT, fullStateChanges);
+        
+        if (!fullStateChanges.cells.empty()) {
+            gridVersion++;
+        }
+        for (const auto& [x, y] : fullStateChanges.cells) {
+            stateHash.SetCell(x, y, gameState.grid[y][x], gameTime);
+            if (y < GRID_HEIGHT) rowVersions[y] = gridVersion;
+        }
+        for (int id : fullStateChanges.players) {
+            stateHash.SetPlayer(gameState.players[id]);
+        }
+        for (int id : fullStateChanges.removedPlayers) {
+            stateHash.RemovePlayer(id);
+        }
+        for (const auto& animal : gameState.animals) {
+            if (std::find(fullStateChanges.animals.begin(), fullStateChanges.animals.end(), animal.id) !=
+                fullStateChanges.animals.end()) {
+                stateHash.SetAnimal(animal, gameTime);
+            }
+        }
+        for (int id : fullStateChanges.removedAnimals) {
+            stateHash.RemoveAnimal(id, gameTime);
+        }
+        return applied;
+    }
+    
+    void OnStateDelta(const StateDelta& delta) {
+        // Host is the source of the updates
         if (isHost) {
             return;
         }
-        // Preserve local player ID and don't overwrite local player data
-        int preservedLocalId = localPlayerId;
-        Player preservedLocalPlayer;
-        bool hasLocalPlayer = gameState.players.find(localPlayerId) != gameState.players.end();
-        if (hasLocalPlayer) {
-            preservedLocalPlayer = gameState.players[localPlayerId];
+        
+        if (delta.reset) {
+            for (int y = 0; y < GRID_HEIGHT; y++) {
+                for (int x = 0; x < GRID_WIDTH; x++) {
+                    if (gameState.grid[y][x].type != CellType::EMPTY) {
+                        SetCell(x, y, CellType::EMPTY, -1, 0.0f);
+                    }
+                }
+            }
+            for (const auto& animal : gameState.animals) {
+                stateHash.RemoveAnimal(animal.id, gameTime);
+            }
+            gameState.animals.clear();
+        }
+        for (const auto& chunk : delta.leftChunks) {
+            ClearChunk(chunk.first, chunk.second);
+        }
+        for (const auto& chunk : delta.enteredChunks) {
+            ClearChunk(chunk.first, chunk.second);
+        }
+        
+        for (const auto& update : delta.cells) {
+            if (update.x < 0 || update.x >= GRID_WIDTH || update.y < 0 || update.y >= GRID_HEIGHT) continue;
+            SetCell(update.x, update.y, update.cell.type, update.cell.playerId, update.cell.growth);
+        }
+        
+        // OnPlayerUpdate skips the local player and adds unknown players
+        for (const auto& player : delta.players) {
+            OnPlayerUpdate(player);
+        }
+        
+        for (const auto& update : delta.animals) {
+            auto it = std::find_if(gameState.animals.begin(), gameState.animals.end(),
+                                   [&](const Animal& a) { return a.id == update.id; });
+            if (it != gameState.animals.end()) {
+                it->x = update.x;
+                it->y = update.y;
+                it->type = update.type;
+            } else {
+                gameState.animals.push_back(update);
+            }
+            stateHash.SetAnimal(update, gameTime);
+        }
+        
+        for (int id : delta.removedAnimals) {
+            stateHash.RemoveAnimal(id, gameTime);
+            gameState.animals.erase(std::remove_if(gameState.animals.begin(), gameState.animals.end(),
+                                                   [id](const Animal& a) { return a.id == id; }),
+                                    gameState.animals.end());
+        }
+    }
+    
+    // Forget everything inside an interest chunk (cells and animals)
+    void ClearChunk(int chunkX, int chunkY) {
+        int startX = chunkX * INTEREST_CHUNK_SIZE;
+        int startY = chunkY * INTEREST_CHUNK_SIZE;
+        int endX = std::min(GRID_WIDTH, startX + INTEREST_CHUNK_SIZE);
+        int endY = std::min(GRID_HEIGHT, startY + INTEREST_CHUNK_SIZE);
+        
+        for (int y = std::max(0, startY); y < endY; y++) {
+            for (int x = std::max(0, startX); x < endX; x++) {
+                if (gameState.grid[y][x].type != CellType::EMPTY) {
+                    SetCell(x, y, CellType::EMPTY, -1, 0.0f);
+                }
+            }
+        }
+        
+        gameState.animals.erase(std::remove_if(gameState.animals.begin(), gameState.animals.end(),
+                                               [&](const Animal& a) {
+                                                   if (a.x >= startX && a.x < endX && a.y >= startY && a.y < endY) {
+                                                       stateHash.RemoveAnimal(a.id, gameTime);
+                                                       return true;
+                                                   }
+                                                   return false;
+                                               }),
+                                gameState.animals.end());
+    }
+    
+    // All cell type/owner changes go through here so the snapshot scheduler and state hash see them
+    void SetCell(int x, int y, CellType type, int playerId, float growth) {
+        Cell& cell = gameState.grid[y][x];
+        cell.type = type;
+        cell.playerId = playerId;
+        cell.growth = growth;
+        stateHash.SetCell(x, y, cell, gameTime);
+        gridVersion++;
+        rowVersions[y] = gridVersion;
+        if (snapshotScheduler) {
+            snapshotScheduler->MarkCellChanged(x, y, gameTime);
+        }
+    }
+    
+    // After the grid was replaced wholesale
+    void MarkGridChanged() {
+        gridVersion++;
+        std::fill(rowVersions.begin(), rowVersions.end(), gridVersion);
+    }
+    
+    // Terrain tiles overlapping the view, grown by margin tiles on each side
+    TileRange VisibleTiles(int margin) const {
+        return {std::max(0, visibleCells.minX / TERRAIN_TILE_CELLS - margin),
+                std::max(0, visibleCells.minY / TERRAIN_TILE_CELLS - margin),
+                std::min(TERRAIN_TILES_X - 1, visibleCells.maxX / TERRAIN_TILE_CELLS + margin),
+                std::min(TERRAIN_TILES_Y - 1, visibleCells.maxY / TERRAIN_TILE_CELLS + margin)};
+    }
+    
+    // World-space rectangle of a tile, cut off at the map edge
+    static Rectangle TerrainTileBounds(int tileX, int tileY) {
+        int startX = tileX * TERRAIN_TILE_CELLS;
+        int startY = tileY * TERRAIN_TILE_CELLS;
+        int width = std::min(TERRAIN_TILE_CELLS, GRID_WIDTH - startX);
+        int height = std::min(TERRAIN_TILE_CELLS, GRID_HEIGHT - startY);
+        return {static_cast<float>(startX * CELL_SIZE), static_cast<float>(startY * CELL_SIZE),
+                static_cast<float>(width * CELL_SIZE), static_cast<float>(height * CELL_SIZE)};
+    }
+    
+    // Cache textures for the tiles next to the view, before they scroll in,
+    // and give back those that scrolled well away (the gap between the two
+    // margins keeps a tile on the boundary from being reloaded every frame).
+    // Texture memory and redraw work follow the window, not the map
+    void UpdateTerrainTiles(const RenderSnapshot& snapshot) {
+        TRACE_SCOPE("UpdateTerrainTiles");
+        if (snapshot.cells.size() != static_cast<size_t>(GRID_WIDTH * GRID_HEIGHT)) return;
+        
+        TileRange keep = VisibleTiles(2);
+        for (size_t i = 0; i < terrainTiles.size();) {
+            if (keep.Contains(terrainTiles[i].tileX, terrainTiles[i].tileY)) {
+                i++;
+                continue;
+            }
+            terrainTileSlots[terrainTiles[i].tileY * TERRAIN_TILES_X + terrainTiles[i].tileX] = -1;
+            spareTerrainTextures.push_back(terrainTiles[i].texture);
+            if (i + 1 < terrainTiles.size()) {
+                terrainTiles[i] = std::move(terrainTiles.back());
+                terrainTileSlots[terrainTiles[i].tileY * TERRAIN_TILES_X + terrainTiles[i].tileX] = static_cast<int>(i);
+            }
+            terrainTiles.pop_back();
+        }
+        
+        bool loaded = false;
+        TileRange wanted = VisibleTiles(1);
+        for (int tileY = wanted.minY; tileY <= wanted.maxY; tileY++) {
+            for (int tileX = wanted.minX; tileX <= wanted.maxX; tileX++) {
+                int& slot = terrainTileSlots[tileY * TERRAIN_TILES_X + tileX];
+                if (slot >= 0) continue;
+                
+                TerrainTile tile;
+                if (!spareTerrainTextures.empty()) {
+                    tile.texture = spareTerrainTextures.back();
+                    spareTerrainTextures.pop_back();
+                } else {
+                    tile.texture = LoadRenderTexture(TERRAIN_TILE_CELLS * CELL_SIZE, TERRAIN_TILE_CELLS * CELL_SIZE);
+                    if (tile.texture.id == 0) continue;  // Drawn cell by cell instead
+                }
+                tile.tileX = tileX;
+                tile.tileY = tileY;
+                tile.drawnRowVersions.assign(TERRAIN_TILE_CELLS, 0);
+                tile.drawnCells.assign(TERRAIN_TILE_CELLS * TERRAIN_TILE_CELLS, Cell());
+                slot = static_cast<int>(terrainTiles.size());
+                terrainTiles.push_back(std::move(tile));
+                loaded = true;
+            }
+        }
+        
+        if (!loaded && snapshot.gridVersion == drawnGridVersion) return;
+        for (TerrainTile& tile : terrainTiles) {
+            RedrawTerrainTile(tile, snapshot);
         }
+        drawnGridVersion = snapshot.gridVersion;
+    }
+    
+    // DrawCell paints its own grass first and stays inside the cell, so a
+    // changed cell can be redrawn without touching its neighbours. Rows that
+    // didn't change since the tile last drew them are skipped outright
+    void RedrawTerrainTile(TerrainTile& tile, const RenderSnapshot& snapshot) {
+        int startX = tile.tileX * TERRAIN_TILE_CELLS;
+        int startY = tile.tileY * TERRAIN_TILE_CELLS;
+        int endX = std::min(GRID_WIDTH, startX + TERRAIN_TILE_CELLS);
+        int endY = std::min(GRID_HEIGHT, startY + TERRAIN_TILE_CELLS);
         
-        // Preserve bullets - they are created via actions which are already synced
-        auto preservedBullets = gameState.bullets;
+        bool drawing = false;
+        for (int y = startY; y < endY; y++) {
+            uint64_t& drawnVersion = tile.drawnRowVersions[y - startY];
+            if (!tile.fresh && snapshot.rowVersions[y] == drawnVersion) continue;
+            drawnVersion = snapshot.rowVersions[y];
+            for (int x = startX; x < endX; x++) {
+                const Cell& cell = snapshot.cells[y * GRID_WIDTH + x];
+                Cell& drawn = tile.drawnCells[(y - startY) * TERRAIN_TILE_CELLS + (x - startX)];
+                if (!tile.fresh && cell.type == drawn.type && cell.playerId == drawn.playerId) continue;
+                if (!drawing) {
+                    // Cells draw at their world position; shift the tile's corner to the texture origin
+                    Camera2D tileCamera = {};
+                    tileCamera.target = {static_cast<float>(startX * CELL_SIZE), static_cast<float>(startY * CELL_SIZE)};
+                    tileCamera.zoom = 1.0f;
+                    BeginTextureMode(tile.texture);
+                    if (tile.fresh) ClearBackground(DARKGREEN);
+                    BeginMode2D(tileCamera);
+                    drawing = true;
+                }
+                DrawCell(x, y, cell);
+                drawn = cell;
+            }
+        }
+        if (drawing) {
+            spriteBatch.Flush();
+            EndMode2D();
+            EndTextureMode();
+        }
+        tile.fresh = false;
+    }
+    
+    static Color MinimapColor(const Cell& cell) {
+        bool owned = cell.playerId >= 0;
+        Color owner = owned ? PLAYER_COLORS[cell.playerId % 8] : GREEN;
+        switch (cell.type) {
+            case CellType::SHRUBBERY:     return LIME;
+            case CellType::TREE_SEEDLING: return ColorBrightness(owner, 0.4f);
+            case CellType::TREE_YOUNG:    return ColorBrightness(owner, 0.15f);
+            case CellType::TREE_MATURE:   return owned ? owner : Color{0, 60, 20, 255};
+            case CellType::GRAVE:         return owned ? ColorBrightness(owner, -0.5f) : GRAY;
+            default:                      return DARKGREEN;
+        }
+    }
+    
+    // Rewrite the minimap pixels of changed rows and upload each run of them
+    void UpdateMinimap(const RenderSnapshot& snapshot) {
+        TRACE_SCOPE("UpdateMinimap");
+        if (snapshot.gridVersion == minimapGridVersion) return;
+        if (snapshot.cells.size() != static_cast<size_t>(GRID_WIDTH * GRID_HEIGHT)) return;
+        if (minimapTexture.id == 0) {
+            minimapImage = GenImageColor(GRID_WIDTH, GRID_HEIGHT, DARKGREEN);
+            minimapTexture = LoadTextureFromImage(minimapImage);
+            if (minimapTexture.id == 0) return;
+            SetTextureFilter(minimapTexture, TEXTURE_FILTER_POINT);
+            minimapRowVersions.assign(GRID_HEIGHT, 0);
+        }
         
-        // Apply the received state
-        gameState = state;
+        Color* pixels = static_cast<Color*>(minimapImage.data);
+        int runStart = -1;
+        for (int y = 0; y <= GRID_HEIGHT; y++) {
+            bool dirty = y < GRID_HEIGHT && snapshot.rowVersions[y] != minimapRowVersions[y];
+            if (dirty) {
+                for (int x = 0; x < GRID_WIDTH; x++) {
+                    pixels[y * GRID_WIDTH + x] = MinimapColor(snapshot.cells[y * GRID_WIDTH + x]);
+                }
+                minimapRowVersions[y] = snapshot.rowVersions[y];
+                if (runStart < 0) runStart = y;
+            } else if (runStart >= 0) {
+                Rectangle rows = {0.0f, static_cast<float>(runStart), static_cast<float>(GRID_WIDTH),
+                                  static_cast<float>(y - runStart)};
+                UpdateTextureRec(minimapTexture, rows, pixels + runStart * GRID_WIDTH);
+                runStart = -1;
+            }
+        }
+        minimapGridVersion = snapshot.gridVersion;
+    }
+    
+    // Minimap in the bottom right corner, with players and the camera's view on top
+    void DrawMinimap(const RenderSnapshot& snapshot) {
+        if (!showMinimap || minimapTexture.id == 0) return;
         
-        // Restore bullets - bullets are synced via actions, not full game state
-        gameState.bullets = preservedBullets;
+        int scale = std::max(1, MINIMAP_MAX_SIZE / std::max(GRID_WIDTH, GRID_HEIGHT));
+        int width = GRID_WIDTH * scale;
+        int height = GRID_HEIGHT * scale;
+        int left = GetScreenWidth() - width - 10;
+        int top = GetScreenHeight() - height - 10;
         
-        // Restore local player if it was preserved
-        if (hasLocalPlayer) {
-            gameState.players[preservedLocalId] = preservedLocalPlayer;
+        DrawRectangle(left - 2, top - 2, width + 4, height + 4, Fade(BLACK, 0.6f));
+        DrawTexturePro(minimapTexture, {0.0f, 0.0f, static_cast<float>(GRID_WIDTH), static_cast<float>(GRID_HEIGHT)},
+                       {static_cast<float>(left), static_cast<float>(top), static_cast<float>(width), static_cast<float>(height)},
+                       {0.0f, 0.0f}, 0.0f, WHITE);
+        for (const auto& player : snapshot.players) {
+            if (!player.alive) continue;
+            DrawRectangle(left + player.x * scale, top + player.y * scale, scale, scale, player.color);
+            if (player.id == snapshot.localPlayerId) {
+                DrawRectangleLines(left + player.x * scale - 1, top + player.y * scale - 1, scale + 2, scale + 2, WHITE);
+            }
         }
+        DrawRectangleLines(left + visibleCells.minX * scale, top + visibleCells.minY * scale,
+                           (visibleCells.maxX - visibleCells.minX + 1) * scale,
+                           (visibleCells.maxY - visibleCells.minY + 1) * scale, Fade(WHITE, 0.7f));
     }
     
     void InitializeGrid() {
         gameState.grid.resize(GRID_HEIGHT, std::vector<Cell>(GRID_WIDTH));
+        gameState.animals.reserve(MAX_ANIMALS);
+        gameState.bullets.reserve(EXPECTED_BULLETS);
+        previousAnimals.reserve(MAX_ANIMALS);
         
         // Add some initial shrubbery (reduced for smaller grid)
         for (int i = 0; i < 60; i++) {  // Reduced from 100
-            int x = rng() % GRID_WIDTH;
-            int y = rng() % GRID_HEIGHT;
+            int x = rng.world.NextInt(GRID_WIDTH);
+            int y = rng.world.NextInt(GRID_HEIGHT);
             if (gameState.grid[y][x].type == CellType::EMPTY) {
-                gameState.grid[y][x].type = CellType::SHRUBBERY;
+                SetCell(x, y, CellType::SHRUBBERY, -1, 0.0f);
             }
         }
     }
@@ -434,36 +1063,40 @@ private:
         Player& player = gameState.players[playerId];
         
         // Spawn in random corner
-        std::vector<std::pair<int, int>> corners = {
+        static const std::pair<int, int> corners[] = {
             {0, 0}, {GRID_WIDTH-1, 0}, {0, GRID_HEIGHT-1}, {GRID_WIDTH-1, GRID_HEIGHT-1}
         };
         
-        auto corner = corners[rng() % corners.size()];
+        auto corner = corners[rng.players.NextInt(4)];
         player.x = corner.first;
         player.y = corner.second;
         player.alive = true;
+        stateHash.SetPlayer(player);
         
         // Clear the spawn location
-        gameState.grid[player.y][player.x].type = CellType::EMPTY;
+        const Cell& spawnCell = gameState.grid[player.y][player.x];
+        SetCell(player.x, player.y, CellType::EMPTY, spawnCell.playerId, spawnCell.growth);
     }
 
     void UpdateAnimals() {
-        // Only host spawns and updates animals
-        if (!isHost) {
+        TRACE_SCOPE("UpdateAnimals");
+        // Only host spawns and updates animals, unless every peer simulates in lockstep
+        if (!isHost && !lockstep) {
             return;
         }
         
         // Spawn new animals
-        if (gameState.animals.size() < MAX_ANIMALS && (rng() % 1000) < (ANIMAL_SPAWN_RATE * 1000)) {
+        if (gameState.animals.size() < MAX_ANIMALS && rng.animals.NextInt(1000) < (ANIMAL_SPAWN_RATE * 1000)) {
             Animal animal;
-            animal.type = (rng() % 2 == 0) ? AnimalType::RABBIT : AnimalType::DEER;
-            animal.x = rng() % GRID_WIDTH;
-            animal.y = rng() % GRID_HEIGHT;
+            animal.type = (rng.animals.NextInt(2) == 0) ? AnimalType::RABBIT : AnimalType::DEER;
+            animal.x = rng.animals.NextInt(GRID_WIDTH);
+            animal.y = rng.animals.NextInt(GRID_HEIGHT);
             animal.id = nextAnimalId++;
-            animal.moveDelay = 0.5f + (rng() % 100) / 100.0f;
+            animal.moveDelay = 0.5f + rng.animals.NextInt(100) / 100.0f;
             
             if (gameState.grid[animal.y][animal.x].type == CellType::EMPTY) {
                 gameState.animals.push_back(animal);
+                stateHash.SetAnimal(animal, gameTime);
             }
         }
 
@@ -475,11 +1108,11 @@ private:
                 int newY = animal.y;
                 
                 // Simple AI: move randomly but prefer cells with food
-                std::vector<std::pair<int, int>> moves = {
+                std::pair<int, int> moves[] = {
                     {0, 1}, {0, -1}, {1, 0}, {-1, 0}
                 };
                 
-                std::shuffle(moves.begin(), moves.end(), rng);
+                rng.animals.Shuffle(moves);
                 
                 for (auto move : moves) {
                     int testX = animal.x + move.first;
@@ -496,9 +1129,7 @@ private:
                             newY = testY;
                             
                             // Eat the vegetation
-                            cell.type = CellType::EMPTY;
-                            cell.playerId = -1;
-                            cell.growth = 0.0f;
+                            SetCell(testX, testY, CellType::EMPTY, -1, 0.0f);
                             break;
                         } else if (cell.type == CellType::EMPTY) {
                             newX = testX;
@@ -510,11 +1141,13 @@ private:
                 animal.x = newX;
                 animal.y = newY;
                 animal.lastMove = gameTime;
+                stateHash.SetAnimal(animal, gameTime);
             }
         }
     }
 
     void UpdateTrees() {
+        TRACE_SCOPE("UpdateTrees");
         for (int y = 0; y < GRID_HEIGHT; y++) {
             for (int x = 0; x < GRID_WIDTH; x++) {
                 Cell& cell = gameState.grid[y][x];
@@ -525,9 +1158,9 @@ private:
                         cell.lastUpdate = gameTime;
                         
                         if (cell.growth >= 0.5f && cell.type == CellType::TREE_SEEDLING) {
-                            cell.type = CellType::TREE_YOUNG;
+                            SetCell(x, y, CellType::TREE_YOUNG, cell.playerId, cell.growth);
                         } else if (cell.growth >= 1.0f && cell.type == CellType::TREE_YOUNG) {
-                            cell.type = CellType::TREE_MATURE;
+                            SetCell(x, y, CellType::TREE_MATURE, cell.playerId, cell.growth);
                         }
                     }
                 }
@@ -562,9 +1195,7 @@ private:
                 
                 Cell& cell = gameState.grid[plantY][plantX];
                 if (cell.type == CellType::EMPTY || cell.type == CellType::SHRUBBERY) {
-                    cell.type = CellType::TREE_SEEDLING;
-                    cell.playerId = playerId;
-                    cell.growth = 0.0f;
+                    SetCell(plantX, plantY, CellType::TREE_SEEDLING, playerId, 0.0f);
                     cell.lastUpdate = gameTime;
                 }
                 break;
@@ -584,15 +1215,12 @@ private:
                 
                 Cell& cell = gameState.grid[chopY][chopX];
                 if (cell.type == CellType::TREE_MATURE) {
-                    cell.type = CellType::EMPTY;
-                    cell.playerId = -1;
-                    cell.growth = 0.0f;
+                    SetCell(chopX, chopY, CellType::EMPTY, -1, 0.0f);
                     player.score += 10;
+                    stateHash.SetPlayer(player);
                     
                     // Play axe sound effect
-                    if (soundsLoaded && audioResumed) {
-                        PlaySound(axeSound);
-                    }
+                    axeSoundCount++;
                 }
                 break;
             }
@@ -620,14 +1248,29 @@ private:
                 gameState.bullets.push_back(bullet);
                 
                 // Play shoot sound effect
-                if (soundsLoaded && audioResumed) {
-                    PlaySound(shootSound);
-                }
+                shootSoundCount++;
                 break;
             }
         }
     }
 
+    void BatchRect(SpriteLayer layer, float x, float y, float width, float height, Color color) {
+        spriteBatch.AddRect(layer, {x, y, width, height}, color);
+    }
+    
+    void BatchCircle(SpriteLayer layer, float centerX, float centerY, float radius, Color color) {
+        spriteBatch.AddCircle(layer, {centerX, centerY}, radius, color);
+    }
+    
+    // Pixel position between the previous and current tick; moves of more than
+    // one cell (respawns, corrections) snap instead of sliding across the map
+    static Vector2 InterpolatePosition(int x, int y, int prevX, int prevY, float alpha) {
+        if (std::abs(prevX - x) > 1 || std::abs(prevY - y) > 1) {
+            return {static_cast<float>(x * CELL_SIZE), static_cast<float>(y * CELL_SIZE)};
+        }
+        return {(prevX + (x - prevX) * alpha) * CELL_SIZE, (prevY + (y - prevY) * alpha) * CELL_SIZE};
+    }
+    
     void DrawCell(int x, int y, const Cell& cell) {
         // Draw background grass
         Rectangle rect = {
@@ -636,7 +1279,7 @@ private:
             static_cast<float>(CELL_SIZE), 
             static_cast<float>(CELL_SIZE)
         };
-        DrawRectangleRec(rect, DARKGREEN);
+        spriteBatch.AddRect(SpriteLayer::TERRAIN, rect, DARKGREEN);
         
         switch (cell.type) {
             case CellType::EMPTY:
@@ -645,22 +1288,22 @@ private:
                 
             case CellType::SHRUBBERY:
                 // Draw more detailed vegetation as multiple green patches
-                DrawRectangle(x * CELL_SIZE + 8, y * CELL_SIZE + 8, CELL_SIZE - 16, CELL_SIZE - 16, GREEN);
-                DrawRectangle(x * CELL_SIZE + 4, y * CELL_SIZE + 12, 8, 8, LIME);
-                DrawRectangle(x * CELL_SIZE + CELL_SIZE - 12, y * CELL_SIZE + 6, 6, 6, LIME);
+                BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 8, y * CELL_SIZE + 8, CELL_SIZE - 16, CELL_SIZE - 16, GREEN);
+                BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 4, y * CELL_SIZE + 12, 8, 8, LIME);
+                BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + CELL_SIZE - 12, y * CELL_SIZE + 6, 6, 6, LIME);
                 break;
                 
             case CellType::TREE_SEEDLING:
                 if (spritesLoaded) {
                     // Small tree sprite with player color tint
                     Color tint = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : WHITE;
-                    DrawSprite(SPRITE_TREE_SMALL, x * CELL_SIZE, y * CELL_SIZE, tint);
+                    DrawSprite(SpriteLayer::TERRAIN, SPRITE_TREE_SMALL, x * CELL_SIZE, y * CELL_SIZE, tint);
                 } else {
                     // Better fallback: small tree shape
                     Color treeColor = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : GREEN;
                     // Draw a small tree-like shape
-                    DrawRectangle(x * CELL_SIZE + 18, y * CELL_SIZE + 28, 4, 8, BROWN); // trunk
-                    DrawCircle(x * CELL_SIZE + 20, y * CELL_SIZE + 24, 8, treeColor);   // leaves
+                    BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 18, y * CELL_SIZE + 28, 4, 8, BROWN); // trunk
+                    BatchCircle(SpriteLayer::TERRAIN, x * CELL_SIZE + 20, y * CELL_SIZE + 24, 8, treeColor);   // leaves
                 }
                 break;
                 
@@ -668,13 +1311,13 @@ private:
                 if (spritesLoaded) {
                     // Medium tree sprite with player color tint
                     Color tint = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : WHITE;
-                    DrawSprite(SPRITE_TREE_SMALL, x * CELL_SIZE, y * CELL_SIZE, tint);
+                    DrawSprite(SpriteLayer::TERRAIN, SPRITE_TREE_SMALL, x * CELL_SIZE, y * CELL_SIZE, tint);
                 } else {
                     // Better fallback: medium tree shape
                     Color treeColor = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : GREEN;
                     // Draw a medium tree-like shape
-                    DrawRectangle(x * CELL_SIZE + 16, y * CELL_SIZE + 24, 8, 12, BROWN); // trunk
-                    DrawCircle(x * CELL_SIZE + 20, y * CELL_SIZE + 18, 12, treeColor);   // leaves
+                    BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 16, y * CELL_SIZE + 24, 8, 12, BROWN); // trunk
+                    BatchCircle(SpriteLayer::TERRAIN, x * CELL_SIZE + 20, y * CELL_SIZE + 18, 12, treeColor);   // leaves
                 }
                 break;
                 
@@ -682,25 +1325,25 @@ private:
                 if (spritesLoaded) {
                     // Large tree sprite with player color tint
                     Color tint = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : WHITE;
-                    DrawSprite(SPRITE_TREE_LARGE, x * CELL_SIZE, y * CELL_SIZE, tint);
+                    DrawSprite(SpriteLayer::TERRAIN, SPRITE_TREE_LARGE, x * CELL_SIZE, y * CELL_SIZE, tint);
                 } else {
                     // Better fallback: large tree shape
                     Color treeColor = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : GREEN;
                     // Draw a large tree-like shape
-                    DrawRectangle(x * CELL_SIZE + 14, y * CELL_SIZE + 20, 12, 16, BROWN); // trunk
-                    DrawCircle(x * CELL_SIZE + 20, y * CELL_SIZE + 12, 16, treeColor);     // leaves
-                    DrawCircle(x * CELL_SIZE + 16, y * CELL_SIZE + 16, 10, treeColor);     // extra leaves
-                    DrawCircle(x * CELL_SIZE + 24, y * CELL_SIZE + 16, 10, treeColor);     // extra leaves
+                    BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 14, y * CELL_SIZE + 20, 12, 16, BROWN); // trunk
+                    BatchCircle(SpriteLayer::TERRAIN, x * CELL_SIZE + 20, y * CELL_SIZE + 12, 16, treeColor);     // leaves
+                    BatchCircle(SpriteLayer::TERRAIN, x * CELL_SIZE + 16, y * CELL_SIZE + 16, 10, treeColor);     // extra leaves
+                    BatchCircle(SpriteLayer::TERRAIN, x * CELL_SIZE + 24, y * CELL_SIZE + 16, 10, treeColor);     // extra leaves
                 }
                 break;
             
             case CellType::GRAVE: {
                 // Draw a more detailed tombstone-like shape (scaled up)
                 Color graveColor = (cell.playerId >= 0) ? PLAYER_COLORS[cell.playerId % 8] : GRAY;
-                DrawRectangle(x * CELL_SIZE + 12, y * CELL_SIZE + 8, 16, 24, graveColor);
-                DrawRectangle(x * CELL_SIZE + 8, y * CELL_SIZE + 20, 24, 12, graveColor);
+                BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 12, y * CELL_SIZE + 8, 16, 24, graveColor);
+                BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 8, y * CELL_SIZE + 20, 24, 12, graveColor);
                 // Add some detail
-                DrawRectangle(x * CELL_SIZE + 14, y * CELL_SIZE + 12, 12, 2, DARKGRAY);
+                BatchRect(SpriteLayer::TERRAIN, x * CELL_SIZE + 14, y * CELL_SIZE + 12, 12, 2, DARKGRAY);
                 break;
             }
             
@@ -711,17 +1354,11 @@ private:
         }
     }
 
-    void DrawPlayer(const Player& player) {
+    void DrawPlayer(const RenderPlayer& player, float alpha) {
         if (!player.alive) return;
         
-        // Draw grass background first
-        Rectangle rect = {
-            static_cast<float>(player.x * CELL_SIZE),
-            static_cast<float>(player.y * CELL_SIZE),
-            static_cast<float>(CELL_SIZE),
-            static_cast<float>(CELL_SIZE)
-        };
-        DrawRectangleRec(rect, DARKGREEN);
+        Vector2 position = InterpolatePosition(player.x, player.y, player.prevX, player.prevY, alpha);
+        Rectangle rect = {position.x, position.y, static_cast<float>(CELL_SIZE), static_cast<float>(CELL_SIZE)};
         
         // Draw appropriate player sprite based on mode
         if (spritesLoaded) {
@@ -742,91 +1379,76 @@ private:
             bool flipX = (player.lastDirectionX < 0);
             
             // Draw player sprite with color tint and flip if moving left
-            DrawSprite(spriteIndex, player.x * CELL_SIZE, player.y * CELL_SIZE, player.color, flipX);
+            DrawSprite(SpriteLayer::PLAYERS, spriteIndex, position.x, position.y, player.color, flipX);
         } else {
-            // Fallback: colored rectangle with mode indicator
-            DrawRectangleRec(rect, player.color);
-            
-            const char* modeChar = "P";
-            if (player.mode == PlayerMode::SHOOT) modeChar = "S";
-            else if (player.mode == PlayerMode::CHOP) modeChar = "C";
-            
-            DrawText(modeChar, player.x * CELL_SIZE + 2, player.y * CELL_SIZE + 2, 16, BLACK);
+            // Fallback: colored rectangle, the mode letter is drawn by DrawPlayerLabel
+            spriteBatch.AddRect(SpriteLayer::PLAYERS, rect, player.color);
         }
         
-        // Draw direction indicator for shooting mode
+        // Draw direction indicator for shooting mode, turning with the eased rotation
         if (player.mode == PlayerMode::SHOOT && (player.lastDirectionX != 0 || player.lastDirectionY != 0)) {
-            int centerX = player.x * CELL_SIZE + CELL_SIZE / 2;
-            int centerY = player.y * CELL_SIZE + CELL_SIZE / 2;
-            int endX = centerX + player.lastDirectionX * 12;
-            int endY = centerY + player.lastDirectionY * 12;
+            float rotation = player.prevRotation + WrapAngle(player.rotation - player.prevRotation) * alpha;
+            Vector2 direction = {std::sin(rotation), -std::cos(rotation)};  // 0 = up
+            Vector2 side = {-direction.y, direction.x};
+            Vector2 center = {position.x + CELL_SIZE / 2.0f, position.y + CELL_SIZE / 2.0f};
+            Vector2 end = {center.x + direction.x * 12.0f, center.y + direction.y * 12.0f};
             
             // Draw aiming line
-            DrawLine(centerX, centerY, endX, endY, RED);
+            spriteBatch.AddLine(SpriteLayer::OVERLAY, center, end, 1.0f, RED);
             
             // Draw arrow head
-            Vector2 v1, v2, v3;
-            if (player.lastDirectionX > 0) { // Right
-                v1 = {static_cast<float>(endX), static_cast<float>(endY)};
-                v2 = {static_cast<float>(endX-4), static_cast<float>(endY-2)};
-                v3 = {static_cast<float>(endX-4), static_cast<float>(endY+2)};
-            } else if (player.lastDirectionX < 0) { // Left
-                v1 = {static_cast<float>(endX), static_cast<float>(endY)};
-                v2 = {static_cast<float>(endX+4), static_cast<float>(endY-2)};
-                v3 = {static_cast<float>(endX+4), static_cast<float>(endY+2)};
-            } else if (player.lastDirectionY > 0) { // Down
-                v1 = {static_cast<float>(endX), static_cast<float>(endY)};
-                v2 = {static_cast<float>(endX-2), static_cast<float>(endY-4)};
-                v3 = {static_cast<float>(endX+2), static_cast<float>(endY-4)};
-            } else if (player.lastDirectionY < 0) { // Up
-                v1 = {static_cast<float>(endX), static_cast<float>(endY)};
-                v2 = {static_cast<float>(endX-2), static_cast<float>(endY+4)};
-                v3 = {static_cast<float>(endX+2), static_cast<float>(endY+4)};
-            }
-            DrawTriangle(v1, v2, v3, RED);
-        }
-    }
-
-    void DrawBullet(const Bullet& bullet) {
-        // Calculate current position
-        float travelTime = gameTime - bullet.startTime;
+            Vector2 back = {end.x - direction.x * 4.0f, end.y - direction.y * 4.0f};
+            Vector2 v2 = {back.x + side.x * 2.0f, back.y + side.y * 2.0f};
+            Vector2 v3 = {back.x - side.x * 2.0f, back.y - side.y * 2.0f};
+            spriteBatch.AddTriangle(SpriteLayer::OVERLAY, end, v2, v3, RED);
+        }
+    }
+
+    // Text is not batched; drawn after the batch so it stays on top of the fallback rectangle
+    void DrawPlayerLabel(const RenderPlayer& player, float alpha) {
+        if (!player.alive || spritesLoaded) return;
+        
+        const char* modeChar = "P";
+        if (player.mode == PlayerMode::SHOOT) modeChar = "S";
+        else if (player.mode == PlayerMode::CHOP) modeChar = "C";
+        
+        Vector2 position = InterpolatePosition(player.x, player.y, player.prevX, player.prevY, alpha);
+        DrawText(modeChar, static_cast<int>(position.x) + 2, static_cast<int>(position.y) + 2, 16, BLACK);
+    }
+
+    void DrawBullet(const RenderBullet& bullet, float renderTime) {
+        // Position at the interpolated render time rather than the last tick
+        float travelTime = std::max(0.0f, renderTime - bullet.startTime);
         float distance = travelTime * 8.0f; // Same speed as UpdateBullets
         
         float currentX = bullet.x * CELL_SIZE + bullet.dirX * distance * CELL_SIZE;
         float currentY = bullet.y * CELL_SIZE + bullet.dirY * distance * CELL_SIZE;
         
         // Draw bullet as a small yellow circle
-        DrawCircle(static_cast<int>(currentX + CELL_SIZE/2), static_cast<int>(currentY + CELL_SIZE/2), 3, YELLOW);
+        spriteBatch.AddCircle(SpriteLayer::BULLETS, {currentX + CELL_SIZE/2, currentY + CELL_SIZE/2}, 3.0f, YELLOW);
     }
 
-    void DrawAnimal(const Animal& animal) {
-        // Draw grass background first
-        Rectangle rect = {
-            static_cast<float>(animal.x * CELL_SIZE), 
-            static_cast<float>(animal.y * CELL_SIZE), 
-            static_cast<float>(CELL_SIZE), 
-            static_cast<float>(CELL_SIZE)
-        };
-        DrawRectangleRec(rect, DARKGREEN);
+    void DrawAnimal(const RenderAnimal& animal, float alpha) {
+        Vector2 position = InterpolatePosition(animal.x, animal.y, animal.prevX, animal.prevY, alpha);
         
         // Draw appropriate animal sprite
         if (spritesLoaded) {
             SpriteIndex spriteIndex = (animal.type == AnimalType::RABBIT) ? SPRITE_RABBIT : SPRITE_DEER;
-            DrawSprite(spriteIndex, animal.x * CELL_SIZE, animal.y * CELL_SIZE);
+            DrawSprite(SpriteLayer::ANIMALS, spriteIndex, position.x, position.y);
         } else {
             // Fallback: colored rectangle
             Color animalColor = (animal.type == AnimalType::RABBIT) ? WHITE : BROWN;
-            DrawRectangle(animal.x * CELL_SIZE + 8, animal.y * CELL_SIZE + 8, CELL_SIZE - 16, CELL_SIZE - 16, animalColor);
+            BatchRect(SpriteLayer::ANIMALS, position.x + 8, position.y + 8, CELL_SIZE - 16, CELL_SIZE - 16, animalColor);
             
             // Add some simple detail for animals
             if (animal.type == AnimalType::RABBIT) {
                 // Rabbit ears
-                DrawRectangle(animal.x * CELL_SIZE + 12, animal.y * CELL_SIZE + 4, 4, 8, WHITE);
-                DrawRectangle(animal.x * CELL_SIZE + 20, animal.y * CELL_SIZE + 4, 4, 8, WHITE);
+                BatchRect(SpriteLayer::ANIMALS, position.x + 12, position.y + 4, 4, 8, WHITE);
+                BatchRect(SpriteLayer::ANIMALS, position.x + 20, position.y + 4, 4, 8, WHITE);
             } else {
                 // Deer antlers
-                DrawRectangle(animal.x * CELL_SIZE + 10, animal.y * CELL_SIZE + 4, 2, 6, BROWN);
-                DrawRectangle(animal.x * CELL_SIZE + 24, animal.y * CELL_SIZE + 4, 2, 6, BROWN);
+                BatchRect(SpriteLayer::ANIMALS, position.x + 10, position.y + 4, 2, 6, BROWN);
+                BatchRect(SpriteLayer::ANIMALS, position.x + 24, position.y + 4, 2, 6, BROWN);
             }
         }
     }
@@ -836,10 +1458,18 @@ public:
     std::unique_ptr<FirebaseReporter> firebaseReporter;
     std::string currentRoom;
     
-    RobbanPlanterar() : rng(std::chrono::steady_clock::now().time_since_epoch().count()) {
+    // A headless game only simulates, for replays; it needs no window
+    explicit RobbanPlanterar(bool headless = false)
+        : rng(std::chrono::steady_clock::now().time_since_epoch().count()), headless(headless) {
+        snapshotScheduler = std::make_unique<SnapshotScheduler>(GRID_WIDTH, GRID_HEIGHT, SnapshotConfig(), GameInterestConfig());
+        ResetPendingInput();
         InitializeGrid();
         SetupNetworking();
+        if (headless) {
+            return;
+        }
         LoadSprites();
+        spriteBatch.Load();
         LoadSounds();
         
         // Initialize Firebase reporter
@@ -847,7 +1477,7 @@ public:
         
         // Enable Firebase reporting on all platforms
         firebaseReportingEnabled = true;
-        std::cout << "[Game] Firebase reporting enabled" << std::endl;
+        LOGI(GAME, "Firebase reporting enabled");
         
         // Don't create a player yet - wait for network initialization
         // The player will be created when:
@@ -857,26 +1487,53 @@ public:
     }
     
     ~RobbanPlanterar() {
+        StopSimulationThread();
+        
+        if (worldCheckpointer && isHost && !lockstep) {
+            worldCheckpointer->SaveNow(gameState, CurrentWorldMeta());
+        }
+        
         // Stop Firebase reporting
         if (firebaseReporter) {
             firebaseReporter->Stop();
         }
         
-        if (spritesLoaded && spriteSheet.id > 0) {
-            UnloadTexture(spriteSheet);
+        if (spritesLoaded && spriteAtlas.id > 0) {
+            UnloadTexture(spriteAtlas);
             spritesLoaded = false;
         }
         
+        spriteBatch.Unload();
+        
+        for (const TerrainTile& tile : terrainTiles) {
+            UnloadRenderTexture(tile.texture);
+        }
+        terrainTiles.clear();
+        for (const RenderTexture2D& texture : spareTerrainTextures) {
+            UnloadRenderTexture(texture);
+        }
+        spareTerrainTextures.clear();
+        
+        if (minimapTexture.id > 0) {
+            UnloadTexture(minimapTexture);
+        }
+        if (minimapImage.data != nullptr) {
+            UnloadImage(minimapImage);
+        }
+        
         if (soundsLoaded) {
             UnloadSound(shootSound);
             UnloadSound(axeSound);
             soundsLoaded = false;
         }
         
-        CloseAudioDevice();
+        if (!headless) {
+            CloseAudioDevice();
+        }
     }
 
     void UpdateBullets() {
+        TRACE_SCOPE("UpdateBullets");
         const float BULLET_SPEED = 8.0f; // cells per second
         const float BULLET_LIFETIME = 2.0f; // seconds
         
@@ -913,7 +1570,9 @@ public:
                     // Hit animal
                     if (gameState.players.find(bullet.playerId) != gameState.players.end()) {
                         gameState.players[bullet.playerId].score += 5;
+                        stateHash.SetPlayer(gameState.players[bullet.playerId]);
                     }
+                    stateHash.RemoveAnimal(animalIt->id, gameTime);
                     gameState.animals.erase(animalIt);
                     bullet.active = false;
                     break;
@@ -931,11 +1590,11 @@ public:
                     otherPlayer.alive = false;
                     if (gameState.players.find(bullet.playerId) != gameState.players.end()) {
                         gameState.players[bullet.playerId].score -= 5;
+                        stateHash.SetPlayer(gameState.players[bullet.playerId]);
                     }
                     
                     // Create grave
-                    gameState.grid[newY][newX].type = CellType::GRAVE;
-                    gameState.grid[newY][newX].playerId = id;
+                    SetCell(newX, newY, CellType::GRAVE, id, gameState.grid[newY][newX].growth);
                     
                     // Respawn the killed player
                     SpawnPlayer(id);
@@ -961,77 +1620,495 @@ public:
         }
     }
 
-    void Update() {
-        gameTime = GetTime();
-
-        // Resume audio context on first user interaction (required for web browsers)
-        #ifdef PLATFORM_WEB
-        if (!audioResumed && soundsLoaded) {
-            // Check if any key is pressed
-            if (GetKeyPressed() != 0 || IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-                // Resume audio context for web
-                audioResumed = true;
-                std::cout << "Audio context resumed after user interaction" << std::endl;
-            }
-        }
-        #else
-        audioResumed = true; // Native platforms don't need this
-        #endif
-
-        // Start Firebase reporting when game starts or when hosting/joining
-        static bool firebaseStarted = false;
-        if (firebaseReportingEnabled && !firebaseStarted && firebaseReporter) {
-            firebaseReporter->Start();
-            firebaseReporter->UpdateGameState(gameState);
-            // firebaseReporter->ReportNow(); // Initial report at startup - removed to report only after room is set
-            firebaseStarted = true;
-            std::cout << "[Game] Firebase reporting started" << std::endl;
+    static PlayerMode NextMode(PlayerMode mode) {
+        switch (mode) {
+            case PlayerMode::PLANT: return PlayerMode::SHOOT;
+            case PlayerMode::SHOOT: return PlayerMode::CHOP;
+            case PlayerMode::CHOP: return PlayerMode::PLANT;
         }
-
-        // Ensure local player exists before accessing
-        if (gameState.players.find(localPlayerId) == gameState.players.end()) {
-            // Player doesn't exist yet, skip this frame
-            return;
+        return PlayerMode::PLANT;
+    }
+    
+    // Reads keyboard and touch into an input without touching the game state
+    PlayerInput PollLocalInput(int playerId, const RenderPlayer& localPlayer) {
+        PlayerInput input = {};
+        input.playerId = playerId;
+        input.mode = -1;
+        
+        if (IsKeyPressed(KEY_P)) {
+            input.mode = static_cast<int>(NextMode(localPlayer.mode));
         }
         
-        Player& localPlayer = gameState.players[localPlayerId];
-
-        // Send network updates only when player state changes
-        static Player lastSentState = {};
-        static bool hasInitialState = false;
+        // Check for movement input
+        if (IsKeyPressed(KEY_W) || IsKeyPressed(KEY_UP)) { input.moveY = -1; }
+        if (IsKeyPressed(KEY_S) || IsKeyPressed(KEY_DOWN)) { input.moveY = 1; }
+        if (IsKeyPressed(KEY_A) || IsKeyPressed(KEY_LEFT)) { input.moveX = -1; }
+        if (IsKeyPressed(KEY_D) || IsKeyPressed(KEY_RIGHT)) { input.moveX = 1; }
         
-        if (isMultiplayer) {
-            bool stateChanged = !hasInitialState ||
-                               lastSentState.x != localPlayer.x ||
-                               lastSentState.y != localPlayer.y ||
-                               lastSentState.mode != localPlayer.mode ||
-                               lastSentState.score != localPlayer.score ||
-                               lastSentState.alive != localPlayer.alive ||
-                               lastSentState.lastDirectionX != localPlayer.lastDirectionX ||
-                               lastSentState.lastDirectionY != localPlayer.lastDirectionY;
-            
-            if (stateChanged) {
-                networkManager->SendPlayerUpdate(localPlayer);
-                lastSentState = localPlayer;
-                hasInitialState = true;
-            }
+        // Action with spacebar
+        if (IsKeyPressed(KEY_SPACE)) {
+            input.action = true;
         }
         
-        // Host sends full game state periodically (every 500ms) to sync animals and other state
-        static float lastGameStateSync = 0.0f;
-        if (isHost && isMultiplayer && gameTime - lastGameStateSync > 0.5f) {
-            networkManager->SendGameState(gameState);
-            lastGameStateSync = gameTime;
-        }
+        // Touch input for mobile
+        if (GetTouchPointCount() > 0) {
+            Vector2 touchPos = GetTouchPosition(0);
+            Vector2 worldPos = GetScreenToWorld2D(touchPos, camera);
+            // Check upper right corner for tool switch
+            if (touchPos.x > WINDOW_WIDTH * 0.75f && touchPos.y < WINDOW_HEIGHT * 0.25f) {
+                input.mode = static_cast<int>(NextMode(localPlayer.mode));
+            }
+            // Check bottom left and bottom right for shoot
+            else if ((touchPos.x < WINDOW_WIDTH * 0.25f && touchPos.y > WINDOW_HEIGHT * 0.75f) ||
+                     (touchPos.x > WINDOW_WIDTH * 0.75f && touchPos.y > WINDOW_HEIGHT * 0.75f)) {
+                input.action = true;
+            }
+            // Check above player for move up
+            else if (worldPos.y < localPlayer.y * CELL_SIZE) {
+                input.moveX = 0;
+                input.moveY = -1;
+            }
+            // Check to the right of player for move right
+            else if (worldPos.x > (localPlayer.x + 1) * CELL_SIZE) {
+                input.moveX = 1;
+                input.moveY = 0;
+            }
+        }
+        
+        return input;
+    }
+    
+    // Applies one player's input; used for the local player on each fixed
+    // step tick and for every player's input on each lockstep tick
+    void ApplyPlayerInput(int playerId, const PlayerInput& input) {
+        auto it = gameState.players.find(playerId);
+        if (it == gameState.players.end()) return;
+        Player& player = it->second;
+        
+        if (input.mode >= 0) {
+            player.mode = static_cast<PlayerMode>(input.mode);
+        }
+        
+        // Apply movement if within bounds
+        if (input.moveX != 0 || input.moveY != 0) {
+            int newX = player.x + input.moveX;
+            int newY = player.y + input.moveY;
+            
+            if (newX >= 0 && newX < GRID_WIDTH && newY >= 0 && newY < GRID_HEIGHT) {
+                player.x = newX;
+                player.y = newY;
+                
+                // Update direction for shooting
+                player.lastDirectionX = input.moveX;
+                player.lastDirectionY = input.moveY;
+                player.lastMove = gameTime;
+            }
+        }
+        
+        stateHash.SetPlayer(player);
+        
+        if (input.action) {
+            HandlePlayerAction(playerId, -1, -1); // Use -1 to indicate current position
+        }
+    }
+    
+    void BeginLockstep() {
+        LockstepConfig defaults;
+        LockstepStartMessage start;
+        start.seed = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        start.tickRate = defaults.tickRate;
+        start.inputDelay = defaults.inputDelay;
+        for (const auto& [id, player] : gameState.players) {
+            start.playerIds.push_back(id);
+        }
+        
+        if (isMultiplayer && networkManager) {
+            networkManager->SendLockstepStart(start);
+        }
+        StartLockstep(start);
+    }
+    
+    void StartLockstep(const LockstepStartMessage& start) {
+        LockstepConfig config;
+        config.tickRate = start.tickRate;
+        config.inputDelay = start.inputDelay;
+        if (start.startTick > 0) {
+            // Joining a running session: our own join arrives as LOCKSTEP_JOIN
+            // like everyone else's, the world as LOCKSTEP_WORLD
+            LOGI(LOCKSTEP, "Joining at tick " << start.startTick << " with " << start.playerIds.size() << " players");
+            lockstep = std::make_unique<LockstepSession>(start.playerIds, config, start.startTick);
+            lockstepAccumulator = 0.0f;
+            lockstepWorldPending = true;
+            ResetPendingInput();
+            return;
+        }
+        
+        LOGI(LOCKSTEP, "Starting with seed " << start.seed << ", " << start.playerIds.size()
+                       << " players, " << start.tickRate << " ticks/s, input delay " << start.inputDelay);
+        
+        lockstep = std::make_unique<LockstepSession>(start.playerIds, config);
+        lockstepAccumulator = 0.0f;
+        lockstepWorldPending = false;
+        ResetPendingInput();
+        
+        // Every peer rebuilds the same world from the shared seed
+        rng.Seed(start.seed);
+        gameTime = 0.0f;
+        nextAnimalId = 0;
+        gameState.grid.clear();
+        gameState.animals.clear();
+        gameState.bullets.clear();
+        InitializeGrid();
+        
+        for (auto it = gameState.players.begin(); it != gameState.players.end();) {
+            if (std::find(start.playerIds.begin(), start.playerIds.end(), it->first) == start.playerIds.end()) {
+                it = gameState.players.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (int playerId : lockstep->GetParticipants()) {
+            // Not AddPlayer: that would spawn (and draw from the RNG) only on peers missing the player
+            Player& player = gameState.players[playerId];
+            player.id = playerId;
+            player.color = PLAYER_COLORS[playerId % 8];
+            player.mode = PlayerMode::PLANT;
+            player.score = 0;
+            player.lastAction = 0.0f;
+            player.lastMove = 0.0f;
+            player.lastDirectionX = 0;
+            player.lastDirectionY = 0;
+            SpawnPlayer(playerId);
+        }
+        stateHash.Rebuild(gameState, gameTime);
+        MarkGridChanged();
+        journalKeyframeDue = true;
+    }
+    
+    // Host: brings peers that connected during lockstep into the session at
+    // a tick every peer agrees on. One whose id is still in the session,
+    // from the player who had it before and is leaving, waits until it is free
+    void StartLockstepJoins() {
+        for (auto it = lockstepWaiting.begin(); it != lockstepWaiting.end();) {
+            int playerId = *it;
+            if (lockstep->IsParticipant(playerId) || lockstep->IsJoining(playerId)) {
+                ++it;
+                continue;
+            }
+            LockstepStartMessage start;
+            start.seed = 0;  // The world comes whole, at the join tick
+            start.tickRate = lockstep->GetConfig().tickRate;
+            start.inputDelay = lockstep->GetConfig().inputDelay;
+            start.startTick = lockstep->GetJoinTick();
+            lockstep->GetParticipantsAfterPending(start.playerIds);
+            lockstep->AddParticipant(playerId, start.startTick);
+            // The start first, so the new peer has a session to take its join into
+            networkManager->SendLockstepStart(start, RouteTo(playerId));
+            networkManager->SendLockstepJoin(playerId, start.startTick);
+            it = lockstepWaiting.erase(it);
+        }
+    }
+    
+    // A peer joining a running session takes over the host's world at its
+    // join tick, then simulates on from there like everyone else
+    void OnLockstepWorld(int tick, std::string_view world) {
+        if (!lockstep || !lockstepWorldPending) return;
+        if (tick != lockstep->GetCurrentTick()) {
+            LOGE(LOCKSTEP, "Got the tick " << tick << " world, expected tick " << lockstep->GetCurrentTick());
+            return;
+        }
+        GameState state;
+        WorldMeta meta;
+        if (!DecodeWorld(world.data(), world.size(), state, meta) ||
+            state.grid.size() != static_cast<size_t>(GRID_HEIGHT) ||
+            state.grid[0].size() != static_cast<size_t>(GRID_WIDTH)) {
+            LOGE(LOCKSTEP, "Could not read the tick " << tick << " world");
+            return;
+        }
+        gameState = std::move(state);
+        rng = meta.rng;
+        gameTime = meta.gameTime;
+        nextAnimalId = meta.nextAnimalId;
+        stateHash.Rebuild(gameState, gameTime);
+        MarkGridChanged();
+        journalKeyframeDue = true;
+        lockstepWorldPending = false;
+        LOGI(LOCKSTEP, "Joined at tick " << tick << " with " << gameState.players.size() << " players");
+    }
+    
+    void ResetPendingInput() {
+        pendingInput = {};
+        pendingInput.mode = -1;
+    }
+    
+    // Merge this frame's input into the one waiting for the next tick
+    void MergePendingInput(const PlayerInput& input) {
+        if (input.moveX != 0 || input.moveY != 0) {
+            pendingInput.moveX = input.moveX;
+            pendingInput.moveY = input.moveY;
+        }
+        if (input.mode >= 0) {
+            pendingInput.mode = input.mode;
+        }
+        pendingInput.action = pendingInput.action || input.action;
+    }
+    
+    void UpdateLockstep(float dt) {
+        TRACE_SCOPE("UpdateLockstep");
+        if (lockstepWorldPending) {
+            return;  // Nothing to simulate until the host's world arrives
+        }
+        if (!lockstepWaiting.empty()) {
+            StartLockstepJoins();
+        }
+        float tickDuration = lockstep->GetTickDuration();
+        // Don't try to catch up on more than a few ticks after a stall
+        lockstepAccumulator = std::min(lockstepAccumulator + dt, std::max(tickDuration * 5.0f, simCatchUp));
+        
+        while (lockstepAccumulator >= tickDuration) {
+            int inputTick = lockstep->GetInputTick();
+            if (lockstep->ExpectsInput(localPlayerId, inputTick) && !lockstep->HasInput(inputTick, localPlayerId)) {
+                pendingInput.playerId = localPlayerId;
+                pendingInput.tick = inputTick;
+                lockstep->AddInput(pendingInput);
+                if (isMultiplayer && networkManager) {
+                    networkManager->SendPlayerInput(pendingInput);
+                }
+                ResetPendingInput();
+            }
+            
+            // Waiting for a remote player's input
+            if (!lockstep->CanAdvance()) break;
+            
+            lockstepAccumulator -= tickDuration;
+            SimulateTick();
+        }
+        simAlpha = std::min(lockstepAccumulator / tickDuration, 1.0f);
+    }
+    
+    void SimulateTick() {
+        int tick = lockstep->GetCurrentTick();
+        lockstep->TakeRemovals(tick, lockstepRemovals);
+        for (int playerId : lockstepRemovals) {
+            if (IsJournaling()) {
+                journal.WriteLeave(playerId);
+            }
+            RemovePlayer(playerId);
+        }
+        lockstep->TakeJoins(tick, lockstepJoins);
+        for (int playerId : lockstepJoins) {
+            if (IsJournaling()) {
+                journal.WriteJoin(playerId);
+            }
+            // Spawns from the shared RNG, the same on every peer; a joining
+            // peer already has itself in the world it was sent
+            AddPlayer(playerId);
+            if (isHost && playerId != localPlayerId) {
+                EncodeWorld(gameState, CurrentWorldMeta(), lockstepWorld);
+                networkManager->SendLockstepWorld(playerId, tick, lockstepWorld);
+            }
+        }
+        FrameArray<PlayerInput> inputs = lockstep->AdvanceTick(frameArena);
+        RecordJournalTick(tick * lockstep->GetTickDuration(), lockstep->GetTickDuration(), inputs.begin(), inputs.size());
+        BeginSimTick();
+        gameTime = tick * lockstep->GetTickDuration();
+        
+        for (const PlayerInput& input : inputs) {
+            ApplyPlayerInput(input.playerId, input);
+        }
+        
+        UpdateWorld();
+        EasePlayerRotations(lockstep->GetTickDuration());
+        
+        if (lockstep->IsChecksumTick(tick)) {
+            uint64_t hash = stateHash.GetHash();
+            lockstep->RecordLocalChecksum(tick, hash);
+            if (isMultiplayer && networkManager) {
+                networkManager->SendStateChecksum(localPlayerId, tick, hash);
+            }
+        }
+    }
+
+    // The per-tick systems, each timed into robban_subsystem_seconds
+    void UpdateWorld() {
+        {
+            ScopedTimer timer(animalsTime);
+            UpdateAnimals();
+        }
+        {
+            ScopedTimer timer(treesTime);
+            UpdateTrees();
+        }
+        {
+            ScopedTimer timer(bulletsTime);
+            UpdateBullets();
+        }
+    }
+
+    // Remember where everything was, for the renderer to interpolate from
+    void BeginSimTick() {
+        previousPlayers.clear();
+        for (const auto& [id, player] : gameState.players) {
+            previousPlayers[id] = {player.x, player.y, player.rotationAngle};
+        }
+        previousAnimals.clear();
+        for (const auto& animal : gameState.animals) {
+            previousAnimals[animal.id] = {animal.x, animal.y, 0.0f};
+        }
+    }
+    
+    // Visual only: turns rotationAngle towards the facing direction
+    void EasePlayerRotations(float dt) {
+        float blend = 1.0f - std::exp(-ROTATION_EASE_RATE * dt);
+        for (auto& [id, player] : gameState.players) {
+            if (player.lastDirectionX == 0 && player.lastDirectionY == 0) continue;
+            float target = std::atan2(static_cast<float>(player.lastDirectionX), static_cast<float>(-player.lastDirectionY));
+            player.rotationAngle += WrapAngle(target - player.rotationAngle) * blend;
+        }
+    }
+    
+    static float WrapAngle(float angle) {
+        return std::remainder(angle, 2.0f * PI);
+    }
+    
+    void UpdateFixedStep(float dt) {
+        TRACE_SCOPE("UpdateFixedStep");
+        // Don't try to catch up on more than a few ticks after a stall
+        simAccumulator = std::min(simAccumulator + dt, std::max(simTickDuration * 5.0f, simCatchUp));
+        
+        while (simAccumulator >= simTickDuration) {
+            simAccumulator -= simTickDuration;
+            PlayerInput tickInput = pendingInput;
+            tickInput.playerId = localPlayerId;
+            ResetPendingInput();
+            RecordJournalTick(gameTime + simTickDuration, simTickDuration, &tickInput, 1);
+            
+            BeginSimTick();
+            gameTime += simTickDuration;
+            ApplyPlayerInput(localPlayerId, tickInput);
+            
+            // Send mode change and action to network if multiplayer
+            if (isMultiplayer && networkManager && networkManager->IsConnected()) {
+                const Player& localPlayer = gameState.players[localPlayerId];
+                if (tickInput.mode >= 0) {
+                    networkManager->SendPlayerModeChange(localPlayerId, tickInput.mode);
+                }
+                if (tickInput.action) {
+                    ActionMessage action;
+                    action.playerId = localPlayerId;
+                    action.targetX = localPlayer.x;
+                    action.targetY = localPlayer.y;
+                    action.actionType = static_cast<int>(localPlayer.mode);
+                    networkManager->SendPlayerAction(action);
+                }
+            }
+            
+            UpdateWorld();
+            EasePlayerRotations(simTickDuration);
+        }
+        simAlpha = simAccumulator / simTickDuration;
+    }
+    
+    float GetTickDuration() const {
+        return lockstep ? lockstep->GetTickDuration() : simTickDuration;
+    }
+
+    // Advances the game by dt seconds. Never calls raylib input or drawing
+    // functions, so it can run on the simulation thread
+    void Simulate(float dt) {
+        TRACE_SCOPE("Simulate");
+        frameArena.Reset();
+        // Input the render thread collected since the last step
+        bool hostPressed = false;
+        bool joinPressed = false;
+        bool lockstepPressed = false;
+        FrameInput frame;
+        while (frameInputs.Pop(frame)) {
+            MergePendingInput(frame.player);
+            hostPressed = hostPressed || frame.host;
+            joinPressed = joinPressed || frame.join;
+            lockstepPressed = lockstepPressed || frame.lockstep;
+        }
+
+        // Start Firebase reporting when game starts or when hosting/joining
+        static bool firebaseStarted = false;
+        if (firebaseReportingEnabled && !firebaseStarted && firebaseReporter) {
+            firebaseReporter->Start();
+            firebaseReporter->UpdatePlayers(gameState.players);
+            // firebaseReporter->ReportNow(); // Initial report at startup - removed to report only after room is set
+            firebaseStarted = true;
+            LOGI(GAME, "Firebase reporting started");
+        }
+
+        // Ensure local player exists before accessing
+        if (gameState.players.find(localPlayerId) == gameState.players.end()) {
+            // Player doesn't exist yet, skip this frame
+            ResetPendingInput();
+            return;
+        }
+        
+        Player& localPlayer = gameState.players[localPlayerId];
+
+        // Send network updates only when player state changes
+        static Player lastSentState = {};
+        static bool hasInitialState = false;
+        
+        if (isMultiplayer && !lockstep) {
+            bool stateChanged = !hasInitialState ||
+                               lastSentState.x != localPlayer.x ||
+                               lastSentState.y != localPlayer.y ||
+                               lastSentState.mode != localPlayer.mode ||
+                               lastSentState.score != localPlayer.score ||
+                               lastSentState.alive != localPlayer.alive ||
+                               lastSentState.lastDirectionX != localPlayer.lastDirectionX ||
+                               lastSentState.lastDirectionY != localPlayer.lastDirectionY;
+            
+            if (stateChanged) {
+                networkManager->SendPlayerUpdate(localPlayer);
+                lastSentState = localPlayer;
+                hasInitialState = true;
+            }
+        }
+        
+        // Clients report per-chunk hashes so the host can resend only the chunks that drifted
+        if (isMultiplayer && !isHost && !lockstep && gameTime - lastStateHashTime > STATE_HASH_INTERVAL) {
+            uint64_t summary = CollectChunkHashes(reportedChunks);
+            networkManager->SendStateHash(localPlayerId, summary, reportedChunks);
+            lastStateHashTime = gameTime;
+        }
+        
+        // Host sends each peer a budgeted, prioritised update of whatever changed
+        if (isHost && isMultiplayer && !lockstep &&
+            gameTime - lastSnapshotTime > snapshotScheduler->GetConfig().sendInterval) {
+            snapshotScheduler->Observe(gameState, gameTime);
+            networkManager->GetConnectedPlayerIds(snapshotPeers);
+            for (int peerId : snapshotPeers) {
+                if (snapshotScheduler->BuildPacket(peerId, gameState, gameTime, snapshotPacket)) {
+                    networkManager->SendGameStateUpdate(peerId, snapshotPacket);
+                }
+            }
+            lastSnapshotTime = gameTime;
+        }
+        
+        // Only the host has the whole world to save
+        if (worldCheckpointer && isHost && !lockstep) {
+            worldCheckpointer->Poll();
+            if (gameTime - lastCheckpointTime > WORLD_CHECKPOINT_INTERVAL) {
+                worldCheckpointer->Start(gameState, CurrentWorldMeta());
+                lastCheckpointTime = gameTime;
+            }
+        }
         
         // Network controls
         if (!isMultiplayer) {
-            if (IsKeyPressed(KEY_H)) {
+            if (hostPressed) {
                 // Host a game
                 currentRoom = "RobbanRoom";
                 isMultiplayer = true;
                 isHost = true;
                 
+                ResumeSavedWorld();
+                
                 // Create the host player (player 0) if not already created
                 if (gameState.players.find(localPlayerId) == gameState.players.end()) {
                     Player localPlayer;
@@ -1044,19 +2121,19 @@ public:
                 if (!networkManager->CreateRoom(currentRoom)) {
                     isMultiplayer = false;
                     isHost = false;
-                    std::cout << "[Game] Failed to create room!" << std::endl;
+                    LOGW(GAME, "Failed to create room!");
                 } else {
                     std::string actualRoomId = networkManager->GetRoomId();
-                    std::cout << "[Game] Hosting room: " << actualRoomId << std::endl;
-                    std::cout << "[Game] Created room with ID: " << actualRoomId << std::endl;
+                    LOGI(GAME, "Hosting room: " << actualRoomId);
+                    LOGI(GAME, "Created room with ID: " << actualRoomId);
                     // Update Firebase reporter with room ID
                     if (firebaseReporter) {
-                        std::cout << "[Game] Updating Firebase with room ID: " << actualRoomId << std::endl;
+                        LOGI(GAME, "Updating Firebase with room ID: " << actualRoomId);
                         firebaseReporter->UpdateRoomId(actualRoomId);
                         firebaseReporter->ReportNow();
                     }
                 }
-            } else if (IsKeyPressed(KEY_J)) {
+            } else if (joinPressed) {
                 // Join a game (simplified - in real version would show input dialog)
                 currentRoom = "RobbanRoom_1234"; // Example room ID
                 isMultiplayer = true;
@@ -1064,13 +2141,13 @@ public:
                 if (!networkManager->JoinRoom(currentRoom)) {
                      isMultiplayer = false;
                     isHost = false;
-                    std::cout << "[Game] Failed to join room!" << std::endl;
+                    LOGW(GAME, "Failed to join room!");
                 } else {
-                    std::cout << "[Game] Joining room: " << currentRoom << std::endl;
-                    std::cout << "[Game] Join successful, room ID: " << currentRoom << std::endl;
+                    LOGI(GAME, "Joining room: " << currentRoom);
+                    LOGI(GAME, "Join successful, room ID: " << currentRoom);
                     // Update Firebase reporter with room ID
                     if (firebaseReporter) {
-                        std::cout << "[Game] Updating Firebase with room ID: " << currentRoom << std::endl;
+                        LOGI(GAME, "Updating Firebase with room ID: " << currentRoom);
                         firebaseReporter->UpdateRoomId(currentRoom);
                         firebaseReporter->ReportNow();
                     }
@@ -1078,187 +2155,495 @@ public:
             }
         }
         
-        // Handle input
-        if (IsKeyPressed(KEY_P)) {
-            switch (localPlayer.mode) {
-                case PlayerMode::PLANT: localPlayer.mode = PlayerMode::SHOOT; break;
-                case PlayerMode::SHOOT: localPlayer.mode = PlayerMode::CHOP; break;
-                case PlayerMode::CHOP: localPlayer.mode = PlayerMode::PLANT; break;
+        // Lockstep is started by the host (or alone) and restarts everyone's world from a shared seed
+        if (lockstepPressed && !lockstep && (isHost || !isMultiplayer)) {
+            BeginLockstep();
+        }
+        
+        if (lockstep) {
+            UpdateLockstep(dt);
+        } else {
+            UpdateFixedStep(dt);
+        }
+
+        // Update Firebase reporter with the roster and scores (a no-op unless they changed)
+        if (firebaseReportingEnabled && firebaseReporter && firebaseStarted) {
+            firebaseReporter->UpdatePlayers(gameState.players);
+
+#ifdef PLATFORM_WEB
+            // Web implementation requires manual update from main loop
+            firebaseReporter->Update();
+#endif
+        }
+
+        // Process network messages. Deferred browser events such as the host
+        // button arrive before multiplayer has started, so always drain them
+        if (networkManager) {
+            networkManager->ProcessMessages();
+        }
+    }
+    
+    // Hashes of the non-empty chunks, as clients report them, and their XOR
+    uint64_t CollectChunkHashes(std::vector<ChunkHash>& chunks) const {
+        chunks.clear();
+        uint64_t summary = 0;
+        for (int chunk = 0; chunk < stateHash.GetChunkCount(); chunk++) {
+            uint64_t hash = stateHash.GetChunkHash(chunk);
+            if (hash == 0) continue; // Empty chunks are implied
+            chunks.push_back({chunk % stateHash.GetChunksX(), chunk / stateHash.GetChunksX(), hash});
+            summary ^= hash;
+        }
+        return summary;
+    }
+    
+    static double SteadySeconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // Copy what the renderer needs into the free snapshot buffer and hand it over
+    void PublishSnapshot() {
+        TRACE_SCOPE("PublishSnapshot");
+        RenderSnapshot& snapshot = renderSnapshots.WriteBuffer();
+        snapshot.publishedAt = SteadySeconds();
+        snapshot.gameTime = gameTime;
+        snapshot.tickDuration = GetTickDuration();
+        snapshot.alpha = simAlpha;
+        
+        // This buffer may be a few versions behind, so compare against its own
+        // copy and only recopy the rows that changed since
+        if (snapshot.gridVersion != gridVersion) {
+            if (snapshot.cells.size() != static_cast<size_t>(GRID_WIDTH * GRID_HEIGHT)) {
+                snapshot.cells.assign(GRID_WIDTH * GRID_HEIGHT, Cell());
+                snapshot.rowVersions.assign(GRID_HEIGHT, 0);
             }
-            
-            // Send mode change to network
-            if (isMultiplayer && networkManager && networkManager->IsConnected()) {
-                networkManager->SendPlayerModeChange(localPlayerId, static_cast<int>(localPlayer.mode));
+            for (int y = 0; y < GRID_HEIGHT; y++) {
+                if (snapshot.rowVersions[y] == rowVersions[y]) continue;
+                const std::vector<Cell>& row = gameState.grid[y];
+                std::copy(row.begin(), row.begin() + GRID_WIDTH, snapshot.cells.begin() + y * GRID_WIDTH);
+                snapshot.rowVersions[y] = rowVersions[y];
             }
+            snapshot.gridVersion = gridVersion;
         }
         
-        // Movement with throttling for better control
-        int newX = localPlayer.x;
-        int newY = localPlayer.y;
-        int moveX = 0, moveY = 0;
+        snapshot.players.clear();
+        for (const auto& [id, player] : gameState.players) {
+            RenderPlayer entry = {id, player.x, player.y, player.x, player.y, player.rotationAngle, player.rotationAngle,
+                                  player.mode, player.color, player.alive, player.lastDirectionX, player.lastDirectionY,
+                                  player.score};
+            auto previous = previousPlayers.find(id);
+            if (previous != previousPlayers.end()) {
+                entry.prevX = previous->second.x;
+                entry.prevY = previous->second.y;
+                entry.prevRotation = previous->second.rotation;
+            }
+            snapshot.players.push_back(entry);
+        }
         
-        // Check for movement input
-        if (IsKeyPressed(KEY_W) || IsKeyPressed(KEY_UP)) { moveY = -1; }
-        if (IsKeyPressed(KEY_S) || IsKeyPressed(KEY_DOWN)) { moveY = 1; }
-        if (IsKeyPressed(KEY_A) || IsKeyPressed(KEY_LEFT)) { moveX = -1; }
-        if (IsKeyPressed(KEY_D) || IsKeyPressed(KEY_RIGHT)) { moveX = 1; }
+        snapshot.animals.clear();
+        for (const auto& animal : gameState.animals) {
+            RenderAnimal entry = {animal.id, animal.type, animal.x, animal.y, animal.x, animal.y};
+            auto previous = previousAnimals.find(animal.id);
+            if (previous != previousAnimals.end()) {
+                entry.prevX = previous->second.x;
+                entry.prevY = previous->second.y;
+            }
+            snapshot.animals.push_back(entry);
+        }
+        
+        snapshot.bullets.clear();
+        for (const auto& bullet : gameState.bullets) {
+            snapshot.bullets.push_back({bullet.x, bullet.y, bullet.dirX, bullet.dirY, bullet.startTime});
+        }
+        
+        snapshot.localPlayerId = localPlayerId;
+        snapshot.multiplayer = isMultiplayer && networkManager;
+        snapshot.host = networkManager && networkManager->IsHost();
+        snapshot.playerCount = networkManager ? networkManager->GetPlayerCount() : 0;
+        snapshot.room = currentRoom;
+        snapshot.lockstep = lockstep != nullptr;
+        snapshot.lockstepTick = lockstep ? lockstep->GetCurrentTick() : 0;
+        snapshot.desynced = lockstep && lockstep->IsDesynced();
+        snapshot.desyncTick = lockstep ? lockstep->GetDesyncTick() : -1;
+        snapshot.desyncPlayerId = lockstep ? lockstep->GetDesyncPlayerId() : -1;
+        snapshot.shootSounds = shootSoundCount;
+        snapshot.axeSounds = axeSoundCount;
+        snapshot.networkMessages = networkManager ? networkManager->GetMessagesReceived() : 0;
+        
+        playersGauge.Set(static_cast<double>(gameState.players.size()));
+        animalsGauge.Set(static_cast<double>(gameState.animals.size()));
+        bulletsGauge.Set(static_cast<double>(gameState.bullets.size()));
+        peersGauge.Set(networkManager ? networkManager->GetPeerCount() : 0);
+        
+        uint64_t contentHash = HashSnapshotContent(snapshot);
+        if (contentHash != publishedContentHash) {
+            publishedContentHash = contentHash;
+            publishedContentVersion++;
+        }
+        snapshot.contentVersion = publishedContentVersion;
+        snapshot.animating = !snapshot.bullets.empty();
+        for (const auto& player : snapshot.players) {
+            if (player.x != player.prevX || player.y != player.prevY || player.rotation != player.prevRotation) {
+                snapshot.animating = true;
+            }
+        }
+        for (const auto& animal : snapshot.animals) {
+            if (animal.x != animal.prevX || animal.y != animal.prevY) snapshot.animating = true;
+        }
+        
+        renderSnapshots.Publish();
+    }
+    
+    // FNV-1a over everything Draw() shows, except the time-based bullet flight
+    static uint64_t HashSnapshotContent(const RenderSnapshot& snapshot) {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                hash ^= (value >> (i * 8)) & 0xFF;
+                hash *= 1099511628211ull;
+            }
+        };
+        auto mixFloat = [&mix](float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            mix(bits);
+        };
+        
+        mix(snapshot.gridVersion);
+        for (const auto& player : snapshot.players) {
+            mix(player.id);
+            mix((static_cast<uint64_t>(player.x) << 32) | static_cast<uint32_t>(player.y));
+            mix((static_cast<uint64_t>(player.prevX) << 32) | static_cast<uint32_t>(player.prevY));
+            mixFloat(player.rotation);
+            mixFloat(player.prevRotation);
+            mix(static_cast<uint64_t>(player.mode));
+            mix((static_cast<uint64_t>(player.color.r) << 24) | (player.color.g << 16) | (player.color.b << 8) | player.color.a);
+            mix(player.alive);
+            mix((static_cast<uint64_t>(player.lastDirectionX) << 32) | static_cast<uint32_t>(player.lastDirectionY));
+            mix(player.score);
+        }
+        for (const auto& animal : snapshot.animals) {
+            mix(animal.id);
+            mix(static_cast<uint64_t>(animal.type));
+            mix((static_cast<uint64_t>(animal.x) << 32) | static_cast<uint32_t>(animal.y));
+            mix((static_cast<uint64_t>(animal.prevX) << 32) | static_cast<uint32_t>(animal.prevY));
+        }
+        mix(snapshot.bullets.size());
+        mix(snapshot.localPlayerId);
+        mix((snapshot.multiplayer ? 1 : 0) | (snapshot.host ? 2 : 0) | (snapshot.lockstep ? 4 : 0) | (snapshot.desynced ? 8 : 0));
+        mix(snapshot.playerCount);
+        mix(std::hash<std::string>()(snapshot.room));
+        mix(snapshot.lockstepTick);
+        mix((static_cast<uint64_t>(snapshot.desyncTick) << 32) | static_cast<uint32_t>(snapshot.desyncPlayerId));
+        return hash;
+    }
+    
+    // Render-thread half of input: reads raylib and queues it for the simulation
+    void PollFrameInput() {
+        TRACE_SCOPE("PollFrameInput");
+        FrameInput frame = {};
+        const RenderSnapshot& snapshot = renderSnapshots.ReadBuffer();
+        const RenderPlayer* localPlayer = snapshot.FindPlayer(snapshot.localPlayerId);
+        if (localPlayer) {
+            frame.player = PollLocalInput(snapshot.localPlayerId, *localPlayer);
+        } else {
+            frame.player.mode = -1;
+        }
+        frame.host = IsKeyPressed(KEY_H);
+        frame.join = IsKeyPressed(KEY_J);
+        frame.lockstep = IsKeyPressed(KEY_L);
+        
+        if (IsKeyPressed(KEY_M)) {
+            showMinimap = !showMinimap;
+        }
+        #ifdef ROBBAN_TRACING
+        if (IsKeyPressed(KEY_F9) || trace::ConsumeDumpRequest()) {
+            trace::WriteChromeTrace();
+        }
+        #endif
+        
+        Vector2 mouseDelta = GetMouseDelta();
+        frameChangedView = frame.player.moveX != 0 || frame.player.moveY != 0 || frame.player.mode >= 0 ||
+                           frame.player.action || frame.host || frame.join || frame.lockstep ||
+                           GetMouseWheelMove() != 0.0f || IsKeyPressed(KEY_EQUAL) || IsKeyPressed(KEY_KP_ADD) ||
+                           IsKeyPressed(KEY_MINUS) || IsKeyPressed(KEY_KP_SUBTRACT) || IsKeyPressed(KEY_M) ||
+                           IsMouseButtonPressed(MOUSE_BUTTON_LEFT) || GetTouchPointCount() > 0;
+        frameUserActive = frameChangedView || mouseDelta.x != 0.0f || mouseDelta.y != 0.0f;
+        
+        // Resume audio context on first user interaction (required for web browsers)
+        #ifdef PLATFORM_WEB
+        if (!audioResumed && soundsLoaded) {
+            // Check if any key is pressed
+            if (GetKeyPressed() != 0 || IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+                // Resume audio context for web
+                audioResumed = true;
+                LOGI(AUDIO, "Audio context resumed after user interaction");
+            }
+        }
+        #else
+        audioResumed = true; // Native platforms don't need this
+        #endif
+        
+        if (!frameInputs.Push(frame)) {
+            LOG_LIMITED(WARNING, GAME, 1, "Input queue full, dropping a frame of input");
+        }
+    }
+    
+    // Single-threaded frame: input, simulation and snapshot on the caller's thread
+    void Update() {
+        TRACE_SCOPE("Update");
+        PollFrameInput();
+        // Measured here rather than with GetFrameTime(), which only advances on drawn frames
+        double now = SteadySeconds();
+        float dt = lastUpdateAt > 0.0 ? static_cast<float>(now - lastUpdateAt) : 0.0f;
+        lastUpdateAt = now;
+        // Two frames, so one late frame is still caught up on but a real stall is not
+        simCatchUp = static_cast<float>(GetFrameInterval()) * 2.0f;
+        Simulate(dt);
+        PublishSnapshot();
+    }
+    
+    void SetAdaptiveFrames(bool enabled) {
+        adaptiveFrames = enabled;
+        LOGI(FRAMES, "Adaptive frame rate " << (enabled ? "on" : "off"));
+    }
+    bool IsAdaptiveFrames() const { return adaptiveFrames; }
+    
+    // Picks up the latest snapshot and says whether drawing it would change
+    // what is on screen
+    bool NeedsRedraw() {
+        renderSnapshots.Acquire();
+        const RenderSnapshot& snapshot = renderSnapshots.ReadBuffer();
+        return snapshot.contentVersion != drawnContentVersion || snapshot.animating || frameChangedView ||
+               !stressSprites.empty() || IsWindowResized() || audioResumed != drawnAudioResumed;
+    }
+    
+    // Stands in for Draw() on frames that don't change the picture: sounds
+    // still play, and input is polled as EndDrawing() would have done
+    void SkipDraw() {
+        TRACE_SCOPE("SkipDraw");
+        renderSnapshots.Acquire();
+        PlaySnapshotSounds(renderSnapshots.ReadBuffer());
+        PollInputEvents();
+    }
+    
+    // Draws this frame, or with adaptive pacing only if it changed. Call after
+    // Update() or PollFrameInput()
+    void Present() {
+        if (!adaptiveFrames) {
+            Draw();
+            framesDrawnCounter.Add();
+            return;
+        }
+        
+        double now = GetTime();
+        bool changed = NeedsRedraw();
+        uint32_t networkMessages = renderSnapshots.ReadBuffer().networkMessages;
+        if (frameUserActive || networkMessages != seenNetworkMessages) {
+            framePacer.NoteActivity(now);
+        }
+        seenNetworkMessages = networkMessages;
         
-        // Apply movement if within bounds
-        if (moveX != 0 || moveY != 0) {
-            newX += moveX;
-            newY += moveY;
-            
-            if (newX >= 0 && newX < GRID_WIDTH && newY >= 0 && newY < GRID_HEIGHT) {
-                localPlayer.x = newX;
-                localPlayer.y = newY;
-                
-                // Update direction for shooting
-                localPlayer.lastDirectionX = moveX;
-                localPlayer.lastDirectionY = moveY;
-                localPlayer.lastMove = gameTime;
-            }
+        bool draw = framePacer.ShouldDraw(now, IsWindowFocused(), changed);
+        if (draw) {
+            Draw();
+        } else {
+            SkipDraw();
         }
+        framePacer.EndFrame(now, draw);
+        (draw ? framesDrawnCounter : framesSkippedCounter).Add();
         
-        // Action with spacebar
-        if (IsKeyPressed(KEY_SPACE)) {
-            HandlePlayerAction(localPlayerId, -1, -1); // Use -1 to indicate current position
-
-            // Send action to network if multiplayer
-            if (isMultiplayer && networkManager && networkManager->IsConnected()) {
-                ActionMessage action;
-                action.playerId = localPlayerId;
-                action.targetX = localPlayer.x;
-                action.targetY = localPlayer.y;
-                action.actionType = static_cast<int>(localPlayer.mode);
-                networkManager->SendPlayerAction(action);
+        #ifdef PLATFORM_WEB
+        // Leave requestAnimationFrame for a slow timer while idle; a single-threaded
+        // multiplayer game keeps the frame rate so it keeps simulating
+        bool loopIdle = framePacer.IsIdle() && !(renderSnapshots.ReadBuffer().multiplayer && !simRunning);
+        if (loopIdle != webLoopIdle) {
+            webLoopIdle = loopIdle;
+            if (loopIdle) {
+                emscripten_set_main_loop_timing(EM_TIMING_SETTIMEOUT, 1000 / framePacer.GetConfig().idleFps);
+            } else {
+                emscripten_set_main_loop_timing(EM_TIMING_RAF, 1);
             }
         }
-
-        // Touch input for mobile
-        if (GetTouchPointCount() > 0) {
-            Vector2 touchPos = GetTouchPosition(0);
-            // Check upper right corner for tool switch
-            if (touchPos.x > WINDOW_WIDTH * 0.75f && touchPos.y < WINDOW_HEIGHT * 0.25f) {
-                // Switch tool
-                switch (localPlayer.mode) {
-                    case PlayerMode::PLANT: localPlayer.mode = PlayerMode::SHOOT; break;
-                    case PlayerMode::SHOOT: localPlayer.mode = PlayerMode::CHOP; break;
-                    case PlayerMode::CHOP: localPlayer.mode = PlayerMode::PLANT; break;
-                }
-
-                // Send mode change to network
-                if (isMultiplayer && networkManager && networkManager->IsConnected()) {
-                    networkManager->SendPlayerModeChange(localPlayerId, static_cast<int>(localPlayer.mode));
-                }
-            }
-            // Check bottom left and bottom right for shoot
-            else if ((touchPos.x < WINDOW_WIDTH * 0.25f && touchPos.y > WINDOW_HEIGHT * 0.75f) ||
-                     (touchPos.x > WINDOW_WIDTH * 0.75f && touchPos.y > WINDOW_HEIGHT * 0.75f)) {
-                // Shoot action
-                HandlePlayerAction(localPlayerId, -1, -1);
-
-                // Send action to network if multiplayer
-                if (isMultiplayer && networkManager && networkManager->IsConnected()) {
-                    ActionMessage action;
-                    action.playerId = localPlayerId;
-                    action.targetX = localPlayer.x;
-                    action.targetY = localPlayer.y;
-                    action.actionType = static_cast<int>(localPlayer.mode);
-                    networkManager->SendPlayerAction(action);
-                }
-            }
-            // Check above player for move up
-            else if (touchPos.y < localPlayer.y * CELL_SIZE) {
-                // Move up
-                int newY = localPlayer.y - 1;
-                if (newY >= 0) {
-                    localPlayer.y = newY;
-                    localPlayer.lastDirectionX = 0;
-                    localPlayer.lastDirectionY = -1;
-                    localPlayer.lastMove = gameTime;
-                }
-            }
-            // Check to the right of player for move right
-            else if (touchPos.x > (localPlayer.x + 1) * CELL_SIZE) {
-                // Move right
-                int newX = localPlayer.x + 1;
-                if (newX < GRID_WIDTH) {
-                    localPlayer.x = newX;
-                    localPlayer.lastDirectionX = 1;
-                    localPlayer.lastDirectionY = 0;
-                    localPlayer.lastMove = gameTime;
-                }
+        #endif
+    }
+    
+    // Seconds from the start of this frame to the next; only meaningful with adaptive pacing
+    double GetFrameInterval() const {
+        // The single-threaded loop also runs the simulation, which a multiplayer
+        // game can't slow down while others are playing
+        bool keepTicking = renderSnapshots.ReadBuffer().multiplayer && !simRunning;
+        return framePacer.GetFrameInterval(keepTicking);
+    }
+    
+    void StartSimulationThread() {
+        simRunning = true;
+        simThread = std::thread([this]() {
+            TRACE_THREAD_NAME("simulation");
+            double lastStep = SteadySeconds();
+            while (simRunning) {
+                double now = SteadySeconds();
+                Simulate(static_cast<float>(now - lastStep));
+                PublishSnapshot();
+                lastStep = now;
+                
+                // Sleep until the next tick is due
+                float accumulator = lockstep ? lockstepAccumulator : simAccumulator;
+                float wait = std::clamp(GetTickDuration() - accumulator, 0.001f, GetTickDuration());
+                std::this_thread::sleep_for(std::chrono::duration<float>(wait));
             }
+        });
+        LOGI(GAME, "Simulation thread started");
+    }
+    
+    void StopSimulationThread() {
+        simRunning = false;
+        if (simThread.joinable()) {
+            simThread.join();
         }
+    }
 
-
-
-        UpdateAnimals();
-        UpdateTrees();
-        UpdateBullets();
-        //SyncGameState();
-
-        // Update Firebase reporter with current game state
-        if (firebaseReportingEnabled && firebaseReporter && firebaseStarted) {
-            firebaseReporter->UpdateGameState(gameState);
-
-#ifdef PLATFORM_WEB
-            // Web implementation requires manual update from main loop
-            firebaseReporter->Update();
-#endif
+    // Zoom input, follow the local player and work out which cells are on screen
+    void UpdateViewport(const RenderSnapshot& snapshot, float alpha) {
+        TRACE_SCOPE("UpdateViewport");
+        float zoomSteps = GetMouseWheelMove();
+        if (IsKeyPressed(KEY_EQUAL) || IsKeyPressed(KEY_KP_ADD)) zoomSteps += 1.0f;
+        if (IsKeyPressed(KEY_MINUS) || IsKeyPressed(KEY_KP_SUBTRACT)) zoomSteps -= 1.0f;
+        if (camera.zoom <= 0.0f) camera.zoom = 1.0f;
+        if (zoomSteps != 0.0f) {
+            camera.zoom = std::clamp(camera.zoom * std::pow(1.25f, zoomSteps), CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM);
         }
-
-        // Process network messages
-        if (isMultiplayer && networkManager) {
-            networkManager->ProcessMessages();
+        
+        float screenWidth = static_cast<float>(GetScreenWidth());
+        float screenHeight = static_cast<float>(GetScreenHeight());
+        float worldWidth = static_cast<float>(GRID_WIDTH * CELL_SIZE);
+        float worldHeight = static_cast<float>(GRID_HEIGHT * CELL_SIZE);
+        float viewWidth = screenWidth / camera.zoom;
+        float viewHeight = screenHeight / camera.zoom;
+        
+        camera.offset = {screenWidth / 2.0f, screenHeight / 2.0f};
+        const RenderPlayer* localPlayer = snapshot.FindPlayer(snapshot.localPlayerId);
+        if (localPlayer) {
+            Vector2 position = InterpolatePosition(localPlayer->x, localPlayer->y, localPlayer->prevX, localPlayer->prevY, alpha);
+            camera.target = {position.x + CELL_SIZE / 2.0f, position.y + CELL_SIZE / 2.0f};
+        } else {
+            camera.target = {worldWidth / 2.0f, worldHeight / 2.0f};
         }
+        
+        // Keep the view inside the map, or centre the map when it is smaller than the view
+        camera.target.x = (worldWidth <= viewWidth) ? worldWidth / 2.0f
+                        : std::clamp(camera.target.x, viewWidth / 2.0f, worldWidth - viewWidth / 2.0f);
+        camera.target.y = (worldHeight <= viewHeight) ? worldHeight / 2.0f
+                        : std::clamp(camera.target.y, viewHeight / 2.0f, worldHeight - viewHeight / 2.0f);
+        
+        visibleCells.minX = std::max(0, static_cast<int>(std::floor((camera.target.x - viewWidth / 2.0f) / CELL_SIZE)));
+        visibleCells.minY = std::max(0, static_cast<int>(std::floor((camera.target.y - viewHeight / 2.0f) / CELL_SIZE)));
+        visibleCells.maxX = std::min(GRID_WIDTH - 1, static_cast<int>(std::floor((camera.target.x + viewWidth / 2.0f) / CELL_SIZE)));
+        visibleCells.maxY = std::min(GRID_HEIGHT - 1, static_cast<int>(std::floor((camera.target.y + viewHeight / 2.0f) / CELL_SIZE)));
+        
+        // Sample the 2x sprites whenever a cell covers more than CELL_SIZE pixels
+        atlasLevel = (camera.zoom * GetWindowScaleDPI().x > 1.0f) ? 1 : 0;
+    }
+    
+    bool IsCellVisible(int x, int y, int margin = 0) const {
+        return x >= visibleCells.minX - margin && x <= visibleCells.maxX + margin &&
+               y >= visibleCells.minY - margin && y <= visibleCells.maxY + margin;
     }
 
     void Draw() {
+        TRACE_SCOPE("Draw");
+        ScopedTimer timer(drawTime);
+        renderSnapshots.Acquire();
+        const RenderSnapshot& snapshot = renderSnapshots.ReadBuffer();
+        
+        // Keep interpolating while the next snapshot is on its way
+        float alpha = std::clamp(snapshot.alpha + static_cast<float>(SteadySeconds() - snapshot.publishedAt) / snapshot.tickDuration,
+                                 0.0f, 1.0f);
+        PlaySnapshotSounds(snapshot);
+        
+        UpdateViewport(snapshot, alpha);
+        drawnContentVersion = snapshot.contentVersion;
+        drawnAudioResumed = audioResumed;
+        // Texture mode must not be nested inside the frame's drawing
+        UpdateTerrainTiles(snapshot);
+        UpdateMinimap(snapshot);
+        
         BeginDrawing();
         ClearBackground(DARKGREEN);
+        BeginMode2D(camera);
         
-        // Draw grid
-        for (int y = 0; y < GRID_HEIGHT; y++) {
-            for (int x = 0; x < GRID_WIDTH; x++) {
-                DrawCell(x, y, gameState.grid[y][x]);
+        // Draw the visible terrain tiles (render textures are stored upside down)
+        TileRange visibleTiles = VisibleTiles(0);
+        bool haveCells = snapshot.cells.size() == static_cast<size_t>(GRID_WIDTH * GRID_HEIGHT);
+        for (int tileY = visibleTiles.minY; tileY <= visibleTiles.maxY; tileY++) {
+            for (int tileX = visibleTiles.minX; tileX <= visibleTiles.maxX; tileX++) {
+                int slot = terrainTileSlots[tileY * TERRAIN_TILES_X + tileX];
+                Rectangle bounds = TerrainTileBounds(tileX, tileY);
+                if (slot >= 0) {
+                    const Texture2D& texture = terrainTiles[slot].texture.texture;
+                    Rectangle source = {0.0f, texture.height - bounds.height, bounds.width, -bounds.height};
+                    DrawTexturePro(texture, source, bounds, {0.0f, 0.0f}, 0.0f, WHITE);
+                } else if (haveCells) {
+                    int startX = tileX * TERRAIN_TILE_CELLS;
+                    int startY = tileY * TERRAIN_TILE_CELLS;
+                    for (int y = startY; y < std::min(GRID_HEIGHT, startY + TERRAIN_TILE_CELLS); y++) {
+                        for (int x = startX; x < std::min(GRID_WIDTH, startX + TERRAIN_TILE_CELLS); x++) {
+                            DrawCell(x, y, snapshot.cells[y * GRID_WIDTH + x]);
+                        }
+                    }
+                }
             }
         }
         
-        // Draw animals
-        for (const auto& animal : gameState.animals) {
-            DrawAnimal(animal);
+        // Draw animals (interpolated movement can reach one cell back)
+        for (const auto& animal : snapshot.animals) {
+            if (IsCellVisible(animal.x, animal.y, 1)) DrawAnimal(animal, alpha);
         }
         
-        // Draw bullets
-        for (const auto& bullet : gameState.bullets) {
-            DrawBullet(bullet);
+        // Draw bullets (they travel between cells, so allow one cell of slack)
+        float renderTime = snapshot.gameTime - (1.0f - alpha) * snapshot.tickDuration;
+        for (const auto& bullet : snapshot.bullets) {
+            float distance = std::max(0.0f, renderTime - bullet.startTime) * 8.0f;
+            int cellX = static_cast<int>(std::floor(bullet.x + bullet.dirX * distance));
+            int cellY = static_cast<int>(std::floor(bullet.y + bullet.dirY * distance));
+            if (IsCellVisible(cellX, cellY, 1)) DrawBullet(bullet, renderTime);
         }
         
         // Draw players
-        for (const auto& [id, player] : gameState.players) {
-            DrawPlayer(player);
+        for (const auto& player : snapshot.players) {
+            if (IsCellVisible(player.x, player.y, 1)) DrawPlayer(player, alpha);
+        }
+        
+        for (const auto& sprite : stressSprites) {
+            if (IsCellVisible(sprite.x, sprite.y)) DrawAnimal(sprite, alpha);
+        }
+        
+        spriteBatch.Flush();
+        for (const auto& player : snapshot.players) {
+            if (IsCellVisible(player.x, player.y, 1)) DrawPlayerLabel(player, alpha);
         }
         
+        EndMode2D();
+        
         // Draw UI
-        if (gameState.players.find(localPlayerId) != gameState.players.end()) {
-            DrawText(TextFormat("Score: %d", gameState.players[localPlayerId].score), 10, 10, 20, WHITE);
+        const RenderPlayer* localPlayer = snapshot.FindPlayer(snapshot.localPlayerId);
+        if (localPlayer) {
+            DrawText(TextFormat("Score: %d", localPlayer->score), 10, 10, 20, WHITE);
             
             const char* modeText = "Plant";
-            if (gameState.players[localPlayerId].mode == PlayerMode::SHOOT) modeText = "Shoot";
-            else if (gameState.players[localPlayerId].mode == PlayerMode::CHOP) modeText = "Chop";
+            if (localPlayer->mode == PlayerMode::SHOOT) modeText = "Shoot";
+            else if (localPlayer->mode == PlayerMode::CHOP) modeText = "Chop";
             
             DrawText(TextFormat("Mode: %s (P to switch)", modeText), 10, 35, 20, WHITE);
         } else {
             DrawText("Waiting for player initialization...", 10, 10, 20, YELLOW);
         }
-        DrawText("WASD/Arrows: Move, SPACE: Action", 10, 60, 16, WHITE);
+        DrawText("WASD/Arrows: Move, SPACE: Action, Wheel or +/-: Zoom, M: Map", 10, 60, 16, WHITE);
         
         // Show sprite loading status and debug info
         if (!spritesLoaded) {
             DrawText("Note: robban.png not found - using fallback graphics", 10, 80, 14, YELLOW);
         } else {
-            DrawText(TextFormat("Using sprites: %dx%d", spriteSheet.width, spriteSheet.height), 10, 80, 14, GREEN);
+            DrawText(TextFormat("Using sprite atlas: %dx%d", spriteAtlas.width, spriteAtlas.height), 10, 80, 14, GREEN);
         }
         
         // Show audio status
@@ -1270,33 +2655,508 @@ public:
         
         // Show shooting direction
         int uiOffset = spritesLoaded ? 80 : 100;
-        if (gameState.players.find(localPlayerId) != gameState.players.end() &&
-            gameState.players[localPlayerId].mode == PlayerMode::SHOOT) {
+        if (localPlayer && localPlayer->mode == PlayerMode::SHOOT) {
             const char* dirText = "No direction";
-            if (gameState.players[localPlayerId].lastDirectionX > 0) dirText = "Shooting →";
-            else if (gameState.players[localPlayerId].lastDirectionX < 0) dirText = "Shooting ←";
-            else if (gameState.players[localPlayerId].lastDirectionY > 0) dirText = "Shooting ↓";
-            else if (gameState.players[localPlayerId].lastDirectionY < 0) dirText = "Shooting ↑";
+            if (localPlayer->lastDirectionX > 0) dirText = "Shooting →";
+            else if (localPlayer->lastDirectionX < 0) dirText = "Shooting ←";
+            else if (localPlayer->lastDirectionY > 0) dirText = "Shooting ↓";
+            else if (localPlayer->lastDirectionY < 0) dirText = "Shooting ↑";
             
             DrawText(dirText, 10, uiOffset, 16, YELLOW);
             uiOffset += 20;
         }
         
         // Multiplayer UI
-        if (isMultiplayer && networkManager) {
-            DrawText(TextFormat("Room: %s", currentRoom.c_str()), 10, uiOffset, 16, WHITE);
-            DrawText(TextFormat("Players: %d", networkManager->GetPlayerCount()), 10, uiOffset + 20, 16, WHITE);
+        if (snapshot.multiplayer) {
+            DrawText(TextFormat("Room: %s", snapshot.room.c_str()), 10, uiOffset, 16, WHITE);
+            DrawText(TextFormat("Players: %d", snapshot.playerCount), 10, uiOffset + 20, 16, WHITE);
             
-            if (networkManager->IsHost()) {
+            if (snapshot.host) {
                 DrawText("HOST", 10, uiOffset + 40, 16, YELLOW);
             }
+            uiOffset += 60;
         } else {
-            DrawText("Press H to host, J to join", 10, uiOffset, 16, WHITE);
+            DrawText("Press H to host, J to join, L for lockstep", 10, uiOffset, 16, WHITE);
+            uiOffset += 20;
+        }
+        
+        if (snapshot.lockstep) {
+            DrawText(TextFormat("LOCKSTEP tick %d", snapshot.lockstepTick), 10, uiOffset, 16, SKYBLUE);
+            if (snapshot.desynced) {
+                DrawText(TextFormat("DESYNC at tick %d (player %d)", snapshot.desyncTick, snapshot.desyncPlayerId),
+                         10, uiOffset + 20, 16, RED);
+            }
+        }
+        
+        DrawMinimap(snapshot);
+        
+        if (!stressSprites.empty()) {
+            DrawText(TextFormat("STRESS %d sprites: %d quads in %d batches, %.2f ms/frame",
+                                static_cast<int>(stressSprites.size()), spriteBatch.GetLastQuadCount(),
+                                spriteBatch.GetLastBatchCount(), GetFrameTime() * 1000.0f),
+                     10, WINDOW_HEIGHT - 26, 16, ORANGE);
+            DrawFPS(WINDOW_WIDTH - 90, 10);
+            ReportStressFrame();
         }
         
         EndDrawing();
     }
 
+    void PlaySnapshotSounds(const RenderSnapshot& snapshot) {
+        bool audible = soundsLoaded && audioResumed;
+        if (audible && snapshot.shootSounds != playedShootSounds) PlaySound(shootSound);
+        if (audible && snapshot.axeSounds != playedAxeSounds) PlaySound(axeSound);
+        playedShootSounds = snapshot.shootSounds;
+        playedAxeSounds = snapshot.axeSounds;
+    }
+
+    void SetSimulationRate(int ticksPerSecond) {
+        simTickDuration = 1.0f / static_cast<float>(std::clamp(ticksPerSecond, 1, 240));
+        LOGI(GAME, "Simulating at " << ticksPerSecond << " Hz");
+    }
+    
+    // Checkpoints go to path from now on, and the first time we host, the
+    // world saved there (if any) replaces the freshly generated one
+    void EnableWorldSaves(const std::string& path) {
+        worldCheckpointer = std::make_unique<WorldCheckpointer>(path);
+        LOGI(SAVE, "World saves: " << path);
+    }
+    
+    WorldMeta CurrentWorldMeta() const {
+        WorldMeta meta;
+        meta.gameTime = gameTime;
+        meta.nextAnimalId = nextAnimalId;
+        meta.rng = rng;
+        return meta;
+    }
+    
+    void ResumeSavedWorld() {
+        if (!worldCheckpointer || worldResumed) return;
+        worldResumed = true;
+        lastCheckpointTime = gameTime;
+        
+        GameState saved;
+        WorldMeta meta;
+        if (!LoadWorld(worldCheckpointer->GetPath(), saved, meta)) return;
+        if (saved.grid.size() != GRID_HEIGHT || saved.grid[0].size() != GRID_WIDTH) {
+            LOGW(SAVE, "Saved world is " << (saved.grid.empty() ? 0 : saved.grid[0].size()) << "x"
+                       << saved.grid.size() << ", this build plays on " << GRID_WIDTH << "x" << GRID_HEIGHT);
+            return;
+        }
+        
+        gameState.grid.swap(saved.grid);
+        gameState.animals.swap(saved.animals);
+        gameState.bullets.clear();
+        // The host takes up where it left off; everyone else joins afresh with a new id
+        auto host = saved.players.find(localPlayerId);
+        if (host != saved.players.end()) {
+            host->second.username = globalUsername;
+            gameState.players[localPlayerId] = std::move(host->second);
+        }
+        rng = meta.rng;
+        gameTime = meta.gameTime;
+        nextAnimalId = meta.nextAnimalId;
+        lastSnapshotTime = gameTime;
+        lastStateHashTime = gameTime;
+        lastCheckpointTime = gameTime;
+        
+        stateHash.Rebuild(gameState, gameTime);
+        MarkGridChanged();
+        journalKeyframeDue = true;
+        LOGI(SAVE, "Resumed world from " << worldCheckpointer->GetPath() << " at " << gameTime << " s, "
+                   << gameState.animals.size() << " animals");
+    }
+    
+    // Records the session to path from now on. Only a world we simulate
+    // ourselves (hosting, or lockstep) is journaled; a client's is the host's
+    void StartJournal(const std::string& path) {
+        if (journal.Open(path)) {
+            journalKeyframeDue = true;
+        }
+    }
+    
+    bool IsJournaling() const {
+        return journal.IsOpen() && (isHost || lockstep);
+    }
+    
+    // Called before each simulation step with the inputs it will apply
+    void RecordJournalTick(float tickTime, float dt, const PlayerInput* inputs, size_t count) {
+        if (!IsJournaling()) return;
+        if (journalKeyframeDue || journalTick % JOURNAL_KEYFRAME_TICKS == 0) {
+            journal.WriteKeyframe(journalTick, localPlayerId, stateHash.GetHash(), gameState, CurrentWorldMeta());
+            journalKeyframeDue = false;
+        }
+        journal.WriteTick(tickTime, dt, inputs, count);
+        journalTick++;
+    }
+    
+    // Headless: runs a journal from the last keyframe at or before seekTick
+    // to its end as fast as it will go, checking the world against every
+    // keyframe on the way. 0 if they all matched, 1 if the replay diverged
+    int PlayReplay(const std::string& path, int seekTick) {
+        auto openStart = std::chrono::steady_clock::now();
+        JournalReader reader;
+        if (!reader.Open(path)) {
+            LOGE(GAME, "Could not read journal " << path);
+            return 2;
+        }
+        GameState keyframeState;
+        WorldMeta meta;
+        JournalEntry entry;
+        if (!reader.Seek(std::max(0, seekTick), keyframeState, meta, entry)) {
+            LOGE(GAME, "No keyframe at or before tick " << seekTick << " in " << path);
+            return 2;
+        }
+        
+        gameState = std::move(keyframeState);
+        rng = meta.rng;
+        gameTime = meta.gameTime;
+        nextAnimalId = meta.nextAnimalId;
+        localPlayerId = entry.localPlayerId;
+        stateHash.Rebuild(gameState, gameTime);
+        MarkGridChanged();
+        int startTick = entry.tick;
+        float startTime = gameTime;
+        double seekSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openStart).count();
+        LOGI(GAME, "Replaying " << path << " from tick " << startTick << " of " << reader.GetTickCount()
+                   << " (" << reader.GetKeyframeCount() << " keyframes), seek took " << seekSeconds * 1000.0 << " ms");
+        
+        auto replayStart = std::chrono::steady_clock::now();
+        int ticks = 0;
+        int checked = 0;
+        int mismatches = 0;
+        while (reader.Next(entry)) {
+            switch (entry.type) {
+                case JournalRecord::KEYFRAME:
+                    checked++;
+                    if (entry.stateHash != stateHash.GetHash()) {
+                        // Everything after the first divergence follows from it
+                        if (mismatches++ == 0) {
+                            LOGW(GAME, "Replay diverged by tick " << entry.tick);
+                        }
+                    }
+                    break;
+                case JournalRecord::TICK:
+                    BeginSimTick();
+                    gameTime = entry.gameTime;
+                    for (const PlayerInput& input : entry.inputs) {
+                        ApplyPlayerInput(input.playerId, input);
+                    }
+                    UpdateWorld();
+                    EasePlayerRotations(entry.dt);
+                    ticks++;
+                    break;
+                case JournalRecord::JOIN:
+                    AddPlayer(entry.playerId);
+                    break;
+                case JournalRecord::LEAVE:
+                    RemovePlayer(entry.playerId);
+                    break;
+                case JournalRecord::PLAYER_UPDATE:
+                    ApplyPlayerUpdate(entry.player);
+                    break;
+                case JournalRecord::ACTION:
+                    HandlePlayerAction(entry.action.playerId, entry.action.targetX, entry.action.targetY,
+                                       entry.action.actionType);
+                    break;
+            }
+        }
+        
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+        float simulatedSeconds = gameTime - startTime;
+        LOGI(GAME, "Replayed " << ticks << " ticks (" << simulatedSeconds << " s of play) in " << wallSeconds << " s, "
+                   << (wallSeconds > 0.0 ? simulatedSeconds / wallSeconds : 0.0) << "x real time; "
+                   << checked << " keyframes checked, " << mismatches << " diverged");
+        return mismatches == 0 ? 0 : 1;
+    }
+    
+    // Scatter render-only sprites over the map and stop capping the frame rate,
+    // so frame time reflects the renderer (e.g. under LIBGL_ALWAYS_SOFTWARE=1)
+    void StartStress(int count) {
+        std::mt19937 stressRandom(12345);
+        std::uniform_int_distribution<int> cellX(0, GRID_WIDTH - 1);
+        std::uniform_int_distribution<int> cellY(0, GRID_HEIGHT - 1);
+        
+        stressSprites.clear();
+        stressSprites.reserve(count);
+        for (int i = 0; i < count; i++) {
+            int x = cellX(stressRandom);
+            int y = cellY(stressRandom);
+            AnimalType type = (i % 2 == 0) ? AnimalType::RABBIT : AnimalType::DEER;
+            stressSprites.push_back({-1 - i, type, x, y, x, y});
+        }
+        
+        SetTargetFPS(0);
+        LOGI(STRESS, "Drawing " << count << " extra sprites, frame rate uncapped");
+    }
+    
+    void ReportStressFrame() {
+        stressFrameTime += GetFrameTime();
+        stressFrames++;
+        stressReportTimer += GetFrameTime();
+        if (stressReportTimer < 5.0f) return;
+        
+        float averageMs = stressFrameTime / stressFrames * 1000.0f;
+        LOGI(STRESS, stressSprites.size() << " sprites: " << averageMs << " ms/frame avg over "
+                     << stressFrames << " frames, " << spriteBatch.GetLastQuadCount() << " quads in "
+                     << spriteBatch.GetLastBatchCount() << " batches");
+        stressFrameTime = 0.0f;
+        stressFrames = 0;
+        stressReportTimer = 0.0f;
+    }
+
+    void StartAllocCheck(int ticks) {
+        if (!alloc::IsCompiledIn()) {
+            LOGE(GAME, "--alloc-check needs a build configured with -DALLOC_TRACKING=ON");
+            allocCheckResult = 2;
+            return;
+        }
+        allocCheckTicks = ticks;
+        networkManager->EnableLoopback();
+        
+        // Host as player 0, then let the bot in as player 1
+        currentRoom = "AllocCheck";
+        isMultiplayer = true;
+        isHost = true;
+        AddPlayer(localPlayerId);
+        networkManager->CreateRoom(currentRoom);
+        networkManager->HandlePlayerJoined("loopback");
+        allocCheckBot = gameState.players[ALLOC_CHECK_BOT_ID];
+        allocCheckBot.username = "bot";
+        LOGI(GAME, "Allocation check: " << ALLOC_CHECK_WARMUP_TICKS << " warm-up ticks, then " << ticks << " measured");
+    }
+    
+    bool IsAllocCheckRunning() const { return allocCheckTicks > 0 && allocCheckResult < 0; }
+    int GetAllocCheckResult() const { return allocCheckResult; }
+    
+    PlayerInput RandomBotInput(int playerId) {
+        static const int steps[4][2] = {{0, 1}, {0, -1}, {1, 0}, {-1, 0}};
+        PlayerInput input = {};
+        input.playerId = playerId;
+        input.mode = -1;
+        if (allocCheckRandom.NextInt(100) < 40) {
+            const int* step = steps[allocCheckRandom.NextInt(4)];
+            input.moveX = step[0];
+            input.moveY = step[1];
+        }
+        if (allocCheckRandom.NextInt(100) < 5) {
+            input.mode = static_cast<int>(allocCheckRandom.NextInt(3));
+        }
+        input.action = allocCheckRandom.NextInt(100) < 20;
+        return input;
+    }
+    
+    // Plays the bot as its own client would: it moves itself and tells the
+    // host, which receives it all through the decoders on the next tick
+    void DriveAllocCheckBot() {
+        PlayerInput input = RandomBotInput(ALLOC_CHECK_BOT_ID);
+        Player& bot = allocCheckBot;
+        int newX = bot.x + input.moveX;
+        int newY = bot.y + input.moveY;
+        if ((input.moveX != 0 || input.moveY != 0) && newX >= 0 && newX < GRID_WIDTH && newY >= 0 && newY < GRID_HEIGHT) {
+            bot.x = newX;
+            bot.y = newY;
+            bot.lastDirectionX = input.moveX;
+            bot.lastDirectionY = input.moveY;
+        }
+        if (input.mode >= 0) {
+            bot.mode = static_cast<PlayerMode>(input.mode);
+            networkManager->SendPlayerModeChange(ALLOC_CHECK_BOT_ID, input.mode);
+        }
+        networkManager->SendPlayerUpdate(bot);
+        if (input.action) {
+            ActionMessage action = {ALLOC_CHECK_BOT_ID, bot.x, bot.y, static_cast<int>(bot.mode)};
+            networkManager->SendPlayerAction(action);
+        }
+        
+        // The rarer messages too, so their codecs warm up and get checked
+        if (allocCheckTick % 120 == 0) {
+            uint64_t summary = CollectChunkHashes(reportedChunks);
+            networkManager->SendStateHash(ALLOC_CHECK_BOT_ID, summary, reportedChunks);
+        }
+        if (allocCheckTick % 30 == 0) {
+            networkManager->SendGameState(gameState);
+        }
+    }
+    
+    // Stands in for Update() during --alloc-check
+    void UpdateAllocCheck() {
+        FrameInput frame = {};
+        frame.player = RandomBotInput(localPlayerId);
+        frameInputs.Push(frame);
+        
+        bool measuring = allocCheckTick >= ALLOC_CHECK_WARMUP_TICKS;
+        if (measuring) {
+            alloc::CaptureNextStack();
+        }
+        alloc::Scope scope;
+        DriveAllocCheckBot();
+        Simulate(simTickDuration);
+        PublishSnapshot();
+        uint64_t allocations = scope.Allocations();
+        
+        if (measuring && allocations > 0) {
+            allocCheckFailures++;
+            LOGE(GAME, "Tick " << allocCheckTick << " allocated " << allocations << " times (" << scope.Bytes()
+                       << " bytes), the first one from:");
+            Log::Flush();
+            if (!alloc::WriteCapturedStack()) {
+                LOGE(GAME, "(no stack, call stacks are only captured with glibc)");
+            }
+        }
+        
+        allocCheckTick++;
+        if (allocCheckTick == ALLOC_CHECK_WARMUP_TICKS) {
+            LOGI(GAME, "Allocation check warmed up, measuring");
+        }
+        if (allocCheckTick >= ALLOC_CHECK_WARMUP_TICKS + allocCheckTicks) {
+            if (allocCheckFailures == 0) {
+                LOGI(GAME, "Allocation check passed: " << allocCheckTicks << " ticks without a heap allocation ("
+                           << networkManager->GetMessagesReceived() << " messages decoded)");
+            } else {
+                LOGE(GAME, "Allocation check failed: " << allocCheckFailures << " of " << allocCheckTicks
+                           << " ticks allocated");
+            }
+            allocCheckResult = allocCheckFailures == 0 ? 0 : 1;
+        }
+    }
+
+    // --headless N: the simulation thread, the input queue and the snapshot
+    // handoff without a window or GL. The calling thread stands in for the
+    // renderer, feeding random input and checking every snapshot. Natively
+    // the game hosts over the loopback transport; in the pthreads web build
+    // under Node, headless_peer.js plays PeerJS, clicks Host through the
+    // lobby callbacks and joins as a client
+    void StartHeadless(double seconds) {
+        headlessEnd = SteadySeconds() + seconds;
+        #ifndef PLATFORM_WEB
+        networkManager->EnableLoopback();
+        currentRoom = "Headless";
+        isMultiplayer = true;
+        isHost = true;
+        AddPlayer(localPlayerId);
+        networkManager->CreateRoom(currentRoom);
+        networkManager->HandlePlayerJoined("loopback");
+        #endif
+        StartSimulationThread();
+        LOGI(GAME, "Headless run for " << seconds << " s");
+    }
+    
+    // One frame of the stand-in renderer; false once the run is over
+    bool UpdateHeadless() {
+        if (renderSnapshots.Acquire()) {
+            const RenderSnapshot& snapshot = renderSnapshots.ReadBuffer();
+            headlessSnapshots++;
+            if (snapshot.gameTime < headlessGameTime) {
+                headlessErrors++;
+                LOGE(GAME, "Snapshot went back in time, " << headlessGameTime << " s to " << snapshot.gameTime << " s");
+            }
+            if (snapshot.cells.size() != static_cast<size_t>(GRID_WIDTH * GRID_HEIGHT) ||
+                snapshot.rowVersions.size() != static_cast<size_t>(GRID_HEIGHT)) {
+                headlessErrors++;
+                LOGE(GAME, "Snapshot grid is " << snapshot.cells.size() << " cells, expected " << GRID_WIDTH * GRID_HEIGHT);
+            }
+            headlessGameTime = snapshot.gameTime;
+            headlessPlayers = std::max(headlessPlayers, static_cast<int>(snapshot.players.size()));
+            headlessMessages = snapshot.networkMessages;
+        }
+        
+        FrameInput frame = {};
+        frame.player = RandomBotInput(renderSnapshots.ReadBuffer().localPlayerId);
+        if (!frameInputs.Push(frame)) {
+            headlessDroppedInputs++;
+        }
+        headlessFrames++;
+        return SteadySeconds() < headlessEnd;
+    }
+    
+    // Stops the simulation thread and reports; 0 if the simulation kept
+    // publishing sane snapshots
+    int FinishHeadless(double seconds) {
+        StopSimulationThread();
+        bool advanced = headlessGameTime > seconds * 0.5;
+        bool passed = headlessErrors == 0 && advanced && headlessPlayers > 0;
+        LOGI(GAME, "Headless run " << (passed ? "passed" : "failed") << ": " << headlessFrames << " frames, "
+                   << headlessSnapshots << " snapshots, " << headlessGameTime << " s simulated in " << seconds << " s, "
+                   << headlessPlayers << " players, " << headlessMessages << " messages decoded, "
+                   << headlessDroppedInputs << " inputs dropped, " << headlessErrors << " errors");
+        if (!advanced) {
+            LOGE(GAME, "The simulation fell behind or stalled");
+        }
+        return passed ? 0 : 1;
+    }
+    
+    // --lockstep-check N: a host and a client play a lockstep session of N
+    // ticks over the in-process transport, with random input, and a third
+    // game connects halfway through and is brought into the session. Every
+    // game has to finish tick N with the same state hash and without having
+    // seen a desync. 0 if they did
+    static int RunLockstepCheck(int ticks) {
+        RobbanPlanterar host(true);
+        RobbanPlanterar client(true);
+        RobbanPlanterar joiner(true);
+        host.currentRoom = "LockstepCheck";
+        host.isMultiplayer = true;
+        host.isHost = true;
+        host.AddPlayer(host.localPlayerId);
+        host.networkManager->HostLocal(host.currentRoom);
+        client.networkManager->JoinLocal(*host.networkManager, "client");
+        std::vector<RobbanPlanterar*> games = {&host, &client};
+        
+        int joinedAt = -1;
+        for (int step = 0; step < ticks * 10; step++) {
+            if (joinedAt < 0 && host.lockstep && host.lockstep->GetCurrentTick() >= ticks / 2) {
+                joinedAt = host.lockstep->GetCurrentTick();
+                joiner.networkManager->JoinLocal(*host.networkManager, "joiner");
+                games.push_back(&joiner);
+            }
+            bool finished = joinedAt >= 0;
+            for (RobbanPlanterar* game : games) {
+                // Past the last tick a game still forwards and takes in inputs
+                game->networkManager->ProcessMessages();
+                int remaining = game->lockstep ? ticks - game->lockstep->GetCurrentTick() : ticks;
+                finished = finished && remaining == 0;
+                if (remaining == 0) continue;
+                FrameInput frame = {};
+                frame.player = game->RandomBotInput(game->localPlayerId);
+                frame.lockstep = game == &host && step == 10;  // A few ticks in, once the client has its id
+                game->frameInputs.Push(frame);
+                if (game->lockstep) {
+                    // Never past the last tick, however far behind it is
+                    float tickDuration = game->lockstep->GetTickDuration();
+                    game->lockstepAccumulator = std::min(game->lockstepAccumulator, (remaining - 1) * tickDuration);
+                }
+                game->Simulate(game->GetTickDuration());
+            }
+            if (finished) break;
+        }
+        
+        bool passed = joinedAt >= 0;
+        uint64_t hostHash = host.stateHash.GetHash();
+        for (RobbanPlanterar* game : games) {
+            const char* role = game == &host ? "host" : game == &client ? "client" : "joiner";
+            if (!game->lockstep || game->lockstep->GetCurrentTick() != ticks) {
+                LOGE(GAME, "The " << role << " stopped at tick " << (game->lockstep ? game->lockstep->GetCurrentTick() : -1));
+                passed = false;
+            } else if (game->lockstep->IsDesynced()) {
+                LOGE(GAME, "The " << role << " saw a desync at tick " << game->lockstep->GetDesyncTick() << " with player "
+                           << game->lockstep->GetDesyncPlayerId());
+                passed = false;
+            } else if (game->stateHash.GetHash() != hostHash || game->gameState.players.size() != games.size()) {
+                LOGE(GAME, "The " << role << " ended with " << game->gameState.players.size() << " players, hash "
+                           << std::hex << game->stateHash.GetHash() << " against the host's " << hostHash << std::dec);
+                passed = false;
+            }
+        }
+        if (passed) {
+            LOGI(GAME, "Lockstep check passed: " << games.size() << " games at tick " << ticks << " with hash " << std::hex
+                       << hostHash << std::dec << ", the third connected at tick " << joinedAt);
+        } else {
+            LOGE(GAME, "Lockstep check failed");
+        }
+        return passed ? 0 : 1;
+    }
+    
     void AddPlayer(int playerId) {
         if (gameState.players.find(playerId) == gameState.players.end()) {
             Player newPlayer;
@@ -1309,6 +3169,7 @@ public:
 
     void RemovePlayer(int playerId) {
         gameState.players.erase(playerId);
+        stateHash.RemovePlayer(playerId);
     }
 };
 
@@ -1318,37 +3179,281 @@ extern "C" void setUsername(const char* name) {
 
 // Callback function to handle peer ready event (defined after class to access members)
 extern "C" void HandlePeerReady(const char* peerId) {
-    std::cout << "[Game] HandlePeerReady called with peer ID: " << peerId << std::endl;
+    LOGI(GAME, "HandlePeerReady called with peer ID: " << peerId);
     if (g_gameInstance && g_gameInstance->firebaseReporter) {
         g_gameInstance->firebaseReporter->UpdateRoomId(peerId);
         g_gameInstance->currentRoom = peerId;
         g_gameInstance->firebaseReporter->ReportNow();
-        std::cout << "[Game] Firebase reporter updated with room ID: " << peerId << std::endl;
+        LOGI(GAME, "Firebase reporter updated with room ID: " << peerId);
     } else {
-        std::cout << "[Game] WARNING: Cannot update Firebase reporter (game instance or reporter is null)" << std::endl;
+        LOGW(GAME, "Cannot update Firebase reporter (game instance or reporter is null)");
     }
 }
 
-int main() {
+#ifdef PLATFORM_WEB
+// One iteration of the game loop; the web build can't block in a while loop
+// without ASYNCIFY, so the browser drives it instead
+static void RunWebFrame(void* arg) {
+    RobbanPlanterar* game = static_cast<RobbanPlanterar*>(arg);
+    game->Update();
+    game->Present();
+    Log::Flush();  // No writer thread on the web
+}
+
+// The same for the pthreads build, where the simulation runs in a worker
+static void RunThreadedWebFrame(void* arg) {
+    RobbanPlanterar* game = static_cast<RobbanPlanterar*>(arg);
+    game->PollFrameInput();
+    game->Present();
+    Log::Flush();
+}
+
+#ifdef ROBBAN_WEB_THREADS
+static double g_headlessSeconds = 0.0;
+
+// --headless under Node: returning to the event loop between frames lets the
+// main thread run the JavaScript calls the worker proxies to it
+static void RunHeadlessWebFrame(void* arg) {
+    RobbanPlanterar* game = static_cast<RobbanPlanterar*>(arg);
+    bool running = game->UpdateHeadless();
+    Log::Flush();
+    if (!running) {
+        int result = game->FinishHeadless(g_headlessSeconds);
+        Log::Flush();
+        emscripten_cancel_main_loop();
+        emscripten_force_exit(result);
+    }
+}
+#endif
+#endif
+
+// Sleeps out the rest of an adaptively paced frame; otherwise EndDrawing()
+// already waited for the target frame rate
+static void WaitForNextFrame(const RobbanPlanterar& game, double frameStart) {
+    if (!game.IsAdaptiveFrames()) return;
+    double remaining = frameStart + game.GetFrameInterval() - GetTime();
+    if (remaining > 0.0) WaitTime(remaining);
+}
+
+int main(int argc, char** argv) {
+    int stressCount = 0;
+    int simRate = SIM_TICK_RATE;
+    bool threaded = false;
+    bool fixedFps = false;
+    int allocCheckTicks = 0;
+    double headlessSeconds = 0.0;
+    #ifndef PLATFORM_WEB
+    int lockstepCheckTicks = 0;
+    int metricsPort = 0;
+    std::string metricsFile;
+    int benchFanoutPeers = 0;
+    std::string worldPath;
+    std::string journalPath;
+    bool journalEnabled = true;
+    std::string replayPath;
+    int replaySeekTick = 0;
+    #endif
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stress" && i + 1 < argc) {
+            stressCount = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--sim-hz" && i + 1 < argc) {
+            simRate = std::atoi(argv[++i]);
+        } else if (arg == "--fixed-fps") {
+            fixedFps = true;  // Draw every frame at 60 fps, as before adaptive pacing
+        } else if (arg == "--headless") {
+            // Optional duration in seconds
+            bool hasSeconds = i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9';
+            headlessSeconds = hasSeconds ? std::max(1.0, std::atof(argv[++i])) : 10.0;
+        } else if (arg == "--log" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            if (!Log::Configure(spec)) {
+                LOGW(GAME, "Could not parse --log " << spec << ", expected e.g. net=debug,firebase=warning");
+            }
+        }
+        #ifndef PLATFORM_WEB
+        if (arg == "--threaded") {
+            threaded = true;  // The web build decides at compile time
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            metricsPort = std::atoi(argv[++i]);
+        } else if (arg == "--metrics-file" && i + 1 < argc) {
+            metricsFile = argv[++i];
+        } else if (arg == "--alloc-check") {
+            // Optional tick count
+            bool hasCount = i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9';
+            allocCheckTicks = hasCount ? std::max(1, std::atoi(argv[++i])) : 1800;
+        } else if (arg == "--lockstep-check") {
+            // Optional tick count
+            bool hasCount = i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9';
+            lockstepCheckTicks = hasCount ? std::max(100, std::atoi(argv[++i])) : 600;
+        } else if (arg == "--bench-fanout") {
+            // Optional peer count
+            bool hasCount = i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9';
+            benchFanoutPeers = hasCount ? std::max(1, std::atoi(argv[++i])) : 8;
+        } else if (arg == "--world" && i + 1 < argc) {
+            worldPath = argv[++i];
+        } else if (arg == "--journal" && i + 1 < argc) {
+            journalPath = argv[++i];
+        } else if (arg == "--no-journal") {
+            journalEnabled = false;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--seek" && i + 1 < argc) {
+            replaySeekTick = std::max(0, std::atoi(argv[++i]));
+        }
+        #endif
+    }
+    
+    // Stress runs measure the renderer, so they draw every frame as fast as possible
+    bool adaptiveFrames = !fixedFps && stressCount == 0;
+    
+    #ifdef ROBBAN_TRACING
+    TRACE_THREAD_NAME("main");
+    trace::InstallSignalHandler();
+    #endif
+    
+    #ifndef PLATFORM_WEB
+    // Headless, so no window
+    if (benchFanoutPeers > 0) {
+        int result = RunFanoutBenchmark(benchFanoutPeers, 10.0, GRID_WIDTH, GRID_HEIGHT, GameInterestConfig());
+        Log::Flush();
+        return result;
+    }
+    if (lockstepCheckTicks > 0) {
+        int result = RobbanPlanterar::RunLockstepCheck(lockstepCheckTicks);
+        Log::Flush();
+        return result;
+    }
+    if (headlessSeconds > 0.0) {
+        int result;
+        {
+            RobbanPlanterar game(true);
+            g_gameInstance = &game;
+            game.StartHeadless(headlessSeconds);
+            while (game.UpdateHeadless()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(16));
+            }
+            result = game.FinishHeadless(headlessSeconds);
+            g_gameInstance = nullptr;
+        }
+        Log::Flush();
+        return result;
+    }
+    if (!replayPath.empty()) {
+        int result;
+        {
+            RobbanPlanterar replay(true);
+            result = replay.PlayReplay(replayPath, replaySeekTick);
+        }
+        Log::Flush();
+        return result;
+    }
+    #else
+    if (headlessSeconds > 0.0) {
+        #ifdef ROBBAN_WEB_THREADS
+        // simulate_infinite_loop keeps game alive until RunHeadlessWebFrame exits
+        RobbanPlanterar game(true);
+        g_gameInstance = &game;
+        g_headlessSeconds = headlessSeconds;
+        SetPeerReadyCallback(HandlePeerReady);
+        game.StartHeadless(headlessSeconds);
+        emscripten_set_main_loop_arg(RunHeadlessWebFrame, &game, 60, 1);
+        #else
+        LOGE(GAME, "--headless needs the pthreads web build (robban_headless_mt)");
+        Log::Flush();
+        return 2;
+        #endif
+    }
+    #endif
+    
     InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Robban Planterar");
-    SetTargetFPS(60);
+    #ifndef PLATFORM_WEB
+    // The browser paces frames with requestAnimationFrame; adaptive pacing waits by itself
+    SetTargetFPS(adaptiveFrames ? 0 : 60);
+    #endif
     
     RobbanPlanterar game;
     g_gameInstance = &game;  // Set global pointer for callbacks
+    if (simRate != SIM_TICK_RATE) {
+        game.SetSimulationRate(simRate);
+    }
+    if (stressCount > 0) {
+        game.StartStress(stressCount);
+    }
+    game.SetAdaptiveFrames(adaptiveFrames);
+    #ifdef PLATFORM_WEB
+    // Kept in IndexedDB, so a host that closes the tab gets its forest back
+    MountWorldStorage("/saves");
+    game.EnableWorldSaves("/saves/world.rbw");
+    #else
+    if (!worldPath.empty()) {
+        game.EnableWorldSaves(worldPath);
+    }
+    // Every session is recorded unless it is a measurement run
+    if (journalEnabled && allocCheckTicks == 0 && stressCount == 0) {
+        if (journalPath.empty()) {
+            char stamp[32];
+            std::time_t now = std::time(nullptr);
+            std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+            journalPath = std::string("robban-journal-") + stamp + ".rbj";
+        }
+        game.StartJournal(journalPath);
+    }
+    #endif
     
     // Register the peer ready callback
     #ifdef PLATFORM_WEB
     SetPeerReadyCallback(HandlePeerReady);
+    
+    // The browser calls RunWebFrame once per animation frame. With
+    // simulate_infinite_loop main() never returns, so game stays alive
+    // (and is never destroyed) for the lifetime of the page
+    #ifdef ROBBAN_WEB_THREADS
+    game.StartSimulationThread();
+    emscripten_set_main_loop_arg(RunThreadedWebFrame, &game, 0, 1);
+    #else
+    emscripten_set_main_loop_arg(RunWebFrame, &game, 0, 1);
+    #endif
     #endif
     
-    while (!WindowShouldClose()) {
-        game.Update();
-        game.Draw();
+    #ifndef PLATFORM_WEB
+    MetricsExporter metricsExporter;
+    if (metricsPort > 0 || !metricsFile.empty()) {
+        metricsExporter.Start(metricsPort, metricsFile);
+    }
+    #endif
+    
+    int exitCode = 0;
+    if (allocCheckTicks > 0) {
+        // Single-threaded and unpaced, so the ticks run back to back
+        game.StartAllocCheck(allocCheckTicks);
+        while (game.IsAllocCheckRunning() && !WindowShouldClose()) {
+            game.UpdateAllocCheck();
+            game.Present();
+        }
+        exitCode = std::max(0, game.GetAllocCheckResult());
+    } else if (threaded) {
+        // This thread only polls input and draws; the simulation runs on its own
+        game.StartSimulationThread();
+        while (!WindowShouldClose()) {
+            double frameStart = GetTime();
+            game.PollFrameInput();
+            game.Present();
+            WaitForNextFrame(game, frameStart);
+        }
+        game.StopSimulationThread();
+    } else {
+        while (!WindowShouldClose()) {
+            double frameStart = GetTime();
+            game.Update();
+            game.Present();
+            WaitForNextFrame(game, frameStart);
+        }
     }
     
     g_gameInstance = nullptr;  // Clean up
     CloseWindow();
-    return 0;
+    return exitCode;
 }
 
 
@@ -0,0 +1,221 @@
+// Checks the native FirebaseReporter against tools/firebase_mock.py: that a
+// burst of ReportNow() calls is coalesced into one or two reports carrying
+// the latest roster, that reports share one kept-alive connection, that
+// failures back off exponentially, and that Stop() abandons a hung report
+// at once. Run through the mock, which passes its address:
+//
+//     python3 tools/firebase_mock.py --run ./firebase_harness
+//
+// Exits non-zero if any check fails.
+
+#include "FirebaseReporter.h"
+#include "Log.h"
+#include <curl/curl.h>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct MockRequest {
+    double seconds = 0.0;
+    int port = 0;
+    int status = 0;
+    std::string body;
+};
+
+size_t AppendResponse(void* contents, size_t size, size_t nmemb, void* userp) {
+    static_cast<std::string*>(userp)->append(static_cast<char*>(contents), size * nmemb);
+    return size * nmemb;
+}
+
+class Mock {
+private:
+    std::string base;
+
+    bool Get(const std::string& path, std::string& response) {
+        CURL* curl = curl_easy_init();
+        if (!curl) return false;
+        std::string url = base + path;
+        response.clear();
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendResponse);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+        CURLcode result = curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+        return result == CURLE_OK;
+    }
+
+public:
+    explicit Mock(const std::string& base) : base(base) {}
+
+    std::string StatusUrl() const { return base + "/api/server/status"; }
+
+    // Clears what was received and sets how the next reports are answered
+    bool Control(const std::string& query) {
+        std::string response;
+        return Get("/control?reset=1&" + query, response);
+    }
+
+    std::vector<MockRequest> Requests() {
+        std::vector<MockRequest> requests;
+        std::string response;
+        if (!Get("/requests", response)) return requests;
+        std::istringstream lines(response);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::istringstream fields(line);
+            MockRequest request;
+            fields >> request.seconds >> request.port >> request.status;
+            std::getline(fields, request.body);
+            requests.push_back(request);
+        }
+        return requests;
+    }
+
+    // Polls until at least count reports arrived, or the timeout passes
+    std::vector<MockRequest> WaitForRequests(size_t count, double timeoutSeconds) {
+        auto deadline = Clock::now() + std::chrono::duration<double>(timeoutSeconds);
+        std::vector<MockRequest> requests = Requests();
+        while (requests.size() < count && Clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            requests = Requests();
+        }
+        return requests;
+    }
+};
+
+int failures = 0;
+
+void Check(bool passed, const std::string& what) {
+    if (passed) {
+        LOGI(FIREBASE, "PASS " << what);
+    } else {
+        LOGE(FIREBASE, "FAIL " << what);
+        failures++;
+    }
+}
+
+std::map<int, Player> Roster(int score) {
+    std::map<int, Player> players;
+    Player& player = players[0];
+    player.id = 0;
+    player.score = score;
+    player.username = "harness";
+    return players;
+}
+
+// Two reports a while apart go over the same connection
+void CheckConnectionReuse(Mock& mock) {
+    mock.Control("");
+    FirebaseReporter reporter;
+    reporter.Start();
+    reporter.ReportNow();
+    mock.WaitForRequests(1, 5.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    reporter.ReportNow();
+    std::vector<MockRequest> requests = mock.WaitForRequests(2, 5.0);
+    reporter.Stop();
+
+    Check(requests.size() == 2, "connection reuse: both reports arrived");
+    if (requests.size() == 2) {
+        Check(requests[0].port == requests[1].port, "connection reuse: same client port " +
+              std::to_string(requests[0].port) + " and " + std::to_string(requests[1].port));
+    }
+}
+
+// A hundred score changes, each with a ReportNow(), make at most one report
+// per send in flight, and the last one has the final score
+void CheckCoalescing(Mock& mock) {
+    mock.Control("");
+    FirebaseReporter reporter;
+    reporter.Start();
+    for (int score = 0; score < 100; score++) {
+        reporter.UpdatePlayers(Roster(score));
+        reporter.ReportNow();
+    }
+    mock.WaitForRequests(1, 5.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    std::vector<MockRequest> requests = mock.Requests();
+    reporter.Stop();
+
+    Check(!requests.empty() && requests.size() <= 2,
+          "coalescing: 100 ReportNow() calls sent " + std::to_string(requests.size()) + " reports");
+    if (!requests.empty()) {
+        Check(requests.back().body.find("\"score\": 99 ") != std::string::npos, "coalescing: last report has the latest score");
+    }
+}
+
+// Three 500s in a row are retried after roughly 1-2, 2-4 and 4-8 seconds
+// (doubling, with half of each delay jittered), then reporting settles
+void CheckBackoff(Mock& mock) {
+    mock.Control("fail=3");
+    FirebaseReporter reporter;
+    reporter.Start();
+    reporter.ReportNow();
+    std::vector<MockRequest> requests = mock.WaitForRequests(4, 20.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    size_t settled = mock.Requests().size();
+    reporter.Stop();
+
+    Check(requests.size() == 4, "backoff: 3 failures and a success in " + std::to_string(requests.size()) + " reports");
+    if (requests.size() != 4) return;
+    const double ranges[3][2] = {{1.0, 2.0}, {2.0, 4.0}, {4.0, 8.0}};
+    for (int i = 0; i < 3; i++) {
+        double gap = requests[i + 1].seconds - requests[i].seconds;
+        std::ostringstream what;
+        what << "backoff: retry " << i + 1 << " after " << gap << " s, expected " << ranges[i][0] << "-" << ranges[i][1] << " s";
+        Check(gap >= ranges[i][0] - 0.1 && gap <= ranges[i][1] + 0.5, what.str());
+    }
+    Check(requests[3].status == 200 && settled == 4, "backoff: no more reports after the success");
+}
+
+// A report the server never answers doesn't hold up Stop()
+void CheckPromptStop(Mock& mock) {
+    mock.Control("hang=1&hang_seconds=30");
+    FirebaseReporter reporter;
+    reporter.Start();
+    reporter.ReportNow();
+    std::vector<MockRequest> requests = mock.WaitForRequests(1, 5.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));  // Let the client start waiting on the reply
+    Clock::time_point start = Clock::now();
+    reporter.Stop();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Check(requests.size() == 1, "stop: the hung report reached the server");
+    Check(seconds < 0.5, "stop: returned in " + std::to_string(seconds) + " s with a report in flight");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        LOGE(FIREBASE, "Usage: firebase_harness <mock base url>, see tools/firebase_mock.py");
+        return 2;
+    }
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    Mock mock(argv[1]);
+    // Read by every FirebaseReporter constructor
+#ifdef _WIN32
+    _putenv_s("ROBBAN_STATUS_URL", mock.StatusUrl().c_str());
+#else
+    setenv("ROBBAN_STATUS_URL", mock.StatusUrl().c_str(), 1);
+#endif
+
+    CheckConnectionReuse(mock);
+    CheckCoalescing(mock);
+    CheckBackoff(mock);
+    CheckPromptStop(mock);
+
+    LOGI(FIREBASE, (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed"));
+    Log::Flush();
+    curl_global_cleanup();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Mock of the status dashboard endpoint the native FirebaseReporter posts to.
+
+Every POST is recorded with the time it arrived and the client port it came
+from, so a reused connection shows up as the same port. The next N requests
+can be made to fail with a 500, or to hang, through /control. /requests lists
+what was received, one request per line:
+
+    <seconds since start> <client port> <status sent> <body on one line>
+
+Run it alone and point a game at it:
+
+    python3 tools/firebase_mock.py --port 8787
+    ROBBAN_STATUS_URL=http://127.0.0.1:8787/api/server/status ./robban_planterar
+
+or let it start firebase_harness against itself and exit with its result:
+
+    python3 tools/firebase_mock.py --run ./firebase_harness
+"""
+
+import argparse
+import subprocess
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+
+class MockState:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.started = time.monotonic()
+        self.requests = []
+        self.fail = 0     # Answer this many more reports with a 500
+        self.hang = 0     # Then hold this many more for hang_seconds
+        self.hang_seconds = 30.0
+
+    def take_behaviour(self):
+        with self.lock:
+            if self.fail > 0:
+                self.fail -= 1
+                return 500, 0.0
+            if self.hang > 0:
+                self.hang -= 1
+                return 200, self.hang_seconds
+            return 200, 0.0
+
+
+class MockServer(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def handle_error(self, request, client_address):
+        # A reporter that stops drops its kept-alive connection
+        if not isinstance(sys.exc_info()[1], ConnectionError):
+            super().handle_error(request, client_address)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # Keep-alive, so connection reuse can be seen
+
+    def log_message(self, format, *args):
+        pass
+
+    def reply(self, status, body=b""):
+        self.send_response(status)
+        self.send_header("Content-Type", "text/plain")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        state = self.server.state
+        url = urlparse(self.path)
+        if url.path == "/requests":
+            with state.lock:
+                lines = ["%.3f %d %d %s\n" % entry for entry in state.requests]
+            self.reply(200, "".join(lines).encode())
+        elif url.path == "/control":
+            query = parse_qs(url.query)
+            with state.lock:
+                if "reset" in query:
+                    state.requests.clear()
+                    state.fail = 0
+                    state.hang = 0
+                state.fail = int(query.get("fail", [state.fail])[0])
+                state.hang = int(query.get("hang", [state.hang])[0])
+                state.hang_seconds = float(query.get("hang_seconds", [state.hang_seconds])[0])
+            self.reply(200)
+        else:
+            self.reply(404)
+
+    def do_POST(self):
+        state = self.server.state
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length).decode(errors="replace")
+        status, delay = state.take_behaviour()
+        with state.lock:
+            arrived = time.monotonic() - state.started
+            state.requests.append((arrived, self.client_address[1], status, " ".join(body.split())))
+        if delay > 0:
+            time.sleep(delay)  # The client is expected to give up first
+            self.close_connection = True
+            return
+        self.reply(status, b'{"ok":true}' if status == 200 else b'{"error":"mock failure"}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=0, help="port to listen on, any free one by default")
+    parser.add_argument("--run", metavar="HARNESS", help="run HARNESS <base url>, then exit with its status")
+    args = parser.parse_args()
+
+    server = MockServer(("127.0.0.1", args.port), Handler)
+    server.state = MockState()
+    base = "http://127.0.0.1:%d" % server.server_address[1]
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+
+    if args.run:
+        result = subprocess.call([args.run, base])
+        server.shutdown()
+        return result
+
+    print("Mock status endpoint at %s/api/server/status" % base, flush=True)
+    try:
+        thread.join()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())